@@ -0,0 +1,206 @@
+"""
+Content-addressed cache of compiled Myriad simulations.
+
+A build is keyed on the hash of every rendered source file plus the
+environment that affects compilation. An unchanged model reuses its earlier
+build outright; a partly changed one is rebuilt in parallel with the object
+files of unchanged units copied in from earlier builds, so only changed
+units are recompiled.
+"""
+
+import os
+import sys
+import shutil
+import hashlib
+import logging
+import platform
+import subprocess
+import time
+
+from tempfile import mkdtemp
+
+#######
+# Log #
+#######
+
+LOG = logging.getLogger(__name__)
+LOG.addHandler(logging.NullHandler())
+
+#############
+# Constants #
+#############
+
+#: Default cache location, overridable with MYRIAD_CACHE_DIR
+DEFAULT_CACHE_DIR = os.path.join(
+    os.getenv("XDG_CACHE_HOME", os.path.join(os.path.expanduser("~"), ".cache")),
+    "myriad")
+
+#: Environment variables that change what make/setup.py produce
+BUILD_ENV_VARS = ("CC", "CXX", "CFLAGS", "LDFLAGS", "DEFINES", "LTO",
+                  "CUDA_PATH")
+
+#: File written into a build directory once it is complete
+COMPLETE_MARKER = ".myriad_build_complete"
+
+#: Extensions of files that are compiled into their own object file
+SOURCE_EXTS = (".c", ".cu")
+
+#: Extensions of files any compilation unit may include
+HEADER_EXTS = (".h", ".cuh")
+
+#: Name of the sub-directory holding cached object files
+OBJECTS_DIR = "objects"
+
+
+###########
+# Classes #
+###########
+
+
+class BuildCache(object):
+    """
+    Cache of build directories, keyed on the content of their sources.
+    """
+
+    def __init__(self, root: str=None, jobs: int=None):
+        #: Directory holding cached builds
+        self.root = root if root else os.getenv("MYRIAD_CACHE_DIR",
+                                                DEFAULT_CACHE_DIR)
+        #: Number of parallel make jobs
+        self.jobs = jobs if jobs else (os.cpu_count() or 1)
+        os.makedirs(os.path.join(self.root, OBJECTS_DIR), exist_ok=True)
+
+    @staticmethod
+    def _env_digest() -> bytes:
+        """ Digest of the toolchain environment shared by all units """
+        env_hash = hashlib.sha256()
+        env_hash.update(sys.version.encode("UTF-8"))
+        env_hash.update(platform.platform().encode("UTF-8"))
+        for var in BUILD_ENV_VARS:
+            env_hash.update(("%s=%s\0" % (var, os.getenv(var, ""))).encode("UTF-8"))
+        return env_hash.digest()
+
+    @staticmethod
+    def _read_sources(src_dir: str) -> dict:
+        """ Reads every regular file in src_dir, keyed on name """
+        sources = {}
+        for name in sorted(os.listdir(src_dir)):
+            path = os.path.join(src_dir, name)
+            if os.path.isfile(path):
+                with open(path, "rb") as filep:
+                    sources[name] = filep.read()
+        return sources
+
+    def key(self, src_dir: str) -> str:
+        """ Returns the cache key of the sources in src_dir """
+        key_hash = hashlib.sha256(self._env_digest())
+        for name, content in self._read_sources(src_dir).items():
+            key_hash.update(name.encode("UTF-8") + b"\0")
+            key_hash.update(hashlib.sha256(content).digest())
+        return key_hash.hexdigest()
+
+    def _unit_keys(self, sources: dict) -> dict:
+        """
+        Returns the key of each compilation unit, keyed on object file name.
+
+        A unit depends on its own source, every header (we don't track which
+        ones it includes), the Makefile and the toolchain environment.
+        """
+        shared_hash = hashlib.sha256(self._env_digest())
+        for name, content in sources.items():
+            if name.endswith(HEADER_EXTS) or name == "Makefile":
+                shared_hash.update(name.encode("UTF-8") + b"\0")
+                shared_hash.update(hashlib.sha256(content).digest())
+        unit_keys = {}
+        for name, content in sources.items():
+            stem, ext = os.path.splitext(name)
+            if ext in SOURCE_EXTS:
+                unit_hash = shared_hash.copy()
+                unit_hash.update(name.encode("UTF-8") + b"\0")
+                unit_hash.update(content)
+                unit_keys[stem + ".o"] = unit_hash.hexdigest()
+        return unit_keys
+
+    def lookup(self, key: str) -> str:
+        """ Returns the completed build directory for key, or None """
+        build_dir = os.path.join(self.root, key)
+        if os.path.isfile(os.path.join(build_dir, COMPLETE_MARKER)):
+            # Mark as recently used, for prune()
+            os.utime(build_dir, None)
+            return build_dir
+        return None
+
+    def _seed_objects(self, build_dir: str, unit_keys: dict) -> int:
+        """ Copies cached objects of unchanged units into build_dir """
+        # Objects must look newer than the sources just copied in
+        newer = time.time() + 1.0
+        num_seeded = 0
+        for obj_name, unit_key in unit_keys.items():
+            cached = os.path.join(self.root, OBJECTS_DIR, unit_key + ".o")
+            if os.path.isfile(cached):
+                dest = os.path.join(build_dir, obj_name)
+                shutil.copyfile(cached, dest)
+                os.utime(dest, (newer, newer))
+                num_seeded += 1
+        return num_seeded
+
+    def _store_objects(self, build_dir: str, unit_keys: dict):
+        """ Saves objects built in build_dir for reuse by later builds """
+        for obj_name, unit_key in unit_keys.items():
+            built = os.path.join(build_dir, obj_name)
+            cached = os.path.join(self.root, OBJECTS_DIR, unit_key + ".o")
+            if os.path.isfile(built) and not os.path.isfile(cached):
+                # Copy then rename, so readers never see a partial object
+                tmp_path = cached + ".%d" % os.getpid()
+                shutil.copyfile(built, tmp_path)
+                os.replace(tmp_path, cached)
+
+    def build(self, src_dir: str, command: list=None) -> str:
+        """
+        Returns a build directory for the sources in src_dir, building them
+        with command (default: parallel make all) only on a cache miss.
+        """
+        key = self.key(src_dir)
+        build_dir = self.lookup(key)
+        if build_dir is not None:
+            LOG.debug("Build cache hit for %s", key)
+            return build_dir
+        LOG.debug("Build cache miss for %s", key)
+
+        # Build privately, then publish the whole directory at once
+        sources = self._read_sources(src_dir)
+        unit_keys = self._unit_keys(sources)
+        tmp_dir = mkdtemp(prefix=key[:16] + ".", dir=self.root)
+        try:
+            for name in sources:
+                shutil.copy2(os.path.join(src_dir, name), tmp_dir)
+            num_seeded = self._seed_objects(tmp_dir, unit_keys)
+            LOG.debug("Reusing %d of %d compiled units",
+                      num_seeded, len(unit_keys))
+            if command is None:
+                command = ["make", "-j%d" % self.jobs, "all"]
+            subprocess.check_call(command, cwd=tmp_dir)
+            self._store_objects(tmp_dir, unit_keys)
+            with open(os.path.join(tmp_dir, COMPLETE_MARKER), "w") as filep:
+                filep.write(key + "\n")
+            build_dir = os.path.join(self.root, key)
+            try:
+                os.rename(tmp_dir, build_dir)
+            except OSError:
+                # Someone else published the same build first; use theirs
+                shutil.rmtree(tmp_dir, ignore_errors=True)
+        except BaseException:
+            shutil.rmtree(tmp_dir, ignore_errors=True)
+            raise
+        return build_dir
+
+    def prune(self, max_builds: int):
+        """ Removes all but the max_builds most recently used builds """
+        builds = []
+        for name in os.listdir(self.root):
+            path = os.path.join(self.root, name)
+            if name != OBJECTS_DIR and os.path.isdir(path):
+                builds.append((os.path.getmtime(path), path))
+        builds.sort(reverse=True)
+        for _, path in builds[max_builds:]:
+            shutil.rmtree(path, ignore_errors=True)
@@ -16,6 +16,7 @@ from pkg_resources import resource_string
 
 from .myriad_mako_wrapper import MakoFileTemplate
 from .myriad_metaclass import MyriadMetaclass
+from .myriad_build_cache import BuildCache
 
 #############
 # Templates #
@@ -62,6 +63,16 @@ MYRIAD_COMMUNICATOR_H_TEMPLATE = resource_string(
     __name__,
     "templates" + os.sep + "myriad_communicator.h.mako").decode("UTF-8")
 
+#: Template for myriad_checkpoint.c (checkpoint/restart of simulation state)
+MYRIAD_CHECKPOINT_C_TEMPLATE = resource_string(
+    __name__,
+    "templates" + os.sep + "myriad_checkpoint.c.mako").decode("UTF-8")
+
+#: Template for myriad_checkpoint.h (checkpoint/restart header)
+MYRIAD_CHECKPOINT_H_TEMPLATE = resource_string(
+    __name__,
+    "templates" + os.sep + "myriad_checkpoint.h.mako").decode("UTF-8")
+
 #: Template for pmyriad.c (myriad Python 'glue' for object interpretation)
 PYMYRIAD_C_TEMPLATE = resource_string(
     __name__,
@@ -101,12 +112,17 @@ class SubprocessCommunicator(object):
         #: Myriad binary relative path
         self.binary_rel_path = binary_rel_path
 
-    def spawn_child(self):
-        """ Spawns subprocess executable """
+    def spawn_child(self, env: dict=None):
+        """ Spawns subprocess executable, adding env to its environment """
+        child_env = None
+        if env:
+            child_env = dict(os.environ)
+            child_env.update(env)
         self.child_proc = subprocess.Popen(
             [os.getcwd() + self.binary_rel_path],
             stdin=subprocess.PIPE,
-            stdout=subprocess.PIPE)
+            stdout=subprocess.PIPE,
+            env=child_env)
 
     def setup_connection(self):
         """ Waits for the subprocess to connect to the socket """
@@ -125,6 +141,32 @@ class SubprocessCommunicator(object):
             raise ValueError("Invalid obj_id value: value out of range")
         return self.myriad_comm_mod.retrieve_obj(obj_id)
 
+    def request_data_bulk(self, obj_ids=None) -> list:
+        """
+        Requests many objects from the subprocess in a single exchange and
+        returns them as a list of Compartment objects, in request order.
+
+        obj_ids may be None (the whole network), a range with step 1, or any
+        sequence of IDs.
+        """
+        if self.child_proc is None:
+            raise RuntimeError("Child process is not yet running")
+        elif self.connected is False:
+            raise RuntimeError("Not connected to child process")
+        if obj_ids is None:
+            return self.myriad_comm_mod.retrieve_range()
+        elif isinstance(obj_ids, range) and obj_ids.step == 1:
+            if obj_ids.start < 0:
+                raise ValueError("Invalid obj_ids value: value out of range")
+            elif len(obj_ids) == 0:
+                return []
+            return self.myriad_comm_mod.retrieve_range(obj_ids.start,
+                                                       len(obj_ids))
+        obj_ids = list(obj_ids)
+        if any(obj_id < 0 for obj_id in obj_ids):
+            raise ValueError("Invalid obj_ids value: value out of range")
+        return self.myriad_comm_mod.retrieve_list(obj_ids)
+
     def close_connection(self):
         """ Closes the connection to the subprocess """
         # Ask child process to terminate
@@ -189,8 +231,24 @@ def _setup_simul_params(params, dependencies) -> dict:
         params["FAST_EXP"] = False
     if "MYRIAD_ALLOCATOR" not in params:
         params["MYRIAD_ALLOCATOR"] = False
+    if "MYRIAD_ARENA" not in params:
+        params["MYRIAD_ARENA"] = False
     if "NUM_THREADS" not in params:
         params["NUM_THREADS"] = 1
+    if "SCHED_CHUNK" not in params:
+        params["SCHED_CHUNK"] = 1
+    if "BUILD_CACHE" not in params:
+        params["BUILD_CACHE"] = True
+    if "SHM_NETWORK" not in params:
+        params["SHM_NETWORK"] = not params["MYRIAD_ARENA"]
+    elif params["SHM_NETWORK"] and params["MYRIAD_ARENA"]:
+        raise ValueError("SHM_NETWORK and MYRIAD_ARENA are mutually exclusive")
+    if "CHECKPOINT_EVERY" not in params:
+        params["CHECKPOINT_EVERY"] = 0
+    elif params["CHECKPOINT_EVERY"] < 0:
+        raise ValueError("CHECKPOINT_EVERY must not be negative")
+    elif params["CHECKPOINT_EVERY"] and params["CUDA"]:
+        raise ValueError("Checkpointing is not supported with CUDA")
     if "RANDOM_SEED" not in params:
         params["RANDOM_SEED"] = 42  # FIXME: Use time() for default seed
     # TODO: More intelligently create dependency object string
@@ -243,6 +301,10 @@ class MyriadSimul(_MyriadSimulParent, metaclass=_MyriadSimulMeta):
         self._myriad_communicator_c_tmpl = None
         #: Template for myriad_communicator.h myriad UDP socket API for IPC
         self._myriad_communicator_h_tmpl = None
+        #: Template for myriad_checkpoint.c checkpoint/restart of state
+        self._myriad_checkpoint_c_tmpl = None
+        #: Template for myriad_checkpoint.h checkpoint/restart header
+        self._myriad_checkpoint_h_tmpl = None
         #: Template for pmyriad.c myriad Python 'glue' for object interp
         self._pymyriad_c_tmpl = None
         #: Template for pymyriad_commuinicator.c myriad Python 'glue' for IPC
@@ -331,6 +393,14 @@ class MyriadSimul(_MyriadSimulParent, metaclass=_MyriadSimulMeta):
             template_dir_name + "myriad_communicator.h",
             MYRIAD_COMMUNICATOR_H_TEMPLATE,
             final_params)
+        self._myriad_checkpoint_c_tmpl = MakoFileTemplate(
+            template_dir_name + "myriad_checkpoint.c",
+            MYRIAD_CHECKPOINT_C_TEMPLATE,
+            final_params)
+        self._myriad_checkpoint_h_tmpl = MakoFileTemplate(
+            template_dir_name + "myriad_checkpoint.h",
+            MYRIAD_CHECKPOINT_H_TEMPLATE,
+            final_params)
         self._pymyriad_c_tmpl = MakoFileTemplate(
             template_dir_name + "pymyriad.c",
             PYMYRIAD_C_TEMPLATE,
@@ -349,27 +419,47 @@ class MyriadSimul(_MyriadSimulParent, metaclass=_MyriadSimulMeta):
         self._myriad_alloc_h_tmpl.render_to_file()
         self._myriad_communicator_c_tmpl.render_to_file()
         self._myriad_communicator_h_tmpl.render_to_file()
+        self._myriad_checkpoint_c_tmpl.render_to_file()
+        self._myriad_checkpoint_h_tmpl.render_to_file()
         self._pymyriad_c_tmpl.render_to_file()
         self._pymyriad_communicator_c_tmpl.render_to_file()
         # Return template directory
         return template_dir
 
-    def run(self):
-        """ Runs the simulation and puts results back into Python objects """
+    def run(self, checkpoint_file: str=None, restart_from: str=None):
+        """
+        Runs the simulation and puts results back into Python objects.
+
+        With CHECKPOINT_EVERY set, the state is checkpointed into
+        checkpoint_file (myriad.ckpt in the working directory by default).
+        Given restart_from, the simulation resumes from the newest complete
+        checkpoint in that file instead of starting over; the network must
+        be the one that was checkpointed.
+
+        Simulation parameters (dt, simul_len, NUM_THREADS, ...) and object
+        parameters are compiled into the rendered sources, so changing any of
+        them between runs rebuilds the simulation; the build cache only
+        recompiles the units that changed. Reading them at startup is only
+        supported by the standalone purec engine (MYRIAD_RUNTIME_PARAMS).
+        """
         # Calculate the number of compartments
         if len(self._compartments) == 0:
             raise RuntimeError("No compartments found!")
         # Create & render templates for simulation-specific files
         template_dir = self._render_templates(
             {"NUM_COMPARTMENTS": len(self._compartments)})
-        # Once templates are rendered, perform compilation
-        # time.sleep(15)
-        subprocess.check_call(
-            ["make", "-C", template_dir.name, "-j1", "all"])
+        # Once templates are rendered, perform compilation (or reuse a
+        # previous build of identical sources)
+        if self.simul_params["BUILD_CACHE"]:
+            build_dir = BuildCache().build(template_dir.name)
+        else:
+            subprocess.check_call(
+                ["make", "-C", template_dir.name, "-j1", "all"])
+            build_dir = template_dir.name
         # Invalidate cache and load dynamic extensions
         # TODO: Change this path to something platform-specific (autodetect)
         sys.path.append(
-            os.path.join(template_dir.name, "build", "lib.linux-x86_64-3.4"))
+            os.path.join(build_dir, "build", "lib.linux-x86_64-3.4"))
         importlib.invalidate_caches()
         myriad_comm_mod = importlib.import_module("myriad_comm")
         for dependency in getattr(self, "dependencies"):
@@ -377,8 +467,13 @@ class MyriadSimul(_MyriadSimulParent, metaclass=_MyriadSimulMeta):
                 importlib.import_module(dependency.__name__.lower())
         # Run simulation and return the communicator object back
         comm = SubprocessCommunicator(
-            myriad_comm_mod, os.path.join(template_dir.name, "main.bin"))
-        comm.spawn_child()
+            myriad_comm_mod, os.path.join(build_dir, "main.bin"))
+        child_env = {}
+        if checkpoint_file:
+            child_env["MYRIAD_CHECKPOINT"] = os.path.abspath(checkpoint_file)
+        if restart_from:
+            child_env["MYRIAD_RESTART"] = os.path.abspath(restart_from)
+        comm.spawn_child(child_env)
         time.sleep(0.25)  # FIXME: Change this sleep to a wait of some kind
         comm.setup_connection()
         return comm
@@ -0,0 +1,307 @@
+"""
+Reader and writer for Myriad's compressed trace files.
+
+A trace stores one value per recorded step, variable and cell, in chunks of
+rows whose columns (one per variable and cell) are compressed independently.
+Reading a time window of one cell only decompresses that cell's columns in
+the chunks overlapping the window. See purec/trace_file.h for the layout,
+which this module mirrors.
+"""
+
+import mmap
+import zlib
+import logging
+
+import numpy as np
+
+#######
+# Log #
+#######
+
+LOG = logging.getLogger(__name__)
+LOG.addHandler(logging.NullHandler())
+
+#############
+# Constants #
+#############
+
+#: Identifies a trace file
+TRACE_MAGIC = b"MYRTRC\0\1"
+
+#: Identifies a chunk
+CHUNK_MAGIC = b"CHNK"
+
+#: Bytes reserved per variable name
+VAR_NAME_LEN = 16
+
+#: Column stored as plain doubles
+CODEC_RAW = 0
+
+#: Column stored XOR-delta encoded, byte-shuffled and deflated
+CODEC_XOR_SHUFFLE_DEFLATE = 1
+
+#: struct trace_header
+HEADER_DTYPE = np.dtype([("magic", "V8"), ("num_vars", "u4"), ("_pad", "u4"),
+                         ("num_cells", "u8"), ("every", "u8"), ("dt", "f8"),
+                         ("chunk_rows", "u8"), ("num_rows", "u8"),
+                         ("index_offset", "u8")])
+
+#: struct trace_chunk_header
+CHUNK_DTYPE = np.dtype([("magic", "V4"), ("num_cols", "u4"),
+                        ("first_row", "u8"), ("num_rows", "u8"),
+                        ("data_size", "u8")])
+
+#: struct trace_column
+COLUMN_DTYPE = np.dtype([("offset", "u8"), ("nbytes", "u4"), ("codec", "u4")])
+
+
+################
+# Column codec #
+################
+
+
+def encode_column(values, level=1):
+    """
+    Compresses a column of doubles, returning (codec, data).
+
+    Falls back to the raw bytes if compression does not shrink the column.
+    """
+    values = np.ascontiguousarray(values, dtype=np.float64)
+    bits = values.view(np.uint64)
+    delta = bits.copy()
+    delta[1:] ^= bits[:-1]
+    planes = delta.view(np.uint8).reshape(len(values), 8).T.tobytes()
+    packed = zlib.compress(planes, level)
+    if len(packed) < values.nbytes:
+        return CODEC_XOR_SHUFFLE_DEFLATE, packed
+    return CODEC_RAW, values.tobytes()
+
+
+def decode_column(codec, data, num_rows):
+    """ Inverse of encode_column, returning a new float64 array """
+    if codec == CODEC_RAW:
+        values = np.frombuffer(data, dtype=np.float64, count=num_rows)
+        return values.copy()
+    if codec != CODEC_XOR_SHUFFLE_DEFLATE:
+        raise ValueError("Unknown column codec {0}".format(codec))
+    raw = zlib.decompress(data)
+    if len(raw) != num_rows * 8:
+        raise ValueError("Corrupt column: {0} bytes".format(len(raw)))
+    planes = np.frombuffer(raw, dtype=np.uint8).reshape(8, num_rows)
+    delta = np.ascontiguousarray(planes.T).view(np.uint64).ravel()
+    return np.bitwise_xor.accumulate(delta).view(np.float64)
+
+
+###########
+# Classes #
+###########
+
+
+class TraceFile(object):
+    """
+    Memory-mapped trace file, complete or still being written.
+
+    A trace still being written has no chunk index yet; its chunks are found
+    by walking them instead, and only complete ones are visible.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        with open(path, "rb") as trace:
+            self._map = mmap.mmap(trace.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            self._parse()
+        except Exception:
+            self._map.close()
+            raise
+
+    def _read(self, dtype, offset, count=1):
+        """ Copies count records of dtype at offset out of the map """
+        end = offset + dtype.itemsize * count
+        if end > len(self._map):
+            raise ValueError("Truncated trace file " + self.path)
+        return np.frombuffer(self._map[offset:end], dtype=dtype, count=count)
+
+    def _parse(self):
+        header = self._read(HEADER_DTYPE, 0)[0]
+        if bytes(header["magic"]) != TRACE_MAGIC:
+            raise ValueError(self.path + " is not a Myriad trace")
+        if header["num_vars"] == 0 or header["num_cells"] == 0 or \
+           header["chunk_rows"] == 0:
+            raise ValueError("Invalid trace header in " + self.path)
+
+        #: Steps between rows
+        self.every = int(header["every"])
+        #: Simulation time step - ms
+        self.dt = float(header["dt"])
+        #: Rows per chunk
+        self.chunk_rows = int(header["chunk_rows"])
+
+        offset = HEADER_DTYPE.itemsize
+        names = self._read(np.dtype("S" + str(VAR_NAME_LEN)), offset,
+                           int(header["num_vars"]))
+        #: Variable names, in column order
+        self.variables = [name.decode("ascii") for name in names]
+        offset += VAR_NAME_LEN * len(self.variables)
+        #: Cell IDs, in column order
+        self.cells = self._read(np.dtype("u8"), offset,
+                                int(header["num_cells"])).copy()
+        offset += 8 * len(self.cells)
+        self._cell_cols = {int(cell): col for col, cell in
+                           reversed(list(enumerate(self.cells)))}
+        self._num_cols = len(self.variables) * len(self.cells)
+
+        if header["index_offset"] != 0:
+            self.num_rows = int(header["num_rows"])
+            num_chunks = -(-self.num_rows // self.chunk_rows)
+            self._chunk_offsets = self._read(
+                np.dtype("u8"), int(header["index_offset"]), num_chunks)
+        else:
+            self._scan_chunks(offset)
+
+    def _chunk_at(self, offset):
+        """ Returns the chunk header at offset, or None if incomplete """
+        table_len = self._num_cols * COLUMN_DTYPE.itemsize
+        if offset + CHUNK_DTYPE.itemsize + table_len > len(self._map):
+            return None
+        chunk = self._read(CHUNK_DTYPE, offset)[0]
+        if bytes(chunk["magic"]) != CHUNK_MAGIC or \
+           chunk["num_cols"] != self._num_cols or \
+           not 0 < chunk["num_rows"] <= self.chunk_rows or \
+           offset + CHUNK_DTYPE.itemsize + table_len + int(chunk["data_size"]) > \
+           len(self._map):
+            return None
+        return chunk
+
+    def _scan_chunks(self, offset):
+        """ Finds the complete chunks of a trace without an index """
+        offsets = []
+        self.num_rows = 0
+        chunk = self._chunk_at(offset)
+        while chunk is not None and chunk["first_row"] == self.num_rows:
+            offsets.append(offset)
+            self.num_rows += int(chunk["num_rows"])
+            offset += CHUNK_DTYPE.itemsize + \
+                self._num_cols * COLUMN_DTYPE.itemsize + int(chunk["data_size"])
+            chunk = self._chunk_at(offset)
+        self._chunk_offsets = np.array(offsets, dtype=np.uint64)
+
+    def column(self, cell, var="vm"):
+        """ Returns the column index of a cell's variable """
+        if var not in self.variables:
+            raise KeyError("No variable {0} in trace".format(var))
+        if int(cell) not in self._cell_cols:
+            raise KeyError("No cell {0} in trace".format(cell))
+        return self.variables.index(var) * len(self.cells) + \
+            self._cell_cols[int(cell)]
+
+    def read(self, cell, var="vm", start=0, stop=None):
+        """
+        Reads rows [start, stop) of one cell's variable as a float64 array.
+
+        Only the chunks overlapping the window are decompressed.
+        """
+        col = self.column(cell, var)
+        start, stop, _ = slice(start, stop).indices(self.num_rows)
+        out = np.empty(max(stop - start, 0), dtype=np.float64)
+
+        row = start
+        while row < stop:
+            offset = int(self._chunk_offsets[row // self.chunk_rows])
+            chunk = self._chunk_at(offset)
+            if chunk is None or \
+               chunk["first_row"] != row // self.chunk_rows * self.chunk_rows:
+                raise ValueError("Corrupt chunk at offset {0}".format(offset))
+            table = offset + CHUNK_DTYPE.itemsize
+            entry = self._read(COLUMN_DTYPE, table + col * COLUMN_DTYPE.itemsize)[0]
+            data_start = table + self._num_cols * COLUMN_DTYPE.itemsize + \
+                int(entry["offset"])
+            data = self._map[data_start:data_start + int(entry["nbytes"])]
+            values = decode_column(int(entry["codec"]), data,
+                                   int(chunk["num_rows"]))
+
+            first = row - int(chunk["first_row"])
+            num = min(len(values) - first, stop - row)
+            out[row - start:row - start + num] = values[first:first + num]
+            row += num
+
+        return out
+
+    def times(self, start=0, stop=None):
+        """ Simulation times (ms) of rows [start, stop) """
+        start, stop, _ = slice(start, stop).indices(self.num_rows)
+        return np.arange(start, stop) * (self.every * self.dt)
+
+    def close(self):
+        """ Unmaps the file """
+        self._map.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+#############
+# Functions #
+#############
+
+
+def write_trace(path, values, cells, variables=("vm",), every=1, dt=0.0,
+                chunk_rows=4096):
+    """
+    Writes a complete trace.
+
+    values is indexed [row, variable, cell]; a 2-D array of [row, cell] is
+    taken as a single variable.
+    """
+    values = np.asarray(values, dtype=np.float64)
+    if values.ndim == 2:
+        values = values[:, np.newaxis, :]
+    num_rows, num_vars, num_cells = values.shape
+    if num_vars != len(variables) or num_cells != len(cells):
+        raise ValueError("values do not match variables and cells")
+    if chunk_rows < 1:
+        raise ValueError("chunk_rows must be at least 1")
+
+    header = np.zeros(1, dtype=HEADER_DTYPE)
+    header["magic"] = np.void(TRACE_MAGIC)
+    header["num_vars"] = num_vars
+    header["num_cells"] = num_cells
+    header["every"] = every
+    header["dt"] = dt
+    header["chunk_rows"] = chunk_rows
+    header["num_rows"] = num_rows
+
+    with open(path, "wb") as trace:
+        trace.write(header.tobytes())
+        trace.write(np.array(variables, dtype="S" + str(VAR_NAME_LEN)).tobytes())
+        trace.write(np.asarray(cells, dtype=np.uint64).tobytes())
+
+        offsets = []
+        columns = values.reshape(num_rows, num_vars * num_cells)
+        for first in range(0, num_rows, chunk_rows):
+            block = columns[first:first + chunk_rows]
+            table = np.zeros(block.shape[1], dtype=COLUMN_DTYPE)
+            data = []
+            for col in range(block.shape[1]):
+                codec, packed = encode_column(block[:, col])
+                table[col] = (sum(len(d) for d in data), len(packed), codec)
+                data.append(packed)
+
+            chunk = np.zeros(1, dtype=CHUNK_DTYPE)
+            chunk["magic"] = np.void(CHUNK_MAGIC)
+            chunk["num_cols"] = block.shape[1]
+            chunk["first_row"] = first
+            chunk["num_rows"] = len(block)
+            chunk["data_size"] = sum(len(d) for d in data)
+            offsets.append(trace.tell())
+            trace.write(chunk.tobytes())
+            trace.write(table.tobytes())
+            trace.write(b"".join(data))
+
+        header["index_offset"] = trace.tell()
+        trace.write(np.array(offsets, dtype=np.uint64).tobytes())
+        trace.seek(0)
+        trace.write(header.tobytes())
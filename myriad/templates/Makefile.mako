@@ -83,7 +83,7 @@ INCLUDES := -I.
 CUDA_LINK_OBJ := dlink.o
 % endif
 OBJECTS := ${myriad_lib_objs}
-COBJECTS := myriad_alloc.o myriad_communicator.o
+COBJECTS := myriad_alloc.o myriad_communicator.o myriad_checkpoint.o
 BINARY  := app.bin
 
 ################
@@ -11,6 +11,11 @@
 #include <signal.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <limits.h>
+% if SHM_NETWORK:
+#include <sys/mman.h>
+#include <sys/socket.h>
+% endif
 
 % if NUM_THREADS > 1:
 #include <omp.h>
@@ -39,6 +44,9 @@ __thread union _eco _eco;
 ## Myriad communicator header for communicating with parent process
 #include "myriad_communicator.h"
 
+## Checkpoint/restart of the network
+#include "myriad_checkpoint.h"
+
 ## CUDA Network & Staging arrays
 % if CUDA:
 __constant__ struct Compartment* dnetwork[NUM_CELLS];
@@ -48,6 +56,36 @@ struct Compartment* snetwork[NUM_CELLS];
 ## Host-side network array
 struct Compartment* hnetwork[NUM_CELLS];
 
+% if SHM_NETWORK:
+############################
+## Shared-memory network ##
+############################
+
+## Objects are placed in a memfd segment that the Python side maps directly,
+## so results are read in place instead of copied through the socket.
+static int shm_fd = -1;
+static char* shm_base = NULL;
+static size_t shm_size = 0, shm_offset = 0;
+
+## Alignment of every object in the segment
+#define SHM_ALIGN 64
+#define SHM_ROUND_UP(n) (((n) + SHM_ALIGN - 1) & ~((size_t) SHM_ALIGN - 1))
+
+static void* shm_calloc(const size_t size)
+{
+    const size_t offset = __atomic_fetch_add(&shm_offset,
+                                             SHM_ROUND_UP(size),
+                                             __ATOMIC_RELAXED);
+    if (offset + size > shm_size)
+    {
+        fputs("Shared-memory network segment exhausted.\\n", stderr);
+        return NULL;
+    }
+    ## Fresh pages of the segment are already zeroed
+    return shm_base + offset;
+}
+
+% endif
 ## Size-of vtable and function
 const size_t size_vtable[NUM_CU_CLASS] = {
 % for myriad_class in myriad_classes:
@@ -60,12 +98,25 @@ size_t myriad_sizeof(void* obj)
     return size_vtable[((struct MyriadObject*) obj)->class_id];
 }
 
+## Allocates zeroed memory for an object of the given class
+static void* myriad_alloc_obj(const enum MyriadClass mclass)
+{
+% if MYRIAD_ARENA:
+    ## From the arena of the node the calling thread runs on
+    return _my_calloc(1, size_vtable[mclass]);
+% elif SHM_NETWORK:
+    return shm_calloc(size_vtable[mclass]);
+% else:
+    return calloc(1, size_vtable[mclass]);
+% endif
+}
+
 ## Myriad new definition
 void* myriad_new(const enum MyriadClass mclass, ...)
 {
     va_list ap;
     ## Allocate object
-    struct MyriadObject* new_obj = (struct MyriadObject*) calloc(1, size_vtable[mclass]);
+    struct MyriadObject* new_obj = (struct MyriadObject*) myriad_alloc_obj(mclass);
     assert(new_obj);
     ## Assing class id
     memcpy((void*) &new_obj->class_id, &mclass, sizeof(void*));
@@ -138,6 +189,14 @@ static int serversock_fd = -1, socket_fd = -1;
 
 static void cleanup_conn(void)
 {
+% if SHM_NETWORK:
+    if (shm_fd > 0)
+    {
+        munmap(shm_base, shm_size);
+        close(shm_fd);
+        shm_fd = -1;
+    }
+% endif
     if (serversock_fd > 0)
     {
         m_close_socket(serversock_fd);
@@ -157,6 +216,65 @@ static void handle_signal(int signo)
     exit(EXIT_FAILURE);
 }
 
+###################
+## Checkpointing ##
+###################
+
+## Object a checkpoint table entry stands for
+static inline void* network_obj(const struct m_ckpt_obj* obj)
+{
+    struct Compartment* comp = hnetwork[obj->cell];
+    return obj->mech == M_CKPT_COMPARTMENT ? (void*) comp : comp->my_mechs[obj->mech];
+}
+
+% if CHECKPOINT_EVERY:
+## Taken every CHECKPOINT_EVERY steps, NULL until the network exists
+static m_ckpt_t checkpoint = NULL;
+
+## Lists every object of the network and opens the checkpoint file named by
+## MYRIAD_CHECKPOINT for them
+static m_ckpt_t open_checkpoint(void)
+{
+    uint64_t num_objs = 0;
+    for (size_t i = 0; i < NUM_CELLS; i++)
+    {
+        num_objs += 1 + hnetwork[i]->num_mechs;
+    }
+    struct m_ckpt_obj* objs = (struct m_ckpt_obj*) calloc(num_objs, sizeof(struct m_ckpt_obj));
+    if (objs == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t k = 0;
+    for (size_t i = 0; i < NUM_CELLS; i++)
+    {
+        const struct Compartment* comp = hnetwork[i];
+        objs[k++] = (struct m_ckpt_obj) {
+            .cell = i,
+            .class_id = (uint32_t) ((const struct MyriadObject*) comp)->class_id,
+            .mech = M_CKPT_COMPARTMENT,
+            .size = myriad_sizeof((void*) comp),
+        };
+        for (uint64_t j = 0; j < comp->num_mechs; j++)
+        {
+            objs[k++] = (struct m_ckpt_obj) {
+                .cell = i,
+                .class_id = (uint32_t) ((const struct MyriadObject*) comp->my_mechs[j])->class_id,
+                .mech = (uint32_t) j,
+                .size = myriad_sizeof(comp->my_mechs[j]),
+            };
+        }
+    }
+
+    const char* path = getenv("MYRIAD_CHECKPOINT");
+    m_ckpt_t ckpt = m_ckpt_open(path != NULL ? path : M_CKPT_DEFAULT_PATH,
+                                objs, num_objs, NUM_CELLS, size_vtable, NUM_CU_CLASS);
+    free(objs);
+    return ckpt;
+}
+
+% endif
 ##########################
 ## Simulation functions ##
 ##########################
@@ -190,20 +308,109 @@ __global__ void run_simul(uint_fast32_t cstep, double gtime)
     }
 }
 % else:
-static void run_simul(void)
+% if NUM_THREADS > 1:
+## Per-thread time spent stepping cells, one cache line each
+static struct
+{
+    double busy;
+    char _pad[64 - sizeof(double)];
+} thread_busy[NUM_THREADS];
+
+static void report_imbalance(void)
 {
-    register double gtime = DT;
-    for (uint_fast32_t cstep = 1; cstep < SIMUL_LEN; cstep++)
+    double max_busy = 0.0, sum_busy = 0.0;
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        printf("Thread %d busy for %.3f s\\n", t, thread_busy[t].busy);
+        max_busy = thread_busy[t].busy > max_busy ? thread_busy[t].busy : max_busy;
+        sum_busy += thread_busy[t].busy;
+    }
+    if (sum_busy > 0.0)
     {
+        printf("Load imbalance (max/mean - 1): %.1f%%\\n",
+               100.0 * (max_busy / (sum_busy / NUM_THREADS) - 1.0));
+    }
+}
+
+% endif
+% if MYRIAD_ARENA:
+## Thread that builds, and later steps, cell i; must match run_simul's schedule
+#define CELL_OWNER(i) (((i) / SCHED_CHUNK) % NUM_THREADS)
+
+% endif
+## Steps the network from start_step, whose simulation time is start_time
+static void run_simul(const uint64_t start_step, const double start_time)
+{
 % if NUM_THREADS > 1:
-        #pragma omp parallel for
+% if MYRIAD_ARENA:
+    ## Each cell lives in its owner's NUMA-local arena, so the schedule must be
+    ## static: a thread that stole another's cells would read remote memory.
+% else:
+    ## Cells differ in cost, so hand them out SCHED_CHUNK at a time: threads
+    ## that finish cheap cells early take more instead of idling.
 % endif
+    #pragma omp parallel num_threads(NUM_THREADS)
+    {
+        const int tid = omp_get_thread_num();
+        double gtime = start_time;
+        for (uint_fast32_t cstep = start_step; cstep < SIMUL_LEN; cstep++)
+        {
+            const double t_start = omp_get_wtime();
+% if MYRIAD_ARENA:
+            #pragma omp for schedule(static, SCHED_CHUNK) nowait
+% else:
+            #pragma omp for schedule(dynamic, SCHED_CHUNK) nowait
+% endif
+            for (size_t i = 0; i < NUM_CELLS; i++)
+            {
+                compartment_simul(hnetwork[i], gtime, cstep);
+            }
+            thread_busy[tid].busy += omp_get_wtime() - t_start;
+            #pragma omp barrier
+            gtime += DT;
+% if CHECKPOINT_EVERY:
+
+            ## Every object is settled between steps; copy them all, sharing
+            ## the work, and leave the writing to the checkpoint's own thread
+            if (checkpoint != NULL && cstep % CHECKPOINT_EVERY == 0)
+            {
+                #pragma omp single
+                m_ckpt_begin(checkpoint);
+                #pragma omp for schedule(static)
+                for (uint64_t k = 0; k < checkpoint->header.num_objs; k++)
+                {
+                    m_ckpt_copy(checkpoint, k, network_obj(&checkpoint->objs[k]));
+                }
+                #pragma omp single nowait
+                m_ckpt_commit(checkpoint, cstep + 1, gtime);
+            }
+% endif
+        }
+    }
+    report_imbalance();
+% else:
+    register double gtime = start_time;
+    for (uint_fast32_t cstep = start_step; cstep < SIMUL_LEN; cstep++)
+    {
         for (size_t i = 0; i < NUM_CELLS; i++)
         {
             compartment_simul(hnetwork[i], gtime, cstep);
         }
         gtime += DT;
+% if CHECKPOINT_EVERY:
+
+        if (checkpoint != NULL && cstep % CHECKPOINT_EVERY == 0)
+        {
+            m_ckpt_begin(checkpoint);
+            for (uint64_t k = 0; k < checkpoint->header.num_objs; k++)
+            {
+                m_ckpt_copy(checkpoint, k, network_obj(&checkpoint->objs[k]));
+            }
+            m_ckpt_commit(checkpoint, cstep + 1, gtime);
+        }
+% endif
     }
+% endif
 }
 % endif
 
@@ -221,8 +428,19 @@ static inline void init_network(void)
 % endfor
 
     ## Allocate and initialize host objects, copying them to the device
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+    ## Every thread builds the cells it will step, so their objects are
+    ## allocated from (and first touched on) that thread's NUMA node.
+    #pragma omp parallel num_threads(NUM_THREADS)
+    {
+    const int tid = omp_get_thread_num();
+% endif
     size_t id = 0;
 % for comp in compartments:    
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+    if (CELL_OWNER(id) == (size_t) tid)
+    {
+% endif
     ## TODO: Initialize mechanisms 'hosted' by this compartment
     void* mechs[MAX_NUM_MECHS] = {NULL};
     size_t j = 0;
@@ -235,19 +453,223 @@ static inline void init_network(void)
                  ,${str(getattr(comp, param))}
     % endfor
     );
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+    }
+% endif
     id++;
 % endfor
-    
-    ## Copy staging network array to device network array
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+    }
+% endif
+}
+
+## Rebuilds the network from the newest complete checkpoint in path, giving
+## the step to carry on from and its simulation time
+static int restore_network(const char* path, uint64_t* step, double* gtime)
+{
+    struct m_ckpt_image image;
+    if (m_ckpt_read(path, &image))
+    {
+        return -1;
+    }
+
+    ## Objects must be of this build's classes, and each cell's compartment
+    ## must come first, followed by exactly its mechanisms, in order
+    bool ok = image.header.num_cells == NUM_CELLS && image.header.num_classes == NUM_CU_CLASS;
+    for (size_t i = 0; ok && i < NUM_CU_CLASS; i++)
+    {
+        ok = image.size_vtable[i] == size_vtable[i];
+    }
+    uint64_t cell = 0, num_mechs = 0, expected_mechs = 0;
+    for (uint64_t k = 0; ok && k < image.header.num_objs; k++)
+    {
+        const struct m_ckpt_obj* obj = &image.objs[k];
+        if (obj->mech == M_CKPT_COMPARTMENT)
+        {
+            ok = num_mechs == expected_mechs && obj->cell == (k == 0 ? 0 : cell + 1);
+            cell = obj->cell;
+            num_mechs = 0;
+            expected_mechs = ((const struct Compartment*) (image.data + obj->offset))->num_mechs;
+            ok = ok && expected_mechs <= MAX_NUM_MECHS;
+        } else {
+            ok = k > 0 && obj->cell == cell && obj->mech == num_mechs++;
+        }
+    }
+    ok = ok && num_mechs == expected_mechs && cell + 1 == NUM_CELLS;
+    if (!ok)
+    {
+        fprintf(stderr, "Checkpoint %s is not of this network.\\n", path);
+        m_ckpt_image_free(&image);
+        return -1;
+    }
+
+    ## Compartments come before their mechanisms, so can be linked to them
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+    #pragma omp parallel num_threads(NUM_THREADS)
+    {
+    const int tid = omp_get_thread_num();
+% endif
+    for (uint64_t k = 0; k < image.header.num_objs; k++)
+    {
+        const struct m_ckpt_obj* obj = &image.objs[k];
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+        if (CELL_OWNER(obj->cell) != (size_t) tid)
+        {
+            continue;
+        }
+% endif
+        void* new_obj = myriad_alloc_obj((enum MyriadClass) obj->class_id);
+        assert(new_obj);
+        memcpy(new_obj, image.data + obj->offset, obj->size);
+        if (obj->mech == M_CKPT_COMPARTMENT)
+        {
+            hnetwork[obj->cell] = (struct Compartment*) new_obj;
+        } else {
+            hnetwork[obj->cell]->my_mechs[obj->mech] = new_obj;
+        }
+    }
+% if MYRIAD_ARENA and NUM_THREADS > 1:
+    }
+% endif
+
+    *step = image.slot.step;
+    *gtime = image.slot.gtime;
+    m_ckpt_image_free(&image);
+    return 0;
+}
+
 % if CUDA:
+## Copy staging network array to device network array
+static void copy_network_to_device(void)
+{
     for (size_t id = 0; id < NUM_CELLS; id++)
     {
         snetwork[id] = myriad_cuda_new((struct MyriadObject*) hnetwork[id]);
     }
     CUDA_CHECK_CALL(cudaMemcpyToSymbol(dnetwork, snetwork, NUM_CELLS * sizeof(void*)));
+}
+
 % endif
+
+% if not SHM_NETWORK:
+##########################
+## Bulk object transfer ##
+##########################
+
+## Most buffers handed to one sendmsg()
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+## Answers a bulk request (whose M_BULK_REQUEST has been read) with every
+## object it names in one stream, gathering objects and their mechanisms
+## straight from where they live instead of copying them into a buffer.
+static int send_objects(const int fd)
+{
+    struct m_bulk_request req;
+    if (m_receive_data(fd, &req, sizeof(req)) != (ssize_t) sizeof(req) ||
+        req.magic != M_BULK_MAGIC)
+    {
+        fputs("Invalid bulk request.\\n", stderr);
+        return -1;
+    }
+
+    ## Resolve the request into a list of IDs, checking every one of them
+    struct m_bulk_reply reply = {.magic = M_BULK_MAGIC, .status = 0, .num_objs = 0};
+    uint64_t* ids = NULL;
+    if (req.type == M_BULK_RANGE)
+    {
+        if (req.count == 0 && req.first < NUM_CELLS)
+        {
+            req.count = NUM_CELLS - req.first;
+        }
+        if (req.first >= NUM_CELLS || req.count > NUM_CELLS - req.first)
+        {
+            reply.status = -1;
+        }
+    } else if (req.type == M_BULK_LIST && req.count > NUM_CELLS) {
+        ## Refuse it, but only once the IDs already sent are out of the way
+        if (req.count > UINT64_MAX / sizeof(uint64_t) ||
+            m_discard_data(fd, req.count * sizeof(uint64_t)))
+        {
+            return -1;
+        }
+        reply.status = -1;
+    } else if (req.type == M_BULK_LIST) {
+        if ((ids = (uint64_t*) malloc(req.count * sizeof(uint64_t) + 1)) == NULL ||
+            m_receive_data(fd, ids, req.count * sizeof(uint64_t)) != (ssize_t) (req.count * sizeof(uint64_t)))
+        {
+            free(ids);
+            return -1;
+        }
+        for (uint64_t i = 0; i < req.count; i++)
+        {
+            reply.status = ids[i] < NUM_CELLS ? reply.status : -1;
+        }
+    } else {
+        reply.status = -1;
+    }
+    reply.num_objs = reply.status == 0 ? req.count : 0;
+
+    ## Per-object headers and mechanism sizes must outlive the iovecs
+    struct m_obj_frame* frames = (struct m_obj_frame*)
+        calloc(reply.num_objs + 1, sizeof(struct m_obj_frame));
+    uint64_t (*mech_sizes)[MAX_NUM_MECHS] = (uint64_t (*)[MAX_NUM_MECHS])
+        calloc(reply.num_objs + 1, sizeof(*mech_sizes));
+    struct iovec iov[IOV_MAX];
+    int iovcnt = 0, ret = -1;
+    if (frames == NULL || mech_sizes == NULL)
+    {
+        goto cleanup;
+    }
+    iov[iovcnt++] = (struct iovec) {.iov_base = &reply, .iov_len = sizeof(reply)};
+
+    for (uint64_t i = 0; i < reply.num_objs; i++)
+    {
+        const uint64_t id = ids != NULL ? ids[i] : req.first + i;
+        const struct Compartment* comp = (const struct Compartment*) hnetwork[id];
+        frames[i].id = id;
+        frames[i].obj_size = myriad_sizeof(hnetwork[id]);
+        frames[i].num_mechs = comp->num_mechs;
+        for (uint64_t j = 0; j < comp->num_mechs; j++)
+        {
+            mech_sizes[i][j] = myriad_sizeof(comp->my_mechs[j]);
+        }
+
+        ## Flush first if this object's buffers would not fit
+        if (iovcnt + 3 + (int) comp->num_mechs > IOV_MAX)
+        {
+            if (m_send_iov(fd, iov, iovcnt) < 0)
+            {
+                goto cleanup;
+            }
+            iovcnt = 0;
+        }
+        iov[iovcnt++] = (struct iovec) {.iov_base = &frames[i], .iov_len = sizeof(frames[i])};
+        iov[iovcnt++] = (struct iovec) {.iov_base = hnetwork[id], .iov_len = frames[i].obj_size};
+        iov[iovcnt++] = (struct iovec) {.iov_base = mech_sizes[i],
+                                        .iov_len = comp->num_mechs * sizeof(uint64_t)};
+        for (uint64_t j = 0; j < comp->num_mechs; j++)
+        {
+            iov[iovcnt++] = (struct iovec) {.iov_base = comp->my_mechs[j],
+                                            .iov_len = mech_sizes[i][j]};
+        }
+    }
+    if (m_send_iov(fd, iov, iovcnt) < 0)
+    {
+        goto cleanup;
+    }
+    printf("Sent %" PRIu64 " objects in bulk.\\n", reply.num_objs);
+    ret = 0;
+
+cleanup:
+    free(mech_sizes);
+    free(frames);
+    free(ids);
+    return ret;
 }
 
+% endif
 ###################
 ## Main function ##
 ###################
@@ -288,15 +710,78 @@ int main(void)
     const size_t total_mem_usage = calc_total_size(&num_allocs);
     assert(myriad_alloc_init(total_mem_usage, num_allocs) == 0);
 
-    ## Instantiate new cells with myriad_new(), add mechanisms, etc.
-    init_network();
+% if SHM_NETWORK:
+    ## Map the network segment. Its size bounds every cell at a compartment
+    ## plus MAX_NUM_MECHS mechanisms of the largest class; pages that are
+    ## never touched cost nothing.
+    size_t max_obj_size = 0;
+    for (size_t i = 0; i < NUM_CU_CLASS; i++)
+    {
+        max_obj_size = size_vtable[i] > max_obj_size ? size_vtable[i] : max_obj_size;
+    }
+    shm_offset = SHM_ROUND_UP(sizeof(struct m_shm_index) + NUM_CELLS * sizeof(uint64_t));
+    shm_size = shm_offset + NUM_CELLS * (MAX_NUM_MECHS + 1) * SHM_ROUND_UP(max_obj_size);
+    if ((shm_fd = m_shm_create(shm_size)) == -1)
+    {
+        fputs("Unable to create shared-memory network segment. Exiting.\\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    shm_base = (char*) mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_NORESERVE, shm_fd, 0);
+    if (shm_base == MAP_FAILED)
+    {
+        perror("mmap network segment: ");
+        exit(EXIT_FAILURE);
+    }
+
+% endif
+    ## Instantiate new cells with myriad_new(), add mechanisms, etc., or pick
+    ## up where the run that left a checkpoint in MYRIAD_RESTART stopped
+    uint64_t start_step = 1;
+    double start_time = DT;
+    const char* restart_path = getenv("MYRIAD_RESTART");
+    if (restart_path != NULL && restart_path[0] != '\0')
+    {
+        if (restore_network(restart_path, &start_step, &start_time))
+        {
+            fputs("Unable to restart from checkpoint. Exiting.\\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        printf("Restarting at step %" PRIu64 ".\\n", start_step);
+    } else {
+        init_network();
+    }
+% if CUDA:
+    copy_network_to_device();
+% endif
+
+% if SHM_NETWORK:
+    ## Publish where each cell lives, for the Python side
+    struct m_shm_index* shm_index = (struct m_shm_index*) shm_base;
+    shm_index->magic = M_SHM_MAGIC;
+    shm_index->base = (uint64_t) (uintptr_t) shm_base;
+    shm_index->size = shm_offset;
+    shm_index->num_objs = NUM_CELLS;
+    for (size_t i = 0; i < NUM_CELLS; i++)
+    {
+        shm_index->obj_offset[i] = (uint64_t) ((char*) hnetwork[i] - shm_base);
+    }
+
+% endif
+% if CHECKPOINT_EVERY:
+    if ((checkpoint = open_checkpoint()) == NULL)
+    {
+        fputs("Unable to open checkpoint file. Exiting.\\n", stderr);
+        exit(EXIT_FAILURE);
+    }
 
+% endif
     ## Invoke simulation kernel
 % if CUDA:
     const dim3 block(NUM_CELLS);
 	const dim3 grid(NUM_CELLS / block.x);
     ## fprintf(stderr, "Execution configuration <<<%d, %d>>>\\n", grid.x, block.x);
-    run_simul<<<grid, block>>>(1, DT);
+    run_simul<<<grid, block>>>(start_step, start_time);
     CUDA_CHECK_CALL(cudaDeviceSynchronize());
     ## Copy objects back to host-side & free staging array
     for (size_t i = 0; i < NUM_CELLS; i++)
@@ -306,9 +791,19 @@ int main(void)
             (struct MyriadObject*) snetwork[i]);
     }
 % else:
-    run_simul();
+    run_simul(start_step, start_time);
+% endif
+% if CHECKPOINT_EVERY:
+    if (m_ckpt_close(checkpoint))
+    {
+        fputs("Some checkpoints were not completely written.\\n", stderr);
+    }
+    checkpoint = NULL;
 % endif
 
+    ## Report heap usage of the run
+    myriad_alloc_print_stats(stdout);
+
     ## Do IPC with parent python process
     if ((socket_fd = m_server_socket_accept(serversock_fd)) == -1)
     {
@@ -316,6 +811,24 @@ int main(void)
         exit(EXIT_FAILURE);
     }
 
+% if SHM_NETWORK:
+    ## Hand over the network segment; the results are read in place, so all
+    ## that is left is to stay alive until the parent hangs up.
+    if (m_send_fd(socket_fd, shm_fd))
+    {
+        fputs("Failed to send network segment via socket.\\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    puts("Sent network segment.");
+
+    char hangup = 0;
+    while (recv(socket_fd, &hangup, sizeof(hangup), 0) > 0)
+    {
+        continue;
+    }
+    puts("Parent closed connection.");
+    exit(EXIT_SUCCESS);
+% else:
     ## Main message loop
     while (1)
     {
@@ -325,7 +838,17 @@ int main(void)
 
         // Process message for object request
         int obj_req = -1;
-        if (m_receive_int(socket_fd, &obj_req) || obj_req < 0)
+        const bool received = m_receive_int(socket_fd, &obj_req) == 0;
+        if (received && obj_req == M_BULK_REQUEST)
+        {
+            if (send_objects(socket_fd))
+            {
+                fputs("Bulk transfer failed. Terminating simulation.\\n", stderr);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        if (!received || obj_req < 0 || obj_req >= NUM_CELLS)
         {
             fputs("Terminating simulation.\\n", stderr);
             exit(EXIT_FAILURE);
@@ -333,7 +856,7 @@ int main(void)
         printf("Object data request: %d\\n", obj_req);
 
         // Send size of compartment object & wait for it to be accepted
-        const size_t obj_size = myriad_sizeof(network[obj_req]);
+        const size_t obj_size = myriad_sizeof(hnetwork[obj_req]);
         if (m_send_int(socket_fd, obj_size))
         {
             fputs("Failed to send object size via socket.\\n", stderr);
@@ -346,7 +869,7 @@ int main(void)
         ///////////////////////////////
         
         // Send object data
-        if (m_send_data(socket_fd, network[obj_req], obj_size) < 0)
+        if (m_send_data(socket_fd, hnetwork[obj_req], obj_size) < 0)
         {
             fputs("Serialization aborted: m_send_data failed\\n", stderr);
             exit(EXIT_FAILURE);
@@ -357,7 +880,7 @@ int main(void)
         // PHASE 3: SEND MECHANISM DATA ONE-BY-ONE //
         /////////////////////////////////////////////
         
-        const struct Compartment* as_cmp = (const struct Compartment*) network[obj_req];
+        const struct Compartment* as_cmp = (const struct Compartment*) hnetwork[obj_req];
         printf("Sending information for %" PRIu64 " mechanisms.\\n", as_cmp->num_mechs);
         const uint64_t my_num_mechs = as_cmp->num_mechs;
         for (uint64_t i = 0; i < my_num_mechs; i++)
@@ -388,4 +911,5 @@ int main(void)
     puts("Exited message loop.");
     
     exit(EXIT_SUCCESS);
+% endif
 }
@@ -94,13 +94,19 @@ extern __thread union _eco _eco;  ## Must be thread-local due to side-effects.
 #define EXP(x) _exp(x)
 
 
-## Simulation parameters
+## Simulation parameters. These are baked in here rather than read at startup
+## as purec's MYRIAD_RUNTIME_PARAMS build does: the Python bindings size the
+## voltage history by SIMUL_LEN, so a changed value means a rebuild.
 
 #define NUM_THREADS ${NUM_THREADS}
 #define SIMUL_LEN ${SIMUL_LEN}
 #define DT ${DT}
 #define NUM_CELLS ${NUM_COMPARTMENTS}
 #define MAX_NUM_MECHS ${MAX_NUM_MECHS}
+## Cells handed to an OpenMP thread at a time
+#define SCHED_CHUNK ${SCHED_CHUNK}
+## Steps between checkpoints, 0 for none
+#define CHECKPOINT_EVERY ${CHECKPOINT_EVERY}
 
 
 ## CUDA includes (note: this has only been tested up to 6.5)
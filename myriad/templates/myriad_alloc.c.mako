@@ -10,13 +10,269 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include <errno.h>
 #include <sys/mman.h>
+% if MYRIAD_ARENA:
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+% else:
 #include <semaphore.h>
+% endif
 
 #include "myriad_alloc.h"
 
+#define ROUND_UP(x, align) (((x) + (align) - 1) & ~((size_t) (align) - 1))
+
+//! Bytes taken by the header in front of each block
+#define HEADER_SIZE ROUND_UP(sizeof(struct alloc_header), MYRIAD_ALLOC_GRAIN)
+
+#define BLOCK_HEADER(loc) ((struct alloc_header*) ((char*) (loc) - HEADER_SIZE))
+
+//! Statistics; updated atomically so threads can share them
+static struct myriad_alloc_stats _stats;
+
+#define STAT_ADD(field, n) __atomic_fetch_add(&_stats.field, n, __ATOMIC_RELAXED)
+#define STAT_SUB(field, n) __atomic_fetch_sub(&_stats.field, n, __ATOMIC_RELAXED)
+
+/**
+ * Size class of an allocation of size bytes, and the block size it needs.
+ *
+ * Sizes up to MYRIAD_ALLOC_SMALL_MAX get an exact class per grain; larger
+ * ones share a class per power of two and keep their exact (grain-rounded)
+ * size, so a larger block may be reused for a smaller request but not the
+ * other way round.
+ */
+static inline uint16_t _size_class(const size_t size, size_t* block_size)
+{
+    *block_size = ROUND_UP(size > 0 ? size : 1, MYRIAD_ALLOC_GRAIN);
+    if (*block_size <= MYRIAD_ALLOC_SMALL_MAX)
+    {
+        return (uint16_t) (*block_size / MYRIAD_ALLOC_GRAIN - 1);
+    }
+    const uint32_t log2_size = 64 - __builtin_clzl(*block_size - 1);
+    return (uint16_t) (MYRIAD_ALLOC_SMALL_CLASSES + log2_size -
+                       __builtin_ctzl(MYRIAD_ALLOC_SMALL_MAX));
+}
+
+// Pops a block of at least block_size off a free list, NULL if there is none.
+// Only the head is considered, and only if it would not waste too much of
+// itself to track in its header.
+static inline void* _free_list_pop(void** head, const size_t block_size)
+{
+    void* loc = *head;
+    if (loc == NULL || BLOCK_HEADER(loc)->nbytes < block_size ||
+        BLOCK_HEADER(loc)->nbytes - block_size > UINT16_MAX - MYRIAD_ALLOC_GRAIN)
+    {
+        return NULL;
+    }
+    *head = *(void**) loc;
+    STAT_SUB(bytes_free, BLOCK_HEADER(loc)->nbytes);
+    STAT_ADD(num_reused, 1);
+    return loc;
+}
+
+static inline void _free_list_push(void** head, void* loc)
+{
+    *(void**) loc = *head;
+    *head = loc;
+    STAT_ADD(bytes_free, BLOCK_HEADER(loc)->nbytes);
+}
+
+// Accounts for a block going live to serve a request of size bytes
+static inline void _stats_alloc(struct alloc_header* header, const size_t size)
+{
+    const size_t nbytes = header->nbytes;
+    header->slack = (uint16_t) (nbytes - size);
+    STAT_ADD(num_allocs, 1);
+    STAT_ADD(bytes_requested, nbytes - header->slack);
+    const size_t in_use = STAT_ADD(bytes_in_use, nbytes) + nbytes;
+    size_t high = __atomic_load_n(&_stats.high_water, __ATOMIC_RELAXED);
+    while (in_use > high &&
+           !__atomic_compare_exchange_n(&_stats.high_water, &high, in_use, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        continue;
+    }
+}
+
+// Accounts for a live block being freed
+static inline void _stats_free(const struct alloc_header* header)
+{
+    STAT_ADD(num_frees, 1);
+    STAT_SUB(bytes_in_use, header->nbytes);
+    STAT_SUB(bytes_requested, header->nbytes - header->slack);
+}
+
+% if MYRIAD_ARENA:
+//! Huge page size the arena is rounded up to
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+//! Header tags of live and freed blocks, to catch bad frees
+#define TAG_LIVE 0x4D594C56
+#define TAG_FREE 0x4D594652
+
+struct alloc_arena myriad_arena;
+
+//! Chunk the calling thread is currently bump-allocating from
+static __thread char* _tl_cur = NULL;
+static __thread char* _tl_end = NULL;
+
+//! Per-thread free lists, one per size class
+static __thread void* _free_lists[MYRIAD_ALLOC_NUM_CLASSES];
+
+// Number of NUMA nodes to split the arena across
+static uint32_t _arena_num_nodes(void)
+{
+    const char* numa = getenv("MYRIAD_ARENA_NUMA");
+    if (numa != NULL && atoi(numa) == 0)
+    {
+        return 1;
+    }
+
+    // Node list looks like "0" or "0-3"; we want the highest node + 1
+    FILE* fp = fopen("/sys/devices/system/node/online", "r");
+    if (fp == NULL)
+    {
+        return 1;
+    }
+    unsigned int lo = 0, hi = 0;
+    const int matched = fscanf(fp, "%u-%u", &lo, &hi);
+    fclose(fp);
+
+    uint32_t num_nodes = (matched == 2 ? hi : lo) + 1;
+    return num_nodes > MYRIAD_ARENA_MAX_NODES ? MYRIAD_ARENA_MAX_NODES : num_nodes;
+}
+
+// NUMA node of the CPU the calling thread is running on
+static inline uint32_t _arena_my_node(void)
+{
+    unsigned int cpu = 0, node = 0;
+    if (myriad_arena.num_nodes == 1 ||
+        syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    {
+        return 0;
+    }
+    return node % myriad_arena.num_nodes;
+}
+
+// Reserves size bytes, preferring explicit huge pages, then THP
+static char* _arena_map(const size_t size, bool* hugetlb)
+{
+    // No MAP_NORESERVE here: without a reservation an exhausted huge page
+    // pool shows up as SIGBUS on first touch instead of failing the mmap.
+    void* loc = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (loc != MAP_FAILED)
+    {
+        *hugetlb = true;
+        return (char*) loc;
+    }
+
+    loc = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (loc == MAP_FAILED)
+    {
+        return NULL;
+    }
+    // Transparent huge pages are only a hint; ignore failure
+    madvise(loc, size, MADV_HUGEPAGE);
+    *hugetlb = false;
+    return (char*) loc;
+}
+
+int myriad_alloc_init(const size_t heap_size, const size_t num_allocs)
+{
+    myriad_arena.num_nodes = _arena_num_nodes();
+    // Every thread may strand up to one partially used chunk
+    myriad_arena.node_size = ROUND_UP(heap_size + ${NUM_THREADS} * MYRIAD_ARENA_CHUNK,
+                                      HUGE_PAGE_SIZE);
+
+    for (uint32_t n = 0; n < myriad_arena.num_nodes; n++)
+    {
+        struct arena_node* node = &myriad_arena.nodes[n];
+        node->base = _arena_map(myriad_arena.node_size, &node->hugetlb);
+        if (node->base == NULL)
+        {
+            perror("myriad_alloc_init, map arena: ");
+            exit(EXIT_FAILURE);
+        }
+        atomic_init(&node->offset, 0);
+
+        // Pages are placed on first touch anyway; this just makes it explicit
+        // for pages touched by a thread that has since migrated.
+        if (myriad_arena.num_nodes > 1)
+        {
+            const unsigned long nodemask = 1UL << n;
+            syscall(SYS_mbind, node->base, myriad_arena.node_size, MPOL_PREFERRED,
+                    &nodemask, sizeof(nodemask) * 8, 0);
+        }
+    }
+
+    return 0;
+}
+
+void* myriad_malloc(const size_t size, bool lock)
+{
+    size_t nbytes = 0;
+    const uint16_t size_class = _size_class(size, &nbytes);
+
+    // Fastest path: reuse a block this thread freed earlier
+    void* loc = _free_list_pop(&_free_lists[size_class], nbytes);
+    if (loc != NULL)
+    {
+        struct alloc_header* header = BLOCK_HEADER(loc);
+        header->tag = TAG_LIVE;
+        _stats_alloc(header, size);
+        return loc;
+    }
+
+    // Fast path: room left in this thread's chunk
+    const size_t needed = HEADER_SIZE + nbytes;
+    if (_tl_cur == NULL || needed > (size_t) (_tl_end - _tl_cur))
+    {
+        if (needed > myriad_arena.node_size)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        // Claim a fresh chunk (or several, for big allocations) on our node
+        const size_t chunk = ROUND_UP(needed, MYRIAD_ARENA_CHUNK);
+        struct arena_node* node = &myriad_arena.nodes[_arena_my_node()];
+        const size_t offset = atomic_fetch_add_explicit(&node->offset, chunk,
+                                                        memory_order_relaxed);
+        if (offset + chunk > myriad_arena.node_size)
+        {
+            errno = ENOMEM;
+            return NULL;
+        }
+        STAT_ADD(bytes_reserved, chunk);
+
+        _tl_cur = node->base + offset;
+        _tl_end = _tl_cur + chunk;
+
+        // Try to lock, if asked; silently fail. Locking faults the chunk in
+        // from this thread, so it lands on this thread's node.
+        if (lock)
+        {
+            mlock(_tl_cur, chunk);
+        }
+    }
+
+    struct alloc_header* header = (struct alloc_header*) _tl_cur;
+    header->size_class = size_class;
+    header->tag = TAG_LIVE;
+    header->nbytes = nbytes;
+    _tl_cur += needed;
+
+    _stats_alloc(header, size);
+    return (char*) header + HEADER_SIZE;
+}
+% else:
+
 #ifdef DEBUG
 #include <assert.h>
 #define SEMA_P assert(0 == sem_wait(&myriad_memdat.sema))
@@ -26,6 +282,9 @@
 #define SEMA_V sem_post(&myriad_memdat.sema)
 #endif
 
+//! Free lists, one per size class; guarded by the semaphore
+static void* _free_lists[MYRIAD_ALLOC_NUM_CLASSES];
+
 int myriad_alloc_init(const size_t heap_size, const size_t num_allocs)
 {
     // Initialize semaphore first.
@@ -39,9 +298,10 @@ int myriad_alloc_init(const size_t heap_size, const size_t num_allocs)
     myriad_memdat.meta_indx = 0;
     myriad_memdat.offset = 0;
     
-    // Set initial sizes
-    myriad_memdat.heap_size = heap_size * sizeof(char);
-    myriad_memdat.metadata_size = num_allocs * sizeof(struct alloc_data);
+    // Set initial sizes, leaving room for each allocation's header and rounding
+    myriad_memdat.heap_size = heap_size * sizeof(char) +
+        num_allocs * (HEADER_SIZE + MYRIAD_ALLOC_GRAIN);
+    myriad_memdat.metadata_size = num_allocs;
 
     // Initialize metadata
     myriad_memdat.metadata = calloc(num_allocs, sizeof(struct alloc_data));
@@ -52,7 +312,7 @@ int myriad_alloc_init(const size_t heap_size, const size_t num_allocs)
     }
 
     // Initialize heap
-    myriad_memdat.heap = calloc(heap_size, sizeof(char));
+    myriad_memdat.heap = calloc(myriad_memdat.heap_size, sizeof(char));
     if (myriad_memdat.heap == NULL)
     {
         perror("myriad_alloc_init, allocate heap: ");
@@ -64,15 +324,31 @@ int myriad_alloc_init(const size_t heap_size, const size_t num_allocs)
 
 void* myriad_malloc(const size_t size, bool lock)
 {
+    size_t nbytes = 0;
+    const uint16_t size_class = _size_class(size, &nbytes);
+
     SEMA_P;
-    
+
+    // Reuse a freed block of this class if there is one; it keeps its
+    // metadata entry and lock status from when it was first allocated.
+    void* loc = _free_list_pop(&_free_lists[size_class], nbytes);
+    if (loc != NULL)
+    {
+        struct alloc_header* header = BLOCK_HEADER(loc);
+        myriad_memdat.metadata[header->meta_indx].nbytes = header->nbytes;
+        _stats_alloc(header, size);
+        SEMA_V;
+        return loc;
+    }
+
     /* We fail if at least one of the following holds:
      * 1) The total size of the allocation is larger than the heap size
      * 2) The size of the next allocation causes us to overrun the heap
      * 3) We have run out of places to store metadata (too many allocations)
      */
-    if (size > myriad_memdat.heap_size ||
-        myriad_memdat.offset + size >= myriad_memdat.heap_size ||
+    const size_t needed = HEADER_SIZE + nbytes;
+    if (needed > myriad_memdat.heap_size ||
+        myriad_memdat.offset + needed > myriad_memdat.heap_size ||
         myriad_memdat.meta_indx >= myriad_memdat.metadata_size)
     {
         errno = ENOMEM;
@@ -82,14 +358,18 @@ void* myriad_malloc(const size_t size, bool lock)
 
     // Find next free location, set metadata.
     // Get current location in heap, which we assume to be empty.
-    void* loc = &myriad_memdat.heap[myriad_memdat.offset];
+    struct alloc_header* header = (struct alloc_header*) &myriad_memdat.heap[myriad_memdat.offset];
+    header->size_class = size_class;
+    header->meta_indx = (uint32_t) myriad_memdat.meta_indx;
+    header->nbytes = nbytes;
+    loc = (char*) header + HEADER_SIZE;
     
     // Register offset and size in metadata index.
-    myriad_memdat.metadata[myriad_memdat.meta_indx].offset = myriad_memdat.offset;
-    myriad_memdat.metadata[myriad_memdat.meta_indx].nbytes = size;
+    myriad_memdat.metadata[myriad_memdat.meta_indx].offset = myriad_memdat.offset + HEADER_SIZE;
+    myriad_memdat.metadata[myriad_memdat.meta_indx].nbytes = nbytes;
     
     // Try to lock, if asked
-    if (lock == false || mlock(loc, size) != 0)
+    if (lock == false || mlock(loc, nbytes) != 0)
     {
         // Silently fail
         myriad_memdat.metadata[myriad_memdat.meta_indx].memlocked = false;
@@ -99,13 +379,17 @@ void* myriad_malloc(const size_t size, bool lock)
 
     // Increment index and offset to reflect new allocation
     myriad_memdat.meta_indx++;
-    myriad_memdat.offset += size;
+    myriad_memdat.offset += needed;
+    STAT_ADD(bytes_reserved, needed);
+    _stats_alloc(header, size);
 
     // Return allocated region of memory
     SEMA_V;
     return loc;
 }
 
+% endif
+
 void* myriad_calloc(const size_t num_elems, const size_t size, bool lock)
 {
     void* loc = myriad_malloc(num_elems * size, lock);
@@ -119,12 +403,59 @@ void* myriad_calloc(const size_t num_elems, const size_t size, bool lock)
     return loc;
 }
 
+% if MYRIAD_ARENA:
+int myriad_finalize()
+{
+    int status = 0;
+    for (uint32_t n = 0; n < myriad_arena.num_nodes; n++)
+    {
+        if (munmap(myriad_arena.nodes[n].base, myriad_arena.node_size) != 0)
+        {
+            status = -1;
+        }
+        myriad_arena.nodes[n].base = NULL;
+    }
+    myriad_arena.num_nodes = 0;
+    _tl_cur = _tl_end = NULL;
+    memset(_free_lists, 0, sizeof(_free_lists));
+
+    return status;
+}
+
+void myriad_free(void* loc)
+{
+    // If the memory location is not a live block within a sub-arena, panic!
+    for (uint32_t n = 0; n < myriad_arena.num_nodes; n++)
+    {
+        const struct arena_node* node = &myriad_arena.nodes[n];
+        if ((uintptr_t) loc >= (uintptr_t) node->base + HEADER_SIZE &&
+            (uintptr_t) loc < (uintptr_t) node->base + atomic_load(&node->offset) &&
+            BLOCK_HEADER(loc)->tag == TAG_LIVE)
+        {
+            struct alloc_header* header = BLOCK_HEADER(loc);
+            header->tag = TAG_FREE;
+            _stats_free(header);
+            _free_list_push(&_free_lists[header->size_class], loc);
+            return;
+        }
+    }
+
+    errno = EFAULT;
+    perror("myriad_free: ");
+    exit(EXIT_FAILURE);
+}
+
+#undef HUGE_PAGE_SIZE
+#undef TAG_LIVE
+#undef TAG_FREE
+% else:
 int myriad_finalize()
 {
     SEMA_P;
 
     free(myriad_memdat.heap);
     free(myriad_memdat.metadata);
+    memset(_free_lists, 0, sizeof(_free_lists));
 
     return sem_destroy(&myriad_memdat.sema);
 }
@@ -133,38 +464,74 @@ void myriad_free(void* loc)
 {
     SEMA_P;
     // If the memory location is not within our bounds, panic!
-    if ((uintptr_t) loc < (uintptr_t) myriad_memdat.heap ||
-        (uintptr_t) loc > (uintptr_t) myriad_memdat.heap + myriad_memdat.offset)
+    if ((uintptr_t) loc < (uintptr_t) myriad_memdat.heap + HEADER_SIZE ||
+        (uintptr_t) loc >= (uintptr_t) myriad_memdat.heap + myriad_memdat.offset)
     {
-    failure:
-        errno = EFAULT;
-        perror("myriad_free: ");
-        SEMA_V;
-        exit(EXIT_FAILURE);
+        goto failure;
     }
 
-    // Calculate offset from pointer location to heap.
+    // The header leads straight to the metadata entry; check it agrees, and
+    // that the block is not already free.
+    const struct alloc_header* header = BLOCK_HEADER(loc);
     const ptrdiff_t offset = (uintptr_t) loc - (uintptr_t) myriad_memdat.heap;
-    for (uint64_t i = 0; i < myriad_memdat.metadata_size; i++)
+    if (header->meta_indx >= myriad_memdat.meta_indx ||
+        myriad_memdat.metadata[header->meta_indx].offset != offset ||
+        myriad_memdat.metadata[header->meta_indx].nbytes == 0)
     {
-        if (offset == myriad_memdat.metadata[i].offset)
-        {
-            myriad_memdat.metadata[i].offset = 0;
-            if (myriad_memdat.metadata[i].memlocked)
-            {
-                munlock(loc, myriad_memdat.metadata[i].nbytes);
-            }
-            myriad_memdat.metadata[i].memlocked = false;
-            myriad_memdat.metadata[i].nbytes = 0;
-            myriad_memdat.meta_indx = i;
-            SEMA_V;
-            return;
-        }
+        goto failure;
     }
 
+    // Block stays locked, since it will likely be reused
+    myriad_memdat.metadata[header->meta_indx].nbytes = 0;
+    _stats_free(header);
+    _free_list_push(&_free_lists[header->size_class], loc);
+    SEMA_V;
+    return;
+
     // Something bad has happened
-    goto failure;
+failure:
+    errno = EFAULT;
+    perror("myriad_free: ");
+    SEMA_V;
+    exit(EXIT_FAILURE);
 }
 
 #undef SEMA_P
 #undef SEMA_V
+% endif
+
+void myriad_alloc_get_stats(struct myriad_alloc_stats* stats)
+{
+    __atomic_load(&_stats.bytes_requested, &stats->bytes_requested, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.bytes_in_use, &stats->bytes_in_use, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.high_water, &stats->high_water, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.bytes_reserved, &stats->bytes_reserved, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.bytes_free, &stats->bytes_free, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.num_allocs, &stats->num_allocs, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.num_reused, &stats->num_reused, __ATOMIC_RELAXED);
+    __atomic_load(&_stats.num_frees, &stats->num_frees, __ATOMIC_RELAXED);
+}
+
+void myriad_alloc_print_stats(FILE* fp)
+{
+    struct myriad_alloc_stats stats;
+    myriad_alloc_get_stats(&stats);
+
+    const double external = stats.bytes_reserved > 0 ?
+        100.0 * stats.bytes_free / stats.bytes_reserved : 0.0;
+    const double internal = stats.bytes_in_use > 0 ?
+        100.0 * (stats.bytes_in_use - stats.bytes_requested) / stats.bytes_in_use : 0.0;
+
+    fprintf(fp, "Allocator: %" PRIu64 " allocs (%" PRIu64 " reused), %" PRIu64 " frees\n",
+            stats.num_allocs, stats.num_reused, stats.num_frees);
+    fprintf(fp, "Allocator: %zu bytes in use, high-water mark %zu, %zu reserved\n",
+            stats.bytes_in_use, stats.high_water, stats.bytes_reserved);
+    fprintf(fp, "Allocator: fragmentation %.1f%% external (%zu bytes free), %.1f%% internal\n",
+            external, stats.bytes_free, internal);
+}
+
+#undef ROUND_UP
+#undef HEADER_SIZE
+#undef BLOCK_HEADER
+#undef STAT_ADD
+#undef STAT_SUB
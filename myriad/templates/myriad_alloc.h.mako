@@ -6,11 +6,113 @@
 #ifndef MYRIAD_ALLOC_H
 #define MYRIAD_ALLOC_H
 
+#include <stdio.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+% if MYRIAD_ARENA:
+#include <stdatomic.h>
+% else:
 #include <semaphore.h>
+% endif
 
+//! Granularity (and alignment) of every allocation
+#define MYRIAD_ALLOC_GRAIN 16
+
+//! Largest allocation served from an exact-size class
+#define MYRIAD_ALLOC_SMALL_MAX 1024
+
+//! Exact-size classes, one per MYRIAD_ALLOC_GRAIN bytes up to the above
+#define MYRIAD_ALLOC_SMALL_CLASSES (MYRIAD_ALLOC_SMALL_MAX / MYRIAD_ALLOC_GRAIN)
+
+//! Total size classes: exact small ones, then one per power of two above
+#define MYRIAD_ALLOC_NUM_CLASSES (MYRIAD_ALLOC_SMALL_CLASSES + 64)
+
+/**
+ * Header preceding every allocation, so frees need no search.
+ *
+ * Object sizes from size_vtable are all small, so each Myriad class gets an
+ * exact-size class of its own and freed objects are reused as-is.
+ */
+struct alloc_header
+{
+    //! Free list the block returns to
+    uint16_t size_class;
+    //! Bytes of the block the live allocation does not use
+    uint16_t slack;
+% if MYRIAD_ARENA:
+    //! Whether the block is live or on a free list
+    uint32_t tag;
+% else:
+    //! Metadata entry of the block
+    uint32_t meta_indx;
+% endif
+    //! Usable bytes in the block
+    uint64_t nbytes;
+};
+
+/**
+ * Allocator statistics, cumulative since myriad_alloc_init.
+ */
+struct myriad_alloc_stats
+{
+    //! Bytes in live allocations, as requested
+    size_t bytes_requested;
+    //! Bytes in live allocations, as rounded up to their block size
+    size_t bytes_in_use;
+    //! Largest bytes_in_use seen
+    size_t high_water;
+    //! Heap consumed so far, headers and unused chunk tails included
+    size_t bytes_reserved;
+    //! Bytes in freed blocks waiting to be reused
+    size_t bytes_free;
+    //! Number of successful allocations
+    uint64_t num_allocs;
+    //! Number of allocations served from a free list
+    uint64_t num_reused;
+    //! Number of frees
+    uint64_t num_frees;
+};
+
+% if MYRIAD_ARENA:
+//! Bytes a thread carves out of its node's arena at a time (one huge page)
+#ifndef MYRIAD_ARENA_CHUNK
+#define MYRIAD_ARENA_CHUNK (2UL << 20)
+#endif
+
+//! Most NUMA nodes the arena will split itself across
+#define MYRIAD_ARENA_MAX_NODES 64
+
+/**
+ * Sub-arena backing all allocations made by threads running on one node.
+ * Threads claim whole chunks with a single atomic add and bump-allocate
+ * inside them without further synchronization.
+ */
+struct arena_node
+{
+    //! Start of the mapping
+    char* base;
+    //! Bytes handed out as chunks so far
+    atomic_size_t offset;
+    //! Whether the mapping is backed by explicit (hugetlbfs) huge pages
+    bool hugetlb;
+} __attribute__((aligned(64)));
+
+/**
+ * Arena state: one sub-arena per NUMA node, all of the same size.
+ */
+struct alloc_arena
+{
+    //! Number of sub-arenas in use
+    uint32_t num_nodes;
+    //! Size of each sub-arena's mapping
+    size_t node_size;
+    //! Sub-arenas, indexed by NUMA node
+    struct arena_node nodes[MYRIAD_ARENA_MAX_NODES];
+};
+
+extern struct alloc_arena myriad_arena;
+% else:
 /**
  * Allocation metadata structure.
  */
@@ -45,10 +147,17 @@ struct alloc_buffer
     //! Raw data buffer
     char* heap;
 } myriad_memdat;
+% endif
 
 /**
  * @brief Initializes memory subsystem.
  *
+% if MYRIAD_ARENA:
+ * Maps one sub-arena of `heap_size` bytes (plus a chunk of slack per thread)
+ * for each online NUMA node, or a single one if MYRIAD_ARENA_NUMA=0 is set in
+ * the environment. Huge pages are used when available.
+ *
+% endif
  * @param heap_size Initial heap size to allocate.
  * @param num_allocs Number of metadata allocations to create.
  *
@@ -89,9 +198,35 @@ extern void* myriad_calloc(const size_t num_elems, const size_t size, bool lock)
 
 /**
  * @brief Frees a section of memory allocated by myriad_[m|c]alloc
- * 
+ *
+ * The block goes onto its size class's free list for reuse by a later
+ * allocation of the same class; memory is only returned to the system by
+ * myriad_finalize.
+% if MYRIAD_ARENA:
+ * Free lists are per-thread, so a block is reused by the thread that freed
+ * it.
+% endif
+ *
  * @param loc Location of memory to free
  */
 extern void myriad_free(void* loc) __attribute__((nonnull));
 
+/**
+ * @brief Copies out current allocator statistics.
+ *
+ * @param stats Where to write the statistics
+ */
+extern void myriad_alloc_get_stats(struct myriad_alloc_stats* stats)
+    __attribute__((nonnull));
+
+/**
+ * @brief Prints allocator statistics, including fragmentation.
+ *
+ * External fragmentation is the share of reserved heap sitting unused on free
+ * lists; internal fragmentation is the share of live blocks lost to rounding.
+ *
+ * @param fp Stream to print to
+ */
+extern void myriad_alloc_print_stats(FILE* fp) __attribute__((cold));
+
 #endif
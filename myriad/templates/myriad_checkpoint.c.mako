@@ -0,0 +1,480 @@
+/**
+ * @file myriad_checkpoint.c
+ * @brief Checkpoint/restart of the whole simulation state.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "myriad_checkpoint.h"
+
+#define ROUND_UP(x, align) (((x) + (align) - 1) & ~((uint64_t) (align) - 1))
+
+//! File offset of a slot's state
+#define SLOT_DESC_OFFSET(s) (offsetof(struct m_ckpt_header, slots) + (s) * sizeof(struct m_ckpt_slot))
+
+//! Writes all of buf at offset, retrying partial writes
+static int _m_ckpt_pwrite(const int fd, const void* buf, size_t len, off_t offset)
+{
+    const char* pos = (const char*) buf;
+    while (len > 0)
+    {
+        const ssize_t written = pwrite(fd, pos, len, offset);
+        if (written <= 0)
+        {
+            return -1;
+        }
+        pos += written;
+        len -= (size_t) written;
+        offset += written;
+    }
+    return 0;
+}
+
+//! Reads all of buf from offset, failing on a short file
+static int _m_ckpt_pread(const int fd, void* buf, size_t len, off_t offset)
+{
+    char* pos = (char*) buf;
+    while (len > 0)
+    {
+        const ssize_t got = pread(fd, pos, len, offset);
+        if (got <= 0)
+        {
+            return -1;
+        }
+        pos += got;
+        len -= (size_t) got;
+        offset += got;
+    }
+    return 0;
+}
+
+//! Bytes before the slots: header, class sizes and object table
+static uint64_t _m_ckpt_meta_size(const struct m_ckpt_header* header)
+{
+    return sizeof(struct m_ckpt_header) +
+        header->num_classes * sizeof(uint64_t) +
+        header->num_objs * sizeof(struct m_ckpt_obj);
+}
+
+//! Index of the newest complete slot, or -1 if there is none
+static int _m_ckpt_newest(const struct m_ckpt_header* header)
+{
+    int newest = -1;
+    for (int s = 0; s < 2; s++)
+    {
+        if (header->slots[s].complete &&
+            (newest < 0 || header->slots[s].generation > header->slots[newest].generation))
+        {
+            newest = s;
+        }
+    }
+    return newest;
+}
+
+////////////////////////
+// Background writing //
+////////////////////////
+
+//! Writes the changed blocks of slot s, marking it incomplete until done
+static bool _m_ckpt_write_slot(m_ckpt_t ckpt, const int s, struct m_ckpt_slot desc)
+{
+    const uint64_t num_blocks = ckpt->header.image_size / M_CKPT_BLOCK_SIZE;
+    const off_t slot_start = (off_t) (ckpt->header.slot_offset + s * ckpt->header.image_size);
+    unsigned char* dirty = ckpt->dirty[s];
+
+    desc.complete = 0;
+    if (_m_ckpt_pwrite(ckpt->fd, &desc, sizeof(desc), SLOT_DESC_OFFSET(s)) ||
+        fdatasync(ckpt->fd))
+    {
+        return false;
+    }
+
+    // Write runs of changed blocks in one go each
+    uint64_t b = 0;
+    while (b < num_blocks)
+    {
+        if (!dirty[b])
+        {
+            b++;
+            continue;
+        }
+        uint64_t end = b;
+        while (end < num_blocks && dirty[end])
+        {
+            dirty[end++] = 0;
+        }
+        if (_m_ckpt_pwrite(ckpt->fd,
+                           ckpt->images[s] + b * M_CKPT_BLOCK_SIZE,
+                           (end - b) * M_CKPT_BLOCK_SIZE,
+                           slot_start + (off_t) (b * M_CKPT_BLOCK_SIZE)))
+        {
+            return false;
+        }
+        b = end;
+    }
+
+    desc.complete = 1;
+    return fdatasync(ckpt->fd) == 0 &&
+        _m_ckpt_pwrite(ckpt->fd, &desc, sizeof(desc), SLOT_DESC_OFFSET(s)) == 0 &&
+        fdatasync(ckpt->fd) == 0;
+}
+
+static void* _m_ckpt_write(void* arg)
+{
+    m_ckpt_t ckpt = (m_ckpt_t) arg;
+
+    pthread_mutex_lock(&ckpt->lock);
+    while (true)
+    {
+        while (!ckpt->pending[0] && !ckpt->pending[1] && !ckpt->done)
+        {
+            pthread_cond_wait(&ckpt->cond, &ckpt->lock);
+        }
+        if (!ckpt->pending[0] && !ckpt->pending[1])
+        {
+            break;
+        }
+
+        // Oldest first, if both are waiting
+        int s = ckpt->pending[0] ? 0 : 1;
+        if (ckpt->pending[0] && ckpt->pending[1] &&
+            ckpt->header.slots[1].generation < ckpt->header.slots[0].generation)
+        {
+            s = 1;
+        }
+        const struct m_ckpt_slot desc = ckpt->header.slots[s];
+        pthread_mutex_unlock(&ckpt->lock);
+
+        // Stepping never touches a pending slot's image
+        const bool ok = _m_ckpt_write_slot(ckpt, s, desc);
+
+        pthread_mutex_lock(&ckpt->lock);
+        ckpt->failed = ckpt->failed || !ok;
+        ckpt->in_sync[s] = ok;
+        ckpt->header.slots[s].complete = ok;
+        ckpt->pending[s] = false;
+        pthread_cond_broadcast(&ckpt->cond);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+
+    return NULL;
+}
+
+/////////////////
+// Checkpoints //
+/////////////////
+
+static void _m_ckpt_free(m_ckpt_t ckpt)
+{
+    if (ckpt->fd >= 0)
+    {
+        close(ckpt->fd);
+    }
+    free(ckpt->objs);
+    free(ckpt->images[0]);
+    free(ckpt->images[1]);
+    free(ckpt->dirty[0]);
+    free(ckpt->dirty[1]);
+    free(ckpt);
+}
+
+//! Whether the file behind fd was laid out for the same header and tables
+static bool _m_ckpt_matches(const int fd,
+                            const struct m_ckpt_header* header,
+                            struct m_ckpt_slot slots[2],
+                            const uint64_t* sizes,
+                            const struct m_ckpt_obj* objs)
+{
+    struct m_ckpt_header old;
+    const size_t sizes_len = header->num_classes * sizeof(uint64_t);
+    const size_t objs_len = header->num_objs * sizeof(struct m_ckpt_obj);
+    unsigned char* tables = (unsigned char*) malloc(sizes_len + objs_len + 1);
+    bool same = tables != NULL &&
+        _m_ckpt_pread(fd, &old, sizeof(old), 0) == 0 &&
+        memcmp(old.magic, header->magic, sizeof(old.magic)) == 0 &&
+        old.num_cells == header->num_cells &&
+        old.num_objs == header->num_objs &&
+        old.num_classes == header->num_classes &&
+        old.image_size == header->image_size &&
+        old.slot_offset == header->slot_offset &&
+        _m_ckpt_pread(fd, tables, sizes_len + objs_len, sizeof(old)) == 0 &&
+        memcmp(tables, sizes, sizes_len) == 0 &&
+        memcmp(tables + sizes_len, objs, objs_len) == 0;
+    free(tables);
+
+    if (same)
+    {
+        memcpy(slots, old.slots, sizeof(old.slots));
+    }
+    return same;
+}
+
+m_ckpt_t m_ckpt_open(const char* path,
+                     const struct m_ckpt_obj* objs,
+                     const uint64_t num_objs,
+                     const uint64_t num_cells,
+                     const size_t* size_vtable,
+                     const uint64_t num_classes)
+{
+    m_ckpt_t ckpt = (m_ckpt_t) calloc(1, sizeof(struct m_ckpt));
+    uint64_t* sizes = (uint64_t*) calloc(num_classes + 1, sizeof(uint64_t));
+    if (ckpt == NULL || sizes == NULL)
+    {
+        free(ckpt);
+        free(sizes);
+        return NULL;
+    }
+    ckpt->fd = -1;
+    for (uint64_t i = 0; i < num_classes; i++)
+    {
+        sizes[i] = size_vtable[i];
+    }
+
+    // Lay the objects out, each at an aligned offset of the image
+    memcpy(ckpt->header.magic, M_CKPT_MAGIC, sizeof(ckpt->header.magic));
+    ckpt->header.num_cells = num_cells;
+    ckpt->header.num_objs = num_objs;
+    ckpt->header.num_classes = num_classes;
+    ckpt->objs = (struct m_ckpt_obj*) calloc(num_objs + 1, sizeof(struct m_ckpt_obj));
+    if (ckpt->objs == NULL)
+    {
+        free(sizes);
+        _m_ckpt_free(ckpt);
+        return NULL;
+    }
+    uint64_t image_size = 0;
+    for (uint64_t i = 0; i < num_objs; i++)
+    {
+        ckpt->objs[i] = objs[i];
+        ckpt->objs[i].offset = image_size;
+        image_size = ROUND_UP(image_size + objs[i].size, M_CKPT_OBJ_ALIGN);
+    }
+    ckpt->header.image_size = ROUND_UP(image_size, M_CKPT_BLOCK_SIZE);
+    ckpt->header.image_size = ckpt->header.image_size > 0 ?
+        ckpt->header.image_size : M_CKPT_BLOCK_SIZE;
+    ckpt->header.slot_offset = ROUND_UP(_m_ckpt_meta_size(&ckpt->header), M_CKPT_BLOCK_SIZE);
+
+    const uint64_t num_blocks = ckpt->header.image_size / M_CKPT_BLOCK_SIZE;
+    for (int s = 0; s < 2; s++)
+    {
+        ckpt->images[s] = (unsigned char*) calloc(ckpt->header.image_size, 1);
+        ckpt->dirty[s] = (unsigned char*) calloc(num_blocks, 1);
+    }
+    ckpt->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (ckpt->images[0] == NULL || ckpt->images[1] == NULL ||
+        ckpt->dirty[0] == NULL || ckpt->dirty[1] == NULL || ckpt->fd < 0)
+    {
+        perror("m_ckpt_open: ");
+        free(sizes);
+        _m_ckpt_free(ckpt);
+        return NULL;
+    }
+
+    // Keep the checkpoints of an earlier run of the same network, since we
+    // may have just restarted from them; start over otherwise
+    if (!_m_ckpt_matches(ckpt->fd, &ckpt->header, ckpt->header.slots, sizes, ckpt->objs))
+    {
+        memset(ckpt->header.slots, 0, sizeof(ckpt->header.slots));
+        if (ftruncate(ckpt->fd, 0) ||
+            _m_ckpt_pwrite(ckpt->fd, &ckpt->header, sizeof(ckpt->header), 0) ||
+            _m_ckpt_pwrite(ckpt->fd, sizes, num_classes * sizeof(uint64_t),
+                           sizeof(ckpt->header)) ||
+            _m_ckpt_pwrite(ckpt->fd, ckpt->objs, num_objs * sizeof(struct m_ckpt_obj),
+                           sizeof(ckpt->header) + num_classes * sizeof(uint64_t)) ||
+            fdatasync(ckpt->fd))
+        {
+            perror("m_ckpt_open, write header: ");
+            free(sizes);
+            _m_ckpt_free(ckpt);
+            return NULL;
+        }
+    }
+    free(sizes);
+
+    // Leave the newest complete checkpoint alone until there is a newer one
+    const int newest = _m_ckpt_newest(&ckpt->header);
+    ckpt->next = newest >= 0 ? 1 - newest : 0;
+    for (int s = 0; s < 2; s++)
+    {
+        ckpt->generation = ckpt->header.slots[s].generation > ckpt->generation ?
+            ckpt->header.slots[s].generation : ckpt->generation;
+    }
+
+    if (pthread_mutex_init(&ckpt->lock, NULL) != 0 ||
+        pthread_cond_init(&ckpt->cond, NULL) != 0 ||
+        pthread_create(&ckpt->writer, NULL, &_m_ckpt_write, ckpt) != 0)
+    {
+        fputs("Could not start checkpoint writer thread\n", stderr);
+        _m_ckpt_free(ckpt);
+        return NULL;
+    }
+
+    return ckpt;
+}
+
+void m_ckpt_begin(m_ckpt_t ckpt)
+{
+    const int s = ckpt->next;
+
+    pthread_mutex_lock(&ckpt->lock);
+    if (ckpt->pending[s])
+    {
+        ckpt->stalls++;
+        while (ckpt->pending[s])
+        {
+            pthread_cond_wait(&ckpt->cond, &ckpt->lock);
+        }
+    }
+    const bool in_sync = ckpt->in_sync[s];
+    pthread_mutex_unlock(&ckpt->lock);
+
+    // Nothing is known about what the slot holds, so all of it is written
+    if (!in_sync)
+    {
+        memset(ckpt->dirty[s], 1, ckpt->header.image_size / M_CKPT_BLOCK_SIZE);
+    }
+}
+
+void m_ckpt_copy(m_ckpt_t ckpt, const uint64_t obj_indx, const void* obj)
+{
+    const int s = ckpt->next;
+    const struct m_ckpt_obj* entry = &ckpt->objs[obj_indx];
+    const unsigned char* src = (const unsigned char*) obj;
+    uint64_t pos = entry->offset;
+    const uint64_t end = entry->offset + entry->size;
+
+    // Compare and copy a block at a time, so that only changes get written
+    while (pos < end)
+    {
+        const uint64_t block = pos / M_CKPT_BLOCK_SIZE;
+        const uint64_t block_end = (block + 1) * M_CKPT_BLOCK_SIZE;
+        const uint64_t len = (block_end < end ? block_end : end) - pos;
+        unsigned char* dst = ckpt->images[s] + pos;
+        if (memcmp(dst, src, len) != 0)
+        {
+            memcpy(dst, src, len);
+            // Objects sharing a block may be copied by different threads
+            __atomic_store_n(&ckpt->dirty[s][block], 1, __ATOMIC_RELAXED);
+        }
+        src += len;
+        pos += len;
+    }
+}
+
+void m_ckpt_commit(m_ckpt_t ckpt, const uint64_t step, const double gtime)
+{
+    pthread_mutex_lock(&ckpt->lock);
+    const int s = ckpt->next;
+    ckpt->header.slots[s].generation = ++ckpt->generation;
+    ckpt->header.slots[s].step = step;
+    ckpt->header.slots[s].gtime = gtime;
+    ckpt->header.slots[s].complete = 0;
+    ckpt->pending[s] = true;
+    ckpt->next = 1 - s;
+    pthread_cond_broadcast(&ckpt->cond);
+    pthread_mutex_unlock(&ckpt->lock);
+}
+
+int m_ckpt_close(m_ckpt_t ckpt)
+{
+    if (ckpt == NULL)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ckpt->lock);
+    ckpt->done = true;
+    pthread_cond_broadcast(&ckpt->cond);
+    pthread_mutex_unlock(&ckpt->lock);
+    pthread_join(ckpt->writer, NULL);
+
+    const bool failed = ckpt->failed;
+    if (ckpt->stalls > 0)
+    {
+        fprintf(stderr, "Checkpoint writer fell behind %" PRIu64 " times\n", ckpt->stalls);
+    }
+    pthread_mutex_destroy(&ckpt->lock);
+    pthread_cond_destroy(&ckpt->cond);
+    _m_ckpt_free(ckpt);
+
+    return failed ? -1 : 0;
+}
+
+/////////////
+// Restart //
+/////////////
+
+void m_ckpt_image_free(struct m_ckpt_image* image)
+{
+    free(image->size_vtable);
+    free(image->objs);
+    free(image->data);
+    memset(image, 0, sizeof(*image));
+}
+
+int m_ckpt_read(const char* path, struct m_ckpt_image* image)
+{
+    memset(image, 0, sizeof(*image));
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("m_ckpt_read: ");
+        return -1;
+    }
+
+    struct m_ckpt_header* header = &image->header;
+    if (_m_ckpt_pread(fd, header, sizeof(*header), 0) ||
+        memcmp(header->magic, M_CKPT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->slot_offset < _m_ckpt_meta_size(header))
+    {
+        fprintf(stderr, "%s is not a Myriad checkpoint\n", path);
+        close(fd);
+        return -1;
+    }
+    const int newest = _m_ckpt_newest(header);
+    if (newest < 0)
+    {
+        fprintf(stderr, "%s holds no complete checkpoint\n", path);
+        close(fd);
+        return -1;
+    }
+    image->slot = header->slots[newest];
+
+    image->size_vtable = (uint64_t*) calloc(header->num_classes + 1, sizeof(uint64_t));
+    image->objs = (struct m_ckpt_obj*) calloc(header->num_objs + 1, sizeof(struct m_ckpt_obj));
+    image->data = (unsigned char*) malloc(header->image_size + 1);
+    bool ok = image->size_vtable != NULL && image->objs != NULL && image->data != NULL &&
+        _m_ckpt_pread(fd, image->size_vtable, header->num_classes * sizeof(uint64_t),
+                      sizeof(*header)) == 0 &&
+        _m_ckpt_pread(fd, image->objs, header->num_objs * sizeof(struct m_ckpt_obj),
+                      sizeof(*header) + header->num_classes * sizeof(uint64_t)) == 0 &&
+        _m_ckpt_pread(fd, image->data, header->image_size,
+                      (off_t) (header->slot_offset + newest * header->image_size)) == 0;
+    close(fd);
+
+    for (uint64_t i = 0; ok && i < header->num_objs; i++)
+    {
+        const struct m_ckpt_obj* obj = &image->objs[i];
+        ok = obj->cell < header->num_cells &&
+            obj->class_id < header->num_classes &&
+            obj->size == image->size_vtable[obj->class_id] &&
+            obj->offset <= header->image_size &&
+            obj->size <= header->image_size - obj->offset;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Checkpoint %s is damaged\n", path);
+        m_ckpt_image_free(image);
+        return -1;
+    }
+
+    return 0;
+}
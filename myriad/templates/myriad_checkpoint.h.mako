@@ -0,0 +1,201 @@
+/**
+ * @file myriad_checkpoint.h
+ * @brief Checkpoint/restart of the whole simulation state.
+ *
+ * A checkpoint file holds every object of the network as it was between two
+ * steps. It is relocatable: objects are stored as their bytes alongside a
+ * table of their class IDs and of which cell (and which mechanism slot of
+ * it) they belong to, so a restart re-allocates them anywhere and re-links
+ * each compartment's mechanism pointers from the table. Connectivity between
+ * cells is held by ID inside the objects, so it needs no relinking.
+ *
+ * The file has two slots, each able to hold a whole snapshot, written in
+ * turn. A slot is marked incomplete before it is overwritten and complete
+ * only once its data is on disk, so a crash mid-write always leaves the
+ * other slot to restart from.
+ *
+ * Taking a checkpoint copies the objects into an in-memory image of the slot
+ * being written, block by block, noting which blocks changed since that
+ * slot was last written; a background thread then writes only those blocks
+ * while stepping carries on. Stepping only waits if a checkpoint is due
+ * before the one before it has been written.
+ *
+ * File layout (native endianness):
+ * - struct m_ckpt_header;
+ * - num_classes uint64_t class sizes (size_vtable);
+ * - num_objs struct m_ckpt_obj, cell by cell, each compartment first;
+ * - two slot images of image_size bytes, starting at slot_offset.
+ */
+#ifndef MYRIAD_CHECKPOINT_H
+#define MYRIAD_CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+//! Identifies a checkpoint file ("MYRCKPT" followed by a format version)
+#define M_CKPT_MAGIC "MYRCKPT\1"
+
+//! Unit of change tracking and of writes
+#define M_CKPT_BLOCK_SIZE 4096
+
+//! Alignment of objects within an image
+#define M_CKPT_OBJ_ALIGN 64
+
+//! Mechanism index given to a compartment itself
+#define M_CKPT_COMPARTMENT UINT32_MAX
+
+//! Checkpoint file to write when none is given with MYRIAD_CHECKPOINT
+#define M_CKPT_DEFAULT_PATH "myriad.ckpt"
+
+/**
+ * Object table entry.
+ */
+struct m_ckpt_obj
+{
+    //! Cell the object belongs to
+    uint64_t cell;
+    //! Class ID of the object
+    uint32_t class_id;
+    //! Index in the cell's mechanism list, M_CKPT_COMPARTMENT for the cell itself
+    uint32_t mech;
+    //! Offset of the object's bytes within an image
+    uint64_t offset;
+    //! Size of the object
+    uint64_t size;
+};
+
+/**
+ * State of one slot, updated in place.
+ */
+struct m_ckpt_slot
+{
+    //! Increases with every checkpoint taken, 0 if never completed
+    uint64_t generation;
+    //! Next step to simulate
+    uint64_t step;
+    //! Simulation time of that step
+    double gtime;
+    //! Whether all of the slot's data is on disk
+    uint64_t complete;
+};
+
+struct m_ckpt_header
+{
+    //! Always M_CKPT_MAGIC
+    char magic[8];
+    uint64_t num_cells;
+    uint64_t num_objs;
+    uint64_t num_classes;
+    //! Bytes per slot image
+    uint64_t image_size;
+    //! File offset of slot 0, slot 1 follows it
+    uint64_t slot_offset;
+    struct m_ckpt_slot slots[2];
+};
+
+typedef struct m_ckpt
+{
+    int fd;
+    struct m_ckpt_header header;
+    struct m_ckpt_obj* objs;
+    //! What each slot holds, or will hold once written
+    unsigned char* images[2];
+    //! Blocks of each image that differ from what its slot holds
+    unsigned char* dirty[2];
+    //! Whether each image is known to mirror its slot
+    bool in_sync[2];
+    //! Slot the next checkpoint goes to
+    int next;
+    //! Generation of the last checkpoint taken
+    uint64_t generation;
+    //! Slots handed to the writer and not yet written
+    bool pending[2];
+    //! Set once no more checkpoints will be taken
+    bool done;
+    //! Set by the writer if a write failed
+    bool failed;
+    //! Times stepping had to wait for the writer
+    uint64_t stalls;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t writer;
+} *m_ckpt_t;
+
+/**
+ * Snapshot read back from a checkpoint file.
+ */
+struct m_ckpt_image
+{
+    struct m_ckpt_header header;
+    uint64_t* size_vtable;
+    struct m_ckpt_obj* objs;
+    //! Slot the snapshot came from
+    struct m_ckpt_slot slot;
+    //! Object bytes, at the offsets given by objs
+    unsigned char* data;
+};
+
+/**
+ * @brief Opens a checkpoint file and starts its writer thread.
+ *
+ * An existing file laid out for the same objects is reused, keeping its
+ * newest complete slot until a newer checkpoint has been written; any other
+ * file is replaced.
+ *
+ * @param[in] path         checkpoint file
+ * @param[in] objs         object table; offsets are filled in here
+ * @param[in] num_objs     number of objects
+ * @param[in] num_cells    number of cells
+ * @param[in] size_vtable  size of each class
+ * @param[in] num_classes  number of classes
+ *
+ * @returns new checkpointer, or NULL on failure.
+ */
+extern m_ckpt_t m_ckpt_open(const char* path,
+                            const struct m_ckpt_obj* objs,
+                            const uint64_t num_objs,
+                            const uint64_t num_cells,
+                            const size_t* size_vtable,
+                            const uint64_t num_classes);
+
+/**
+ * @brief Starts a checkpoint, waiting until the slot it goes to is written.
+ *
+ * Must be followed by m_ckpt_copy of every object, then m_ckpt_commit.
+ */
+extern void m_ckpt_begin(m_ckpt_t ckpt);
+
+/**
+ * @brief Copies object obj_indx of the table into the checkpoint being taken.
+ *
+ * Different objects may be copied by different threads at once.
+ */
+extern void m_ckpt_copy(m_ckpt_t ckpt, const uint64_t obj_indx, const void* obj);
+
+/**
+ * @brief Hands the checkpoint being taken to the writer thread.
+ *
+ * @param[in] step   next step to simulate
+ * @param[in] gtime  simulation time of that step
+ */
+extern void m_ckpt_commit(m_ckpt_t ckpt, const uint64_t step, const double gtime);
+
+/**
+ * @brief Waits for pending checkpoints to be written, then closes ckpt.
+ *
+ * @returns 0 if every checkpoint was written, -1 otherwise.
+ */
+extern int m_ckpt_close(m_ckpt_t ckpt);
+
+/**
+ * @brief Reads the newest complete snapshot of a checkpoint file.
+ *
+ * @returns 0 on success, -1 if there is no complete snapshot to read.
+ */
+extern int m_ckpt_read(const char* path, struct m_ckpt_image* image);
+
+extern void m_ckpt_image_free(struct m_ckpt_image* image);
+
+#endif /* MYRIAD_CHECKPOINT_H */
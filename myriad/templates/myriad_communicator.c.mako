@@ -5,8 +5,12 @@
 #include <signal.h>
 #include <string.h>
 #include <iso646.h>
+#include <errno.h>
+#include <fcntl.h>
 
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -22,6 +26,10 @@ static const struct sockaddr_un SOCK_ADDRESS = {.sun_family = AF_UNIX,
 #define INT_BUFF_LEN sizeof(int)
 #endif
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
 #ifdef DEBUG
 #define debug_puts(msg, fp) fputs(msg, fp)
 #else
@@ -144,6 +152,24 @@ ssize_t m_receive_data(int socket_fd, void *dest, const size_t len)
     return total_bytes;
 }
 
+int m_discard_data(int socket_fd, uint64_t len)
+{
+    unsigned char buff[4096];
+
+    // Bounded reads, however much the peer claims to have sent
+    while (len > 0)
+    {
+        const size_t chunk = len < sizeof(buff) ? (size_t) len : sizeof(buff);
+        if (m_receive_data(socket_fd, buff, chunk) != (ssize_t) chunk)
+        {
+            return -1;
+        }
+        len -= chunk;
+    }
+
+    return 0;
+}
+
 //! Sends data across the socket using the provided connection file descriptor
 ssize_t m_send_data(int socket_fd, void const* source, const size_t len)
 {
@@ -167,6 +193,145 @@ ssize_t m_send_data(int socket_fd, void const* source, const size_t len)
     return total_bytes;
 }
 
+ssize_t m_send_iov(int socket_fd, struct iovec* iov, int iovcnt)
+{
+    ssize_t total_bytes = 0;
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    while (msg.msg_iovlen > 0)
+    {
+        const ssize_t num_bytes_sent = sendmsg(socket_fd, &msg, 0);
+        if (num_bytes_sent <= 0)
+        {
+            perror("m_send_iov: sendmsg() failed");
+            return -1;
+        }
+        total_bytes += num_bytes_sent;
+
+        // Skip what was sent; a partial send may stop mid-buffer
+        size_t left = (size_t) num_bytes_sent;
+        while (msg.msg_iovlen > 0 && left >= msg.msg_iov->iov_len)
+        {
+            left -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (left > 0)
+        {
+            msg.msg_iov->iov_base = (char*) msg.msg_iov->iov_base + left;
+            msg.msg_iov->iov_len -= left;
+        }
+    }
+
+    return total_bytes;
+}
+
+int m_shm_create(const size_t len)
+{
+    int fd = -1;
+#ifdef SYS_memfd_create
+    fd = (int) syscall(SYS_memfd_create, "myriad_network", MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+#endif
+    if (fd == -1 && errno == ENOSYS)
+    {
+        // No memfd: use a POSIX shared memory object, unlinked straight away
+        char name[64];
+        snprintf(name, sizeof(name), "/myriad_network.%ld", (long) getpid());
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd != -1)
+        {
+            shm_unlink(name);
+        }
+    }
+    if (fd == -1)
+    {
+        perror("m_shm_create: memfd_create() failed");
+        return -1;
+    }
+
+    // Pages are only allocated once touched, so len may be generous
+    if (ftruncate(fd, (off_t) len))
+    {
+        perror("m_shm_create: ftruncate() failed");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int m_send_fd(int socket_fd, int fd)
+{
+    char byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(socket_fd, &msg, 0) != 1)
+    {
+        perror("m_send_fd: sendmsg() failed");
+        return -1;
+    }
+    return 0;
+}
+
+int m_receive_fd(int socket_fd)
+{
+    char byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC) != 1)
+    {
+        perror("m_receive_fd: recvmsg() failed");
+        return -1;
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL ||
+        cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+    {
+        debug_puts("No file descriptor received from socket.\n", stderr);
+        return -1;
+    }
+
+    int fd = -1;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
 int m_close_socket(int socket_fd)
 {
     return shutdown(socket_fd, SHUT_RDWR);
@@ -12,6 +12,86 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+
+//! Sent in place of an object ID to start a bulk request
+#define M_BULK_REQUEST (-2)
+
+//! Identifies bulk requests and replies ("MYB1")
+#define M_BULK_MAGIC UINT32_C(0x3142594d)
+
+//! How a bulk request names the objects it wants
+enum m_bulk_type
+{
+    //! `count` objects starting at `first`; a count of 0 means "to the end"
+    M_BULK_RANGE = 0,
+    //! `count` object IDs, as uint64_t, follow the request
+    M_BULK_LIST = 1,
+};
+
+/**
+ * Bulk request, sent after M_BULK_REQUEST.
+ */
+struct m_bulk_request
+{
+    //! Always M_BULK_MAGIC
+    uint32_t magic;
+    //! One of m_bulk_type
+    uint32_t type;
+    //! First object ID (M_BULK_RANGE only)
+    uint64_t first;
+    //! Number of objects
+    uint64_t count;
+};
+
+/**
+ * Bulk reply header. If status is 0 it is followed by num_objs objects,
+ * each an m_obj_frame, the object's bytes, num_mechs uint64_t mechanism
+ * sizes and then the bytes of each mechanism.
+ */
+struct m_bulk_reply
+{
+    //! Always M_BULK_MAGIC
+    uint32_t magic;
+    //! 0 on success, -1 if the request named objects that do not exist
+    int32_t status;
+    //! Number of objects that follow
+    uint64_t num_objs;
+};
+
+//! Header of each object in a bulk reply
+struct m_obj_frame
+{
+    //! Object ID
+    uint64_t id;
+    //! Bytes of the object
+    uint64_t obj_size;
+    //! Number of mechanisms that follow the object
+    uint64_t num_mechs;
+};
+
+//! Identifies a shared-memory network segment ("MYRIADSH")
+#define M_SHM_MAGIC UINT64_C(0x4d59524941445348)
+
+/**
+ * Index at the start of a shared-memory network segment.
+ *
+ * Objects in the segment still hold pointers valid in the simulator's
+ * address space; subtract `base` to get their offset into the segment.
+ */
+struct m_shm_index
+{
+    //! Always M_SHM_MAGIC
+    uint64_t magic;
+    //! Address of the segment in the simulator process
+    uint64_t base;
+    //! Bytes of the segment in use, index included
+    uint64_t size;
+    //! Number of entries in obj_offset
+    uint64_t num_objs;
+    //! Offset of each network object from the start of the segment
+    uint64_t obj_offset[];
+};
 
 //! UDS name. As per POSIX.2001, it *must* start with a ./
 #ifndef UNSOCK_NAME
@@ -31,6 +111,9 @@ extern int m_client_socket_init(void);
 extern ssize_t m_receive_data(int socket_fd, void *dest, const size_t len)
     __attribute__((nonnull(2)));
 
+//! Reads and throws away `len` bytes, e.g. the payload of a refused request
+extern int m_discard_data(int socket_fd, uint64_t len);
+
 //! Receives a single integer value, parsed from the socket
 extern int m_receive_int(int socket_fd, int* dest)
     __attribute__((nonnull(2)));
@@ -38,10 +121,23 @@ extern int m_receive_int(int socket_fd, int* dest)
 //! Sends a single integer value as a fixed-length character buffer
 extern int m_send_int(int socket_fd, int src);
 
+//! Sends a gathered buffer list across the socket in as few syscalls as possible
+extern ssize_t m_send_iov(int socket_fd, struct iovec* iov, int iovcnt)
+    __attribute__((nonnull(2)));
+
 //! Sends data across the socket using the provided connection file descriptor
 extern ssize_t m_send_data(int socket_fd, void const* source, const size_t len)
     __attribute__((nonnull(2)));
 
+//! Creates an anonymous shared-memory file of `len` bytes, returning its fd
+extern int m_shm_create(const size_t len);
+
+//! Passes an open file descriptor to the peer of the socket
+extern int m_send_fd(int socket_fd, int fd);
+
+//! Receives a file descriptor passed with m_send_fd, or returns -1
+extern int m_receive_fd(int socket_fd);
+
 //! Terminates the socket
 extern int m_close_socket(int socket_fd);
 
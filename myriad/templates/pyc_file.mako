@@ -31,7 +31,17 @@ static PyObject* Py${obj_name}_${obj_var_name}
                                                   dims,
                                                   NPY_FLOAT64,
                                                   _self->${obj_var_name});
-    Py_XINCREF(buf_arr);
+    if (buf_arr == NULL)
+    {
+        return NULL;
+    }
+    // A view, so it keeps the object (and whatever holds its memory) alive
+    Py_INCREF(ptr);
+    if (PyArray_SetBaseObject((PyArrayObject*) buf_arr, ptr) < 0)
+    {
+        Py_DECREF(buf_arr);
+        return NULL;
+    }
     return buf_arr;
     % else:
     return Py_BuildValue("${pyc_scalar_types[obj_var_name]}",
@@ -12,6 +12,10 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+% if SHM_NETWORK:
+#include <string.h>
+#include <sys/mman.h>
+% endif
 
 #include "myriad_communicator.h"
 
@@ -23,6 +27,172 @@
 
 static int socket_fd = -1;
 
+% if SHM_NETWORK:
+//! Private (copy-on-write) mapping of the simulator's network segment
+static char* shm_map = NULL;
+//! Size of shm_map
+static size_t shm_len = 0;
+//! Whether each object's mechanism pointers have been made into PyObjects
+static bool* shm_fixed = NULL;
+//! Capsule owning shm_map (and shm_fixed); every object viewing it holds a reference
+static PyObject* shm_owner = NULL;
+
+//! Capsule name of a network segment mapping
+#define SHM_CAPSULE_NAME "myriad_comm.shm"
+
+/**
+ * Unmaps a network segment once nothing views it any more, dropping the
+ * mechanism objects its compartments were given.
+ */
+static void shm_release(PyObject* capsule)
+{
+    char* map = PyCapsule_GetPointer(capsule, SHM_CAPSULE_NAME);
+    bool* fixed = PyCapsule_GetContext(capsule);
+    const struct m_shm_index* index = (const struct m_shm_index*) map;
+    for (uint64_t id = 0; id < index->num_objs; id++)
+    {
+        if (!fixed[id])
+        {
+            continue;
+        }
+        struct Compartment* comp = (struct Compartment*) (map + index->obj_offset[id]);
+        for (uint64_t i = 0; i < comp->num_mechs; i++)
+        {
+            Py_DECREF((PyObject*) comp->my_mechs[i]);
+        }
+    }
+    PyMem_Free(fixed);
+    munmap(map, index->size);
+}
+
+//! Drops the module's reference to the current mapping, if any
+static void shm_detach(void)
+{
+    shm_map = NULL;
+    shm_len = 0;
+    shm_fixed = NULL;
+    Py_CLEAR(shm_owner);
+}
+
+/**
+ * Maps the network segment passed by the simulator.
+ *
+ * Objects are only ever viewed in place (numpy arrays of their traces point
+ * straight into the mapping), so the mapping belongs to a capsule that each
+ * of them references. A new init or close only drops the module's own
+ * reference; the previous mapping goes once its last view does.
+ */
+static int shm_attach(void)
+{
+    const int fd = m_receive_fd(socket_fd);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    struct m_shm_index index;
+    if (pread(fd, &index, sizeof(index), 0) != (ssize_t) sizeof(index) ||
+        index.magic != M_SHM_MAGIC ||
+        index.size < sizeof(index) + index.num_objs * sizeof(uint64_t))
+    {
+        close(fd);
+        return -1;
+    }
+
+    char* map = mmap(NULL, index.size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    bool* fixed = PyMem_Malloc(index.num_objs * sizeof(bool));
+    if (fixed == NULL)
+    {
+        munmap(map, index.size);
+        return -1;
+    }
+    memset(fixed, 0, index.num_objs * sizeof(bool));
+
+    PyObject* owner = PyCapsule_New(map, SHM_CAPSULE_NAME, shm_release);
+    if (owner == NULL || PyCapsule_SetContext(owner, fixed) != 0)
+    {
+        if (owner != NULL)
+        {
+            // Not yet handed over, so free them here rather than in shm_release
+            PyCapsule_SetDestructor(owner, NULL);
+            Py_DECREF(owner);
+        }
+        PyMem_Free(fixed);
+        munmap(map, index.size);
+        return -1;
+    }
+
+    shm_detach();
+    shm_map = map;
+    shm_len = index.size;
+    shm_fixed = fixed;
+    shm_owner = owner;
+    return 0;
+}
+
+//! Translates a simulator pointer into the mapping, or NULL if out of bounds
+static void* shm_translate(const void* sim_ptr, const size_t len)
+{
+    const struct m_shm_index* index = (const struct m_shm_index*) shm_map;
+    const uint64_t offset = (uint64_t) (uintptr_t) sim_ptr - index->base;
+    if (offset < sizeof(*index) || offset >= shm_len || len > shm_len - offset)
+    {
+        return NULL;
+    }
+    return shm_map + offset;
+}
+
+//! Returns the compartment with the given ID, viewed in place
+static struct Compartment* shm_view_obj(const uint64_t id)
+{
+    const struct m_shm_index* index = (const struct m_shm_index*) shm_map;
+    if (index == NULL || id >= index->num_objs)
+    {
+        PyErr_SetString(PyExc_IndexError, "Object ID out of range");
+        return NULL;
+    }
+
+    // View the compartment where the simulator left it
+    struct Compartment* new_comp = NULL;
+    if (index->obj_offset[id] > shm_len - sizeof(struct Compartment) ||
+        (new_comp = (struct Compartment*) (shm_map + index->obj_offset[id]))->num_mechs > MAX_NUM_MECHS)
+    {
+        PyErr_SetString(PyExc_IOError, "Corrupt Myriad network segment");
+        return NULL;
+    }
+
+    // Replace the mechanism pointers with objects viewing them, once (this
+    // only copies the page holding them, as the mapping is private)
+    for (uint64_t i = 0; !shm_fixed[id] && i < new_comp->num_mechs; i++)
+    {
+        void* mech = shm_translate(new_comp->my_mechs[i],
+                                   sizeof(struct Mechanism));
+        PyObject* str = Py_BuildValue("(s)", "Mechanism");
+        PyObject* mech_obj = NULL;
+        if (mech == NULL || str == NULL ||
+            (mech_obj = PyMyriadObject_Init(mech, str, NULL)) == NULL)
+        {
+            Py_XDECREF(str);
+            PyErr_SetString(PyExc_RuntimeError, "Failed viewing Mechanism");
+            return NULL;
+        }
+        // The mapping holds the only reference, dropped by shm_release
+        new_comp->my_mechs[i] = mech_obj;
+    }
+    shm_fixed[id] = true;
+
+    return new_comp;
+}
+
+% endif
+
 //! Module-level variable for connector
 static PyObject* m_init(PyObject* self __attribute__((unused)),
                         PyObject* args __attribute__((unused)))
@@ -43,6 +213,18 @@ static PyObject* m_init(PyObject* self __attribute__((unused)),
                         "Unable to initialize Myriad connector.\n");
         return NULL;
     }
+
+% if SHM_NETWORK:
+    // Blocks until the simulation has finished and hands over its results
+    if (shm_attach())
+    {
+        m_close_socket(socket_fd);
+        socket_fd = -1;
+        PyErr_SetString(PyExc_IOError,
+                        "Unable to map Myriad network segment.\n");
+        return NULL;
+    }
+% endif
     
     Py_RETURN_NONE;
 }
@@ -66,10 +248,114 @@ static PyObject* m_close(PyObject* self __attribute__((unused)),
 
     // Reset socket
     socket_fd = -1;
+% if SHM_NETWORK:
+    shm_detach();
+% endif
 
     Py_RETURN_NONE;
 }
 
+//! Makes a Python object of a compartment whose mechanisms are already wrapped
+static PyObject* wrap_compartment(struct Compartment* new_comp)
+{
+    // Prepare object data for export
+    PyObject* p_obj = NULL, *str = NULL;
+    str = Py_BuildValue("(s)", "Compartment");
+    Py_INCREF(str);
+    p_obj = PyMyriadObject_Init((struct MyriadObject*) new_comp,
+                                str,
+                                NULL);
+    if (p_obj == NULL)
+    {
+        Py_XDECREF(str);
+        PyErr_SetString(PyExc_Exception, "failed constructing new object");
+        return NULL;
+    }
+% if SHM_NETWORK:
+    // Viewed in place, so the mapping has to outlive the object
+    Py_INCREF(shm_owner);
+    ((PyMyriadObject*) p_obj)->owner = shm_owner;
+% endif
+
+    return p_obj;
+}
+
+% if not SHM_NETWORK:
+//! Frees a partly received compartment and the first num_wrapped mechanisms
+static void free_obj_frame(struct Compartment* new_comp, const uint64_t num_wrapped)
+{
+    for (uint64_t i = 0; i < num_wrapped; i++)
+    {
+        PyMyriadObject* mech_obj = (PyMyriadObject*) new_comp->my_mechs[i];
+        PyMem_Free(mech_obj->mobject);
+        mech_obj->mobject = NULL;
+        // The reference PyMyriadObject_Init made for us and the one new_comp held
+        Py_DECREF(mech_obj);
+        Py_DECREF(mech_obj);
+    }
+    PyMem_Free(new_comp);
+}
+
+//! Reads one object of a bulk reply, wrapping each of its mechanisms
+static struct Compartment* receive_obj_frame(void)
+{
+    struct m_obj_frame frame;
+    if (m_receive_data(socket_fd, &frame, sizeof(frame)) != (ssize_t) sizeof(frame) ||
+        frame.obj_size < sizeof(struct Compartment) || frame.num_mechs > MAX_NUM_MECHS)
+    {
+        PyErr_SetString(PyExc_IOError, "Invalid object frame");
+        return NULL;
+    }
+
+    uint64_t mech_sizes[MAX_NUM_MECHS];
+    struct Compartment* new_comp = PyMem_Malloc(frame.obj_size);
+    if (new_comp == NULL)
+    {
+        PyErr_SetString(PyExc_MemoryError, "Failed allocating Compartment.");
+        return NULL;
+    }
+    if (m_receive_data(socket_fd, new_comp, frame.obj_size) != (ssize_t) frame.obj_size ||
+        new_comp->num_mechs != frame.num_mechs ||
+        (frame.num_mechs > 0 &&
+         m_receive_data(socket_fd, mech_sizes, frame.num_mechs * sizeof(uint64_t)) !=
+         (ssize_t) (frame.num_mechs * sizeof(uint64_t))))
+    {
+        PyErr_SetString(PyExc_IOError, "m_receive_data failed");
+        PyMem_Free(new_comp);
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < frame.num_mechs; i++)
+    {
+        void* mech_copy = PyMem_Malloc(mech_sizes[i]);
+        if (mech_copy == NULL ||
+            m_receive_data(socket_fd, mech_copy, mech_sizes[i]) != (ssize_t) mech_sizes[i])
+        {
+            PyErr_SetString(PyExc_IOError, "Failed receiving Mechanism");
+            PyMem_Free(mech_copy);
+            free_obj_frame(new_comp, i);
+            return NULL;
+        }
+
+        PyObject* str = Py_BuildValue("(s)", "Mechanism");
+        PyObject* mech_obj = NULL;
+        if (str == NULL ||
+            (mech_obj = PyMyriadObject_Init(mech_copy, str, NULL)) == NULL)
+        {
+            Py_XDECREF(str);
+            PyMem_Free(mech_copy);
+            free_obj_frame(new_comp, i);
+            PyErr_SetString(PyExc_RuntimeError, "Failed copying Mechanism");
+            return NULL;
+        }
+        Py_INCREF(mech_obj);
+        new_comp->my_mechs[i] = mech_obj;
+    }
+
+    return new_comp;
+}
+
+% endif
 static PyObject* retrieve_obj(PyObject* self __attribute__((unused)),
                               PyObject* args)
 {
@@ -82,6 +368,13 @@ static PyObject* retrieve_obj(PyObject* self __attribute__((unused)),
         return NULL;
     }
 
+% if SHM_NETWORK:
+    struct Compartment* new_comp = shm_view_obj((uint64_t) id);
+    if (new_comp == NULL)
+    {
+        return NULL;
+    }
+% else:
     // Post message saying what object we want
     printf("Requesting object ID %d ...", id);
     if (m_send_int(socket_fd, id))
@@ -174,27 +467,131 @@ static PyObject* retrieve_obj(PyObject* self __attribute__((unused)),
 
         new_comp->my_mechs[i] = mech_obj;
     }
+% endif
 
-    // Prepare object data for export
-    PyObject* p_obj = NULL, *str = NULL;
-    str = Py_BuildValue("(s)", "Compartment");
-    Py_INCREF(str);
-    p_obj = PyMyriadObject_Init((struct MyriadObject*) new_comp,
-                                str,
-                                NULL);
-    if (p_obj == NULL)
+    return wrap_compartment(new_comp);
+}
+
+/**
+ * Retrieves `count` objects in one go: those in `ids`, or if that is NULL,
+ * those starting at `first` (with a count of 0 meaning the rest of them).
+ * Returns them as a list, in request order.
+ */
+static PyObject* retrieve_bulk(const uint64_t* ids,
+                               const uint64_t first,
+                               uint64_t count)
+{
+% if SHM_NETWORK:
+    const struct m_shm_index* index = (const struct m_shm_index*) shm_map;
+    if (index == NULL)
     {
-        Py_XDECREF(str);
-        PyErr_SetString(PyExc_Exception, "failed constructing new object");
+        PyErr_SetString(PyExc_Exception, "Myriad connector is not initialized");
         return NULL;
     }
-    
-    return p_obj;
+    if (ids == NULL && count == 0 && first < index->num_objs)
+    {
+        count = index->num_objs - first;
+    }
+% else:
+    // Ask for everything at once; the reply is a single stream
+    const struct m_bulk_request req = {
+        .magic = M_BULK_MAGIC,
+        .type = ids != NULL ? M_BULK_LIST : M_BULK_RANGE,
+        .first = first,
+        .count = count,
+    };
+    struct m_bulk_reply reply;
+    if (m_send_int(socket_fd, M_BULK_REQUEST) ||
+        m_send_data(socket_fd, &req, sizeof(req)) != (ssize_t) sizeof(req) ||
+        (ids != NULL && count > 0 &&
+         m_send_data(socket_fd, ids, count * sizeof(uint64_t)) != (ssize_t) (count * sizeof(uint64_t))) ||
+        m_receive_data(socket_fd, &reply, sizeof(reply)) != (ssize_t) sizeof(reply) ||
+        reply.magic != M_BULK_MAGIC)
+    {
+        PyErr_SetString(PyExc_IOError, "Bulk request failed");
+        return NULL;
+    }
+    if (reply.status != 0)
+    {
+        PyErr_SetString(PyExc_IndexError, "Object ID out of range");
+        return NULL;
+    }
+    count = reply.num_objs;
+% endif
+
+    PyObject* objs = PyList_New((Py_ssize_t) count);
+    if (objs == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < count; i++)
+    {
+% if SHM_NETWORK:
+        struct Compartment* new_comp = shm_view_obj(ids != NULL ? ids[i] : first + i);
+% else:
+        struct Compartment* new_comp = receive_obj_frame();
+% endif
+        PyObject* p_obj = new_comp != NULL ? wrap_compartment(new_comp) : NULL;
+        if (p_obj == NULL)
+        {
+            Py_DECREF(objs);
+            return NULL;
+        }
+        PyList_SET_ITEM(objs, (Py_ssize_t) i, p_obj);
+    }
+
+    return objs;
+}
+
+static PyObject* retrieve_range(PyObject* self __attribute__((unused)),
+                                PyObject* args)
+{
+    unsigned long long first = 0, count = 0;
+    if (!PyArg_ParseTuple(args, "|KK", &first, &count))
+    {
+        return NULL;
+    }
+    return retrieve_bulk(NULL, first, count);
+}
+
+static PyObject* retrieve_list(PyObject* self __attribute__((unused)),
+                               PyObject* args)
+{
+    PyObject* id_seq = NULL;
+    if (!PyArg_ParseTuple(args, "O", &id_seq) ||
+        (id_seq = PySequence_Fast(id_seq, "IDs must be a sequence")) == NULL)
+    {
+        return NULL;
+    }
+
+    const Py_ssize_t count = PySequence_Fast_GET_SIZE(id_seq);
+    uint64_t* ids = PyMem_Malloc(count * sizeof(uint64_t) + 1);
+    if (ids == NULL)
+    {
+        Py_DECREF(id_seq);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        ids[i] = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(id_seq, i));
+    }
+    Py_DECREF(id_seq);
+    if (PyErr_Occurred())
+    {
+        PyMem_Free(ids);
+        return NULL;
+    }
+
+    PyObject* objs = retrieve_bulk(ids, 0, (uint64_t) count);
+    PyMem_Free(ids);
+    return objs;
 }
 
 static PyMethodDef MyriadCommMethods[] =
 {
      {"retrieve_obj", retrieve_obj, METH_VARARGS, "Retrieve data from a Myriad object."},
+     {"retrieve_range", retrieve_range, METH_VARARGS, "Retrieve a range of Myriad objects (all by default)."},
+     {"retrieve_list", retrieve_list, METH_VARARGS, "Retrieve a list of Myriad objects."},
      {"init", m_init, METH_NOARGS, "Open the Myriad connector."},
      {"close", m_close, METH_NOARGS, "Close the Myriad connector."},
      {NULL, NULL, 0, NULL}
@@ -16,6 +16,8 @@ typedef struct
     PyObject* classname;
     //! Pointer to extant object
     struct MyriadObject* mobject;
+    //! Keeps the memory mobject lives in alive, if we do not own it (or NULL)
+    PyObject* owner;
 } PyMyriadObject;
 
 // C API functions
@@ -39,8 +39,8 @@ __device__ double HHGradedGABAAMechanism_cuda_mech_fun(void* _self,
 	const struct HHSomaCompartment* c2 = (const struct HHSomaCompartment*) post_comp;
 
 	//	Channel dynamics calculation
-	const double pre_vm = c1->vm[curr_step-1];
-	const double post_vm = c2->vm[curr_step-1];
+	const double pre_vm = HHSOMA_VM(c1, curr_step-1);
+	const double post_vm = HHSOMA_VM(c2, curr_step-1);
 	const double prev_g_s = self->g_s[curr_step-1];
 
 	const double fv = 1.0 / (1.0 + exp((pre_vm - self->theta)/-self->sigma));
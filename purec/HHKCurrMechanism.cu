@@ -40,11 +40,17 @@ __device__ double HHKCurrMechanism_cuda_mech_fun(void* _self,
 	const struct HHSomaCompartment* c2 = (const struct HHSomaCompartment*) post_comp;
 
 	//	Channel dynamics calculation
-	const double pre_vm = c1->vm[curr_step-1];
+	const double pre_vm = HHSOMA_VM(c1, curr_step-1);
     const double alpha_n = (-0.01 * (pre_vm + 10.0)) / (exp((pre_vm+10.0)/-10.0) - 1.0);
     const double beta_n  = 0.125 * exp(pre_vm/-80.);
 
+#ifdef HH_EXP_EULER
+    // Exponential Euler, see hh_integrate.h
+    const double n_inf = alpha_n / (alpha_n + beta_n);
+    self->hh_n = n_inf + (self->hh_n - n_inf) * exp(-DT * (alpha_n + beta_n));
+#else
     self->hh_n = DT*(alpha_n*(1-self->hh_n) - beta_n*self->hh_n) + self->hh_n;
+#endif
 
 	//	No extracellular compartment. Current simply "disappears".
 	if (c2 == NULL || c1 == c2)
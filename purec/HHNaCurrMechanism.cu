@@ -40,7 +40,7 @@ __device__ double HHNaCurrMechanism_cuda_mech_fun(void* _self,
 	const struct HHSomaCompartment* c2 = (const struct HHSomaCompartment*) post_comp;
 
 	// Channel dynamics calculation
-	const double pre_vm = c1->vm[curr_step-1];
+	const double pre_vm = HHSOMA_VM(c1, curr_step-1);
 
 	// @TODO: Magic numbers should be extracted out as defines
 	const double alpha_m = (0.32*(pre_vm+45.0)) / (1 - exp(-(pre_vm+45.0)/4.0));
@@ -48,8 +48,16 @@ __device__ double HHNaCurrMechanism_cuda_mech_fun(void* _self,
 	const double alpha_h = (0.128) / (exp((pre_vm+41.0)/18.0));
 	const double beta_h = 4.0 / (1 + exp(-(pre_vm + 18.0)/5.0));
 
+#ifdef HH_EXP_EULER
+    // Exponential Euler, see hh_integrate.h
+    const double m_inf = alpha_m / (alpha_m + beta_m);
+    const double h_inf = alpha_h / (alpha_h + beta_h);
+    self->hh_m = m_inf + (self->hh_m - m_inf) * exp(-DT * (alpha_m + beta_m));
+    self->hh_h = h_inf + (self->hh_h - h_inf) * exp(-DT * (alpha_h + beta_h));
+#else
     self->hh_m = DT*( (alpha_m*(1.0-self->hh_m)) - beta_m*self->hh_m) + self->hh_m;
     self->hh_h = DT*( (alpha_h*(1.0-self->hh_h)) - beta_h*self->hh_h) + self->hh_h;
+#endif
 
 	// No extracellular compartment. Current simply "disappears".
 	if (c2 == NULL || c1 == c2)
@@ -7,6 +7,8 @@
 #include "MyriadObject.h"
 #include "HHSomaCompartment.h"
 #include "HHSomaCompartment.cuh"
+#include "spike_events.h"
+#include "hh_integrate.h"
 
 ///////////////////////////////////////
 // HHSomaCompartment Super Overrides //
@@ -16,16 +18,32 @@ static void* HHSomaCompartment_ctor(void* _self, va_list* app)
     struct HHSomaCompartment* self =
         (struct HHSomaCompartment*) super_ctor(HHSomaCompartment, _self, app);
 
+#ifdef VM_RING_BUFFER
+    // With a bounded history the given vm (if any) is where we record to.
+    double* vm = va_arg(*app, double*);
+#else
     const double* restrict vm = va_arg(*app, double*);
+#endif
     const double init_vm = va_arg(*app, double);
     self->cm = va_arg(*app, double);
+    self->vm_len = sizeof(self->vm) / sizeof(double);
 
+#ifdef VM_RING_BUFFER
+    self->vm_trace = vm;
+    self->vm_step = 0;
+    HHSOMA_VM(self, 0) = init_vm;
+    if (vm != NULL)
+    {
+        vm[0] = init_vm;
+    }
+#else
     // If the given vm is non-NULL, we assume it contains data and copy it.
     if (vm != NULL)
     {
         memcpy(self->vm, vm, SIMUL_LEN * sizeof(double));
         self->vm[0] = init_vm;
     }
+#endif
 
     return _self;
 }
@@ -33,6 +51,14 @@ static void* HHSomaCompartment_ctor(void* _self, va_list* app)
 static void* HHSomaCompartment_cudafy(void* _self, int clobber)
 {
 #ifdef CUDA
+#ifdef VM_RING_BUFFER
+    // The device cannot write to a host recording sink; use VM_RECORDER
+    if (((struct HHSomaCompartment*) _self)->vm_trace != NULL)
+    {
+        fputs("HHSomaCompartment recording sinks are not supported with CUDA\n", stderr);
+        return NULL;
+    }
+#endif
     return super_cudafy(HHSomaCompartment, _self, 0);
 #else
     return NULL;
@@ -53,33 +79,87 @@ static int HHSomaCompartment_dtor(void* _self)
 	return super_dtor(Compartment, self);
 }
 
-static void HHSomaCompartment_simul_fxn(void* _self,
-                                        void** network,
-                                        const double global_time,
-                                        const uint64_t curr_step)
+double HHSomaCompartment_current(void* _self,
+                                 void** network,
+                                 const double I_ext,
+                                 const uint64_t first_mech,
+                                 const double global_time,
+                                 const uint64_t curr_step)
 {
 	struct HHSomaCompartment* self = (struct HHSomaCompartment*) _self;
 
-	double I_sum = 0.0;
+	double I_sum = I_ext;
 
 	//	Calculate mechanism contribution to current term
 #pragma GCC ivdep
-	for (uint64_t i = 0; i < self->_.num_mechs; i++)
+	for (uint64_t i = first_mech; i < self->_.num_mechs; i++)
 	{
 		struct Mechanism* curr_mech = self->_.my_mechs[i]; // TODO: GENERICSE DIS
 		struct Compartment* pre_comp = network[curr_mech->source_id];
 
 		//TODO: Make this conditional on specific Mechanism types
 		//if (curr_mech->fx_type == CURRENT_FXN)
-		I_sum += mechanism_fxn(curr_mech, pre_comp, self, global_time, curr_step);
+		I_sum += mechanism_fxn_every(curr_mech, pre_comp, self, global_time, curr_step);
 	}
 
+	return I_sum;
+}
+
+void HHSomaCompartment_set_vm(void* _self, const double vm, const uint64_t curr_step)
+{
+	struct HHSomaCompartment* self = (struct HHSomaCompartment*) _self;
+
+	HHSOMA_VM(self, curr_step) = vm;
+
+#ifdef VM_RING_BUFFER
+	self->vm_step = curr_step;
+	if (self->vm_trace != NULL)
+	{
+		self->vm_trace[curr_step] = vm;
+	}
+#endif
+
+	// Publish our own threshold crossing for event-driven synapses
+	if (network_spikes != NULL)
+	{
+		spike_events_record(network_spikes,
+							self->_.id,
+							HHSOMA_VM(self, curr_step - 1),
+							vm,
+							curr_step);
+	}
+}
+
+void HHSomaCompartment_integrate(void* _self,
+                                 void** network,
+                                 const double I_ext,
+                                 const double G_ext,
+                                 const uint64_t first_mech,
+                                 const double dt,
+                                 const double global_time,
+                                 const uint64_t curr_step)
+{
+	struct HHSomaCompartment* self = (struct HHSomaCompartment*) _self;
+
+	const double I_sum =
+		HHSomaCompartment_current(self, network, I_ext, first_mech, global_time, curr_step);
+
 	//	Calculate new membrane voltage: (dVm) + prev_vm
-	self->vm[curr_step] = (DT * (I_sum) / (self->cm)) + self->vm[curr_step - 1];
+	HHSomaCompartment_set_vm(self,
+							 hh_vm_update(HHSOMA_VM(self, curr_step - 1), I_sum, G_ext, self->cm, dt),
+							 curr_step);
 
 	return;
 }
 
+static void HHSomaCompartment_simul_fxn(void* _self,
+                                        void** network,
+                                        const double global_time,
+                                        const uint64_t curr_step)
+{
+	HHSomaCompartment_integrate(_self, network, 0.0, 0.0, 0, DT, global_time, curr_step);
+}
+
 ////////////////////////////////////////////
 // HHSomaCompartmentClass Super Overrides //
 ////////////////////////////////////////////
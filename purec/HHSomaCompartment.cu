@@ -34,7 +34,12 @@ __device__ void HHSomaCompartment_cuda_simul_fxn(void* _self,
 	}
 
 	//	Calculate new membrane voltage: (dVm) + prev_vm
-	self->vm[curr_step] = (DT * (I_sum) / (self->cm)) + self->vm[curr_step - 1];
+	HHSOMA_VM(self, curr_step) = (DT * (I_sum) / (self->cm)) + HHSOMA_VM(self, curr_step - 1);
+
+#ifdef VM_RING_BUFFER
+	// Device objects never have a recording sink, see HHSomaCompartment_cudafy
+	self->vm_step = curr_step;
+#endif
 
 	return;
 }
@@ -9,12 +9,28 @@
 extern const void* HHSomaCompartment;
 extern const void* HHSomaCompartmentClass;
 
+//! Accesses membrane voltage at the given step, regardless of history mode
+#ifdef VM_RING_BUFFER
+#define HHSOMA_VM(comp, step) ((comp)->vm[(step) & (VM_RING_LEN - 1)])
+#else
+#define HHSOMA_VM(comp, step) ((comp)->vm[(step)])
+#endif
+
 struct HHSomaCompartment
 {
     //! HHSomaCompartment : Compartment
     struct Compartment _;
+#ifdef VM_RING_BUFFER
+    //! Membrane voltage ring buffer (last VM_RING_LEN steps) - mV
+    double vm[VM_RING_LEN];
+    //! Latest step stored in vm
+    uint64_t vm_step;
+    //! Full-length voltage recording sink in host memory, NULL if not recording - mV
+    double* vm_trace;
+#else
     //! Membrane voltage - mV
     double vm[SIMUL_LEN];
+#endif
     //! Length of soma_vm array
     uint64_t vm_len;
     //! Capacitance - nF
@@ -27,6 +43,52 @@ struct HHSomaCompartmentClass
     struct CompartmentClass _;
 };
 
+/**
+ * Advances membrane voltage by one step (non-virtual simul_fxn body).
+ *
+ * Mechanisms my_mechs[0 .. first_mech) are skipped; their summed current
+ * must instead be given as I_ext (e.g. by the SoA engine, see hh_soa.h).
+ * With HH_IMPLICIT_VM the voltage step is implicit in G_ext, the conductance
+ * of the currents in I_ext; currents of called mechanisms stay explicit.
+ * Called mechanisms keep their own state on the DT grid whatever dt is, so
+ * only stateless ones (e.g. DCCurrentMech) should be left to a longer step.
+ *
+ * @param[in,out] _self        compartment to advance
+ * @param[in]     network      network of compartments, indexed by ID
+ * @param[in]     I_ext        current already computed for this step
+ * @param[in]     G_ext        conductance of I_ext, 0 if unknown
+ * @param[in]     first_mech   index of the first mechanism to call
+ * @param[in]     dt           step size, DT unless stepping adaptively
+ * @param[in]     global_time  current simulation time
+ * @param[in]     curr_step    current simulation step
+ */
+extern void HHSomaCompartment_integrate(void* _self,
+                                        void** network,
+                                        const double I_ext,
+                                        const double G_ext,
+                                        const uint64_t first_mech,
+                                        const double dt,
+                                        const double global_time,
+                                        const uint64_t curr_step);
+
+/**
+ * Sums the current of mechanisms my_mechs[first_mech ..] and I_ext, with
+ * voltages at curr_step - 1. First half of HHSomaCompartment_integrate,
+ * for engines that solve the voltage step themselves (see section.h).
+ */
+extern double HHSomaCompartment_current(void* _self,
+                                        void** network,
+                                        const double I_ext,
+                                        const uint64_t first_mech,
+                                        const double global_time,
+                                        const uint64_t curr_step);
+
+/**
+ * Stores the membrane voltage of curr_step, recording it and any threshold
+ * crossing. Second half of HHSomaCompartment_integrate.
+ */
+extern void HHSomaCompartment_set_vm(void* _self, const double vm, const uint64_t curr_step);
+
 extern void initHHSomaCompartment(const bool init_cuda);
 
 #endif
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "MyriadObject.h"
+#include "Mechanism.h"
+#include "HHSomaCompartment.h"
+#include "HHSpikeGABAAMechanism.h"
+#include "HHSpikeGABAAMechanism.cuh"
+#include "spike_events.h"
+
+/////////////////////////////////////
+// HHSpikeGABAAMechanism Overrides //
+/////////////////////////////////////
+
+static void* HHSpikeGABAAMechanism_ctor(void* _self, va_list* app)
+{
+	struct HHSpikeGABAAMechanism* self =
+		(struct HHSpikeGABAAMechanism*) super_ctor(HHSpikeGABAAMechanism, _self, app);
+
+	self->prev_vm_thresh = va_arg(*app, double);
+	self->t_fired = va_arg(*app, double);
+	self->g_max = va_arg(*app, double);
+	self->tau_alpha = va_arg(*app, double);
+	self->tau_beta = va_arg(*app, double);
+	self->gaba_rev = va_arg(*app, double);
+
+	// Peak of the dual exponential, used to normalize it to g_max
+	self->peak_cond_t = ((self->tau_alpha * self->tau_beta) /
+						 (self->tau_beta - self->tau_alpha)) *
+		log(self->tau_beta / self->tau_alpha);
+	self->norm_const = 1.0 / (exp(-self->peak_cond_t / self->tau_beta) -
+							  exp(-self->peak_cond_t / self->tau_alpha));
+
+	// Traces hold their value as of the last step seen, starting from t = 0
+	self->decay_alpha = exp(-DT / self->tau_alpha);
+	self->decay_beta = exp(-DT / self->tau_beta);
+	if (self->t_fired == -INFINITY)
+	{
+		self->trace_alpha = 0.0;
+		self->trace_beta = 0.0;
+	} else {
+		self->trace_alpha = exp(self->t_fired / self->tau_alpha);
+		self->trace_beta = exp(self->t_fired / self->tau_beta);
+	}
+
+	return self;
+}
+
+static void* HHSpikeGABAAMechanism_cudafy(void* _self, int clobber)
+{
+#ifdef CUDA
+	return super_cudafy(HHSpikeGABAAMechanism, _self, 0);
+#else
+	return NULL;
+#endif
+}
+
+static void HHSpikeGABAAMechanism_decudafy(void* _self, void* cuda_self)
+{
+#ifdef CUDA
+	super_decudafy(Mechanism, _self, cuda_self);
+#endif
+	return;
+}
+
+static int HHSpikeGABAAMechanism_dtor(void* _self)
+{
+	return super_dtor(Mechanism, _self);
+}
+
+// Did the presynaptic cell cross threshold between step - 1 and step?
+static inline bool _crossed_in(const struct HHSpikeGABAAMechanism* self,
+							   const struct HHSomaCompartment* c1,
+							   const uint64_t step)
+{
+	if (network_spikes != NULL && network_spikes->vm_thresh == self->prev_vm_thresh)
+	{
+		// Presynaptic cell recorded it itself; no need to touch its voltage
+		return spike_events_fired(network_spikes, self->_.source_id, step);
+	}
+	const double pre_pre_vm = (step > 0) ? HHSOMA_VM(c1, step-1) : INFINITY;
+	const double pre_vm = HHSOMA_VM(c1, step);
+	return pre_vm > self->prev_vm_thresh && pre_pre_vm < self->prev_vm_thresh;
+}
+
+static double HHSpikeGABAAMechanism_mech_fun(void* _self,
+											 void* pre_comp,
+											 void* post_comp,
+											 const double global_time,
+											 const uint64_t curr_step)
+{
+	struct HHSpikeGABAAMechanism* self = (struct HHSpikeGABAAMechanism*) _self;
+	const struct HHSomaCompartment* c1 = (const struct HHSomaCompartment*) pre_comp;
+	const struct HHSomaCompartment* c2 = (const struct HHSomaCompartment*) post_comp;
+
+	// Called every `every` steps (see mechanism_fxn_every); a crossing in any
+	// of the steps since the last call is seen now, k steps late.
+	const uint64_t every = self->_.update_every > 1 ? self->_.update_every : 1;
+
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+	// Advance both exponentials over those steps; each spike starts a fresh
+	// pair, already decayed by the steps since it was due to be seen
+	double decay_alpha = 1.0, decay_beta = 1.0;
+	double fresh_alpha = 0.0, fresh_beta = 0.0;
+	bool fired = false;
+	for (uint64_t k = 0; k < every; k++)
+	{
+		if (k < curr_step && _crossed_in(self, c1, curr_step - 1 - k))
+		{
+			if (!fired)
+			{
+				self->t_fired = global_time - k * DT;
+			}
+			fired = true;
+			fresh_alpha += decay_alpha;
+			fresh_beta += decay_beta;
+		}
+		decay_alpha *= self->decay_alpha;
+		decay_beta *= self->decay_beta;
+	}
+
+	double trace_alpha = self->trace_alpha * decay_alpha + fresh_alpha;
+	double trace_beta = self->trace_beta * decay_beta + fresh_beta;
+	if (!fired && trace_beta < HHSPIKEGABAA_TRACE_FLOOR && trace_alpha < HHSPIKEGABAA_TRACE_FLOOR)
+	{
+		// Keep idle synapses out of denormal range
+		trace_alpha = 0.0;
+		trace_beta = 0.0;
+	}
+	self->trace_alpha = trace_alpha;
+	self->trace_beta = trace_beta;
+
+	if (trace_beta == 0.0)
+	{
+		return 0.0;
+	}
+
+	const double post_vm = HHSOMA_VM(c2, curr_step-1);
+	return self->norm_const * -self->g_max * (trace_beta - trace_alpha) * (post_vm - self->gaba_rev);
+#else
+	// Only the latest spike matters
+	for (uint64_t k = 0; k < every && k < curr_step; k++)
+	{
+		if (_crossed_in(self, c1, curr_step - 1 - k))
+		{
+			self->t_fired = global_time - k * DT;
+			break;
+		}
+	}
+
+	if (self->t_fired == -INFINITY)
+	{
+		return 0.0;
+	}
+
+	// Long after the last spike the conductance is negligible; go idle
+	if (global_time - self->t_fired > HHSPIKEGABAA_DECAY_CUTOFF * self->tau_beta)
+	{
+		self->t_fired = -INFINITY;
+		return 0.0;
+	}
+
+	const double post_vm = HHSOMA_VM(c2, curr_step-1);
+	const double g_s = exp(-(global_time - self->t_fired) / self->tau_beta) -
+		exp(-(global_time - self->t_fired) / self->tau_alpha);
+	return self->norm_const * -self->g_max * g_s * (post_vm - self->gaba_rev);
+#endif /* HHSPIKEGABAA_EXACT_DECAY */
+}
+
+//////////////////////////////////////////
+// HHSpikeGABAAMechanismClass Overrides //
+//////////////////////////////////////////
+
+static void* HHSpikeGABAAMechanismClass_cudafy(void* _self, int clobber)
+{
+#ifdef CUDA
+	// We know what class we are
+	struct HHSpikeGABAAMechanismClass* my_class = (struct HHSpikeGABAAMechanismClass*) _self;
+
+	// Make a temporary copy-class because we need to change things
+	struct HHSpikeGABAAMechanismClass copy_class = *my_class;
+	struct MyriadClass* copy_class_class = (struct MyriadClass*) &copy_class;
+
+	// Clobber the superclass pointer with the device-side one unless asked not to
+	if (clobber)
+	{
+		mech_fun_t my_mech_fun = NULL;
+		CUDA_CHECK_RETURN(
+			cudaMemcpyFromSymbol(
+				(void**) &my_mech_fun,
+				(const void*) &HHSpikeGABAAMechanism_mech_fxn_t,
+				sizeof(void*),
+				0,
+				cudaMemcpyDeviceToHost
+				)
+			);
+		copy_class._.m_mech_fxn = my_mech_fun;
+
+		const struct MyriadClass* super_class = (const struct MyriadClass*) MechanismClass;
+		memcpy((void**) &copy_class_class->super, &super_class->device_class, sizeof(void*));
+	}
+
+	return super_cudafy(MechanismClass, (void*) &copy_class, 0);
+#else
+	// Can't cudafy if there's no CUDA
+	return NULL;
+#endif
+}
+
+////////////////////////////
+// Dynamic Initialization //
+////////////////////////////
+
+const void* HHSpikeGABAAMechanism;
+const void* HHSpikeGABAAMechanismClass;
+
+void initHHSpikeGABAAMechanism(const bool init_cuda)
+{
+	if (!HHSpikeGABAAMechanismClass)
+	{
+		HHSpikeGABAAMechanismClass =
+			myriad_new(
+				MechanismClass,
+				MechanismClass,
+				sizeof(struct HHSpikeGABAAMechanismClass),
+				myriad_cudafy, HHSpikeGABAAMechanismClass_cudafy,
+				0
+			);
+
+#ifdef CUDA
+		if (init_cuda)
+		{
+			void* tmp_mech_c_t = myriad_cudafy((void*)HHSpikeGABAAMechanismClass, 1);
+			((struct MyriadClass*) HHSpikeGABAAMechanismClass)->device_class = (struct MyriadClass*) tmp_mech_c_t;
+			CUDA_CHECK_RETURN(
+				cudaMemcpyToSymbol(
+					(const void*) &HHSpikeGABAAMechanismClass_dev_t,
+					&tmp_mech_c_t,
+					sizeof(struct HHSpikeGABAAMechanismClass*),
+					0,
+					cudaMemcpyHostToDevice
+					)
+				);
+		}
+#endif
+	}
+
+	if (!HHSpikeGABAAMechanism)
+	{
+		HHSpikeGABAAMechanism =
+			myriad_new(
+				HHSpikeGABAAMechanismClass,
+				Mechanism,
+				sizeof(struct HHSpikeGABAAMechanism),
+				myriad_ctor, HHSpikeGABAAMechanism_ctor,
+				myriad_dtor, HHSpikeGABAAMechanism_dtor,
+				myriad_cudafy, HHSpikeGABAAMechanism_cudafy,
+				myriad_decudafy, HHSpikeGABAAMechanism_decudafy,
+				mechanism_fxn, HHSpikeGABAAMechanism_mech_fun,
+				0
+			);
+
+#ifdef CUDA
+		if (init_cuda)
+		{
+			void* tmp_mech_t = myriad_cudafy((void*)HHSpikeGABAAMechanism, 1);
+			((struct MyriadClass*) HHSpikeGABAAMechanism)->device_class = (struct MyriadClass*) tmp_mech_t;
+			CUDA_CHECK_RETURN(
+				cudaMemcpyToSymbol(
+					(const void*) &HHSpikeGABAAMechanism_dev_t,
+					&tmp_mech_t,
+					sizeof(struct HHSpikeGABAAMechanism*),
+					0,
+					cudaMemcpyHostToDevice
+					)
+				);
+		}
+#endif
+	}
+}
@@ -39,10 +39,27 @@ __device__ double HHSpikeGABAAMechanism_cuda_mech_fun(void* _self,
 	const struct HHSomaCompartment* c2 = (const struct HHSomaCompartment*) post_comp;
 
 	//	Channel dynamics calculation
-    const double pre_pre_vm = (curr_step > 1) ? c1->vm[curr_step-2] : INFINITY;
-	const double pre_vm = c1->vm[curr_step-1];
-	const double post_vm = c2->vm[curr_step-1];
+    const double pre_pre_vm = (curr_step > 1) ? HHSOMA_VM(c1, curr_step-2) : INFINITY;
+	const double pre_vm = HHSOMA_VM(c1, curr_step-1);
+	const double post_vm = HHSOMA_VM(c2, curr_step-1);
     
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+    double trace_alpha = self->trace_alpha * self->decay_alpha;
+    double trace_beta = self->trace_beta * self->decay_beta;
+    if (pre_vm > self->prev_vm_thresh && pre_pre_vm < self->prev_vm_thresh)
+    {
+        self->t_fired = global_time;
+        trace_alpha += 1.0;
+        trace_beta += 1.0;
+    } else if (trace_beta < HHSPIKEGABAA_TRACE_FLOOR && trace_alpha < HHSPIKEGABAA_TRACE_FLOOR) {
+        trace_alpha = 0.0;
+        trace_beta = 0.0;
+    }
+    self->trace_alpha = trace_alpha;
+    self->trace_beta = trace_beta;
+
+    return self->norm_const * -self->g_max * (trace_beta - trace_alpha) * (post_vm - self->gaba_rev);
+#else
     // If we just fired
     if (pre_vm > self->prev_vm_thresh && pre_pre_vm < self->prev_vm_thresh)
     {
@@ -58,6 +75,7 @@ __device__ double HHSpikeGABAAMechanism_cuda_mech_fun(void* _self,
     } else {
         return 0.0;
     }
+#endif /* HHSPIKEGABAA_EXACT_DECAY */
 }
 
 __device__ mech_fun_t HHSpikeGABAAMechanism_mech_fxn_t = HHSpikeGABAAMechanism_cuda_mech_fun;
@@ -25,6 +25,24 @@
 extern const void* HHSpikeGABAAMechanism;
 extern const void* HHSpikeGABAAMechanismClass;
 
+// Define HHSPIKEGABAA_EXACT_DECAY to keep the rising and decaying exponentials
+// as state, scaled by precomputed per-step factors instead of calling exp()
+// every step. Each presynaptic spike then adds to the traces, so overlapping
+// spikes sum rather than the latest one replacing the earlier ones. Idle
+// synapses are skipped once both traces fall below HHSPIKEGABAA_TRACE_FLOOR,
+// so HHSPIKEGABAA_DECAY_CUTOFF does not apply.
+
+#ifndef HHSPIKEGABAA_TRACE_FLOOR
+//! Exact-decay traces below this (relative to a fresh spike) are flushed to zero
+#define HHSPIKEGABAA_TRACE_FLOOR 1e-30
+#endif
+
+#ifndef HHSPIKEGABAA_DECAY_CUTOFF
+//! Tau_beta after the last spike past which the conductance is below
+//! HHSPIKEGABAA_TRACE_FLOOR; the synapse then forgets the spike and goes idle
+#define HHSPIKEGABAA_DECAY_CUTOFF (-log(HHSPIKEGABAA_TRACE_FLOOR))
+#endif
+
 /**
    HHSpikeGABAAMechanism mechanism for Hodgkin-Huxley GABA-a synapse.
 
@@ -41,6 +59,10 @@ struct HHSpikeGABAAMechanism
 	double tau_alpha; 		//! Channel opening time constant - ms
 	double tau_beta;		//! Channel closing time constant - ms
 	double gaba_rev;		//! Synaptic reversal potential - mV
+    double trace_alpha;     //! Summed exp(-(t - t_k)/tau_alpha) over past spikes t_k
+    double trace_beta;      //! Summed exp(-(t - t_k)/tau_beta) over past spikes t_k
+    double decay_alpha;     //! Per-step decay factor exp(-DT/tau_alpha)
+    double decay_beta;      //! Per-step decay factor exp(-DT/tau_beta)
 };
 
 struct HHSpikeGABAAMechanismClass
@@ -58,6 +58,10 @@ struct Mechanism
 	const struct MyriadObject _;
     //! Source ID of the pre-mechanism compartment
 	uint64_t source_id;
+    //! Steps between updates, 0 or 1 for every step (see mechanism_fxn_every)
+	uint32_t update_every;
+    //! Output of the last update, held until the next one
+	double held_fxn;
 };
 
 /**
@@ -75,6 +79,32 @@ struct MechanismClass
 	mech_fun_t m_mech_fxn;
 };
 
+/**
+ * Calls mechanism_fxn every update_every steps and holds its output between.
+ *
+ * Updates are staggered by source compartment so that slow mechanisms of
+ * different cells do not all land on the same step. A mechanism with
+ * update_every > 1 has to account for the steps it did not see itself
+ * (e.g. spikes in between); mechanisms taken over by the SoA engine (see
+ * hh_soa.h) are always updated every step.
+ *
+ * @see mechanism_fxn
+ */
+static inline double mechanism_fxn_every(void* _self,
+                                         void* pre_comp,
+                                         void* post_comp,
+                                         const double global_time,
+                                         const uint64_t curr_step)
+{
+	struct Mechanism* self = (struct Mechanism*) _self;
+	if (self->update_every > 1 && (curr_step + self->source_id) % self->update_every != 0)
+	{
+		return self->held_fxn;
+	}
+	self->held_fxn = mechanism_fxn(_self, pre_comp, post_comp, global_time, curr_step);
+	return self->held_fxn;
+}
+
 /**
  * Initializes prototype mechanism infrastructure on the heap.
  *
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "adaptive_step.h"
+
+adaptive_step_t adaptive_step_new(const uint64_t num_cells,
+                                  const double tol,
+                                  const uint32_t max_stride)
+{
+    if (max_stride == 0 || (max_stride & (max_stride - 1)) != 0)
+    {
+        return NULL;
+    }
+
+    adaptive_step_t ctl = (adaptive_step_t) calloc(1, sizeof(struct adaptive_step));
+    if (ctl == NULL)
+    {
+        return NULL;
+    }
+
+    ctl->num_cells = num_cells;
+    ctl->tol = tol;
+    ctl->max_stride = max_stride;
+    ctl->last_step = (uint64_t*) calloc(num_cells, sizeof(uint64_t));
+    ctl->stride = (uint32_t*) calloc(num_cells, sizeof(uint32_t));
+    ctl->slope = (double*) calloc(num_cells, sizeof(double));
+    ctl->num_updates = (uint64_t*) calloc(num_cells, sizeof(uint64_t));
+    ctl->changes = (uint64_t*) calloc(num_cells * ADAPTIVE_STEP_MAX_CHANGES, sizeof(uint64_t));
+    ctl->num_changes = (uint32_t*) calloc(num_cells, sizeof(uint32_t));
+    ctl->next_change = (uint32_t*) calloc(num_cells, sizeof(uint32_t));
+    if (ctl->last_step == NULL || ctl->stride == NULL || ctl->slope == NULL ||
+        ctl->num_updates == NULL || ctl->changes == NULL || ctl->num_changes == NULL ||
+        ctl->next_change == NULL)
+    {
+        adaptive_step_free(ctl);
+        return NULL;
+    }
+
+    for (uint64_t c = 0; c < num_cells; c++)
+    {
+        ctl->stride[c] = 1;
+    }
+
+    return ctl;
+}
+
+void adaptive_step_free(adaptive_step_t ctl)
+{
+    if (ctl == NULL)
+    {
+        return;
+    }
+    free(ctl->last_step);
+    free(ctl->stride);
+    free(ctl->slope);
+    free(ctl->num_updates);
+    free(ctl->changes);
+    free(ctl->num_changes);
+    free(ctl->next_change);
+    free(ctl);
+}
+
+int adaptive_step_add_change(adaptive_step_t ctl,
+                             const uint64_t cell,
+                             const uint64_t step)
+{
+    uint64_t* changes = ctl->changes + cell * ADAPTIVE_STEP_MAX_CHANGES;
+    uint32_t n = ctl->num_changes[cell];
+    if (n == ADAPTIVE_STEP_MAX_CHANGES)
+    {
+        return -1;
+    }
+
+    // Insertion keeps them sorted
+    while (n > 0 && changes[n - 1] > step)
+    {
+        changes[n] = changes[n - 1];
+        n--;
+    }
+    changes[n] = step;
+    ctl->num_changes[cell]++;
+    return 0;
+}
+
+void adaptive_step_update(adaptive_step_t ctl,
+                          const uint64_t cell,
+                          const uint64_t curr_step,
+                          const double vm_prev,
+                          const double vm,
+                          const bool event)
+{
+    const double h = adaptive_step_size(ctl, cell, curr_step);
+    const double slope = (vm - vm_prev) / h;
+    const double err = 0.5 * h * fabs(slope - ctl->slope[cell]);
+
+    // Skip past changes at or before this step; one right at it counts as an event
+    const uint64_t* changes = ctl->changes + cell * ADAPTIVE_STEP_MAX_CHANGES;
+    uint32_t next = ctl->next_change[cell];
+    bool changed = false;
+    while (next < ctl->num_changes[cell] && changes[next] <= curr_step)
+    {
+        changed |= changes[next] == curr_step;
+        next++;
+    }
+    ctl->next_change[cell] = next;
+
+    // Error goes with h^2, so a doubled step would have about 4x as much
+    uint32_t stride = ctl->stride[cell];
+    if (event || changed)
+    {
+        stride = 1;
+    } else if (err > ctl->tol) {
+        stride = stride > 1 ? stride / 2 : 1;
+    } else if (4.0 * err <= ctl->tol) {
+        stride = stride < ctl->max_stride / 2 ? stride * 2 : ctl->max_stride;
+    }
+
+    // Land on the step before the next change, then on the change itself
+    if (next < ctl->num_changes[cell])
+    {
+        const uint64_t until = changes[next] - curr_step;
+        const uint64_t gap = until > 1 ? until - 1 : until;
+        stride = gap < stride ? (uint32_t) gap : stride;
+    }
+
+    ctl->stride[cell] = stride;
+    ctl->slope[cell] = slope;
+    ctl->last_step[cell] = curr_step;
+    ctl->num_updates[cell]++;
+}
+
+uint64_t adaptive_step_total(const adaptive_step_t ctl)
+{
+    uint64_t total = 0;
+    for (uint64_t c = 0; c < ctl->num_cells; c++)
+    {
+        total += ctl->num_updates[c];
+    }
+    return total;
+}
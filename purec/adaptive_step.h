@@ -0,0 +1,145 @@
+/**
+ * @file    adaptive_step.h
+ *
+ * @brief   Per-cell, error-controlled step sizes on the DT grid.
+ *
+ * @details Each cell advances in strides of a power-of-two number of DT
+ *          steps, up to ADAPTIVE_STEP_MAX_STRIDE, and holds its voltage in
+ *          the steps in between. After each update the local error of the
+ *          (first order) step just taken is estimated from the change in
+ *          slope since the previous one, h/2 * |dVm/dt - dVm/dt_prev|, and
+ *          the stride is halved when that exceeds ADAPTIVE_STEP_TOL or
+ *          doubled when even a doubled step would stay within it. Steps are
+ *          never rejected; the controller only steers the next one.
+ *
+ *          Quiescent cells thus coast along at long strides while spiking
+ *          ones fall back to DT. A cell receiving a synaptic event is
+ *          updated in the step the event arrives and restarts at stride 1,
+ *          so synaptic input is never deferred or smeared over a stride.
+ *          Input from mechanisms outside the SoA engine (DCCurrentMech) is
+ *          only seen at updates, so the steps at which it switches are
+ *          registered up front: strides are cut short to update a cell in
+ *          the step before each such change and again in the step of it,
+ *          where it restarts at stride 1 as for a synaptic event.
+ *          ADAPTIVE_STEP turns on HH_EXP_EULER and HH_IMPLICIT_VM, which
+ *          stay stable over long strides where forward Euler would not.
+ */
+#ifndef ADAPTIVE_STEP_H
+#define ADAPTIVE_STEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myriad.h"
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+//! Local voltage error allowed per update - mV
+#ifndef ADAPTIVE_STEP_TOL
+#define ADAPTIVE_STEP_TOL 0.01
+#endif
+
+//! Longest stride, in steps (a power of 2)
+#ifndef ADAPTIVE_STEP_MAX_STRIDE
+#define ADAPTIVE_STEP_MAX_STRIDE 64
+#endif
+
+//! Most input changes that can be registered per cell
+#ifndef ADAPTIVE_STEP_MAX_CHANGES
+#define ADAPTIVE_STEP_MAX_CHANGES 4
+#endif
+
+typedef struct adaptive_step
+{
+    //! Number of cells, indexed by ID
+    uint64_t num_cells;
+    //! Local voltage error allowed per update - mV
+    double tol;
+    //! Longest stride - steps
+    uint32_t max_stride;
+    //! Step each cell was last updated in
+    uint64_t* restrict last_step;
+    //! Steps from each cell's last update to its next one
+    uint32_t* restrict stride;
+    //! Voltage slope of each cell's last update - mV/ms
+    double* restrict slope;
+    //! Updates taken by each cell
+    uint64_t* restrict num_updates;
+    //! Steps at which each cell's external input changes, ascending,
+    //! ADAPTIVE_STEP_MAX_CHANGES per cell
+    uint64_t* restrict changes;
+    //! Changes registered per cell
+    uint32_t* restrict num_changes;
+    //! Each cell's first change not yet behind its last update
+    uint32_t* restrict next_change;
+} *adaptive_step_t;
+
+/**
+ * @brief Allocates step control for cells that all start at stride 1.
+ *
+ * @param num_cells   number of cells, indexed by ID
+ * @param tol         local voltage error allowed per update - mV
+ * @param max_stride  longest stride in steps, a power of 2
+ *
+ * @returns new step control, or NULL on allocation failure or bad stride.
+ */
+extern adaptive_step_t adaptive_step_new(const uint64_t num_cells,
+                                         const double tol,
+                                         const uint32_t max_stride);
+
+extern void adaptive_step_free(adaptive_step_t ctl);
+
+/**
+ * @brief Registers a step at which a cell's external input changes.
+ *
+ * E.g. a DCCurrentMech switching on at t_start and off after t_stop. Must be
+ * called before the cell is first updated.
+ *
+ * @returns 0 on success, -1 if the cell already has ADAPTIVE_STEP_MAX_CHANGES.
+ */
+extern int adaptive_step_add_change(adaptive_step_t ctl,
+                                    const uint64_t cell,
+                                    const uint64_t step);
+
+//! Whether a cell's stride is up in the given step
+static inline bool adaptive_step_due(const adaptive_step_t ctl,
+                                     const uint64_t cell,
+                                     const uint64_t curr_step)
+{
+    return curr_step - ctl->last_step[cell] >= ctl->stride[cell];
+}
+
+//! Size of a cell's step if it were updated in the given step - ms
+static inline double adaptive_step_size(const adaptive_step_t ctl,
+                                        const uint64_t cell,
+                                        const uint64_t curr_step)
+{
+    return (curr_step - ctl->last_step[cell]) * DT;
+}
+
+/**
+ * @brief Records a cell's update and picks its next stride.
+ *
+ * Safe to call concurrently for different cells.
+ *
+ * @param ctl        step control
+ * @param cell       cell that was updated
+ * @param curr_step  step the cell was updated in
+ * @param vm_prev    voltage before the update - mV
+ * @param vm         voltage after the update - mV
+ * @param event      whether the cell received a synaptic event this step
+ */
+extern void adaptive_step_update(adaptive_step_t ctl,
+                                 const uint64_t cell,
+                                 const uint64_t curr_step,
+                                 const double vm_prev,
+                                 const double vm,
+                                 const bool event);
+
+//! Total updates taken by all cells
+extern uint64_t adaptive_step_total(const adaptive_step_t ctl);
+
+#endif /* ADAPTIVE_STEP_H */
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cell_sched.h"
+
+//! Weight of a new sample in the smoothed per-cell cost
+#define CELL_COST_ALPHA 0.25
+
+double cell_sched_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int cell_sched_init(cell_sched_t* sched,
+                    const uint64_t num_cells,
+                    const uint32_t num_workers,
+                    const bool weighted)
+{
+    memset(sched, 0, sizeof(cell_sched_t));
+    sched->num_cells = num_cells;
+    sched->num_workers = num_workers;
+    sched->weighted = weighted;
+
+    sched->bounds = (uint64_t*) calloc(num_workers + 1, sizeof(uint64_t));
+    sched->cell_cost = (double*) calloc(num_cells, sizeof(double));
+    if (posix_memalign((void**) &sched->workers,
+                       64,
+                       num_workers * sizeof(struct cell_sched_worker)) != 0)
+    {
+        sched->workers = NULL;
+    }
+    if (sched->bounds == NULL || sched->cell_cost == NULL || sched->workers == NULL)
+    {
+        cell_sched_free(sched);
+        return -1;
+    }
+    memset(sched->workers, 0, num_workers * sizeof(struct cell_sched_worker));
+
+    for (uint32_t t = 0; t <= num_workers; t++)
+    {
+        sched->bounds[t] = (t * num_cells) / num_workers;
+    }
+
+    return 0;
+}
+
+void cell_sched_free(cell_sched_t* sched)
+{
+    free(sched->bounds);
+    free(sched->cell_cost);
+    free(sched->workers);
+    sched->bounds = NULL;
+    sched->cell_cost = NULL;
+    sched->workers = NULL;
+}
+
+void cell_sched_record_cell(cell_sched_t* sched, const uint64_t cell, const double ns)
+{
+    double* cost = &sched->cell_cost[cell];
+    *cost = (*cost == 0.0) ? ns : (1.0 - CELL_COST_ALPHA) * (*cost) + CELL_COST_ALPHA * ns;
+}
+
+void cell_sched_rebalance(cell_sched_t* sched)
+{
+    // Account for how uneven the interval that just ended was
+    double max_ns = 0.0, sum_ns = 0.0;
+    for (uint32_t t = 0; t < sched->num_workers; t++)
+    {
+        const double ns = sched->workers[t].interval_ns;
+        max_ns = ns > max_ns ? ns : max_ns;
+        sum_ns += ns;
+        sched->workers[t].interval_ns = 0.0;
+    }
+    if (sum_ns > 0.0)
+    {
+        const double imbalance = max_ns / (sum_ns / sched->num_workers) - 1.0;
+        if (imbalance > sched->worst_imbalance)
+        {
+            sched->worst_imbalance = imbalance;
+        }
+    }
+
+    if (!sched->weighted)
+    {
+        return;
+    }
+
+    double total = 0.0;
+    for (uint64_t i = 0; i < sched->num_cells; i++)
+    {
+        total += sched->cell_cost[i];
+    }
+    if (total <= 0.0)
+    {
+        return;
+    }
+
+    // Cut where the running cost crosses each worker's equal share, taking
+    // whichever side of the crossing cell lands closer to the share.
+    uint64_t cell = 0;
+    double prefix = 0.0;
+    for (uint32_t t = 1; t < sched->num_workers; t++)
+    {
+        const double target = total * t / sched->num_workers;
+        while (cell < sched->num_cells && prefix + sched->cell_cost[cell] <= target)
+        {
+            prefix += sched->cell_cost[cell++];
+        }
+        if (cell < sched->num_cells &&
+            prefix + sched->cell_cost[cell] - target < target - prefix)
+        {
+            prefix += sched->cell_cost[cell++];
+        }
+        sched->bounds[t] = cell;
+    }
+    sched->bounds[sched->num_workers] = sched->num_cells;
+    sched->num_rebalances++;
+}
+
+void cell_sched_report(cell_sched_t* sched, FILE* out)
+{
+    double max_ns = 0.0, sum_ns = 0.0;
+    for (uint32_t t = 0; t < sched->num_workers; t++)
+    {
+        const double ns = sched->workers[t].busy_ns;
+        max_ns = ns > max_ns ? ns : max_ns;
+        sum_ns += ns;
+    }
+    const double mean_ns = sum_ns / sched->num_workers;
+
+    fprintf(out, "Scheduler (%s, %" PRIu64 " rebalances):\n",
+            sched->weighted ? "cost-weighted" : "static",
+            sched->num_rebalances);
+    for (uint32_t t = 0; t < sched->num_workers; t++)
+    {
+        fprintf(out, "\tworker %u: cells [%" PRIu64 ", %" PRIu64 "), busy %.3f s\n",
+                t,
+                sched->bounds[t],
+                sched->bounds[t + 1],
+                sched->workers[t].busy_ns * 1e-9);
+    }
+    fprintf(out, "\timbalance (max/mean - 1): %.1f%% overall, %.1f%% worst interval\n",
+            mean_ns > 0.0 ? 100.0 * (max_ns / mean_ns - 1.0) : 0.0,
+            100.0 * sched->worst_imbalance);
+}
@@ -0,0 +1,101 @@
+/**
+ * @file    cell_sched.h
+ *
+ * @brief   Cost-weighted partitioning of cells across worker threads.
+ *
+ * @details Each worker owns a contiguous range of cells. Per-cell step cost
+ *          is sampled for a few steps every CELL_SCHED_INTERVAL steps and the
+ *          ranges are re-cut so each worker gets roughly equal measured cost.
+ *          Per-worker busy time is accumulated for an end-of-run imbalance
+ *          report.
+ */
+#ifndef CELL_SCHED_H
+#define CELL_SCHED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//! Steps between re-partitioning
+#ifndef CELL_SCHED_INTERVAL
+#define CELL_SCHED_INTERVAL 10000
+#endif
+
+//! Steps at the start of each interval during which cells are timed
+#ifndef CELL_SCHED_SAMPLES
+#define CELL_SCHED_SAMPLES 8
+#endif
+
+//! Per-worker accounting, one cache line each to avoid false sharing
+struct cell_sched_worker
+{
+    //! Time spent stepping cells - ns
+    double busy_ns;
+    //! Time spent stepping cells in the current interval - ns
+    double interval_ns;
+} __attribute__((aligned(64)));
+
+typedef struct cell_sched
+{
+    uint64_t num_cells;
+    uint32_t num_workers;
+    //! Re-partition from measured cost (false keeps the even split)
+    bool weighted;
+    //! Cell range of worker t is [bounds[t], bounds[t + 1])
+    uint64_t* bounds;
+    //! Smoothed per-cell step cost - ns
+    double* cell_cost;
+    struct cell_sched_worker* workers;
+    //! Worst max/mean - 1 of per-worker time seen over any interval
+    double worst_imbalance;
+    uint64_t num_rebalances;
+} cell_sched_t;
+
+/**
+ * @brief Initializes an even split of num_cells cells over num_workers.
+ *
+ * @returns 0 on success, -1 on allocation failure.
+ */
+extern int cell_sched_init(cell_sched_t* sched,
+                           const uint64_t num_cells,
+                           const uint32_t num_workers,
+                           const bool weighted);
+
+extern void cell_sched_free(cell_sched_t* sched);
+
+//! Whether cells should be timed individually in the given step
+static inline bool cell_sched_sampling(const uint64_t curr_step)
+{
+    return curr_step % CELL_SCHED_INTERVAL < CELL_SCHED_SAMPLES;
+}
+
+//! Whether the given step is the last one before re-partitioning
+static inline bool cell_sched_due(const uint64_t curr_step)
+{
+    return curr_step % CELL_SCHED_INTERVAL == CELL_SCHED_INTERVAL - 1;
+}
+
+/**
+ * @brief Records a sampled step cost for one cell. Only the owning worker
+ * may call this for a given cell.
+ */
+extern void cell_sched_record_cell(cell_sched_t* sched,
+                                   const uint64_t cell,
+                                   const double ns);
+
+/**
+ * @brief Re-cuts worker ranges from sampled cell costs.
+ *
+ * Must be called by a single thread while no worker is stepping.
+ */
+extern void cell_sched_rebalance(cell_sched_t* sched);
+
+/**
+ * @brief Prints per-worker busy time, final ranges and observed imbalance.
+ */
+extern void cell_sched_report(cell_sched_t* sched, FILE* out);
+
+//! Monotonic clock reading - ns
+extern double cell_sched_now_ns(void);
+
+#endif /* CELL_SCHED_H */
@@ -264,28 +264,90 @@ static uint64_t next_power_of_2(uint64_t n)
     return n;
 }
 
-ddtable_t ddtable_new(const uint64_t num_keys)
+#ifdef DDTABLE_CONCURRENT
+
+// Next counter shard to hand out, and the one this thread was given
+static uint32_t _dd_next_shard = 0;
+static __thread int32_t _dd_shard = -1;
+
+static inline uint32_t dd_shard(void)
 {
-    // Set the absolute number of key-value pairs, and also
-    // set the internal size since we enforce "power of 2"-sized tables.
+    if (_dd_shard < 0)
+    {
+        _dd_shard = (int32_t) (__atomic_fetch_add(&_dd_next_shard, 1, __ATOMIC_RELAXED)
+                               % DDTABLE_STAT_SHARDS);
+    }
+    return (uint32_t) _dd_shard;
+}
+
+#define DD_COUNT(table, counter) \
+    __atomic_fetch_add(&(table)->shards[dd_shard()].stats.counter, 1, __ATOMIC_RELAXED)
+
+#else
+
+#define DD_COUNT(table, counter) ((table)->_ddtable_##counter++)
+
+#endif /* DDTABLE_CONCURRENT */
+
+#ifdef DDTABLE_OPEN_ADDRESSING
+//! Number of buckets holding at least the given number of keys
+static uint64_t num_buckets_for(const uint64_t num_keys)
+{
+    const uint64_t min_buckets =
+        (num_keys + DDTABLE_BUCKET_SLOTS - 1) / DDTABLE_BUCKET_SLOTS;
+    return next_power_of_2(min_buckets > 0 ? min_buckets : 1);
+}
+#endif
+
+size_t ddtable_footprint(const uint64_t num_keys)
+{
+#ifdef DDTABLE_OPEN_ADDRESSING
+    // Room to align the buckets to a cache line after the struct
+    size_t size = sizeof(struct ddtable) + 63 +
+        (sizeof(struct ddtable_bucket) * num_buckets_for(num_keys));
+#ifdef DDTABLE_CONCURRENT
+    size += sizeof(struct ddtable_stat_shard) * DDTABLE_STAT_SHARDS;
+#endif
+    return size;
+#else
     const uint64_t pot_num_keys = next_power_of_2(num_keys);
-    
-    // Calculate the memory footprint so we can try allocate.
-    const size_t pot_size = (sizeof(double) * pot_num_keys * 2) +
+    return (sizeof(double) * pot_num_keys * 2) +
         sizeof(struct ddtable) + (sizeof(int_fast8_t) * pot_num_keys);
+#endif
+}
+
+ddtable_t ddtable_new(const uint64_t num_keys)
+{
+    // Calculate the memory footprint so we can try allocate.
+    const size_t pot_size = ddtable_footprint(num_keys);
 
     // Allocate entire table at one time
     ddtable_t new_ht = (ddtable_t) _my_malloc(pot_size);
+    if (new_ht == NULL)
+    {
+        return NULL;
+    }
 
-    // Reset entire memory region
+    // Reset entire memory region, which also zeroes the counters
     memset(new_ht, 0, pot_size);
 
-    // Initialize debug information, if specified
-#if DEBUG
-    new_ht->_ddtable_hits = 0;
-    new_ht->_ddtable_misses = 0;
-    new_ht->_ddtable_collisions = 0;
+#ifdef DDTABLE_OPEN_ADDRESSING
+    const uint64_t num_buckets = num_buckets_for(num_keys);
+    new_ht->size = num_buckets - 1;
+    new_ht->num_kv_pairs = num_buckets * DDTABLE_BUCKET_SLOTS;
+
+    // Everything else starts at the first cache line boundary after the struct
+    const uintptr_t lines = (((uintptr_t) (new_ht + 1)) + 63) & ~((uintptr_t) 63);
+#ifdef DDTABLE_CONCURRENT
+    new_ht->shards = (struct ddtable_stat_shard*) lines;
+    new_ht->buckets = (struct ddtable_bucket*) (new_ht->shards + DDTABLE_STAT_SHARDS);
+#else
+    new_ht->buckets = (struct ddtable_bucket*) lines;
 #endif
+#else
+    // Set the absolute number of key-value pairs, and also
+    // set the internal size since we enforce "power of 2"-sized tables.
+    const uint64_t pot_num_keys = next_power_of_2(num_keys);
 
     // This minus one trick is necessary for &: http://goo.gl/FlcEb0
     new_ht->size = pot_num_keys - 1;
@@ -300,6 +362,7 @@ ddtable_t ddtable_new(const uint64_t num_keys)
                                   + sizeof(int_fast8_t*)
                                   + sizeof(double*)
                                   + ((new_ht->size + 1) * sizeof(int_fast8_t)));
+#endif /* DDTABLE_OPEN_ADDRESSING */
 
     return new_ht;
 }
@@ -310,10 +373,11 @@ void ddtable_free(ddtable_t table)
     {
 #if DEBUG
         // Print out debugging information for table lifetime.
+        const struct ddtable_stats stats = ddtable_get_stats(table);
         printf("table %p meta-info:\n", (void*) table);
-        printf("\thits: %" PRIu64 "\n", table->_ddtable_hits);
-        printf("\tmisses: %" PRIu64 "\n", table->_ddtable_misses);
-        printf("\tcollisions: %" PRIu64 "\n", table->_ddtable_collisions);
+        printf("\thits: %" PRIu64 "\n", stats.hits);
+        printf("\tmisses: %" PRIu64 "\n", stats.misses);
+        printf("\tcollisions: %" PRIu64 "\n", stats.collisions);
 #endif
         _my_free(table);
     } else {
@@ -322,52 +386,370 @@ void ddtable_free(ddtable_t table)
     }
 }
 
+struct ddtable_stats ddtable_get_stats(const ddtable_t table)
+{
+#ifdef DDTABLE_CONCURRENT
+    struct ddtable_stats stats = {0, 0, 0};
+    for (int s = 0; s < DDTABLE_STAT_SHARDS; s++)
+    {
+        const struct ddtable_stats* shard = &table->shards[s].stats;
+        stats.hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+        stats.misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+        stats.collisions += __atomic_load_n(&shard->collisions, __ATOMIC_RELAXED);
+    }
+#else
+    const struct ddtable_stats stats =
+        {
+            .hits = table->_ddtable_hits,
+            .misses = table->_ddtable_misses,
+            .collisions = table->_ddtable_collisions
+        };
+#endif
+    return stats;
+}
+
+#ifdef DDTABLE_OPEN_ADDRESSING
+
+/*
+ * Bucket access. In concurrent mode every field a reader may see change is
+ * accessed atomically; writers hold the bucket's sequence number odd while
+ * they modify it, and readers retry a bucket whose sequence moved.
+ */
+#ifdef DDTABLE_CONCURRENT
+
+static inline void dd_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline double dd_load_d(const double* p)
+{
+    double v;
+    __atomic_load(p, &v, __ATOMIC_RELAXED);
+    return v;
+}
+
+static inline void dd_store_d(double* p, double v)
+{
+    __atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+
+#define DD_LOAD_USED(b) __atomic_load_n(&(b)->num_used, __ATOMIC_RELAXED)
+#define DD_STORE_USED(b, n) __atomic_store_n(&(b)->num_used, n, __ATOMIC_RELAXED)
+
+//! Takes the bucket for writing; gives up instead of waiting unless told to
+static inline bool dd_lock(struct ddtable_bucket* bucket, const bool wait)
+{
+    while (1)
+    {
+        uint64_t seq = __atomic_load_n(&bucket->seq, __ATOMIC_RELAXED);
+        if (!(seq & 1) &&
+            __atomic_compare_exchange_n(&bucket->seq, &seq, seq + 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            // Readers must not see our slot writes without the odd sequence
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            return true;
+        }
+        if (!wait)
+        {
+            return false;
+        }
+        dd_cpu_relax();
+    }
+}
+
+static inline void dd_unlock(struct ddtable_bucket* bucket)
+{
+    // Release orders the slot writes before readers can see an even sequence
+    __atomic_fetch_add(&bucket->seq, 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+#define dd_load_d(p) (*(p))
+#define dd_store_d(p, v) (*(p) = (v))
+#define DD_LOAD_USED(b) ((b)->num_used)
+#define DD_STORE_USED(b, n) ((b)->num_used = (n))
+#define dd_lock(bucket, wait) true
+#define dd_unlock(bucket) ((void) (bucket))
+
+#endif /* DDTABLE_CONCURRENT */
+
+//! Outcome of probing for a key
+enum dd_probe_result
+{
+    //! Key found, value returned
+    DD_FOUND,
+    //! Key not found, and a bucket with room was returned
+    DD_ROOM,
+    //! Key not found, and no bucket within DDTABLE_MAX_PROBE had room
+    DD_FULL
+};
+
+/**
+ * @brief Scans one bucket for key.
+ *
+ * @returns number of occupied slots, with *found set if the key was there
+ */
+static inline uint64_t dd_scan(const struct ddtable_bucket* bucket,
+                               const double key,
+                               double* val,
+                               bool* found)
+{
+#ifdef DDTABLE_CONCURRENT
+    while (1)
+    {
+        const uint64_t seq = __atomic_load_n(&bucket->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            dd_cpu_relax();
+            continue;
+        }
+#endif
+        const uint64_t num_used = DD_LOAD_USED(bucket);
+        *found = false;
+        for (uint64_t s = 0; s < num_used; s++)
+        {
+            if (dd_load_d(&bucket->slots[s].key) == key)
+            {
+                *val = dd_load_d(&bucket->slots[s].val);
+                *found = true;
+                break;
+            }
+        }
+#ifdef DDTABLE_CONCURRENT
+        // Only trust what was read if no writer got in meanwhile
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&bucket->seq, __ATOMIC_RELAXED) == seq)
+        {
+            return num_used;
+        }
+    }
+#else
+    return num_used;
+#endif
+}
+
+/**
+ * @brief Probes for key starting at bucket indx.
+ *
+ * Slots fill in order and are never freed, so the first bucket with room
+ * ends the search.
+ *
+ * @param val Set to the key's value if found
+ * @param free_bucket Set to the first bucket with room if not found
+ */
+static inline enum dd_probe_result dd_probe(ddtable_t table,
+                                            const double key,
+                                            uint64_t indx,
+                                            double* val,
+                                            struct ddtable_bucket** free_bucket)
+{
+    for (int probe = 0; probe <= DDTABLE_MAX_PROBE; probe++)
+    {
+        struct ddtable_bucket* bucket = &table->buckets[indx];
+        bool found;
+        const uint64_t num_used = dd_scan(bucket, key, val, &found);
+        if (found)
+        {
+            return DD_FOUND;
+        }
+        if (num_used < DDTABLE_BUCKET_SLOTS)
+        {
+            *free_bucket = bucket;
+            return DD_ROOM;
+        }
+        indx = (indx + 1) & table->size;
+    }
+    return DD_FULL;
+}
+
+/**
+ * @brief Appends the pair to a bucket that had room when probed.
+ *
+ * @returns 0 on success, -1 if the bucket was busy (and wait is false) or
+ *          filled up in the meantime
+ */
+static inline int dd_fill(struct ddtable_bucket* bucket,
+                          const double key,
+                          const double val,
+                          const bool wait)
+{
+    if (!dd_lock(bucket, wait))
+    {
+        return -1;
+    }
+    const uint64_t s = DD_LOAD_USED(bucket);
+    if (s >= DDTABLE_BUCKET_SLOTS)
+    {
+        dd_unlock(bucket);
+        return -1;
+    }
+    dd_store_d(&bucket->slots[s].key, key);
+    dd_store_d(&bucket->slots[s].val, val);
+    DD_STORE_USED(bucket, s + 1);
+    dd_unlock(bucket);
+    return 0;
+}
+
+static inline void dd_prefetch(ddtable_t table, const uint64_t indx)
+{
+    __builtin_prefetch(&table->buckets[indx], 1);
+}
+
+double ddtable_get_val(ddtable_t table, const double key)
+{
+    struct ddtable_bucket* free_bucket;
+    double val;
+    if (dd_probe(table, key, dd_hash(key, table->size), &val, &free_bucket) == DD_FOUND)
+    {
+        DD_COUNT(table, hits);
+        return val;
+    } else { // Cache miss
+        DD_COUNT(table, misses);
+        return DDTABLE_NULL_VAL;
+    }
+}
+
+double ddtable_get_check_key(ddtable_t table, const double key)
+{
+    // Probing always compares keys
+    return ddtable_get_val(table, key);
+}
+
+int ddtable_set_val(ddtable_t table, const double key, const double val)
+{
+    struct ddtable_bucket* free_bucket;
+    double old_val;
+    if (dd_probe(table, key, dd_hash(key, table->size), &old_val, &free_bucket) != DD_ROOM ||
+        dd_fill(free_bucket, key, val, true) != 0)
+    {
+        DD_COUNT(table, collisions);
+        return -1; // Already set, or no room within probing distance
+    }
+    return 0;
+}
+
+void ddtable_clobber_val(ddtable_t table, const double key, const double val)
+{
+    // Walk the probe window holding each bucket, since we may overwrite
+    uint64_t indx = dd_hash(key, table->size);
+    for (int probe = 0; probe <= DDTABLE_MAX_PROBE; probe++)
+    {
+        struct ddtable_bucket* bucket = &table->buckets[indx];
+        dd_lock(bucket, true);
+        const uint64_t num_used = DD_LOAD_USED(bucket);
+        for (uint64_t s = 0; s < num_used; s++)
+        {
+            if (dd_load_d(&bucket->slots[s].key) == key)
+            {
+                dd_store_d(&bucket->slots[s].val, val);
+                dd_unlock(bucket);
+                return;
+            }
+        }
+        if (num_used < DDTABLE_BUCKET_SLOTS)
+        {
+            dd_store_d(&bucket->slots[num_used].key, key);
+            dd_store_d(&bucket->slots[num_used].val, val);
+            DD_STORE_USED(bucket, num_used + 1);
+            dd_unlock(bucket);
+            return;
+        }
+        dd_unlock(bucket);
+        indx = (indx + 1) & table->size;
+    }
+
+    // No room anywhere we would look; evict from the home bucket
+    DD_COUNT(table, collisions);
+    struct ddtable_bucket* home = &table->buckets[dd_hash(key, table->size)];
+    dd_lock(home, true);
+    dd_store_d(&home->slots[0].key, key);
+    dd_store_d(&home->slots[0].val, val);
+    dd_unlock(home);
+}
+
+bool ddtable_check_key(ddtable_t table, const double key)
+{
+    struct ddtable_bucket* free_bucket;
+    double val;
+    return dd_probe(table, key, dd_hash(key, table->size), &val, &free_bucket) == DD_FOUND;
+}
+
+static inline double dd_check_get_set(ddtable_t table,
+                                      const double key,
+                                      const uint64_t indx,
+                                      d2dfun cb)
+{
+    struct ddtable_bucket* free_bucket;
+    double val;
+    switch (dd_probe(table, key, indx, &val, &free_bucket))
+    {
+        case DD_FOUND:
+            DD_COUNT(table, hits);
+            return val;
+        case DD_ROOM:
+            val = cb(key);
+            // Another thread may hold or have just filled the bucket; then
+            // this value simply goes uncached.
+            if (dd_fill(free_bucket, key, val, false) == 0)
+            {
+                DD_COUNT(table, misses);
+            } else {
+                DD_COUNT(table, collisions);
+            }
+            return val;
+        default:
+            DD_COUNT(table, collisions);
+            return cb(key);
+    }
+}
+
+#else
+
+static inline void dd_prefetch(ddtable_t table, const uint64_t indx)
+{
+    __builtin_prefetch(&table->exists[indx], 1);
+    __builtin_prefetch(&table->key_vals[indx << 1], 1);
+}
+
 double ddtable_get_val(ddtable_t table, const double key)
 {
     const uint64_t indx = dd_hash(key, table->size);
 
-#if DEBUG
     // Return the value, if the key exists in the table, mark as a hit.
     // Otherwise, mark it as a miss and return DDTABLE_NULL_VAL
     const bool exists = table->exists[indx];
     if (exists) // Cache hit
     {
-        table->_ddtable_hits++;
+        DD_COUNT(table, hits);
         return table->key_vals[(indx << 1) + 1];
     } else { // Cache miss
-        table->_ddtable_misses++;
+        DD_COUNT(table, misses);
         return DDTABLE_NULL_VAL;
     }
-#else
-    // Return the value, if the key exists in the table
-    return (table->exists[indx]) ?
-        table->key_vals[(indx << 1) + 1] : DDTABLE_NULL_VAL;
-    #endif
 }
 
 double ddtable_get_check_key(ddtable_t table, const double key)
 {
     const uint64_t indx = dd_hash(key, table->size);
 
-#if DEBUG
     const bool found = table->exists[indx];
     const bool matches = table->key_vals[indx << 1] == key;
     if (!found) // Cache miss
     {
-        table->_ddtable_misses++;
+        DD_COUNT(table, misses);
         return DDTABLE_NULL_VAL;
     } else if (matches) { // Cache hit
-        table->_ddtable_hits++;
+        DD_COUNT(table, hits);
         return table->key_vals[(indx << 1) + 1];
     } else { // Cache collision
-        table->_ddtable_collisions++;
+        DD_COUNT(table, collisions);
         return DDTABLE_NULL_VAL;
     }
-#else
-    // If the key exists AND it's identical to the given one, return value.
-    return (table->exists[indx] && table->key_vals[indx << 1] == key)
-        ? table->key_vals[(indx << 1) + 1] : DDTABLE_NULL_VAL;
-    #endif
 }
 
 int ddtable_set_val(ddtable_t table, const double key, const double val)
@@ -382,9 +764,7 @@ int ddtable_set_val(ddtable_t table, const double key, const double val)
                key, val,
                table->key_vals[indx << 1], table->key_vals[(indx << 1) + 1]);
 #endif // DEBUG > 1
-#if DEBUG
-        table->_ddtable_collisions++;
-#endif // DEBUG
+        DD_COUNT(table, collisions);
         return -1; // Collision
     } else {
         table->exists[indx] = (int_fast8_t) 1;
@@ -407,29 +787,25 @@ bool ddtable_check_key(ddtable_t table, const double key)
     return (bool) table->exists[dd_hash(key, table->size)];
 }
 
-double ddtable_check_get_set(ddtable_t table, const double key, d2dfun cb)
+static inline double dd_check_get_set(ddtable_t table,
+                                      const double key,
+                                      const uint64_t indx,
+                                      d2dfun cb)
 {
-    const uint64_t indx = dd_hash(key, table->size);
     const uint64_t indx_s = indx << 1;
     if (table->exists[indx])
     {
         const double val = table->key_vals[indx_s + 1];
         if (val == DDTABLE_NULL_VAL || table->key_vals[indx_s] != key)
         {
-#if DEBUG
-            table->_ddtable_collisions++;
-#endif
+            DD_COUNT(table, collisions);
             return cb(key);
         } else {
-#if DEBUG
-            table->_ddtable_hits++;
-#endif            
+            DD_COUNT(table, hits);
             return val;
         }
     } else {
-#if DEBUG
-        table->_ddtable_misses++;
-#endif          
+        DD_COUNT(table, misses);
         const double val = cb(key);
         table->exists[indx] = (int_fast8_t) 1;
         table->key_vals[indx_s] = key;
@@ -438,4 +814,35 @@ double ddtable_check_get_set(ddtable_t table, const double key, d2dfun cb)
     }
 }
 
+#endif /* DDTABLE_OPEN_ADDRESSING */
+
+double ddtable_check_get_set(ddtable_t table, const double key, d2dfun cb)
+{
+    return dd_check_get_set(table, key, dd_hash(key, table->size), cb);
+}
+
+void ddtable_get_many(ddtable_t table,
+                      const uint64_t n,
+                      const double* restrict keys,
+                      double* restrict vals,
+                      d2dfun cb)
+{
+    uint64_t indx[DDTABLE_BATCH];
+    for (uint64_t start = 0; start < n; start += DDTABLE_BATCH)
+    {
+        const uint64_t len = (n - start < DDTABLE_BATCH) ? n - start : DDTABLE_BATCH;
+
+        // Issue every load of the batch before waiting on any of them
+        for (uint64_t i = 0; i < len; i++)
+        {
+            indx[i] = dd_hash(keys[start + i], table->size);
+            dd_prefetch(table, indx[i]);
+        }
+        for (uint64_t i = 0; i < len; i++)
+        {
+            vals[start + i] = dd_check_get_set(table, keys[start + i], indx[i], cb);
+        }
+    }
+}
+
 #undef DEBUG
@@ -1,6 +1,7 @@
 #ifndef DDTABLE_H
 #define DDTABLE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -26,10 +27,88 @@
 //! Double-to-Double function pointer for callbacks.
 typedef double (*d2dfun) (const double d);
 
+/*
+ * Define DDTABLE_OPEN_ADDRESSING to resolve collisions by linear probing over
+ * cache-line buckets instead of keeping a single slot per hash index. Each
+ * bucket holds DDTABLE_BUCKET_SLOTS key-value pairs next to their occupancy
+ * count, so a lookup usually touches exactly one cache line.
+ */
+/*
+ * Define DDTABLE_CONCURRENT to make one table safe to share between threads
+ * (implies DDTABLE_OPEN_ADDRESSING). Each bucket then carries a sequence
+ * number: writers take it with a compare-and-swap and bump it again when
+ * done, readers retry if it changed under them, so a lookup never returns a
+ * key-value pair torn between two writers. Writers never wait on a busy
+ * bucket to cache a value; the value is computed and returned uncached.
+ */
+#if defined(DDTABLE_CONCURRENT) && !defined(DDTABLE_OPEN_ADDRESSING)
+#define DDTABLE_OPEN_ADDRESSING
+#endif
+
+#ifdef DDTABLE_OPEN_ADDRESSING
+
+//! Key-value pairs per bucket; with the bucket header this fills 64 bytes
+#define DDTABLE_BUCKET_SLOTS 3
+
+//! Buckets probed past the home bucket before giving up on caching a key
+#ifndef DDTABLE_MAX_PROBE
+#define DDTABLE_MAX_PROBE 8
+#endif
+
+//! One cache line of key-value pairs; slots fill in order and are never freed
+struct ddtable_bucket
+{
+    //! Number of occupied slots (the first num_used are valid)
+    uint64_t num_used;
+#ifdef DDTABLE_CONCURRENT
+    //! Odd while a writer holds the bucket
+    uint64_t seq;
+#endif
+    struct
+    {
+        double key;
+        double val;
+    } slots[DDTABLE_BUCKET_SLOTS];
+} __attribute__((aligned(64)));
+
+#endif /* DDTABLE_OPEN_ADDRESSING */
+
+//! Keys hashed and prefetched ahead of lookup by ddtable_get_many
+#ifndef DDTABLE_BATCH
+#define DDTABLE_BATCH 16
+#endif
+
+//! Lookup counters, kept in every build
+struct ddtable_stats
+{
+    //! Lookups that found their key
+    uint64_t hits;
+    //! Lookups that did not find their key (and cached it, if asked to)
+    uint64_t misses;
+    //! Lookups or insertions whose slot was taken by another key
+    uint64_t collisions;
+};
+
+#ifdef DDTABLE_CONCURRENT
+//! Counter shards, so threads do not contend on one cache line
+#ifndef DDTABLE_STAT_SHARDS
+#define DDTABLE_STAT_SHARDS 16
+#endif
+
+struct ddtable_stat_shard
+{
+    struct ddtable_stats stats;
+} __attribute__((aligned(64)));
+#endif /* DDTABLE_CONCURRENT */
+
 //! Hash table for double-valued key-value pairs.
 typedef struct ddtable
 {
-#ifdef DEBUG
+#ifdef DDTABLE_CONCURRENT
+    //! Counters, summed over shards by ddtable_get_stats
+    struct ddtable_stat_shard* restrict shards;
+#else
+    //! Counters; approximate if the table is shared between threads
     uint64_t _ddtable_hits;
     uint64_t _ddtable_misses;
     uint64_t _ddtable_collisions;
@@ -38,10 +117,15 @@ typedef struct ddtable
     uint64_t num_kv_pairs;
     //! Internal size used for hashing
     uint64_t size;
+#ifdef DDTABLE_OPEN_ADDRESSING
+    //! Bucket array, size + 1 buckets long
+    struct ddtable_bucket* restrict buckets;
+#else
     //! Fast-checker for key existence
     int_fast8_t* restrict exists;
     //! Single-alloc array for kv pairs
     double* restrict key_vals;
+#endif
 } *ddtable_t;
 
 /**
@@ -59,6 +143,13 @@ typedef struct ddtable
  */
 extern ddtable_t ddtable_new(const uint64_t num_keys);
 
+/**
+ * @brief Bytes ddtable_new allocates for the given number of keys.
+ *
+ * @param num_keys Minimum number of keys the table would be allocated for.
+ */
+extern size_t ddtable_footprint(const uint64_t num_keys);
+
 /**
  * @brief Frees an allocated hash table.
  *
@@ -78,8 +169,7 @@ extern void ddtable_free(ddtable_t table);
  * 
  * @see get_check_key
  */
-extern double ddtable_get_val(ddtable_t table,
-                              const double key) __attribute__((pure));
+extern double ddtable_get_val(ddtable_t table, const double key);
 
 /**
  * @brief Check if key-value pair has been assigned for the given key.
@@ -105,8 +195,7 @@ extern bool ddtable_check_key(ddtable_t table,
  *
  * @see get_val
  */
-extern double ddtable_get_check_key(ddtable_t table,
-                                    const double key) __attribute__((pure));
+extern double ddtable_get_check_key(ddtable_t table, const double key);
 
 /**
  * @brief Add the given key-value pair to the given hash table.
@@ -160,5 +249,35 @@ extern void ddtable_clobber_val(ddtable_t table,
 extern double ddtable_check_get_set(ddtable_t table,
                                     const double key,
                                     d2dfun cb);
+
+/**
+ * @brief Batched ddtable_check_get_set over a vector of keys.
+ *
+ * Hashes up to DDTABLE_BATCH keys at a time and prefetches their slots
+ * before looking any of them up, so the cache misses of a batch overlap
+ * instead of being paid one after another.
+ *
+ * @param table Hash table to operate on
+ * @param n Number of keys
+ * @param keys Keys to retrieve values for
+ * @param vals Output, vals[i] is the value corresponding to keys[i]
+ * @param cb Side-effect-free function callback to calculate value from key
+ *
+ * @see ddtable_check_get_set
+ */
+extern void ddtable_get_many(ddtable_t table,
+                             const uint64_t n,
+                             const double* restrict keys,
+                             double* restrict vals,
+                             d2dfun cb);
+
+/**
+ * @brief Current lookup counters of the given table.
+ *
+ * @param table Hash table to report on
+ *
+ * @returns hit, miss and collision counts since the table was created
+ */
+extern struct ddtable_stats ddtable_get_stats(const ddtable_t table);
 #undef restrict
 #endif
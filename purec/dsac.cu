@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
@@ -8,6 +12,7 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 
 #ifdef CUDA
 #include <vector_types.h>
@@ -31,6 +36,24 @@ extern "C" {
 #include "HHSpikeGABAAMechanism.h"
 #include "DCCurrentMech.h"
 #include "mmq.h"
+#include "thread_barrier.h"
+#include "cell_sched.h"
+#include "spike_events.h"
+#include "hh_rate_table.h"
+#include "vm_recorder.h"
+#include "synapse_table.h"
+#ifdef HH_SOA
+#include "hh_soa.h"
+#endif
+#ifdef ADAPTIVE_STEP
+#include "adaptive_step.h"
+#endif
+#ifdef SECTIONS
+#include "section.h"
+#endif
+#ifdef ENSEMBLE
+#include "ensemble.h"
+#endif
     
 #ifdef __cplusplus
 }
@@ -64,6 +87,11 @@ double _exp(double y)
 #endif
 #endif
 
+#ifdef SYNAPSE_TABLE
+//! GABA-a synapses of the network, in place of mechanism objects
+static synapse_table_t network_synapses = NULL;
+#endif /* SYNAPSE_TABLE */
+
 static void* new_dsac_soma(unsigned int id,
                            int64_t* connect_to,
                            bool stimulate,
@@ -94,7 +122,14 @@ static void* new_dsac_soma(unsigned int id,
         {
             continue;
         }
-            
+
+#ifdef SYNAPSE_TABLE
+        assert(0 == synapse_table_add(network_synapses,
+                                      id,
+                                      connect_to[i],
+                                      GABA_G_MAX,
+                                      GABA_DELAY_STEPS));
+#else
         void* hh_GABA_a_curr_mech = myriad_new(HHSpikeGABAAMechanism,
                                                connect_to[i],
                                                GABA_VM_THRESH,
@@ -103,7 +138,10 @@ static void* new_dsac_soma(unsigned int id,
                                                GABA_TAU_ALPHA,
                                                GABA_TAU_BETA,
                                                GABA_REV);
+        // Slow synapses need not be recomputed every step
+        ((struct Mechanism*) hh_GABA_a_curr_mech)->update_every = GABA_UPDATE_EVERY;
         assert(0 == add_mechanism(hh_comp_obj, hh_GABA_a_curr_mech));
+#endif
         // DEBUG_PRINTF("GABA synapse from ID# %" PRIi64 " -> #ID %i\n",
         //              connect_to[i],
         //              id);
@@ -112,6 +150,22 @@ static void* new_dsac_soma(unsigned int id,
 	return hh_comp_obj;
 }
 
+#ifdef SECTIONS
+//! Dendritic trees of the network's cells, soma first
+static section_tree_t network_sections = NULL;
+
+//! Passive dendritic compartment, coupled to its cell's soma through the tree
+static void* new_dsac_dendrite(unsigned int id)
+{
+	void* hh_comp_obj = myriad_new(HHSomaCompartment, id, 0, NULL, NULL, INIT_VM, CM);
+	void* hh_leak_mech = myriad_new(HHLeakMechanism, id, G_LEAK, E_REV);
+
+	assert(0 == add_mechanism(hh_comp_obj, hh_leak_mech));
+
+	return hh_comp_obj;
+}
+#endif /* SECTIONS */
+
 #ifndef MYRIAD_ALLOCATOR
 static ssize_t calc_total_size(int* num_allocs) __attribute__((unused));
 #endif
@@ -137,15 +191,16 @@ static ssize_t calc_total_size(int* num_allocs)
     total_size += sizeof(struct HHLeakMechanism) * NUM_CELLS;
     total_size += sizeof(struct HHNaCurrMechanism) * NUM_CELLS;
     total_size += sizeof(struct HHKCurrMechanism) * NUM_CELLS;
+    *num_allocs = *num_allocs + (6 * NUM_CELLS);
+#ifndef SYNAPSE_TABLE
     total_size += sizeof(struct HHSpikeGABAAMechanism) * NUM_CELLS * NUM_CELLS;
-    *num_allocs = *num_allocs + (6 * NUM_CELLS) + (NUM_CELLS * NUM_CELLS);
+    *num_allocs = *num_allocs + (NUM_CELLS * NUM_CELLS);
+#endif
 
     // DDTABLE
     #ifdef USE_DDTABLE
     *num_allocs = *num_allocs + 1;
-    total_size += sizeof(struct ddtable);
-    total_size += sizeof(int_fast8_t) * DDTABLE_NUM_KEYS;
-    total_size += 2 * sizeof(double) * DDTABLE_NUM_KEYS;
+    total_size += ddtable_footprint(DDTABLE_NUM_KEYS);
     #endif
     
     return total_size;
@@ -155,52 +210,389 @@ static ssize_t calc_total_size(int* num_allocs)
 ddtable_t exp_table = NULL;
 #endif /* USE_DDTABLE */
 
-#if NUM_THREADS > 1
+#ifdef HH_SOA
+//! Per-type state arrays for Leak/Na/K mechanisms of the network
+static hh_soa_t hh_soa = NULL;
+#endif /* HH_SOA */
+
+#ifdef ADAPTIVE_STEP
+//! Per-cell step sizes of the network
+static adaptive_step_t network_stepper = NULL;
+
+//! Advances cell i of the network to curr_step if it is due or has input
+static inline void step_cell_adaptive(void** network,
+                                      const uint64_t i,
+                                      const double curr_time,
+                                      const uint64_t curr_step)
+{
+    struct HHSomaCompartment* comp = (struct HHSomaCompartment*) network[i];
+    const double prev_vm = HHSOMA_VM(comp, curr_step - 1);
+    const bool event = synapse_table_pending(network_synapses, network_spikes, i, curr_step);
+
+    if (!event && !adaptive_step_due(network_stepper, i, curr_step))
+    {
+        // Hold voltage: no mechanisms and a zero-length step
+        HHSomaCompartment_integrate(comp, network, 0.0, 0.0, comp->_.num_mechs, 0.0,
+                                    curr_time, curr_step);
+        return;
+    }
+
+    const double h = adaptive_step_size(network_stepper, i, curr_step);
+    hh_soa_step_cell(hh_soa, network, i, h, curr_step);
+    double I_ext = hh_soa->i_ion[i], G_ext = 0.0;
+#ifdef HH_IMPLICIT_VM
+    G_ext = hh_soa->g_ion[i];
+#endif
+    I_ext += synapse_table_step(network_synapses, network_spikes, i, prev_vm, curr_time, curr_step);
+    HHSomaCompartment_integrate(comp,
+                                network,
+                                I_ext,
+                                G_ext,
+                                hh_soa->num_owned[i],
+                                h,
+                                curr_time,
+                                curr_step);
+
+    adaptive_step_update(network_stepper, i, curr_step, prev_vm, HHSOMA_VM(comp, curr_step), event);
+}
+#endif /* ADAPTIVE_STEP */
+
+#ifdef ENSEMBLE
+//! Parameter variants of the network, stepped in lockstep
+static ensemble_t network_ensemble = NULL;
+
+/**
+ * Reads the per-lane values of a parameter from a comma-separated environment
+ * variable, which must give exactly one per lane. If it is unset every lane
+ * is NAN, i.e. keeps the base value.
+ */
+static int ensemble_values(const char* name, double* values)
+{
+    const char* pos = getenv(name);
+    if (pos == NULL || *pos == '\0')
+    {
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            values[l] = NAN;
+        }
+        return 0;
+    }
+
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        char* end = NULL;
+        values[l] = strtod(pos, &end);
+        if (end == pos || (l + 1 < ENSEMBLE_LANES ? *end != ',' : *end != '\0'))
+        {
+            fprintf(stderr, "%s needs %d comma-separated values: %s\n",
+                    name, ENSEMBLE_LANES, getenv(name));
+            return -1;
+        }
+        pos = end + 1;
+    }
+    return 0;
+}
+
+//! Per-lane value of a parameter, or its base value if the lane has none
+static inline double ensemble_value(const double lane_value, const double base)
+{
+    return isnan(lane_value) ? base : lane_value;
+}
+#endif /* ENSEMBLE */
+
+//! Advances cells [start, end) of the network by one step
+static inline void step_cells(void** network,
+                              const uint64_t start,
+                              const uint64_t end,
+                              const double curr_time,
+                              const uint64_t curr_step)
+{
+#if defined(ADAPTIVE_STEP)
+#pragma GCC ivdep
+    for (uint64_t i = start; i < end; i++)
+    {
+        step_cell_adaptive(network, i, curr_time, curr_step);
+    }
+#elif defined(ENSEMBLE)
+    ensemble_step(network_ensemble, network, start, end, curr_time, curr_step);
+#elif defined(SECTIONS)
+    // Each cell is advanced whole by whoever owns its soma
+    const uint64_t first_soma =
+        (start + SECTION_NUM_COMPS - 1) / SECTION_NUM_COMPS * SECTION_NUM_COMPS;
+    for (uint64_t i = first_soma; i < end; i += SECTION_NUM_COMPS)
+    {
+        hh_soa_step(hh_soa, network, i, i + SECTION_NUM_COMPS, curr_step);
+#ifdef SYNAPSE_TABLE
+        hh_soa->i_ion[i] += synapse_table_step(network_synapses,
+                                               network_spikes,
+                                               i,
+                                               HHSOMA_VM((struct HHSomaCompartment*) network[i], curr_step - 1),
+                                               curr_time,
+                                               curr_step);
+#endif
+        const double* G_ext = NULL;
+#ifdef HH_IMPLICIT_VM
+        G_ext = hh_soa->g_ion;
+#endif
+        section_tree_step(network_sections,
+                          network,
+                          i / SECTION_NUM_COMPS,
+                          hh_soa->i_ion,
+                          G_ext,
+                          hh_soa->num_owned,
+                          DT,
+                          curr_time,
+                          curr_step);
+    }
+#elif defined(HH_SOA) || defined(SYNAPSE_TABLE)
+#ifdef HH_SOA
+    hh_soa_step(hh_soa, network, start, end, curr_step);
+#endif
+#pragma GCC ivdep
+    for (uint64_t i = start; i < end; i++)
+    {
+        // Currents computed outside the objects, and mechanisms they cover
+        double I_ext = 0.0, G_ext = 0.0;
+        uint64_t first_mech = 0;
+#ifdef HH_SOA
+        I_ext = hh_soa->i_ion[i];
+        first_mech = hh_soa->num_owned[i];
+#endif
+#ifdef HH_IMPLICIT_VM
+        G_ext = hh_soa->g_ion[i];
+#endif
+#ifdef SYNAPSE_TABLE
+        I_ext += synapse_table_step(network_synapses,
+                                    network_spikes,
+                                    i,
+                                    HHSOMA_VM((struct HHSomaCompartment*) network[i], curr_step - 1),
+                                    curr_time,
+                                    curr_step);
+#endif
+        HHSomaCompartment_integrate(network[i],
+                                    network,
+                                    I_ext,
+                                    G_ext,
+                                    first_mech,
+                                    DT,
+                                    curr_time,
+                                    curr_step);
+    }
+#else
+#pragma GCC ivdep
+    for (uint64_t i = start; i < end; i++)
+    {
+        simul_fxn(network[i], network, curr_time, curr_step);
+    }
+#endif /* ADAPTIVE_STEP, ENSEMBLE, SECTIONS, HH_SOA || SYNAPSE_TABLE */
+}
+
+#ifdef VM_RECORDER
+#ifdef ENSEMBLE
+//! One trace per ensemble lane, in place of network_recorder
+static vm_recorder_t lane_recorders[ENSEMBLE_LANES] = {NULL};
+#endif
+
+/**
+ * Starts streaming voltage traces, configured from the environment:
+ * - MYRIAD_RECORD: output file (default vm_trace.dat), with ".<lane>"
+ *   appended for an ensemble lane (lane >= 0);
+ * - MYRIAD_RECORD_EVERY: record every this many steps (default 1);
+ * - MYRIAD_RECORD_CELLS: comma-separated cell IDs (default all cells).
+ */
+static vm_recorder_t new_recorder(const int lane)
+{
+    const char* path_env = getenv("MYRIAD_RECORD");
+    const char* path = path_env != NULL ? path_env : "vm_trace.dat";
+    const char* every_env = getenv("MYRIAD_RECORD_EVERY");
+    const char* cells_env = getenv("MYRIAD_RECORD_CELLS");
+    const uint64_t every = every_env != NULL ? strtoull(every_env, NULL, 10) : 1;
+
+    uint64_t* cells = (uint64_t*) malloc(NUM_CELLS * sizeof(uint64_t));
+    uint64_t num_cells = 0;
+    if (cells == NULL)
+    {
+        return NULL;
+    }
+    if (cells_env == NULL)
+    {
+        for (uint64_t i = 0; i < NUM_CELLS; i++)
+        {
+            cells[num_cells++] = i;
+        }
+    } else {
+        const char* pos = cells_env;
+        char* end = NULL;
+        while (*pos != '\0' && num_cells < NUM_CELLS)
+        {
+            const uint64_t id = strtoull(pos, &end, 10);
+            if (end == pos || id >= NUM_CELLS)
+            {
+                fprintf(stderr, "Invalid cell ID in MYRIAD_RECORD_CELLS: %s\n", pos);
+                free(cells);
+                return NULL;
+            }
+            cells[num_cells++] = id;
+            pos = *end == ',' ? end + 1 : end;
+        }
+    }
+
+    char lane_path[strlen(path) + 16];
+    if (lane >= 0)
+    {
+        snprintf(lane_path, sizeof(lane_path), "%s.%d", path, lane);
+        path = lane_path;
+    }
+
+    vm_recorder_t rec = vm_recorder_new(path,
+                                        cells,
+                                        num_cells,
+                                        every,
+                                        0,
+                                        DT);
+    free(cells);
+    return rec;
+}
+
+#if defined(ENSEMBLE) && defined(MYRIAD_THREADED)
+//! Whether any lane keeps curr_step (same answer on every thread)
+static bool record_due(const uint64_t curr_step)
+{
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        if (vm_recorder_due(lane_recorders[l], curr_step))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+#endif /* ENSEMBLE && MYRIAD_THREADED */
+
+/**
+ * Records the voltages of curr_step, if due. Must only be called by one
+ * thread at a time, after every cell has finished the step.
+ */
+static void record_step(void** network, const uint64_t curr_step)
+{
+#ifdef ENSEMBLE
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        if (vm_recorder_due(lane_recorders[l], curr_step))
+        {
+            vm_recorder_sample_values(lane_recorders[l], network_ensemble->vm + l, ENSEMBLE_LANES);
+        }
+    }
+#else
+    if (vm_recorder_due(network_recorder, curr_step))
+    {
+        vm_recorder_sample(network_recorder, network, curr_step);
+    }
+#endif /* ENSEMBLE */
+}
+#endif /* VM_RECORDER */
+
+#ifdef MYRIAD_THREADED
 struct _pthread_vals
 {
     void** network;
-    double curr_time;
-    uint64_t curr_step;
-    uint_fast32_t num_done;
-    pthread_mutex_t barrier_mutx;
-    pthread_cond_t barrier_cv;
+    //! Per-step barrier, implementation picked via MYRIAD_BARRIER
+    thread_barrier_t barrier;
+    //! Cell ranges per worker (MYRIAD_SCHED=static disables re-balancing)
+    cell_sched_t sched;
+    //! Pin each worker to its own CPU (MYRIAD_PIN_THREADS=0 disables)
+    bool pin_threads;
+    //! CPUs we are allowed to run on, in order
+    int cpus[CPU_SETSIZE];
+    int num_cpus;
 } _pthread_vals;
 
-static inline void* _thread_run(void* arg)
+static void* _thread_run(void* arg)
 {
     const int thread_id = (unsigned long int) arg;
-    const int network_indx_start = thread_id * (NUM_CELLS / NUM_THREADS);
-    const int network_indx_end = network_indx_start + (NUM_CELLS / NUM_THREADS) - 1;
-    
-    while(_pthread_vals.curr_step < SIMUL_LEN)
-	{
-#pragma GCC ivdep
-		for (int i = network_indx_start; i < network_indx_end; i++)
-		{
-			simul_fxn(_pthread_vals.network[i],
-                      _pthread_vals.network,
-                      _pthread_vals.curr_time,
-                      _pthread_vals.curr_step);
-		}
-
-        pthread_mutex_lock(&_pthread_vals.barrier_mutx);
-        _pthread_vals.num_done++;
-        if (_pthread_vals.num_done < NUM_THREADS)
+    cell_sched_t* sched = &_pthread_vals.sched;
+    struct cell_sched_worker* me = &sched->workers[thread_id];
+
+    if (_pthread_vals.pin_threads && _pthread_vals.num_cpus > 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(_pthread_vals.cpus[thread_id % _pthread_vals.num_cpus], &cpu_set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) != 0)
         {
-            pthread_cond_wait(&_pthread_vals.barrier_cv,
-                              &_pthread_vals.barrier_mutx);
+            fprintf(stderr, "Could not pin thread %d\n", thread_id);
+        }
+    }
+
+    // Every thread keeps its own clock; the barrier keeps them in lock-step
+    uint32_t local_sense = 0;
+    double curr_time = DT;
+    for (uint64_t curr_step = 1; curr_step < SIMUL_LEN; curr_step++)
+    {
+        const uint64_t network_indx_start = sched->bounds[thread_id];
+        const uint64_t network_indx_end = sched->bounds[thread_id + 1];
+
+        const double t_start = cell_sched_now_ns();
+        if (cell_sched_sampling(curr_step))
+        {
+            // Time cells one at a time so the next cut reflects real cost
+            for (uint64_t i = network_indx_start; i < network_indx_end; i++)
+            {
+                const double t_cell = cell_sched_now_ns();
+                step_cells(_pthread_vals.network, i, i + 1, curr_time, curr_step);
+                cell_sched_record_cell(sched, i, cell_sched_now_ns() - t_cell);
+            }
         } else {
-            _pthread_vals.curr_step++;
-            _pthread_vals.curr_time += DT;
-            _pthread_vals.num_done = 0;
-            pthread_cond_broadcast(&_pthread_vals.barrier_cv);
+            step_cells(_pthread_vals.network,
+                       network_indx_start,
+                       network_indx_end,
+                       curr_time,
+                       curr_step);
         }
-        pthread_mutex_unlock(&_pthread_vals.barrier_mutx);
-	}
+        const double t_busy = cell_sched_now_ns() - t_start;
+        me->busy_ns += t_busy;
+        me->interval_ns += t_busy;
+        curr_time += DT;
+
+        thread_barrier_wait(&_pthread_vals.barrier, &local_sense);
+
+#ifdef VM_RECORDER
+#ifdef ENSEMBLE
+        // Lane voltages are overwritten in place by the next step, so hold
+        // everyone at a second barrier until thread 0 has copied them out
+        if (record_due(curr_step))
+        {
+            if (thread_id == 0)
+            {
+                record_step(_pthread_vals.network, curr_step);
+            }
+            thread_barrier_wait(&_pthread_vals.barrier, &local_sense);
+        }
+#else
+        // Every cell is done with this step, and the next one appends to the
+        // HHSOMA_VM ring instead of overwriting it, so the voltages we read
+        // stay put while the other threads run ahead
+        if (thread_id == 0)
+        {
+            record_step(_pthread_vals.network, curr_step);
+        }
+#endif /* ENSEMBLE */
+#endif /* VM_RECORDER */
+
+        // Re-cut ranges while everyone is parked at a second barrier
+        if (cell_sched_due(curr_step))
+        {
+            if (thread_id == 0)
+            {
+                cell_sched_rebalance(sched);
+            }
+            thread_barrier_wait(&_pthread_vals.barrier, &local_sense);
+        }
+    }
 
     return NULL;
 }
-#endif /* NUM_THREADS > 1 */
+#endif /* MYRIAD_THREADED */
 
 static int dsac()
 {
@@ -215,6 +607,20 @@ static int dsac()
     exp_table = ddtable_new(DDTABLE_NUM_KEYS);
 #endif /* USE_DDTABLE */
 
+#ifdef HH_RATE_TABLE
+    rate_table = hh_rate_table_new(HH_RATE_TABLE_VM_MIN, HH_RATE_TABLE_VM_MAX, HH_RATE_TABLE_DVM);
+    if (rate_table == NULL)
+    {
+        fputs("Could not build channel rate tables\n", stderr);
+        return -1;
+    }
+    const double rate_err = hh_rate_table_validate(rate_table);
+    if (!(rate_err <= HH_RATE_TABLE_REL_TOL))
+    {
+        fprintf(stderr, "Warning: channel rate tables off by up to %g (relative)\n", rate_err);
+    }
+#endif /* HH_RATE_TABLE */
+
 #ifdef CUDA
     const bool use_cuda = true;
 #else
@@ -230,21 +636,74 @@ static int dsac()
 	initHHSpikeGABAAMechanism(use_cuda);
 	initHHSomaCompartment(use_cuda);
 
-	void* network[NUM_CELLS];
-    
+    // NUM_CELLS may be a runtime value, so keep these off the stack
+    void** network = (void**) calloc(NUM_CELLS, sizeof(void*));
     const unsigned int num_connxs = NUM_CELLS;
-    int64_t to_connect[num_connxs];
+    int64_t* to_connect = (int64_t*) malloc(num_connxs * sizeof(int64_t));
+    if (network == NULL || to_connect == NULL)
+    {
+        fputs("Could not allocate the network\n", stderr);
+        free(network);
+        free(to_connect);
+        return -1;
+    }
+
+#ifdef SYNAPSE_TABLE
+    network_synapses = synapse_table_new(NUM_CELLS,
+                                         (uint64_t) NUM_CELLS * (NUM_CELLS - 1),
+                                         GABA_TAU_ALPHA,
+                                         GABA_TAU_BETA,
+                                         GABA_REV);
+    if (network_synapses == NULL)
+    {
+        fputs("Could not allocate synapse table\n", stderr);
+        return -1;
+    }
+#endif /* SYNAPSE_TABLE */
+
+#ifdef SECTIONS
+    // Every SECTION_NUM_COMPS compartments are one cell: a soma, then a
+    // passive dendrite that branches in two at every compartment.
+    if (NUM_CELLS % SECTION_NUM_COMPS != 0)
+    {
+        fputs("NUM_CELLS must be a multiple of SECTION_NUM_COMPS\n", stderr);
+        return -1;
+    }
+    network_sections = section_tree_new(NUM_CELLS / SECTION_NUM_COMPS, NUM_CELLS);
+    if (network_sections == NULL)
+    {
+        fputs("Could not allocate section trees\n", stderr);
+        return -1;
+    }
+    for (unsigned int my_id = 0; my_id < NUM_CELLS; my_id++)
+    {
+        const int64_t k = my_id % SECTION_NUM_COMPS;
+        assert(k == section_tree_add(network_sections,
+                                     my_id / SECTION_NUM_COMPS,
+                                     my_id,
+                                     k == 0 ? SECTION_NO_PARENT : (k - 1) / 2,
+                                     SECTION_G_AXIAL));
+        if (k != 0)
+        {
+            network[my_id] = new_dsac_dendrite(my_id);
+        }
+    }
+    section_tree_finish(network_sections);
+    const unsigned int soma_every = SECTION_NUM_COMPS;
+#else
+    const unsigned int soma_every = 1;
+#endif /* SECTIONS */
 
-	for (unsigned int my_id = 0; my_id < NUM_CELLS; my_id++)
+	for (unsigned int my_id = 0; my_id < NUM_CELLS; my_id += soma_every)
 	{
         memset(to_connect, 0, sizeof(int64_t) * num_connxs);
         
-		// All-to-All
-        for (int64_t j = 0; j < NUM_CELLS; j++)
+		// All-to-All, between somata
+        for (int64_t j = 0; j < (int64_t) NUM_CELLS; j++)
         {
-            if (j == my_id)
+            if (j == my_id || j % soma_every != 0)
             {
-                to_connect[j] = -1;  // Don't connect to ourselves
+                to_connect[j] = -1;  // Don't connect to ourselves or dendrites
             } else {
                 to_connect[j] = j;   // Connect to cell j
             }
@@ -257,52 +716,252 @@ static int dsac()
                                        stimulate,
                                        num_connxs);
 	}
+    free(to_connect);
+#ifdef SYNAPSE_TABLE
+    synapse_table_finish(network_synapses);
+#endif
+
+#if defined(SPIKE_EVENTS) && !defined(ENSEMBLE)
+    // Cells record their own spikes; synapses test a bit instead of polling.
+    // Delayed synapses look that many steps further back.
+#ifdef SYNAPSE_TABLE
+    const uint64_t spike_history = (uint64_t) network_synapses->max_delay + 2;
+#else
+    // Synapses updated every GABA_UPDATE_EVERY steps look back that far
+    const uint64_t spike_history = GABA_UPDATE_EVERY + 1;
+#endif
+    network_spikes = spike_events_new(NUM_CELLS, GABA_VM_THRESH, spike_history);
+    if (network_spikes == NULL)
+    {
+        fputs("Could not allocate spike event bitmaps\n", stderr);
+        return -1;
+    }
+#endif /* SPIKE_EVENTS */
 
-#if NUM_THREADS > 1
-    // Pthread parallelism
-    pthread_t _threads[NUM_THREADS];
+#ifdef HH_SOA
+    hh_soa = hh_soa_new(network, NUM_CELLS);
+    if (hh_soa == NULL)
+    {
+        fputs("Could not allocate SoA mechanism state\n", stderr);
+        return -1;
+    }
+#endif /* HH_SOA */
 
-    // Initialize global pthread values
-    _pthread_vals.network = network;
-    _pthread_vals.curr_time = DT;
-    _pthread_vals.curr_step = 1;
-    _pthread_vals.num_done = 0;
-    pthread_mutex_init(&_pthread_vals.barrier_mutx, NULL);
-    pthread_cond_init(&_pthread_vals.barrier_cv, NULL);
+#ifdef ENSEMBLE
+    // Lanes keep their own spike events, so network_spikes stays NULL
+    double lane_g_na[ENSEMBLE_LANES], lane_g_k[ENSEMBLE_LANES], lane_gaba_g_max[ENSEMBLE_LANES];
+    if (ensemble_values("MYRIAD_ENSEMBLE_G_NA", lane_g_na) ||
+        ensemble_values("MYRIAD_ENSEMBLE_G_K", lane_g_k) ||
+        ensemble_values("MYRIAD_ENSEMBLE_GABA_G_MAX", lane_gaba_g_max))
+    {
+        return -1;
+    }
+    network_ensemble = ensemble_new(network,
+                                    hh_soa,
+                                    network_synapses,
+                                    GABA_VM_THRESH,
+                                    lane_g_na,
+                                    lane_g_k,
+                                    lane_gaba_g_max);
+    if (network_ensemble == NULL)
+    {
+        fputs("Could not allocate ensemble lanes\n", stderr);
+        return -1;
+    }
+#endif /* ENSEMBLE */
 
-    for(unsigned long int i = 0; i < NUM_THREADS; ++i)
+#ifdef ADAPTIVE_STEP
+    network_stepper = adaptive_step_new(NUM_CELLS, ADAPTIVE_STEP_TOL, ADAPTIVE_STEP_MAX_STRIDE);
+    if (network_stepper == NULL)
     {
-        if(pthread_create(&_threads[i], NULL, &_thread_run, (void*) i))
+        fputs("Could not allocate adaptive step control\n", stderr);
+        return -1;
+    }
+    // Stimuli are outside the SoA engine, so cells must be told when they switch
+    for (uint64_t i = 0; i < NUM_CELLS; i++)
+    {
+        const struct Compartment* comp = (const struct Compartment*) network[i];
+        for (uint64_t j = 0; j < comp->num_mechs; j++)
         {
-            fprintf(stderr, "Could not create thread %lu\n", i);
-            return -1;
+            const struct DCCurrentMech* dc = (const struct DCCurrentMech*) comp->my_mechs[j];
+            if (!myriad_is_a(dc, DCCurrentMech) || dc->amplitude == 0.0)
+            {
+                continue;
+            }
+            if (adaptive_step_add_change(network_stepper, i, dc->t_start) != 0 ||
+                adaptive_step_add_change(network_stepper, i, dc->t_stop + 1) != 0)
+            {
+                fputs("Too many stimulus changes for adaptive step control\n", stderr);
+                return -1;
+            }
         }
     }
-    for(int i = 0; i < NUM_THREADS; ++i)
+#endif /* ADAPTIVE_STEP */
+
+#ifdef VM_RECORDER
+#ifdef ENSEMBLE
+    for (int l = 0; l < ENSEMBLE_LANES; l++)
     {
-        if(pthread_join(_threads[i], NULL))
+        lane_recorders[l] = new_recorder(l);
+        if (lane_recorders[l] == NULL)
         {
-            fprintf(stderr, "Could not join thread %d\n", i);
+            fprintf(stderr, "Could not start voltage trace recording of lane %d\n", l);
             return -1;
         }
     }
 #else
-    double current_time = DT;
-    for (uint_fast64_t curr_step = 1; curr_step < SIMUL_LEN; curr_step++)
+    network_recorder = new_recorder(-1);
+    if (network_recorder == NULL)
     {
-#pragma GCC ivdep
-        for (uint_fast64_t i = 0; i < NUM_CELLS; i++)
+        fputs("Could not start voltage trace recording\n", stderr);
+        return -1;
+    }
+#endif /* ENSEMBLE */
+    record_step(network, 0);
+#endif /* VM_RECORDER */
+
+#ifdef MYRIAD_THREADED
+    if (NUM_THREADS > 1)
+    {
+        // Pthread parallelism; the main thread doubles as worker 0
+        pthread_t _threads[NUM_THREADS];
+
+        _pthread_vals.network = network;
+        const char* pin_env = getenv("MYRIAD_PIN_THREADS");
+        _pthread_vals.pin_threads = pin_env == NULL || strcmp(pin_env, "0") != 0;
+        _pthread_vals.num_cpus = 0;
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &allowed))
+                {
+                    _pthread_vals.cpus[_pthread_vals.num_cpus++] = cpu;
+                }
+            }
+        }
+        if (thread_barrier_init(&_pthread_vals.barrier,
+                                thread_barrier_type_from_str(getenv("MYRIAD_BARRIER")),
+                                NUM_THREADS) != 0)
+        {
+            fputs("Could not initialize thread barrier\n", stderr);
+            return -1;
+        }
+        const char* sched_env = getenv("MYRIAD_SCHED");
+        if (cell_sched_init(&_pthread_vals.sched,
+                            NUM_CELLS,
+                            NUM_THREADS,
+                            sched_env == NULL || strcmp(sched_env, "static") != 0) != 0)
+        {
+            fputs("Could not initialize cell scheduler\n", stderr);
+            return -1;
+        }
+
+        for(unsigned long int i = 1; i < NUM_THREADS; ++i)
+        {
+            if(pthread_create(&_threads[i], NULL, &_thread_run, (void*) i))
+            {
+                fprintf(stderr, "Could not create thread %lu\n", i);
+                return -1;
+            }
+        }
+        _thread_run((void*) 0);
+        for(unsigned long int i = 1; i < NUM_THREADS; ++i)
         {
-            simul_fxn(network[i], network, current_time, curr_step);
+            if(pthread_join(_threads[i], NULL))
+            {
+                fprintf(stderr, "Could not join thread %lu\n", i);
+                return -1;
+            }
+        }
+        thread_barrier_destroy(&_pthread_vals.barrier);
+        cell_sched_report(&_pthread_vals.sched, stdout);
+        cell_sched_free(&_pthread_vals.sched);
+    } else
+#endif /* MYRIAD_THREADED */
+    {
+        double current_time = DT;
+        for (uint_fast64_t curr_step = 1; curr_step < SIMUL_LEN; curr_step++)
+        {
+            step_cells(network, 0, NUM_CELLS, current_time, curr_step);
+#ifdef VM_RECORDER
+            record_step(network, curr_step);
+#endif /* VM_RECORDER */
+            current_time += DT;
         }
-        current_time += DT;
     }
-#endif /* NUM_THREADS > 1 */
 
     // Cleanup
+    #ifdef VM_RECORDER
+    #ifdef ENSEMBLE
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        if (vm_recorder_close(lane_recorders[l]) != 0)
+        {
+            fprintf(stderr, "Voltage trace of lane %u was not completely written\n", l);
+        }
+        lane_recorders[l] = NULL;
+    }
+    #endif
+    if (vm_recorder_close(network_recorder) != 0)
+    {
+        fputs("Voltage trace was not completely written\n", stderr);
+    }
+    network_recorder = NULL;
+    #endif
+    #ifdef ENSEMBLE
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        uint64_t lane_spikes = 0;
+        for (uint64_t i = 0; i < NUM_CELLS; i++)
+        {
+            lane_spikes += network_ensemble->num_spikes[i * ENSEMBLE_LANES + l];
+        }
+        printf("Ensemble lane %u: G_NA %g, G_K %g, GABA_G_MAX %g: %" PRIu64 " spikes\n",
+               l,
+               ensemble_value(network_ensemble->lane_g_na[l], G_NA),
+               ensemble_value(network_ensemble->lane_g_k[l], G_K),
+               ensemble_value(network_ensemble->lane_gaba_g_max[l], GABA_G_MAX),
+               lane_spikes);
+    }
+    // Objects are left holding lane 0, as if it had been run alone
+    ensemble_scatter(network_ensemble, 0);
+    ensemble_free(network_ensemble);
+    network_ensemble = NULL;
+    #endif
+    #ifdef ADAPTIVE_STEP
+    printf("Adaptive stepping: %" PRIu64 " cell updates in %" PRIu64 " cell-steps\n",
+           adaptive_step_total(network_stepper),
+           (uint64_t) NUM_CELLS * (SIMUL_LEN - 1));
+    adaptive_step_free(network_stepper);
+    network_stepper = NULL;
+    #endif
+    #ifdef SECTIONS
+    section_tree_free(network_sections);
+    network_sections = NULL;
+    #endif
+    #ifdef SYNAPSE_TABLE
+    synapse_table_free(network_synapses);
+    network_synapses = NULL;
+    #endif
+    #ifdef SPIKE_EVENTS
+    spike_events_free(network_spikes);
+    network_spikes = NULL;
+    #endif
+    #ifdef HH_SOA
+    // Objects are what gets sent to the parent process, so bring them up to date
+    hh_soa_scatter(hh_soa);
+    hh_soa_free(hh_soa);
+    hh_soa = NULL;
+    #endif
     #ifdef USE_DDTABLE
     ddtable_free(exp_table);
     #endif
+    #ifdef HH_RATE_TABLE
+    hh_rate_table_free(rate_table);
+    rate_table = NULL;
+    #endif
 
     // Do IPC with parent python process
     struct mmq_connector conn =
@@ -397,6 +1056,7 @@ static int dsac()
     }
     
     puts("Exited message loop.");
+    free(network);
     
     #ifdef MYRIAD_ALLOCATOR
     assert(myriad_finalize() == 0);
@@ -408,8 +1068,17 @@ static int dsac()
 ///////////////////
 // Main function //
 ///////////////////
-int main()
+int main(int argc, char** argv)
 {
+#ifdef MYRIAD_RUNTIME_PARAMS
+    if (myriad_params_parse_args(&myriad_params, argc, argv) != 0 ||
+        myriad_params_validate(&myriad_params) != 0)
+    {
+        fprintf(stderr, "Usage: %s [--config FILE] [KEY=value ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+#endif
+
     srand(42);
     // puts("Hello World!\n");
 
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "HHSomaCompartment.h"
+#include "HHSpikeGABAAMechanism.h"
+#include "hh_integrate.h"
+#include "hh_kernels.h"
+#include "hh_soa.h"
+#include "spike_events.h"
+#include "synapse_table.h"
+#include "ensemble.h"
+
+//! Alignment of every lane array, so lane loops vectorize cleanly
+#define ENSEMBLE_ALIGN 64
+
+// Zeroed, cache-line aligned array of num instances times ENSEMBLE_LANES.
+static void* _ens_calloc(const uint64_t num, const size_t size)
+{
+    void* ptr = NULL;
+    const size_t len = (num > 0 ? num : 1) * ENSEMBLE_LANES * size;
+    if (posix_memalign(&ptr, ENSEMBLE_ALIGN, len) != 0)
+    {
+        return NULL;
+    }
+    memset(ptr, 0, len);
+    return ptr;
+}
+
+// Copies a per-instance array into every lane, or a lane's own value where
+// it has one (not NAN).
+static void _ens_spread(double* restrict dst,
+                        const double* restrict src,
+                        const uint64_t num,
+                        const double* lane_value)
+{
+    for (uint64_t j = 0; j < num; j++)
+    {
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            const bool own = lane_value != NULL && !isnan(lane_value[l]);
+            dst[j * ENSEMBLE_LANES + l] = own ? lane_value[l] : src[j];
+        }
+    }
+}
+
+ensemble_t ensemble_new(void** network,
+                        const hh_soa_t soa,
+                        const synapse_table_t synapses,
+                        const double vm_thresh,
+                        const double* g_na,
+                        const double* g_k,
+                        const double* gaba_g_max)
+{
+    ensemble_t ens = (ensemble_t) calloc(1, sizeof(struct ensemble));
+    if (ens == NULL)
+    {
+        return NULL;
+    }
+
+    ens->num_cells = soa->num_cells;
+    ens->soa = soa;
+    ens->synapses = synapses;
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        ens->lane_g_na[l] = g_na != NULL ? g_na[l] : NAN;
+        ens->lane_g_k[l] = g_k != NULL ? g_k[l] : NAN;
+        ens->lane_gaba_g_max[l] = gaba_g_max != NULL ? gaba_g_max[l] : NAN;
+    }
+
+    ens->spikes = spike_events_new(ens->num_cells * ENSEMBLE_LANES,
+                                   vm_thresh,
+                                   (uint64_t) synapses->max_delay + 2);
+    ens->vm = (double*) _ens_calloc(ens->num_cells, sizeof(double));
+    ens->num_spikes = (uint64_t*) _ens_calloc(ens->num_cells, sizeof(uint64_t));
+    ens->na_vm = (double*) _ens_calloc(soa->na.num, sizeof(double));
+    ens->g_na = (double*) _ens_calloc(soa->na.num, sizeof(double));
+    ens->e_na = (double*) _ens_calloc(soa->na.num, sizeof(double));
+    ens->hh_m = (double*) _ens_calloc(soa->na.num, sizeof(double));
+    ens->hh_h = (double*) _ens_calloc(soa->na.num, sizeof(double));
+    ens->na_i = (double*) _ens_calloc(soa->na.num, sizeof(double));
+    ens->k_vm = (double*) _ens_calloc(soa->k.num, sizeof(double));
+    ens->g_k = (double*) _ens_calloc(soa->k.num, sizeof(double));
+    ens->e_k = (double*) _ens_calloc(soa->k.num, sizeof(double));
+    ens->hh_n = (double*) _ens_calloc(soa->k.num, sizeof(double));
+    ens->k_i = (double*) _ens_calloc(soa->k.num, sizeof(double));
+    ens->t_fired = (double*) _ens_calloc(synapses->num_syns, sizeof(double));
+    if (!ens->spikes || !ens->vm || !ens->num_spikes || !ens->na_vm || !ens->g_na ||
+        !ens->e_na || !ens->hh_m || !ens->hh_h || !ens->na_i || !ens->k_vm ||
+        !ens->g_k || !ens->e_k || !ens->hh_n || !ens->k_i || !ens->t_fired)
+    {
+        ensemble_free(ens);
+        return NULL;
+    }
+
+    for (uint64_t c = 0; c < ens->num_cells; c++)
+    {
+        const double vm = HHSOMA_VM((const struct HHSomaCompartment*) network[c], 0);
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            ens->vm[c * ENSEMBLE_LANES + l] = vm;
+        }
+    }
+    _ens_spread(ens->g_na, soa->g_na, soa->na.num, ens->lane_g_na);
+    _ens_spread(ens->e_na, soa->e_na, soa->na.num, NULL);
+    _ens_spread(ens->hh_m, soa->hh_m, soa->na.num, NULL);
+    _ens_spread(ens->hh_h, soa->hh_h, soa->na.num, NULL);
+    _ens_spread(ens->g_k, soa->g_k, soa->k.num, ens->lane_g_k);
+    _ens_spread(ens->e_k, soa->e_k, soa->k.num, NULL);
+    _ens_spread(ens->hh_n, soa->hh_n, soa->k.num, NULL);
+    for (uint64_t s = 0; s < synapses->num_syns * ENSEMBLE_LANES; s++)
+    {
+        ens->t_fired[s] = -INFINITY;
+    }
+
+    return ens;
+}
+
+void ensemble_free(ensemble_t ens)
+{
+    if (ens == NULL)
+    {
+        return;
+    }
+    spike_events_free(ens->spikes);
+    free(ens->vm);
+    free(ens->num_spikes);
+    free(ens->na_vm);
+    free(ens->g_na);
+    free(ens->e_na);
+    free(ens->hh_m);
+    free(ens->hh_h);
+    free(ens->na_i);
+    free(ens->k_vm);
+    free(ens->g_k);
+    free(ens->e_k);
+    free(ens->hh_n);
+    free(ens->k_i);
+    free(ens->t_fired);
+    free(ens);
+}
+
+// Lanes of each instance [lo, hi) of a block see their cell's lanes.
+static inline void _ens_gather_vm(const ensemble_t ens,
+                                  const struct hh_soa_block* block,
+                                  double* restrict vm,
+                                  const uint64_t lo,
+                                  const uint64_t hi)
+{
+    for (uint64_t j = lo; j < hi; j++)
+    {
+        const double* restrict src = &ens->vm[block->src[j] * ENSEMBLE_LANES];
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            vm[j * ENSEMBLE_LANES + l] = src[l];
+        }
+    }
+}
+
+// Synaptic current of every lane of a cell, as synapse_table_step per lane.
+static inline void _ens_synapses(ensemble_t ens,
+                                 const uint64_t cell,
+                                 const double* restrict vm,
+                                 const double global_time,
+                                 const uint64_t curr_step,
+                                 double* restrict i_syn)
+{
+    const synapse_table_t table = ens->synapses;
+    double g_sum[ENSEMBLE_LANES] = {0.0};
+    double x[2 * ENSEMBLE_LANES], y[2 * ENSEMBLE_LANES];
+
+    for (uint64_t s = table->first[cell]; s < table->first[cell + 1]; s++)
+    {
+        const uint32_t delay = table->delay[s];
+        const uint64_t src = (uint64_t) table->src[s] * ENSEMBLE_LANES;
+        double* restrict t_fired = &ens->t_fired[s * ENSEMBLE_LANES];
+
+        bool active = false;
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            if (curr_step > delay && spike_events_fired(ens->spikes, src + l, curr_step - 1 - delay))
+            {
+                t_fired[l] = global_time;
+            } else if (global_time - t_fired[l] > HHSPIKEGABAA_DECAY_CUTOFF * table->tau_beta) {
+                t_fired[l] = -INFINITY;
+            }
+            const double t_since = global_time - t_fired[l];
+            x[l] = -t_since / table->tau_beta;
+            x[ENSEMBLE_LANES + l] = -t_since / table->tau_alpha;
+            active |= t_since != INFINITY;
+        }
+        // Most synapses of a sweep are idle in every lane
+        if (!active)
+        {
+            continue;
+        }
+
+        hh_kernels_exp(ens->soa->isa, 2 * ENSEMBLE_LANES, x, y);
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            const double t_since = global_time - t_fired[l];
+            if (t_since == INFINITY)
+            {
+                continue;
+            }
+            const double weight = isnan(ens->lane_gaba_g_max[l]) ? table->weight[s] : ens->lane_gaba_g_max[l];
+            g_sum[l] += weight * (y[l] - y[ENSEMBLE_LANES + l]);
+        }
+    }
+
+    for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+    {
+        i_syn[l] = table->norm_const * -g_sum[l] * (vm[l] - table->e_rev);
+    }
+}
+
+void ensemble_step(ensemble_t ens,
+                   void** network,
+                   const uint64_t cell_start,
+                   const uint64_t cell_end,
+                   const double global_time,
+                   const uint64_t curr_step)
+{
+    const hh_soa_t soa = ens->soa;
+    const uint64_t na_lo = soa->na.first[cell_start], na_hi = soa->na.first[cell_end];
+    const uint64_t k_lo = soa->k.first[cell_start], k_hi = soa->k.first[cell_end];
+
+    // Instances times lanes are just more instances to the kernels
+    _ens_gather_vm(ens, &soa->na, ens->na_vm, na_lo, na_hi);
+    _ens_gather_vm(ens, &soa->k, ens->k_vm, k_lo, k_hi);
+    hh_kernels_na(soa->isa, na_lo * ENSEMBLE_LANES, na_hi * ENSEMBLE_LANES, ens->na_vm,
+                  ens->g_na, ens->e_na, ens->hh_m, ens->hh_h, ens->na_i);
+    hh_kernels_k(soa->isa, k_lo * ENSEMBLE_LANES, k_hi * ENSEMBLE_LANES, ens->k_vm,
+                 ens->g_k, ens->e_k, ens->hh_n, ens->k_i);
+
+    for (uint64_t c = cell_start; c < cell_end; c++)
+    {
+        struct HHSomaCompartment* comp = (struct HHSomaCompartment*) network[c];
+        double* restrict vm = &ens->vm[c * ENSEMBLE_LANES];
+        double i_sum[ENSEMBLE_LANES], g_sum[ENSEMBLE_LANES], i_syn[ENSEMBLE_LANES];
+
+        // Same order as hh_soa_step (Leak, Na, K), then synapses and objects
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            i_sum[l] = 0.0;
+            g_sum[l] = 0.0;
+        }
+        for (uint64_t j = soa->leak.first[c]; j < soa->leak.first[c + 1]; j++)
+        {
+#pragma GCC ivdep
+            for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+            {
+                i_sum[l] += -soa->g_leak[j] * (vm[l] - soa->e_rev[j]);
+                g_sum[l] += soa->g_leak[j];
+            }
+        }
+        for (uint64_t j = soa->na.first[c]; j < soa->na.first[c + 1]; j++)
+        {
+            const uint64_t jl = j * ENSEMBLE_LANES;
+#pragma GCC ivdep
+            for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+            {
+                const double m = ens->hh_m[jl + l];
+                i_sum[l] += ens->na_i[jl + l];
+                g_sum[l] += ens->g_na[jl + l] * m*m*m * ens->hh_h[jl + l];
+            }
+        }
+        for (uint64_t j = soa->k.first[c]; j < soa->k.first[c + 1]; j++)
+        {
+            const uint64_t jl = j * ENSEMBLE_LANES;
+#pragma GCC ivdep
+            for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+            {
+                const double n = ens->hh_n[jl + l];
+                i_sum[l] += ens->k_i[jl + l];
+                g_sum[l] += ens->g_k[jl + l] * n*n*n*n;
+            }
+        }
+
+        _ens_synapses(ens, c, vm, global_time, curr_step, i_syn);
+        const double i_obj =
+            HHSomaCompartment_current(comp, network, 0.0, soa->num_owned[c], global_time, curr_step);
+
+        for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            const double I_sum = (i_sum[l] + i_syn[l]) + i_obj;
+            const double vm_new = hh_vm_update(vm[l], I_sum, g_sum[l], comp->cm, DT);
+            spike_events_record(ens->spikes, c * ENSEMBLE_LANES + l, vm[l], vm_new, curr_step);
+            ens->num_spikes[c * ENSEMBLE_LANES + l] +=
+                vm[l] < ens->spikes->vm_thresh && vm_new > ens->spikes->vm_thresh;
+            vm[l] = vm_new;
+        }
+
+        HHSomaCompartment_set_vm(comp, vm[0], curr_step);
+    }
+}
+
+void ensemble_scatter(const ensemble_t ens, const uint32_t lane)
+{
+    const hh_soa_t soa = ens->soa;
+    for (uint64_t j = 0; j < soa->na.num; j++)
+    {
+        soa->hh_m[j] = ens->hh_m[j * ENSEMBLE_LANES + lane];
+        soa->hh_h[j] = ens->hh_h[j * ENSEMBLE_LANES + lane];
+    }
+    for (uint64_t j = 0; j < soa->k.num; j++)
+    {
+        soa->hh_n[j] = ens->hh_n[j * ENSEMBLE_LANES + lane];
+    }
+}
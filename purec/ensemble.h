@@ -0,0 +1,137 @@
+/**
+ * @file    ensemble.h
+ *
+ * @brief   Lockstep ensemble of parameter variants of one network.
+ *
+ * @details Parameter sweeps run the same topology many times with a few
+ *          conductances changed. An ensemble instead runs ENSEMBLE_LANES
+ *          variants at once: every state variable of the SoA engine and the
+ *          synapse table becomes a vector over lanes, stored lanes innermost,
+ *          so one pass over the topology advances every variant and the gate
+ *          kernels vectorize across lanes. Lane l is the network it was
+ *          built from with G_NA, G_K and GABA_G_MAX set to the lane's values;
+ *          each lane keeps its own voltages and spike events.
+ *
+ *          Mechanisms the SoA engine does not own are called once per cell
+ *          and their current is shared by all lanes, so they must not depend
+ *          on voltage (e.g. DCCurrentMech). The objects follow lane 0; every
+ *          lane's voltages are in vm, to be recorded per lane (dsac writes
+ *          one trace per lane, see vm_recorder_sample_values), and its gate
+ *          state can be split back out with ensemble_scatter.
+ */
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <stdint.h>
+
+#include "myriad.h"
+#include "hh_soa.h"
+#include "spike_events.h"
+#include "synapse_table.h"
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+//! Variants simulated together; a divisor of 64 keeps a cell's spike bits in one word
+#ifndef ENSEMBLE_LANES
+#define ENSEMBLE_LANES 4
+#endif
+
+typedef struct ensemble
+{
+    //! Number of compartments in the network
+    uint64_t num_cells;
+    //! Owned mechanisms, their layout and base parameters
+    hh_soa_t soa;
+    //! Synapses, their layout and base weights
+    synapse_table_t synapses;
+    //! Spike events of every lane, cell c's lane l at c * ENSEMBLE_LANES + l
+    spike_events_t spikes;
+
+    //! G_NA, G_K and GABA_G_MAX of each lane, NAN where the network's own apply
+    double lane_g_na[ENSEMBLE_LANES];
+    double lane_g_k[ENSEMBLE_LANES];
+    double lane_gaba_g_max[ENSEMBLE_LANES];
+
+    //! Membrane voltage of the last step, per cell and lane (cell c's lane l
+    //! at c * ENSEMBLE_LANES + l) - mV
+    double* restrict vm;
+    //! Threshold crossings so far, per cell and lane
+    uint64_t* restrict num_spikes;
+
+    //! Per-instance state of the SoA blocks, per instance and lane
+    double* restrict na_vm;
+    double* restrict g_na;
+    double* restrict e_na;
+    double* restrict hh_m;
+    double* restrict hh_h;
+    double* restrict na_i;
+    double* restrict k_vm;
+    double* restrict g_k;
+    double* restrict e_k;
+    double* restrict hh_n;
+    double* restrict k_i;
+
+    //! Time each synapse last fired, per synapse and lane - ms
+    double* restrict t_fired;
+} *ensemble_t;
+
+/**
+ * @brief Replicates the state of a network into ENSEMBLE_LANES lanes.
+ *
+ * The network must already be taken over by soa, and its synapses be in
+ * synapses (finished); both must outlive the ensemble, which reads their
+ * layout and base parameters but never changes them.
+ *
+ * Each per-lane value replaces the parameter of every instance in its lane;
+ * a NULL array or a NAN value keeps the network's own.
+ *
+ * @param network     network of compartments, indexed by ID
+ * @param soa         SoA engine of the network
+ * @param synapses    synapse table of the network
+ * @param vm_thresh   upward crossing of this voltage counts as a spike - mV
+ * @param g_na        G_NA per lane - nS
+ * @param g_k         G_K per lane - nS
+ * @param gaba_g_max  GABA_G_MAX (synapse weight) per lane - nS
+ *
+ * @returns new ensemble, or NULL on allocation failure.
+ */
+extern ensemble_t ensemble_new(void** network,
+                               const hh_soa_t soa,
+                               const synapse_table_t synapses,
+                               const double vm_thresh,
+                               const double* g_na,
+                               const double* g_k,
+                               const double* gaba_g_max);
+
+extern void ensemble_free(ensemble_t ens);
+
+/**
+ * @brief Advances every lane of compartments [cell_start, cell_end) by DT.
+ *
+ * Lane 0's voltage is also stored in the compartment objects. Safe to call
+ * concurrently for disjoint ranges, with a barrier between steps.
+ */
+extern void ensemble_step(ensemble_t ens,
+                          void** network,
+                          const uint64_t cell_start,
+                          const uint64_t cell_end,
+                          const double global_time,
+                          const uint64_t curr_step);
+
+//! Membrane voltage of a cell in a lane, as of the last step - mV
+static inline double ensemble_vm(const ensemble_t ens, const uint64_t cell, const uint32_t lane)
+{
+    return ens->vm[cell * ENSEMBLE_LANES + lane];
+}
+
+/**
+ * @brief Writes one lane's gate state into the SoA engine.
+ *
+ * Follow with hh_soa_scatter to bring the objects up to date as well.
+ */
+extern void ensemble_scatter(const ensemble_t ens, const uint32_t lane);
+
+#endif /* ENSEMBLE_H */
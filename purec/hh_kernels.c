@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "hh_rates.h"
+#include "hh_kernels.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HH_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// Cody-Waite split of ln(2): hi part has trailing zeros so n*hi is exact
+#define LN2_HI 6.93147180369123816490e-01
+#define LN2_LO 1.90821492927058770002e-10
+#define LOG2_E 1.44269504088896338700e+00
+// Adding this forces round-to-nearest integer into the low mantissa bits
+#define ROUND_MAGIC 6755399441055744.0  // 0x1.8p52
+
+// 1/k! for k = 13 .. 0, Horner order
+static const double _exp_coeffs[14] =
+{
+    1.0/6227020800.0, 1.0/479001600.0, 1.0/39916800.0, 1.0/3628800.0,
+    1.0/362880.0, 1.0/40320.0, 1.0/5040.0, 1.0/720.0,
+    1.0/120.0, 1.0/24.0, 1.0/6.0, 1.0/2.0,
+    1.0, 1.0
+};
+
+////////////////////
+// Scalar kernels //
+////////////////////
+
+static void _na_scalar(const uint64_t lo,
+                       const uint64_t hi,
+                       const double* restrict vm,
+                       const double* restrict g_na,
+                       const double* restrict e_na,
+                       double* restrict hh_m,
+                       double* restrict hh_h,
+                       double* restrict i_out)
+{
+#pragma GCC ivdep
+    for (uint64_t j = lo; j < hi; j++)
+    {
+        i_out[j] = hh_na_step(vm[j], g_na[j], e_na[j], &hh_m[j], &hh_h[j]);
+    }
+}
+
+static void _k_scalar(const uint64_t lo,
+                      const uint64_t hi,
+                      const double* restrict vm,
+                      const double* restrict g_k,
+                      const double* restrict e_k,
+                      double* restrict hh_n,
+                      double* restrict i_out)
+{
+#pragma GCC ivdep
+    for (uint64_t j = lo; j < hi; j++)
+    {
+        i_out[j] = hh_k_step(vm[j], g_k[j], e_k[j], &hh_n[j]);
+    }
+}
+
+#ifdef HH_KERNELS_X86
+
+//////////////////
+// AVX2 kernels //
+//////////////////
+
+__attribute__((target("avx2,fma")))
+static inline __m256d _exp_avx2(__m256d x)
+{
+    const __m256d magic = _mm256_set1_pd(ROUND_MAGIC);
+
+    x = _mm256_max_pd(x, _mm256_set1_pd(HH_KERNELS_EXP_MIN));
+    x = _mm256_min_pd(x, _mm256_set1_pd(HH_KERNELS_EXP_MAX));
+
+    // x = n*ln(2) + r, |r| <= ln(2)/2
+    const __m256d t = _mm256_fmadd_pd(x, _mm256_set1_pd(LOG2_E), magic);
+    const __m256d n = _mm256_sub_pd(t, magic);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+
+    __m256d p = _mm256_set1_pd(_exp_coeffs[0]);
+    for (int k = 1; k < 14; k++)
+    {
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(_exp_coeffs[k]));
+    }
+
+    // 2^n straight into the exponent field
+    __m256i e = _mm256_sub_epi64(_mm256_castpd_si256(t), _mm256_castpd_si256(magic));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+}
+
+// See hh_gate_update
+__attribute__((target("avx2,fma")))
+static inline __m256d _gate_avx2(const __m256d m, const __m256d alpha, const __m256d beta)
+{
+#ifdef HH_EXP_EULER
+    // m_inf + (m - m_inf) * exp(-DT * (alpha + beta))
+    const __m256d rate = _mm256_add_pd(alpha, beta);
+    const __m256d m_inf = _mm256_div_pd(alpha, rate);
+    const __m256d decay = _exp_avx2(_mm256_mul_pd(rate, _mm256_set1_pd(-DT)));
+    return _mm256_fmadd_pd(_mm256_sub_pd(m, m_inf), decay, m_inf);
+#else
+    // m + DT * (alpha * (1 - m) - beta * m)
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d dm = _mm256_fnmadd_pd(beta, m, _mm256_mul_pd(alpha, _mm256_sub_pd(one, m)));
+    return _mm256_fmadd_pd(_mm256_set1_pd(DT), dm, m);
+#endif
+}
+
+__attribute__((target("avx2,fma")))
+static void _exp_array_avx2(const uint64_t n, const double* restrict x, double* restrict y)
+{
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm256_storeu_pd(&y[i], _exp_avx2(_mm256_loadu_pd(&x[i])));
+    }
+    for (; i < n; i++)
+    {
+        y[i] = exp(x[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void _na_avx2(const uint64_t lo,
+                     const uint64_t hi,
+                     const double* restrict vm,
+                     const double* restrict g_na,
+                     const double* restrict e_na,
+                     double* restrict hh_m,
+                     double* restrict hh_h,
+                     double* restrict i_out)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    uint64_t j = lo;
+    for (; j + 4 <= hi; j += 4)
+    {
+        const __m256d v = _mm256_loadu_pd(&vm[j]);
+        const __m256d vp45 = _mm256_add_pd(v, _mm256_set1_pd(45.0));
+        const __m256d vp41 = _mm256_add_pd(v, _mm256_set1_pd(41.0));
+        const __m256d vp18 = _mm256_add_pd(v, _mm256_set1_pd(18.0));
+
+        // exp(-(v+18)/5) = 1/exp((v+18)/5), so three exponentials suffice
+        const __m256d e45 = _exp_avx2(_mm256_mul_pd(vp45, _mm256_set1_pd(-1.0/4.0)));
+        const __m256d e41 = _exp_avx2(_mm256_mul_pd(vp41, _mm256_set1_pd(-1.0/18.0)));
+        const __m256d e18 = _exp_avx2(_mm256_mul_pd(vp18, _mm256_set1_pd(1.0/5.0)));
+
+        const __m256d alpha_m = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(0.32), vp45),
+                                              _mm256_sub_pd(one, e45));
+        const __m256d beta_m = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(-0.28), vp18),
+                                             _mm256_sub_pd(one, e18));
+        const __m256d alpha_h = _mm256_mul_pd(_mm256_set1_pd(0.128), e41);
+        const __m256d beta_h = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(4.0), e18),
+                                             _mm256_add_pd(e18, one));
+
+        const __m256d m = _gate_avx2(_mm256_loadu_pd(&hh_m[j]), alpha_m, beta_m);
+        const __m256d h = _gate_avx2(_mm256_loadu_pd(&hh_h[j]), alpha_h, beta_h);
+        _mm256_storeu_pd(&hh_m[j], m);
+        _mm256_storeu_pd(&hh_h[j], h);
+
+        // -g * m^3 * h * (v - e)
+        const __m256d m3h = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(m, m), m), h);
+        const __m256d drive = _mm256_sub_pd(v, _mm256_loadu_pd(&e_na[j]));
+        const __m256d g = _mm256_loadu_pd(&g_na[j]);
+        _mm256_storeu_pd(&i_out[j],
+                         _mm256_mul_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), g), m3h),
+                                       drive));
+    }
+    _na_scalar(j, hi, vm, g_na, e_na, hh_m, hh_h, i_out);
+}
+
+__attribute__((target("avx2,fma")))
+static void _k_avx2(const uint64_t lo,
+                    const uint64_t hi,
+                    const double* restrict vm,
+                    const double* restrict g_k,
+                    const double* restrict e_k,
+                    double* restrict hh_n,
+                    double* restrict i_out)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    uint64_t j = lo;
+    for (; j + 4 <= hi; j += 4)
+    {
+        const __m256d v = _mm256_loadu_pd(&vm[j]);
+        const __m256d vp10 = _mm256_add_pd(v, _mm256_set1_pd(10.0));
+
+        const __m256d e10 = _exp_avx2(_mm256_mul_pd(vp10, _mm256_set1_pd(-1.0/10.0)));
+        const __m256d e80 = _exp_avx2(_mm256_mul_pd(v, _mm256_set1_pd(-1.0/80.0)));
+
+        const __m256d alpha_n = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(-0.01), vp10),
+                                              _mm256_sub_pd(e10, one));
+        const __m256d beta_n = _mm256_mul_pd(_mm256_set1_pd(0.125), e80);
+
+        const __m256d n = _gate_avx2(_mm256_loadu_pd(&hh_n[j]), alpha_n, beta_n);
+        _mm256_storeu_pd(&hh_n[j], n);
+
+        // -g * n^4 * (v - e)
+        const __m256d n2 = _mm256_mul_pd(n, n);
+        const __m256d drive = _mm256_sub_pd(v, _mm256_loadu_pd(&e_k[j]));
+        const __m256d g = _mm256_loadu_pd(&g_k[j]);
+        _mm256_storeu_pd(&i_out[j],
+                         _mm256_mul_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), g),
+                                                     _mm256_mul_pd(n2, n2)),
+                                       drive));
+    }
+    _k_scalar(j, hi, vm, g_k, e_k, hh_n, i_out);
+}
+
+/////////////////////
+// AVX-512 kernels //
+/////////////////////
+
+__attribute__((target("avx512f")))
+static inline __m512d _exp_avx512(__m512d x)
+{
+    const __m512d magic = _mm512_set1_pd(ROUND_MAGIC);
+
+    x = _mm512_max_pd(x, _mm512_set1_pd(HH_KERNELS_EXP_MIN));
+    x = _mm512_min_pd(x, _mm512_set1_pd(HH_KERNELS_EXP_MAX));
+
+    // x = n*ln(2) + r, |r| <= ln(2)/2
+    const __m512d t = _mm512_fmadd_pd(x, _mm512_set1_pd(LOG2_E), magic);
+    const __m512d n = _mm512_sub_pd(t, magic);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+
+    __m512d p = _mm512_set1_pd(_exp_coeffs[0]);
+    for (int k = 1; k < 14; k++)
+    {
+        p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(_exp_coeffs[k]));
+    }
+
+    // 2^n straight into the exponent field
+    __m512i e = _mm512_sub_epi64(_mm512_castpd_si512(t), _mm512_castpd_si512(magic));
+    e = _mm512_slli_epi64(_mm512_add_epi64(e, _mm512_set1_epi64(1023)), 52);
+
+    return _mm512_mul_pd(p, _mm512_castsi512_pd(e));
+}
+
+// See hh_gate_update
+__attribute__((target("avx512f")))
+static inline __m512d _gate_avx512(const __m512d m, const __m512d alpha, const __m512d beta)
+{
+#ifdef HH_EXP_EULER
+    // m_inf + (m - m_inf) * exp(-DT * (alpha + beta))
+    const __m512d rate = _mm512_add_pd(alpha, beta);
+    const __m512d m_inf = _mm512_div_pd(alpha, rate);
+    const __m512d decay = _exp_avx512(_mm512_mul_pd(rate, _mm512_set1_pd(-DT)));
+    return _mm512_fmadd_pd(_mm512_sub_pd(m, m_inf), decay, m_inf);
+#else
+    // m + DT * (alpha * (1 - m) - beta * m)
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d dm = _mm512_fnmadd_pd(beta, m, _mm512_mul_pd(alpha, _mm512_sub_pd(one, m)));
+    return _mm512_fmadd_pd(_mm512_set1_pd(DT), dm, m);
+#endif
+}
+
+__attribute__((target("avx512f")))
+static void _exp_array_avx512(const uint64_t n, const double* restrict x, double* restrict y)
+{
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm512_storeu_pd(&y[i], _exp_avx512(_mm512_loadu_pd(&x[i])));
+    }
+    for (; i < n; i++)
+    {
+        y[i] = exp(x[i]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void _na_avx512(const uint64_t lo,
+                       const uint64_t hi,
+                       const double* restrict vm,
+                       const double* restrict g_na,
+                       const double* restrict e_na,
+                       double* restrict hh_m,
+                       double* restrict hh_h,
+                       double* restrict i_out)
+{
+    const __m512d one = _mm512_set1_pd(1.0);
+    uint64_t j = lo;
+    for (; j + 8 <= hi; j += 8)
+    {
+        const __m512d v = _mm512_loadu_pd(&vm[j]);
+        const __m512d vp45 = _mm512_add_pd(v, _mm512_set1_pd(45.0));
+        const __m512d vp41 = _mm512_add_pd(v, _mm512_set1_pd(41.0));
+        const __m512d vp18 = _mm512_add_pd(v, _mm512_set1_pd(18.0));
+
+        // exp(-(v+18)/5) = 1/exp((v+18)/5), so three exponentials suffice
+        const __m512d e45 = _exp_avx512(_mm512_mul_pd(vp45, _mm512_set1_pd(-1.0/4.0)));
+        const __m512d e41 = _exp_avx512(_mm512_mul_pd(vp41, _mm512_set1_pd(-1.0/18.0)));
+        const __m512d e18 = _exp_avx512(_mm512_mul_pd(vp18, _mm512_set1_pd(1.0/5.0)));
+
+        const __m512d alpha_m = _mm512_div_pd(_mm512_mul_pd(_mm512_set1_pd(0.32), vp45),
+                                              _mm512_sub_pd(one, e45));
+        const __m512d beta_m = _mm512_div_pd(_mm512_mul_pd(_mm512_set1_pd(-0.28), vp18),
+                                             _mm512_sub_pd(one, e18));
+        const __m512d alpha_h = _mm512_mul_pd(_mm512_set1_pd(0.128), e41);
+        const __m512d beta_h = _mm512_div_pd(_mm512_mul_pd(_mm512_set1_pd(4.0), e18),
+                                             _mm512_add_pd(e18, one));
+
+        const __m512d m = _gate_avx512(_mm512_loadu_pd(&hh_m[j]), alpha_m, beta_m);
+        const __m512d h = _gate_avx512(_mm512_loadu_pd(&hh_h[j]), alpha_h, beta_h);
+        _mm512_storeu_pd(&hh_m[j], m);
+        _mm512_storeu_pd(&hh_h[j], h);
+
+        // -g * m^3 * h * (v - e)
+        const __m512d m3h = _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(m, m), m), h);
+        const __m512d drive = _mm512_sub_pd(v, _mm512_loadu_pd(&e_na[j]));
+        const __m512d g = _mm512_loadu_pd(&g_na[j]);
+        _mm512_storeu_pd(&i_out[j],
+                         _mm512_mul_pd(_mm512_mul_pd(_mm512_sub_pd(_mm512_setzero_pd(), g), m3h),
+                                       drive));
+    }
+    _na_scalar(j, hi, vm, g_na, e_na, hh_m, hh_h, i_out);
+}
+
+__attribute__((target("avx512f")))
+static void _k_avx512(const uint64_t lo,
+                      const uint64_t hi,
+                      const double* restrict vm,
+                      const double* restrict g_k,
+                      const double* restrict e_k,
+                      double* restrict hh_n,
+                      double* restrict i_out)
+{
+    const __m512d one = _mm512_set1_pd(1.0);
+    uint64_t j = lo;
+    for (; j + 8 <= hi; j += 8)
+    {
+        const __m512d v = _mm512_loadu_pd(&vm[j]);
+        const __m512d vp10 = _mm512_add_pd(v, _mm512_set1_pd(10.0));
+
+        const __m512d e10 = _exp_avx512(_mm512_mul_pd(vp10, _mm512_set1_pd(-1.0/10.0)));
+        const __m512d e80 = _exp_avx512(_mm512_mul_pd(v, _mm512_set1_pd(-1.0/80.0)));
+
+        const __m512d alpha_n = _mm512_div_pd(_mm512_mul_pd(_mm512_set1_pd(-0.01), vp10),
+                                              _mm512_sub_pd(e10, one));
+        const __m512d beta_n = _mm512_mul_pd(_mm512_set1_pd(0.125), e80);
+
+        const __m512d n = _gate_avx512(_mm512_loadu_pd(&hh_n[j]), alpha_n, beta_n);
+        _mm512_storeu_pd(&hh_n[j], n);
+
+        // -g * n^4 * (v - e)
+        const __m512d n2 = _mm512_mul_pd(n, n);
+        const __m512d drive = _mm512_sub_pd(v, _mm512_loadu_pd(&e_k[j]));
+        const __m512d g = _mm512_loadu_pd(&g_k[j]);
+        _mm512_storeu_pd(&i_out[j],
+                         _mm512_mul_pd(_mm512_mul_pd(_mm512_sub_pd(_mm512_setzero_pd(), g),
+                                                     _mm512_mul_pd(n2, n2)),
+                                       drive));
+    }
+    _k_scalar(j, hi, vm, g_k, e_k, hh_n, i_out);
+}
+
+#endif /* HH_KERNELS_X86 */
+
+//////////////
+// Dispatch //
+//////////////
+
+enum hh_kernels_isa hh_kernels_detect(void)
+{
+    enum hh_kernels_isa best = HH_KERNELS_SCALAR;
+
+#ifdef HH_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        best = HH_KERNELS_AVX512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        best = HH_KERNELS_AVX2;
+    }
+#endif
+
+    const char* cap = getenv("MYRIAD_SIMD");
+    if (cap != NULL)
+    {
+        if (strcmp(cap, "scalar") == 0)
+        {
+            best = HH_KERNELS_SCALAR;
+        } else if (strcmp(cap, "avx2") == 0 && best > HH_KERNELS_AVX2) {
+            best = HH_KERNELS_AVX2;
+        } else if (strcmp(cap, "avx2") != 0 && strcmp(cap, "avx512") != 0) {
+            fprintf(stderr, "Unknown MYRIAD_SIMD value '%s', ignoring\n", cap);
+        }
+    }
+
+    return best;
+}
+
+const char* hh_kernels_isa_name(const enum hh_kernels_isa isa)
+{
+    switch (isa)
+    {
+    case HH_KERNELS_AVX2:
+        return "avx2";
+    case HH_KERNELS_AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+void hh_kernels_exp(const enum hh_kernels_isa isa,
+                    const uint64_t n,
+                    const double* restrict x,
+                    double* restrict y)
+{
+#ifdef HH_KERNELS_X86
+    if (isa == HH_KERNELS_AVX512)
+    {
+        _exp_array_avx512(n, x, y);
+        return;
+    } else if (isa == HH_KERNELS_AVX2) {
+        _exp_array_avx2(n, x, y);
+        return;
+    }
+#endif
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        y[i] = exp(x[i]);
+    }
+}
+
+void hh_kernels_na(const enum hh_kernels_isa isa,
+                   const uint64_t lo,
+                   const uint64_t hi,
+                   const double* restrict vm,
+                   const double* restrict g_na,
+                   const double* restrict e_na,
+                   double* restrict hh_m,
+                   double* restrict hh_h,
+                   double* restrict i_out)
+{
+#ifdef HH_KERNELS_X86
+    if (isa == HH_KERNELS_AVX512)
+    {
+        _na_avx512(lo, hi, vm, g_na, e_na, hh_m, hh_h, i_out);
+        return;
+    } else if (isa == HH_KERNELS_AVX2) {
+        _na_avx2(lo, hi, vm, g_na, e_na, hh_m, hh_h, i_out);
+        return;
+    }
+#endif
+
+    _na_scalar(lo, hi, vm, g_na, e_na, hh_m, hh_h, i_out);
+}
+
+void hh_kernels_k(const enum hh_kernels_isa isa,
+                  const uint64_t lo,
+                  const uint64_t hi,
+                  const double* restrict vm,
+                  const double* restrict g_k,
+                  const double* restrict e_k,
+                  double* restrict hh_n,
+                  double* restrict i_out)
+{
+#ifdef HH_KERNELS_X86
+    if (isa == HH_KERNELS_AVX512)
+    {
+        _k_avx512(lo, hi, vm, g_k, e_k, hh_n, i_out);
+        return;
+    } else if (isa == HH_KERNELS_AVX2) {
+        _k_avx2(lo, hi, vm, g_k, e_k, hh_n, i_out);
+        return;
+    }
+#endif
+
+    _k_scalar(lo, hi, vm, g_k, e_k, hh_n, i_out);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file    hh_kernels.h
+ *
+ * @brief   Batched sodium/potassium gate kernels for the SoA engine.
+ *
+ * @details Scalar, AVX2 and AVX-512 variants of the gate update, selected at
+ *          runtime. Vector variants use their own exponential (see
+ *          hh_kernels_exp) and so ignore FAST_EXP/USE_DDTABLE/HH_RATE_TABLE;
+ *          they agree with the analytic scalar variant to within
+ *          HH_KERNELS_REL_TOL.
+ */
+#ifndef HH_KERNELS_H
+#define HH_KERNELS_H
+
+#include <stdint.h>
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+/**
+ * Maximum relative error of the vector exponential vs. libm exp.
+ *
+ * Cody-Waite reduction to |r| <= ln(2)/2 followed by a degree-13 Taylor
+ * polynomial: truncation error is below 1e-17, so the bound is set by
+ * rounding in the reduction and Horner steps (2 ulp, i.e. 2^-51).
+ * Valid for x in [HH_KERNELS_EXP_MIN, HH_KERNELS_EXP_MAX]; inputs outside
+ * that range are clamped to it.
+ */
+#define HH_KERNELS_EXP_REL_ERR 4.440892098500626e-16
+#define HH_KERNELS_EXP_MIN -708.0
+#define HH_KERNELS_EXP_MAX 709.0
+
+/**
+ * Maximum relative difference between vector and scalar gate updates, per
+ * step, for gates and currents, away from the removable singularities of
+ * the rate functions (vm = -45, -18, -10 mV).
+ */
+#define HH_KERNELS_REL_TOL 1e-12
+
+//! Instruction set used by the gate kernels
+enum hh_kernels_isa
+{
+    HH_KERNELS_SCALAR = 0,
+    HH_KERNELS_AVX2,
+    HH_KERNELS_AVX512
+};
+
+/**
+ * @brief Picks the widest instruction set supported by the running CPU.
+ *
+ * Setting the MYRIAD_SIMD environment variable to "scalar", "avx2" or
+ * "avx512" caps the choice, e.g. for comparing runs.
+ */
+extern enum hh_kernels_isa hh_kernels_detect(void);
+
+//! Human-readable name of the given instruction set
+extern const char* hh_kernels_isa_name(const enum hh_kernels_isa isa);
+
+/**
+ * @brief Computes y[i] = exp(x[i]) for i in [0, n) with the given variant.
+ *
+ * The scalar variant is libm exp; see HH_KERNELS_EXP_REL_ERR for the others.
+ */
+extern void hh_kernels_exp(const enum hh_kernels_isa isa,
+                           const uint64_t n,
+                           const double* restrict x,
+                           double* restrict y);
+
+/**
+ * @brief Advances sodium gates of instances [lo, hi) by one step.
+ *
+ * @param[in]     vm     membrane voltage driving each instance - mV
+ * @param[in,out] hh_m   activation gates
+ * @param[in,out] hh_h   inactivation gates
+ * @param[out]    i_out  current of each instance with the updated gates
+ */
+extern void hh_kernels_na(const enum hh_kernels_isa isa,
+                          const uint64_t lo,
+                          const uint64_t hi,
+                          const double* restrict vm,
+                          const double* restrict g_na,
+                          const double* restrict e_na,
+                          double* restrict hh_m,
+                          double* restrict hh_h,
+                          double* restrict i_out);
+
+/**
+ * @brief Advances potassium gates of instances [lo, hi) by one step.
+ *
+ * @param[in]     vm     membrane voltage driving each instance - mV
+ * @param[in,out] hh_n   activation gates
+ * @param[out]    i_out  current of each instance with the updated gates
+ */
+extern void hh_kernels_k(const enum hh_kernels_isa isa,
+                         const uint64_t lo,
+                         const uint64_t hi,
+                         const double* restrict vm,
+                         const double* restrict g_k,
+                         const double* restrict e_k,
+                         double* restrict hh_n,
+                         double* restrict i_out);
+
+#endif /* HH_KERNELS_H */
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "hh_rates.h"
+#include "hh_rate_table.h"
+
+//! Alignment of the rate arrays, one cache line
+#define HH_RATE_TABLE_ALIGN 64
+
+//! Distance either side of a singularity the limit is averaged over - mV
+#define HH_RATE_TABLE_NUDGE 1e-5
+
+hh_rate_table_t rate_table = NULL;
+
+// Voltages where a rate function is 0/0 (alpha_m, beta_m, alpha_n) - mV
+static const double _singular_vm[] = {-45.0, -18.0, -10.0};
+
+// Rate at vm, or its limit there if vm sits on a removable singularity,
+// where the analytic form cancels catastrophically or divides by zero.
+static double _rate_at(double (*rate)(const double), const double vm)
+{
+    for (size_t s = 0; s < sizeof(_singular_vm) / sizeof(_singular_vm[0]); s++)
+    {
+        if (fabs(vm - _singular_vm[s]) < HH_RATE_TABLE_NUDGE)
+        {
+            return 0.5 * (rate(vm - HH_RATE_TABLE_NUDGE) + rate(vm + HH_RATE_TABLE_NUDGE));
+        }
+    }
+    return rate(vm);
+}
+
+static inline double _rel_err(const double approx, const double exact)
+{
+    return fabs(approx - exact) / fabs(exact);
+}
+
+hh_rate_table_t hh_rate_table_new(const double vm_min,
+                                  const double vm_max,
+                                  const double dvm)
+{
+    if (!(dvm > 0.0 && vm_max > vm_min))
+    {
+        return NULL;
+    }
+
+    hh_rate_table_t table = (hh_rate_table_t) calloc(1, sizeof(struct hh_rate_table));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    table->vm_min = vm_min;
+    table->dvm = dvm;
+    table->inv_dvm = 1.0 / dvm;
+    table->num_points = (uint64_t) ceil((vm_max - vm_min) / dvm) + 1;
+
+    void* na = NULL;
+    void* k = NULL;
+    if (posix_memalign(&na, HH_RATE_TABLE_ALIGN, table->num_points * sizeof(struct hh_na_rates)) != 0 ||
+        posix_memalign(&k, HH_RATE_TABLE_ALIGN, table->num_points * sizeof(struct hh_k_rates)) != 0)
+    {
+        free(na);
+        free(table);
+        return NULL;
+    }
+    table->na = (struct hh_na_rates*) na;
+    table->k = (struct hh_k_rates*) k;
+
+    for (uint64_t i = 0; i < table->num_points; i++)
+    {
+        const double vm = vm_min + i * dvm;
+        table->na[i].alpha_m = _rate_at(hh_na_alpha_m, vm);
+        table->na[i].beta_m = _rate_at(hh_na_beta_m, vm);
+        table->na[i].alpha_h = _rate_at(hh_na_alpha_h, vm);
+        table->na[i].beta_h = _rate_at(hh_na_beta_h, vm);
+        table->k[i].alpha_n = _rate_at(hh_k_alpha_n, vm);
+        table->k[i].beta_n = _rate_at(hh_k_beta_n, vm);
+    }
+
+    return table;
+}
+
+void hh_rate_table_free(hh_rate_table_t table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+    free(table->na);
+    free(table->k);
+    free(table);
+}
+
+double hh_rate_table_validate(const hh_rate_table_t table)
+{
+    static const double fracs[] = {0.25, 0.5, 0.75};
+
+    double max_err = 0.0;
+    for (uint64_t i = 0; i + 1 < table->num_points; i++)
+    {
+        for (size_t f = 0; f < sizeof(fracs) / sizeof(fracs[0]); f++)
+        {
+            const double vm = table->vm_min + (i + fracs[f]) * table->dvm;
+            double r[6];
+            if (!hh_rate_table_na(table, vm, &r[0], &r[1], &r[2], &r[3]) ||
+                !hh_rate_table_k(table, vm, &r[4], &r[5]))
+            {
+                continue;
+            }
+
+            const double errs[6] =
+            {
+                _rel_err(r[0], _rate_at(hh_na_alpha_m, vm)),
+                _rel_err(r[1], _rate_at(hh_na_beta_m, vm)),
+                _rel_err(r[2], _rate_at(hh_na_alpha_h, vm)),
+                _rel_err(r[3], _rate_at(hh_na_beta_h, vm)),
+                _rel_err(r[4], _rate_at(hh_k_alpha_n, vm)),
+                _rel_err(r[5], _rate_at(hh_k_beta_n, vm))
+            };
+            for (int j = 0; j < 6; j++)
+            {
+                if (isnan(errs[j]))
+                {
+                    return NAN;
+                }
+                max_err = errs[j] > max_err ? errs[j] : max_err;
+            }
+        }
+    }
+
+    return max_err;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file    hh_rate_table.h
+ *
+ * @brief   Voltage-indexed lookup tables of Hodgkin-Huxley channel rates.
+ *
+ * @details Tabulates the alpha/beta rate functions of hh_rates.h on a
+ *          uniform voltage grid once at startup and interpolates linearly
+ *          between grid points at runtime, replacing the exponentials of a
+ *          gate update with one multiply-add per rate. Tables are read-only
+ *          once built and shared by all threads. Voltages outside the
+ *          tabulated range fall back to the analytic functions.
+ */
+#ifndef HH_RATE_TABLE_H
+#define HH_RATE_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+//! Lowest tabulated membrane voltage - mV
+#ifndef HH_RATE_TABLE_VM_MIN
+#define HH_RATE_TABLE_VM_MIN -100.0
+#endif
+
+//! Highest tabulated membrane voltage - mV
+#ifndef HH_RATE_TABLE_VM_MAX
+#define HH_RATE_TABLE_VM_MAX 100.0
+#endif
+
+//! Grid spacing - mV
+#ifndef HH_RATE_TABLE_DVM
+#define HH_RATE_TABLE_DVM 0.01
+#endif
+
+/**
+ * Maximum relative error of an interpolated rate vs. the analytic function
+ * accepted by hh_rate_table_validate at the default spacing. Linear
+ * interpolation error grows with the square of HH_RATE_TABLE_DVM.
+ */
+#define HH_RATE_TABLE_REL_TOL 1e-5
+
+//! Sodium rates at one grid point - 1/ms
+struct hh_na_rates
+{
+    double alpha_m;
+    double beta_m;
+    double alpha_h;
+    double beta_h;
+};
+
+//! Potassium rates at one grid point - 1/ms
+struct hh_k_rates
+{
+    double alpha_n;
+    double beta_n;
+};
+
+typedef struct hh_rate_table
+{
+    //! Voltage of the first grid point - mV
+    double vm_min;
+    //! Grid spacing - mV
+    double dvm;
+    //! 1 / dvm, so lookups multiply instead of divide
+    double inv_dvm;
+    //! Number of grid points
+    uint64_t num_points;
+    //! Sodium rates at each grid point
+    struct hh_na_rates* restrict na;
+    //! Potassium rates at each grid point
+    struct hh_k_rates* restrict k;
+} *hh_rate_table_t;
+
+//! Rate tables of the running simulation, NULL to use the analytic rates
+extern hh_rate_table_t rate_table;
+
+/**
+ * @brief Tabulates all channel rates over [vm_min, vm_max] at spacing dvm.
+ *
+ * Grid points that land on a removable singularity of a rate function take
+ * its limit there instead.
+ *
+ * @returns new table, or NULL on invalid range or allocation failure.
+ */
+extern hh_rate_table_t hh_rate_table_new(const double vm_min,
+                                         const double vm_max,
+                                         const double dvm);
+
+extern void hh_rate_table_free(hh_rate_table_t table);
+
+/**
+ * @brief Compares interpolated rates against the analytic functions.
+ *
+ * Samples each grid interval at its midpoint (where linear interpolation
+ * error peaks) and at a few interior points.
+ *
+ * @returns maximum relative error over all rates and samples.
+ */
+extern double hh_rate_table_validate(const hh_rate_table_t table);
+
+// Grid interval and position within it for vm, false if out of range
+static inline bool _hh_rate_table_pos(const hh_rate_table_t table,
+                                      const double vm,
+                                      uint64_t* i,
+                                      double* frac)
+{
+    const double x = (vm - table->vm_min) * table->inv_dvm;
+    // Written so NaN also fails
+    if (!(x >= 0.0 && x < (double) (table->num_points - 1)))
+    {
+        return false;
+    }
+    *i = (uint64_t) x;
+    *frac = x - (double) *i;
+    return true;
+}
+
+/**
+ * @brief Interpolates sodium rates at vm.
+ *
+ * @returns false (leaving outputs untouched) if vm is outside the table.
+ */
+static inline bool hh_rate_table_na(const hh_rate_table_t table,
+                                    const double vm,
+                                    double* alpha_m,
+                                    double* beta_m,
+                                    double* alpha_h,
+                                    double* beta_h)
+{
+    uint64_t i;
+    double f;
+    if (!_hh_rate_table_pos(table, vm, &i, &f))
+    {
+        return false;
+    }
+    const struct hh_na_rates* r = &table->na[i];
+    *alpha_m = r[0].alpha_m + f * (r[1].alpha_m - r[0].alpha_m);
+    *beta_m = r[0].beta_m + f * (r[1].beta_m - r[0].beta_m);
+    *alpha_h = r[0].alpha_h + f * (r[1].alpha_h - r[0].alpha_h);
+    *beta_h = r[0].beta_h + f * (r[1].beta_h - r[0].beta_h);
+    return true;
+}
+
+/**
+ * @brief Interpolates potassium rates at vm.
+ *
+ * @returns false (leaving outputs untouched) if vm is outside the table.
+ */
+static inline bool hh_rate_table_k(const hh_rate_table_t table,
+                                   const double vm,
+                                   double* alpha_n,
+                                   double* beta_n)
+{
+    uint64_t i;
+    double f;
+    if (!_hh_rate_table_pos(table, vm, &i, &f))
+    {
+        return false;
+    }
+    const struct hh_k_rates* r = &table->k[i];
+    *alpha_n = r[0].alpha_n + f * (r[1].alpha_n - r[0].alpha_n);
+    *beta_n = r[0].beta_n + f * (r[1].beta_n - r[0].beta_n);
+    return true;
+}
+
+#endif /* HH_RATE_TABLE_H */
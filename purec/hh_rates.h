@@ -0,0 +1,155 @@
+/**
+ * @file    hh_rates.h
+ *
+ * @brief   Hodgkin-Huxley channel rate functions.
+ *
+ * @details Single definition of the alpha/beta rate functions used by the
+ *          sodium and potassium mechanisms, shared by every backend that
+ *          updates gating variables. With HH_RATE_TABLE defined the gate
+ *          updates interpolate rates from rate_table when it is set; the
+ *          integration rule itself is chosen in hh_integrate.h.
+ */
+#ifndef HH_RATES_H
+#define HH_RATES_H
+
+#include <math.h>
+
+#include "myriad.h"
+#include "hh_integrate.h"
+#ifdef HH_RATE_TABLE
+#include "hh_rate_table.h"
+#endif
+
+// @TODO: Magic numbers should be extracted out as defines
+
+//! Sodium activation opening rate - 1/ms
+static inline double hh_na_alpha_m(const double vm)
+{
+    return (0.32*(vm+45.0)) / (1 - EXP(-(vm+45.0)/4.0));
+}
+
+//! Sodium activation closing rate - 1/ms
+static inline double hh_na_beta_m(const double vm)
+{
+    return (-0.28*(vm+18.0)) / (1 - EXP((vm + 18.0)/5.0));
+}
+
+//! Sodium inactivation opening rate - 1/ms
+static inline double hh_na_alpha_h(const double vm)
+{
+    return (0.128) / (EXP((vm+41.0)/18.0));
+}
+
+//! Sodium inactivation closing rate - 1/ms
+static inline double hh_na_beta_h(const double vm)
+{
+    return 4.0 / (1 + EXP(-(vm + 18.0)/5.0));
+}
+
+//! Potassium activation opening rate - 1/ms
+static inline double hh_k_alpha_n(const double vm)
+{
+    return (-0.01 * (vm + 10.0)) / (EXP((vm+10.0)/-10.0) - 1.0);
+}
+
+//! Potassium activation closing rate - 1/ms
+static inline double hh_k_beta_n(const double vm)
+{
+    return 0.125 * EXP(vm/-80.);
+}
+
+//! All sodium rates at the given voltage, from rate_table if there is one
+static inline void hh_na_get_rates(const double vm,
+                                   double* alpha_m,
+                                   double* beta_m,
+                                   double* alpha_h,
+                                   double* beta_h)
+{
+#ifdef HH_RATE_TABLE
+    if (rate_table != NULL && hh_rate_table_na(rate_table, vm, alpha_m, beta_m, alpha_h, beta_h))
+    {
+        return;
+    }
+#endif
+    *alpha_m = hh_na_alpha_m(vm);
+    *beta_m = hh_na_beta_m(vm);
+    *alpha_h = hh_na_alpha_h(vm);
+    *beta_h = hh_na_beta_h(vm);
+}
+
+//! All potassium rates at the given voltage, from rate_table if there is one
+static inline void hh_k_get_rates(const double vm, double* alpha_n, double* beta_n)
+{
+#ifdef HH_RATE_TABLE
+    if (rate_table != NULL && hh_rate_table_k(rate_table, vm, alpha_n, beta_n))
+    {
+        return;
+    }
+#endif
+    *alpha_n = hh_k_alpha_n(vm);
+    *beta_n = hh_k_beta_n(vm);
+}
+
+/**
+ * Advances sodium gates by a step of size dt at the given voltage.
+ *
+ * @returns sodium current at that voltage with the updated gates
+ */
+static inline double hh_na_step_dt(const double vm,
+                                   const double g_na,
+                                   const double e_na,
+                                   double* hh_m,
+                                   double* hh_h,
+                                   const double dt)
+{
+    double alpha_m, beta_m, alpha_h, beta_h;
+    hh_na_get_rates(vm, &alpha_m, &beta_m, &alpha_h, &beta_h);
+
+    const double m = hh_gate_update(*hh_m, alpha_m, beta_m, dt);
+    const double h = hh_gate_update(*hh_h, alpha_h, beta_h, dt);
+    *hh_m = m;
+    *hh_h = h;
+
+    return -g_na * m*m*m * h * (vm - e_na);
+}
+
+//! Advances sodium gates by one step (DT) at the given voltage
+static inline double hh_na_step(const double vm,
+                                const double g_na,
+                                const double e_na,
+                                double* hh_m,
+                                double* hh_h)
+{
+    return hh_na_step_dt(vm, g_na, e_na, hh_m, hh_h, DT);
+}
+
+/**
+ * Advances the potassium gate by a step of size dt at the given voltage.
+ *
+ * @returns potassium current at that voltage with the updated gate
+ */
+static inline double hh_k_step_dt(const double vm,
+                                  const double g_k,
+                                  const double e_k,
+                                  double* hh_n,
+                                  const double dt)
+{
+    double alpha_n, beta_n;
+    hh_k_get_rates(vm, &alpha_n, &beta_n);
+
+    const double n = hh_gate_update(*hh_n, alpha_n, beta_n, dt);
+    *hh_n = n;
+
+    return -g_k * n*n*n*n * (vm - e_k);
+}
+
+//! Advances the potassium gate by one step (DT) at the given voltage
+static inline double hh_k_step(const double vm,
+                               const double g_k,
+                               const double e_k,
+                               double* hh_n)
+{
+    return hh_k_step_dt(vm, g_k, e_k, hh_n, DT);
+}
+
+#endif /* HH_RATES_H */
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "myriad.h"
+#include "MyriadObject.h"
+#include "Mechanism.h"
+#include "Compartment.h"
+#include "HHSomaCompartment.h"
+#include "HHLeakMechanism.h"
+#include "HHNaCurrMechanism.h"
+#include "HHKCurrMechanism.h"
+#include "hh_rates.h"
+#include "hh_kernels.h"
+#include "hh_soa.h"
+
+//! Alignment of every state array, so per-type loops vectorize cleanly
+#define HH_SOA_ALIGN 64
+
+enum hh_soa_type
+{
+    HH_SOA_NONE = -1,
+    HH_SOA_LEAK = 0,
+    HH_SOA_NA,
+    HH_SOA_K,
+    HH_SOA_NUM_TYPES
+};
+
+// Zeroed, cache-line aligned array; the myriad allocator makes no such promise.
+static void* _soa_calloc(const uint64_t num, const size_t size)
+{
+    void* ptr = NULL;
+    const size_t len = (num > 0 ? num : 1) * size;
+    if (posix_memalign(&ptr, HH_SOA_ALIGN, len) != 0)
+    {
+        return NULL;
+    }
+    memset(ptr, 0, len);
+    return ptr;
+}
+
+static enum hh_soa_type _soa_type_of(const void* mech, const struct Compartment* comp)
+{
+    // Only intrinsic currents: the kernels assume pre == post compartment.
+    if (((const struct Mechanism*) mech)->source_id != comp->id)
+    {
+        return HH_SOA_NONE;
+    } else if (myriad_is_a(mech, HHLeakMechanism)) {
+        return HH_SOA_LEAK;
+    } else if (myriad_is_a(mech, HHNaCurrMechanism)) {
+        return HH_SOA_NA;
+    } else if (myriad_is_a(mech, HHKCurrMechanism)) {
+        return HH_SOA_K;
+    }
+    return HH_SOA_NONE;
+}
+
+static int _soa_block_init(struct hh_soa_block* block,
+                           const uint64_t* counts,
+                           const uint64_t num_cells)
+{
+    block->first = (uint64_t*) _soa_calloc(num_cells + 1, sizeof(uint64_t));
+    if (block->first == NULL)
+    {
+        return -1;
+    }
+    for (uint64_t c = 0; c < num_cells; c++)
+    {
+        block->first[c + 1] = block->first[c] + counts[c];
+    }
+    block->num = block->first[num_cells];
+
+    block->src = (uint64_t*) _soa_calloc(block->num, sizeof(uint64_t));
+    block->objs = (void**) _soa_calloc(block->num, sizeof(void*));
+    block->vm = (double*) _soa_calloc(block->num, sizeof(double));
+    block->i_out = (double*) _soa_calloc(block->num, sizeof(double));
+
+    return (block->src && block->objs && block->vm && block->i_out) ? 0 : -1;
+}
+
+static void _soa_block_free(struct hh_soa_block* block)
+{
+    free(block->first);
+    free(block->src);
+    free(block->objs);
+    free(block->vm);
+    free(block->i_out);
+}
+
+hh_soa_t hh_soa_new(void** network, const uint64_t num_cells)
+{
+    hh_soa_t soa = (hh_soa_t) calloc(1, sizeof(struct hh_soa));
+    if (soa == NULL)
+    {
+        return NULL;
+    }
+    soa->num_cells = num_cells;
+#ifdef HH_SIMD
+    soa->isa = hh_kernels_detect();
+#else
+    soa->isa = HH_KERNELS_SCALAR;
+#endif
+
+    uint64_t* counts[HH_SOA_NUM_TYPES];
+    for (int t = 0; t < HH_SOA_NUM_TYPES; t++)
+    {
+        counts[t] = (uint64_t*) calloc(num_cells, sizeof(uint64_t));
+        assert(counts[t] != NULL);
+    }
+
+    // First pass: count instances per type per cell, and move them up front
+    soa->num_owned = (uint64_t*) _soa_calloc(num_cells, sizeof(uint64_t));
+    soa->i_ion = (double*) _soa_calloc(num_cells, sizeof(double));
+    if (soa->num_owned == NULL || soa->i_ion == NULL)
+    {
+        goto fail;
+    }
+#ifdef HH_IMPLICIT_VM
+    soa->g_ion = (double*) _soa_calloc(num_cells, sizeof(double));
+    if (soa->g_ion == NULL)
+    {
+        goto fail;
+    }
+#endif
+
+    for (uint64_t c = 0; c < num_cells; c++)
+    {
+        assert(myriad_is_a(network[c], HHSomaCompartment));
+        struct Compartment* comp = (struct Compartment*) network[c];
+
+        void* others[MAX_NUM_MECHS];
+        uint64_t num_others = 0, num_owned = 0;
+        for (uint64_t i = 0; i < comp->num_mechs; i++)
+        {
+            const enum hh_soa_type type = _soa_type_of(comp->my_mechs[i], comp);
+            if (type == HH_SOA_NONE)
+            {
+                others[num_others++] = comp->my_mechs[i];
+            } else {
+                counts[type][c]++;
+                comp->my_mechs[num_owned++] = comp->my_mechs[i];
+            }
+        }
+        memcpy(&comp->my_mechs[num_owned], others, num_others * sizeof(void*));
+        soa->num_owned[c] = num_owned;
+    }
+
+    if (_soa_block_init(&soa->leak, counts[HH_SOA_LEAK], num_cells) ||
+        _soa_block_init(&soa->na, counts[HH_SOA_NA], num_cells) ||
+        _soa_block_init(&soa->k, counts[HH_SOA_K], num_cells))
+    {
+        goto fail;
+    }
+
+    soa->g_leak = (double*) _soa_calloc(soa->leak.num, sizeof(double));
+    soa->e_rev = (double*) _soa_calloc(soa->leak.num, sizeof(double));
+    soa->g_na = (double*) _soa_calloc(soa->na.num, sizeof(double));
+    soa->e_na = (double*) _soa_calloc(soa->na.num, sizeof(double));
+    soa->hh_m = (double*) _soa_calloc(soa->na.num, sizeof(double));
+    soa->hh_h = (double*) _soa_calloc(soa->na.num, sizeof(double));
+    soa->g_k = (double*) _soa_calloc(soa->k.num, sizeof(double));
+    soa->e_k = (double*) _soa_calloc(soa->k.num, sizeof(double));
+    soa->hh_n = (double*) _soa_calloc(soa->k.num, sizeof(double));
+    if (!soa->g_leak || !soa->e_rev || !soa->g_na || !soa->e_na ||
+        !soa->hh_m || !soa->hh_h || !soa->g_k || !soa->e_k || !soa->hh_n)
+    {
+        goto fail;
+    }
+
+    // Second pass: gather state, in my_mechs order within each cell
+    for (uint64_t c = 0; c < num_cells; c++)
+    {
+        const struct Compartment* comp = (const struct Compartment*) network[c];
+        uint64_t j_leak = soa->leak.first[c];
+        uint64_t j_na = soa->na.first[c];
+        uint64_t j_k = soa->k.first[c];
+
+        for (uint64_t i = 0; i < soa->num_owned[c]; i++)
+        {
+            void* mech = comp->my_mechs[i];
+            const uint64_t src = ((const struct Mechanism*) mech)->source_id;
+
+            switch (_soa_type_of(mech, comp))
+            {
+            case HH_SOA_LEAK:
+            {
+                const struct HHLeakMechanism* m = (const struct HHLeakMechanism*) mech;
+                soa->leak.src[j_leak] = src;
+                soa->leak.objs[j_leak] = mech;
+                soa->g_leak[j_leak] = m->g_leak;
+                soa->e_rev[j_leak] = m->e_rev;
+                j_leak++;
+                break;
+            }
+            case HH_SOA_NA:
+            {
+                const struct HHNaCurrMechanism* m = (const struct HHNaCurrMechanism*) mech;
+                soa->na.src[j_na] = src;
+                soa->na.objs[j_na] = mech;
+                soa->g_na[j_na] = m->g_na;
+                soa->e_na[j_na] = m->e_na;
+                soa->hh_m[j_na] = m->hh_m;
+                soa->hh_h[j_na] = m->hh_h;
+                j_na++;
+                break;
+            }
+            case HH_SOA_K:
+            {
+                const struct HHKCurrMechanism* m = (const struct HHKCurrMechanism*) mech;
+                soa->k.src[j_k] = src;
+                soa->k.objs[j_k] = mech;
+                soa->g_k[j_k] = m->g_k;
+                soa->e_k[j_k] = m->e_k;
+                soa->hh_n[j_k] = m->hh_n;
+                j_k++;
+                break;
+            }
+            default:
+                assert(false && "Unowned mechanism in owned range");
+            }
+        }
+    }
+
+    for (int t = 0; t < HH_SOA_NUM_TYPES; t++)
+    {
+        free(counts[t]);
+    }
+    return soa;
+
+fail:
+    for (int t = 0; t < HH_SOA_NUM_TYPES; t++)
+    {
+        free(counts[t]);
+    }
+    hh_soa_free(soa);
+    return NULL;
+}
+
+void hh_soa_free(hh_soa_t soa)
+{
+    if (soa == NULL)
+    {
+        return;
+    }
+
+    _soa_block_free(&soa->leak);
+    _soa_block_free(&soa->na);
+    _soa_block_free(&soa->k);
+    free(soa->num_owned);
+    free(soa->i_ion);
+#ifdef HH_IMPLICIT_VM
+    free(soa->g_ion);
+#endif
+    free(soa->g_leak);
+    free(soa->e_rev);
+    free(soa->g_na);
+    free(soa->e_na);
+    free(soa->hh_m);
+    free(soa->hh_h);
+    free(soa->g_k);
+    free(soa->e_k);
+    free(soa->hh_n);
+    free(soa);
+}
+
+static inline void _soa_gather_vm(const struct hh_soa_block* block,
+                                  void** network,
+                                  const uint64_t lo,
+                                  const uint64_t hi,
+                                  const uint64_t curr_step)
+{
+    for (uint64_t j = lo; j < hi; j++)
+    {
+        const struct HHSomaCompartment* c1 =
+            (const struct HHSomaCompartment*) network[block->src[j]];
+        block->vm[j] = HHSOMA_VM(c1, curr_step - 1);
+    }
+}
+
+static void _soa_leak_kernel(const uint64_t lo,
+                             const uint64_t hi,
+                             const double* restrict vm,
+                             const double* restrict g_leak,
+                             const double* restrict e_rev,
+                             double* restrict i_out)
+{
+#pragma GCC ivdep
+    for (uint64_t j = lo; j < hi; j++)
+    {
+        i_out[j] = -g_leak[j] * (vm[j] - e_rev[j]);
+    }
+}
+
+#ifdef HH_IMPLICIT_VM
+//! Summed conductance of a cell's owned mechanisms, with the current gates
+static inline double _soa_cell_conductance(const hh_soa_t soa, const uint64_t c)
+{
+    double G_sum = 0.0;
+    for (uint64_t j = soa->leak.first[c]; j < soa->leak.first[c + 1]; j++)
+    {
+        G_sum += soa->g_leak[j];
+    }
+    for (uint64_t j = soa->na.first[c]; j < soa->na.first[c + 1]; j++)
+    {
+        const double m = soa->hh_m[j];
+        G_sum += soa->g_na[j] * m*m*m * soa->hh_h[j];
+    }
+    for (uint64_t j = soa->k.first[c]; j < soa->k.first[c + 1]; j++)
+    {
+        const double n = soa->hh_n[j];
+        G_sum += soa->g_k[j] * n*n*n*n;
+    }
+    return G_sum;
+}
+#endif /* HH_IMPLICIT_VM */
+
+void hh_soa_step(hh_soa_t soa,
+                 void** network,
+                 const uint64_t cell_start,
+                 const uint64_t cell_end,
+                 const uint64_t curr_step)
+{
+    const uint64_t leak_lo = soa->leak.first[cell_start], leak_hi = soa->leak.first[cell_end];
+    const uint64_t na_lo = soa->na.first[cell_start], na_hi = soa->na.first[cell_end];
+    const uint64_t k_lo = soa->k.first[cell_start], k_hi = soa->k.first[cell_end];
+
+    _soa_gather_vm(&soa->leak, network, leak_lo, leak_hi, curr_step);
+    _soa_gather_vm(&soa->na, network, na_lo, na_hi, curr_step);
+    _soa_gather_vm(&soa->k, network, k_lo, k_hi, curr_step);
+
+    _soa_leak_kernel(leak_lo, leak_hi, soa->leak.vm, soa->g_leak, soa->e_rev,
+                     soa->leak.i_out);
+    hh_kernels_na(soa->isa, na_lo, na_hi, soa->na.vm, soa->g_na, soa->e_na,
+                  soa->hh_m, soa->hh_h, soa->na.i_out);
+    hh_kernels_k(soa->isa, k_lo, k_hi, soa->k.vm, soa->g_k, soa->e_k,
+                 soa->hh_n, soa->k.i_out);
+
+    // Sum per cell in the same order the object path would (Leak, Na, K)
+    for (uint64_t c = cell_start; c < cell_end; c++)
+    {
+        double I_sum = 0.0;
+        for (uint64_t j = soa->leak.first[c]; j < soa->leak.first[c + 1]; j++)
+        {
+            I_sum += soa->leak.i_out[j];
+        }
+        for (uint64_t j = soa->na.first[c]; j < soa->na.first[c + 1]; j++)
+        {
+            I_sum += soa->na.i_out[j];
+        }
+        for (uint64_t j = soa->k.first[c]; j < soa->k.first[c + 1]; j++)
+        {
+            I_sum += soa->k.i_out[j];
+        }
+        soa->i_ion[c] = I_sum;
+    }
+
+#ifdef HH_IMPLICIT_VM
+    for (uint64_t c = cell_start; c < cell_end; c++)
+    {
+        soa->g_ion[c] = _soa_cell_conductance(soa, c);
+    }
+#endif
+}
+
+void hh_soa_step_cell(hh_soa_t soa,
+                      void** network,
+                      const uint64_t cell,
+                      const double dt,
+                      const uint64_t curr_step)
+{
+    // Owned mechanisms are intrinsic, so they all see the cell's own voltage
+    const double vm = HHSOMA_VM((const struct HHSomaCompartment*) network[cell], curr_step - 1);
+
+    double I_sum = 0.0;
+    for (uint64_t j = soa->leak.first[cell]; j < soa->leak.first[cell + 1]; j++)
+    {
+        I_sum += -soa->g_leak[j] * (vm - soa->e_rev[j]);
+    }
+    for (uint64_t j = soa->na.first[cell]; j < soa->na.first[cell + 1]; j++)
+    {
+        I_sum += hh_na_step_dt(vm, soa->g_na[j], soa->e_na[j], &soa->hh_m[j], &soa->hh_h[j], dt);
+    }
+    for (uint64_t j = soa->k.first[cell]; j < soa->k.first[cell + 1]; j++)
+    {
+        I_sum += hh_k_step_dt(vm, soa->g_k[j], soa->e_k[j], &soa->hh_n[j], dt);
+    }
+    soa->i_ion[cell] = I_sum;
+
+#ifdef HH_IMPLICIT_VM
+    soa->g_ion[cell] = _soa_cell_conductance(soa, cell);
+#endif
+}
+
+void hh_soa_scatter(const hh_soa_t soa)
+{
+    for (uint64_t j = 0; j < soa->na.num; j++)
+    {
+        struct HHNaCurrMechanism* m = (struct HHNaCurrMechanism*) soa->na.objs[j];
+        m->hh_m = soa->hh_m[j];
+        m->hh_h = soa->hh_h[j];
+    }
+
+    for (uint64_t j = 0; j < soa->k.num; j++)
+    {
+        struct HHKCurrMechanism* m = (struct HHKCurrMechanism*) soa->k.objs[j];
+        m->hh_n = soa->hh_n[j];
+    }
+}
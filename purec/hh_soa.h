@@ -0,0 +1,130 @@
+/**
+ * @file    hh_soa.h
+ *
+ * @brief   Structure-of-arrays state engine for Hodgkin-Huxley mechanisms.
+ *
+ * @details Alternative backend for HHLeakMechanism, HHNaCurrMechanism and
+ *          HHKCurrMechanism. Mechanisms are still built and attached through
+ *          the object API; the engine then gathers their state into
+ *          contiguous per-type arrays and updates every instance of a type in
+ *          one loop, without pointer-chasing or indirect calls. Mechanisms it
+ *          does not own keep going through mechanism_fxn as usual.
+ */
+#ifndef HH_SOA_H
+#define HH_SOA_H
+
+#include <stdint.h>
+
+#include "hh_kernels.h"
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+//! Instances of a single mechanism type, sorted by owning compartment.
+struct hh_soa_block
+{
+    //! Number of instances of this type
+    uint64_t num;
+    //! Instance offset of each compartment's first instance (num_cells + 1)
+    uint64_t* restrict first;
+    //! Network index of the compartment whose voltage drives each instance
+    uint64_t* restrict src;
+    //! Mechanism objects the state was gathered from
+    void** restrict objs;
+    //! Membrane voltage gathered for the current step - mV
+    double* restrict vm;
+    //! Current produced by each instance in the current step
+    double* restrict i_out;
+};
+
+//! Per-type state arrays for every SoA-owned mechanism in a network.
+typedef struct hh_soa
+{
+    //! Number of compartments in the network
+    uint64_t num_cells;
+    //! Gate kernel variant (vectorized only if built with HH_SIMD)
+    enum hh_kernels_isa isa;
+    //! Number of leading my_mechs entries owned by the engine, per compartment
+    uint64_t* restrict num_owned;
+    //! Summed current of owned mechanisms, per compartment
+    double* restrict i_ion;
+#ifdef HH_IMPLICIT_VM
+    //! Summed conductance of owned mechanisms, per compartment
+    double* restrict g_ion;
+#endif
+
+    //! HHLeakMechanism instances
+    struct hh_soa_block leak;
+    double* restrict g_leak;
+    double* restrict e_rev;
+
+    //! HHNaCurrMechanism instances
+    struct hh_soa_block na;
+    double* restrict g_na;
+    double* restrict e_na;
+    double* restrict hh_m;
+    double* restrict hh_h;
+
+    //! HHKCurrMechanism instances
+    struct hh_soa_block k;
+    double* restrict g_k;
+    double* restrict e_k;
+    double* restrict hh_n;
+} *hh_soa_t;
+
+/**
+ * @brief Gathers Leak/Na/K mechanism state of a network into per-type arrays.
+ *
+ * Every compartment must be an HHSomaCompartment. A mechanism is taken over
+ * if its type is one of the above and its source is its own compartment; each
+ * compartment's my_mechs is stably reordered so taken-over mechanisms come
+ * first (see hh_soa::num_owned), which HHSomaCompartment_integrate relies on.
+ *
+ * @param network   network of compartments, indexed by ID
+ * @param num_cells number of compartments in the network
+ *
+ * @returns new engine, or NULL on allocation failure.
+ */
+extern hh_soa_t hh_soa_new(void** network, const uint64_t num_cells);
+
+/**
+ * @brief Frees all memory of the given engine. Objects are left untouched.
+ */
+extern void hh_soa_free(hh_soa_t soa);
+
+/**
+ * @brief Advances owned mechanisms of compartments [cell_start, cell_end).
+ *
+ * Reads membrane voltage at curr_step - 1, updates gating state and leaves
+ * the summed current of each compartment in hh_soa::i_ion (and, with
+ * HH_IMPLICIT_VM, its summed conductance in hh_soa::g_ion).
+ */
+extern void hh_soa_step(hh_soa_t soa,
+                        void** network,
+                        const uint64_t cell_start,
+                        const uint64_t cell_end,
+                        const uint64_t curr_step);
+
+/**
+ * @brief Advances owned mechanisms of a single compartment by a step of dt.
+ *
+ * Scalar counterpart of hh_soa_step for cells stepping on their own
+ * schedule (see adaptive_step.h); dt may span several steps. Results are
+ * left in the same per-compartment arrays.
+ */
+extern void hh_soa_step_cell(hh_soa_t soa,
+                             void** network,
+                             const uint64_t cell,
+                             const double dt,
+                             const uint64_t curr_step);
+
+/**
+ * @brief Writes array state back into the original mechanism objects.
+ *
+ * Must be called before objects are inspected or sent to another process.
+ */
+extern void hh_soa_scatter(const hh_soa_t soa);
+
+#endif /* HH_SOA_H */
@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #ifdef CUDA
 #include <vector_types.h>
@@ -21,6 +24,23 @@ extern "C"
 	#include "HHNaCurrMechanism.h"
 	#include "HHKCurrMechanism.h"
     #include "DCCurrentMech.h"
+	#include "HHSpikeGABAAMechanism.h"
+	#include "hh_soa.h"
+	#include "hh_kernels.h"
+	#include "hh_rates.h"
+	#include "hh_integrate.h"
+	#include "hh_rate_table.h"
+	#include "ddtable.h"
+	#include "thread_barrier.h"
+	#include "cell_sched.h"
+	#include "spike_events.h"
+	#include "myriad_params.h"
+	#include "vm_recorder.h"
+	#include "trace_file.h"
+	#include "synapse_table.h"
+	#include "adaptive_step.h"
+	#include "section.h"
+	#include "ensemble.h"
 }
 
 #ifdef CUDA
@@ -304,7 +324,13 @@ static int HHCompartmentTest()
 
 	void** network = (void**) calloc(1, sizeof(void*));
 
-	void* hh_comp_obj = myriad_new(HHSomaCompartment, 0, 0, NULL, SIMUL_LEN, NULL, INIT_VM, CM);
+#if defined(VM_RING_BUFFER) && !defined(CUDA)
+	// Host-side recording sink, since the compartment only keeps a few steps
+	double* vm_trace = (double*) calloc(SIMUL_LEN, sizeof(double));
+#else
+	double* vm_trace = NULL;
+#endif
+	void* hh_comp_obj = myriad_new(HHSomaCompartment, 0, 0, NULL, SIMUL_LEN, vm_trace, INIT_VM, CM);
 	void* hh_leak_mech = myriad_new(HHLeakMechanism, 0, G_LEAK, E_REV);
 	void* hh_na_curr_mech = myriad_new(HHNaCurrMechanism, 0, G_NA, E_NA, HH_M, HH_H);
 	void* hh_k_curr_mech = myriad_new(HHKCurrMechanism, 0, G_K, E_K, HH_N);
@@ -362,7 +388,12 @@ static int HHCompartmentTest()
 
 	struct HHSomaCompartment* curr_comp = (struct HHSomaCompartment*) hh_comp_obj;
 	FILE* p_file = fopen("output.dat","wb");
+#if defined(VM_RING_BUFFER) && !defined(CUDA)
+	fwrite(vm_trace, sizeof(double), SIMUL_LEN, p_file);
+	free(vm_trace);
+#else
 	fwrite(curr_comp->vm, sizeof(double), curr_comp->vm_len, p_file);
+#endif
 	fclose(p_file);
 
 	// Free
@@ -374,6 +405,1697 @@ static int HHCompartmentTest()
     return EXIT_SUCCESS;
 }
 
+/////////////////////////////////////
+// Test SoA mechanism state engine //
+/////////////////////////////////////
+
+static int hh_soa_test()
+{
+#ifdef CUDA
+	// The SoA engine is host-only
+	return EXIT_SUCCESS;
+#else
+	initMechanism(0);
+	initDCCurrMech(0);
+	initHHLeakMechanism(0);
+	initHHNaCurrMechanism(0);
+	initHHKCurrMechanism(0);
+	initCompartment(0);
+	initHHSomaCompartment(0);
+
+	// Identical single-cell networks, one driven through each backend
+	void* obj_network[1];
+	void* soa_network[1];
+	void** networks[2] = {obj_network, soa_network};
+	for (int i = 0; i < 2; i++)
+	{
+		void* comp = myriad_new(HHSomaCompartment, 0, 0, NULL, NULL, -65.0, 1.0);
+		// Out of order on purpose: the engine must move its mechanisms up front
+		assert(EXIT_SUCCESS == add_mechanism(comp, myriad_new(DCCurrentMech, 0, 1000, SIMUL_LEN, 9.0)));
+		assert(EXIT_SUCCESS == add_mechanism(comp, myriad_new(HHLeakMechanism, 0, 1.0, -65.0)));
+		assert(EXIT_SUCCESS == add_mechanism(comp, myriad_new(HHNaCurrMechanism, 0, 35.0, 55.0, 0.5, 0.1)));
+		assert(EXIT_SUCCESS == add_mechanism(comp, myriad_new(HHKCurrMechanism, 0, 9.0, -90.0, 0.1)));
+		networks[i][0] = comp;
+	}
+
+	hh_soa_t soa = hh_soa_new(soa_network, 1);
+	assert(soa != NULL);
+	if (soa->num_owned[0] != 3 || soa->leak.num != 1 || soa->na.num != 1 || soa->k.num != 1)
+	{
+		fputs("SoA engine did not take over Leak/Na/K mechanisms\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	const struct HHSomaCompartment* obj_comp = (const struct HHSomaCompartment*) obj_network[0];
+	const struct HHSomaCompartment* soa_comp = (const struct HHSomaCompartment*) soa_network[0];
+	double curr_time = DT;
+	for (uint64_t curr_step = 1; curr_step < SIMUL_LEN; curr_step++)
+	{
+		simul_fxn(obj_network[0], obj_network, curr_time, curr_step);
+
+		// Explicit voltage step on both sides, whatever HH_IMPLICIT_VM says
+		hh_soa_step(soa, soa_network, 0, 1, curr_step);
+		HHSomaCompartment_integrate(soa_network[0],
+									soa_network,
+									soa->i_ion[0],
+									0.0,
+									soa->num_owned[0],
+									DT,
+									curr_time,
+									curr_step);
+
+		if (fabs(HHSOMA_VM(obj_comp, curr_step) - HHSOMA_VM(soa_comp, curr_step)) > 1e-6)
+		{
+			fprintf(stderr, "Backends diverged at step %lu\n", (unsigned long) curr_step);
+			return EXIT_FAILURE;
+		}
+		curr_time += DT;
+	}
+
+	// Objects must reflect array state once scattered back
+	hh_soa_scatter(soa);
+	const struct HHNaCurrMechanism* na_mech =
+		(const struct HHNaCurrMechanism*) ((const struct Compartment*) soa_network[0])->my_mechs[1];
+	if (na_mech->hh_m != soa->hh_m[0] || na_mech->hh_h != soa->hh_h[0])
+	{
+		fputs("Scattered Na state does not match SoA state\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	hh_soa_free(soa);
+
+	return EXIT_SUCCESS;
+#endif /* CUDA */
+}
+
+////////////////////////////////////
+// Test vectorized HH gate kernels //
+////////////////////////////////////
+
+// |a - b| within tol, relative to the larger magnitude (or 1, near zero)
+static inline bool _rel_close(const double a, const double b, const double tol)
+{
+	return fabs(a - b) <= tol * fmax(1.0, fmax(fabs(a), fabs(b)));
+}
+
+static int hh_kernels_test()
+{
+	const enum hh_kernels_isa isa = hh_kernels_detect();
+	printf("\tUsing %s kernels\n", hh_kernels_isa_name(isa));
+
+	// Exponential over the range the rate functions actually see
+	const uint64_t num_x = 200001;
+	double* x = (double*) calloc(num_x, sizeof(double));
+	double* y = (double*) calloc(num_x, sizeof(double));
+	for (uint64_t i = 0; i < num_x; i++)
+	{
+		x[i] = -100.0 + 200.0 * ((double) i / (num_x - 1));
+	}
+	hh_kernels_exp(isa, num_x, x, y);
+	for (uint64_t i = 0; i < num_x; i++)
+	{
+		if (fabs(y[i] - exp(x[i])) > HH_KERNELS_EXP_REL_ERR * exp(x[i]))
+		{
+			fprintf(stderr, "exp(%.17g) off by %g relative\n", x[i], fabs(y[i] / exp(x[i]) - 1.0));
+			return EXIT_FAILURE;
+		}
+	}
+	free(x);
+	free(y);
+
+	// Gate updates over a voltage sweep, stepped repeatedly from the same start
+	const uint64_t num_v = 12345;  // Not a multiple of any vector width
+	double* vm = (double*) calloc(num_v, sizeof(double));
+	double* g = (double*) calloc(num_v, sizeof(double));
+	double* e = (double*) calloc(num_v, sizeof(double));
+	double* gates[2][3];
+	double* i_na[2];
+	double* i_k[2];
+	for (int b = 0; b < 2; b++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			gates[b][k] = (double*) calloc(num_v, sizeof(double));
+		}
+		i_na[b] = (double*) calloc(num_v, sizeof(double));
+		i_k[b] = (double*) calloc(num_v, sizeof(double));
+	}
+
+	for (uint64_t j = 0; j < num_v; j++)
+	{
+		double v = -100.0 + 160.0 * ((double) j / (num_v - 1));
+		// Stay away from the removable singularities at -45, -18 and -10 mV
+		if (fabs(v + 45.0) < 0.01 || fabs(v + 18.0) < 0.01 || fabs(v + 10.0) < 0.01)
+		{
+			v += 0.02;
+		}
+		vm[j] = v;
+		g[j] = 35.0;
+		e[j] = 55.0;
+		for (int b = 0; b < 2; b++)
+		{
+			gates[b][0][j] = 0.5;
+			gates[b][1][j] = 0.1;
+			gates[b][2][j] = 0.1;
+		}
+	}
+
+	// Index 0 is the scalar reference, 1 the dispatched variant
+	const enum hh_kernels_isa variants[2] = {HH_KERNELS_SCALAR, isa};
+	uint64_t num_tested = 0;
+	for (int step = 0; step < 100; step++)
+	{
+		for (int b = 0; b < 2; b++)
+		{
+			// Odd start offset so vector loops see unaligned data and a tail
+			hh_kernels_na(variants[b], 1, num_v, vm, g, e, gates[b][0], gates[b][1], i_na[b]);
+			hh_kernels_k(variants[b], 1, num_v, vm, g, e, gates[b][2], i_k[b]);
+		}
+
+		for (uint64_t j = 1; j < num_v; j++, num_tested++)
+		{
+			if (!_rel_close(gates[0][0][j], gates[1][0][j], HH_KERNELS_REL_TOL) ||
+				!_rel_close(gates[0][1][j], gates[1][1][j], HH_KERNELS_REL_TOL) ||
+				!_rel_close(gates[0][2][j], gates[1][2][j], HH_KERNELS_REL_TOL) ||
+				!_rel_close(i_na[0][j], i_na[1][j], HH_KERNELS_REL_TOL) ||
+				!_rel_close(i_k[0][j], i_k[1][j], HH_KERNELS_REL_TOL))
+			{
+				fprintf(stderr, "Gates differ at vm=%g after %d steps\n", vm[j], step + 1);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	printf("\t%lu gate updates within %g of scalar\n", (unsigned long) num_tested, HH_KERNELS_REL_TOL);
+
+	for (int b = 0; b < 2; b++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			free(gates[b][k]);
+		}
+		free(i_na[b]);
+		free(i_k[b]);
+	}
+	free(vm);
+	free(g);
+	free(e);
+
+	return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////
+// Test convergence of the HH integrators //
+////////////////////////////////////////////
+
+//! Length of the test run and spacing of the compared samples - ms
+#define HH_INTEGRATE_TEST_T_END 10.0
+#define HH_INTEGRATE_TEST_T_SAMPLE 0.1
+#define HH_INTEGRATE_TEST_NUM_SAMPLES 100
+
+/**
+ * Runs a DC-driven single-compartment HH cell with the compiled-in rules at
+ * step size dt, sampling voltage every HH_INTEGRATE_TEST_T_SAMPLE.
+ *
+ * @returns false if voltage or a gate left its valid range
+ */
+static bool _hh_integrate_run(const double dt, double* vm_samples)
+{
+	const double i_dc = 20.0;
+	const uint64_t num_steps = (uint64_t) llround(HH_INTEGRATE_TEST_T_END / dt);
+	const uint64_t sample_every = (uint64_t) llround(HH_INTEGRATE_TEST_T_SAMPLE / dt);
+	double vm = INIT_VM, m = HH_M, h = HH_H, n = HH_N;
+
+	for (uint64_t s = 1; s <= num_steps; s++)
+	{
+		double a_m, b_m, a_h, b_h, a_n, b_n;
+		hh_na_get_rates(vm, &a_m, &b_m, &a_h, &b_h);
+		hh_k_get_rates(vm, &a_n, &b_n);
+		m = hh_gate_update(m, a_m, b_m, dt);
+		h = hh_gate_update(h, a_h, b_h, dt);
+		n = hh_gate_update(n, a_n, b_n, dt);
+
+		const double g_na = G_NA * m*m*m * h;
+		const double g_k = G_K * n*n*n*n;
+		const double i_sum = i_dc - G_LEAK * (vm - E_REV) - g_na * (vm - E_NA) - g_k * (vm - E_K);
+		vm = hh_vm_update(vm, i_sum, G_LEAK + g_na + g_k, CM, dt);
+
+		if (!isfinite(vm) || !(m >= 0.0 && m <= 1.0 && h >= 0.0 && h <= 1.0 && n >= 0.0 && n <= 1.0))
+		{
+			return false;
+		}
+		if (s % sample_every == 0)
+		{
+			vm_samples[s / sample_every - 1] = vm;
+		}
+	}
+
+	return true;
+}
+
+static int hh_integrate_test()
+{
+	double vm_ref[HH_INTEGRATE_TEST_NUM_SAMPLES];
+	double vm_test[HH_INTEGRATE_TEST_NUM_SAMPLES];
+	assert(_hh_integrate_run(0.00005, vm_ref));
+
+	// Halving the step should (about) halve the error, as for any first order rule
+	const double dts[3] = {0.004, 0.002, 0.001};
+	double errs[3];
+	for (int d = 0; d < 3; d++)
+	{
+		if (!_hh_integrate_run(dts[d], vm_test))
+		{
+			fprintf(stderr, "Integration left valid range at dt=%g\n", dts[d]);
+			return EXIT_FAILURE;
+		}
+		errs[d] = 0.0;
+		for (int j = 0; j < HH_INTEGRATE_TEST_NUM_SAMPLES; j++)
+		{
+			errs[d] = fmax(errs[d], fabs(vm_test[j] - vm_ref[j]));
+		}
+		printf("\tdt=%g: max |dVm| %g mV\n", dts[d], errs[d]);
+	}
+	for (int d = 1; d < 3; d++)
+	{
+		const double ratio = errs[d - 1] / errs[d];
+		if (!(ratio > 1.6 && ratio < 2.5))
+		{
+			fprintf(stderr, "Error shrank by %g going to dt=%g, expected ~2\n", ratio, dts[d]);
+			return EXIT_FAILURE;
+		}
+	}
+
+#ifdef HH_EXP_EULER
+	// Gates stay bounded far past the forward Euler stability limit
+	if (!_hh_integrate_run(0.05, vm_test))
+	{
+		fputs("Exponential Euler gates left [0, 1] at dt=0.05\n", stderr);
+		return EXIT_FAILURE;
+	}
+#endif
+
+	return EXIT_SUCCESS;
+}
+
+//////////////////////////////
+// Test channel rate tables //
+//////////////////////////////
+
+static int hh_rate_table_test()
+{
+	if (hh_rate_table_new(0.0, -1.0, 0.01) != NULL || hh_rate_table_new(-1.0, 1.0, 0.0) != NULL)
+	{
+		fputs("Rate table accepted an empty range\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	hh_rate_table_t table = hh_rate_table_new(HH_RATE_TABLE_VM_MIN, HH_RATE_TABLE_VM_MAX, HH_RATE_TABLE_DVM);
+	assert(table != NULL);
+
+	const double max_err = hh_rate_table_validate(table);
+	if (!(max_err <= HH_RATE_TABLE_REL_TOL))
+	{
+		fprintf(stderr, "Interpolated rates off by up to %g (relative)\n", max_err);
+		return EXIT_FAILURE;
+	}
+
+	// Removable singularities must tabulate as their (finite, positive) limits
+	const double singular_vm[3] = {-45.0, -18.0, -10.0};
+	for (int s = 0; s < 3; s++)
+	{
+		double a_m, b_m, a_h, b_h, a_n, b_n;
+		assert(hh_rate_table_na(table, singular_vm[s], &a_m, &b_m, &a_h, &b_h));
+		assert(hh_rate_table_k(table, singular_vm[s], &a_n, &b_n));
+		if (!(a_m > 0.0 && b_m > 0.0 && a_h > 0.0 && b_h > 0.0 && a_n > 0.0 && b_n > 0.0) ||
+			isinf(a_m) || isinf(b_m) || isinf(a_n))
+		{
+			fprintf(stderr, "Bad tabulated rate near %g mV\n", singular_vm[s]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Out of range (including NaN) must be left to the analytic rates
+	const double outside_vm[3] = {HH_RATE_TABLE_VM_MIN - 1.0, HH_RATE_TABLE_VM_MAX + 1.0, NAN};
+	for (int o = 0; o < 3; o++)
+	{
+		double a_n, b_n;
+		if (hh_rate_table_k(table, outside_vm[o], &a_n, &b_n))
+		{
+			fprintf(stderr, "Rate table claimed %g mV\n", outside_vm[o]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	hh_rate_table_free(table);
+
+	return EXIT_SUCCESS;
+}
+
+/////////////////////////////
+// Test ddtable lookup mode //
+/////////////////////////////
+
+static double _ddtable_test_exp(const double x)
+{
+	return exp(x);
+}
+
+static int ddtable_test()
+{
+	// More distinct keys than slots, so some lookups must collide
+	const uint64_t num_keys = 3000;
+	ddtable_t table = ddtable_new(1024);
+	assert(table != NULL);
+
+	double* keys = (double*) calloc(num_keys, sizeof(double));
+	double* vals = (double*) calloc(num_keys, sizeof(double));
+	for (uint64_t i = 0; i < num_keys; i++)
+	{
+		keys[i] = -80.0 + i * 0.037;
+	}
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		ddtable_get_many(table, num_keys, keys, vals, &_ddtable_test_exp);
+		for (uint64_t i = 0; i < num_keys; i++)
+		{
+			if (vals[i] != exp(keys[i]) ||
+				vals[i] != ddtable_check_get_set(table, keys[i], &_ddtable_test_exp))
+			{
+				fprintf(stderr, "Wrong value for key %g in pass %d\n", keys[i], pass);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	// Every lookup is accounted for exactly once
+	const struct ddtable_stats stats = ddtable_get_stats(table);
+	if (stats.hits + stats.misses + stats.collisions != 4 * num_keys ||
+		stats.hits == 0 || stats.misses == 0 || stats.misses > table->num_kv_pairs)
+	{
+		fprintf(stderr, "Bad counters: %lu hits, %lu misses, %lu collisions\n",
+				(unsigned long) stats.hits,
+				(unsigned long) stats.misses,
+				(unsigned long) stats.collisions);
+		return EXIT_FAILURE;
+	}
+
+#ifdef DDTABLE_OPEN_ADDRESSING
+	// At half load probing should find room for every key
+	ddtable_t half = ddtable_new(2 * num_keys);
+	ddtable_get_many(half, num_keys, keys, vals, &_ddtable_test_exp);
+	ddtable_get_many(half, num_keys, keys, vals, &_ddtable_test_exp);
+	const struct ddtable_stats half_stats = ddtable_get_stats(half);
+	if (half_stats.collisions != 0 || half_stats.hits != num_keys)
+	{
+		fprintf(stderr, "Probing dropped %lu keys at half load\n",
+				(unsigned long) half_stats.collisions);
+		return EXIT_FAILURE;
+	}
+	ddtable_free(half);
+#endif
+
+	free(keys);
+	free(vals);
+	ddtable_free(table);
+
+	return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////
+// Stress test concurrent ddtable mode //
+////////////////////////////////////////
+
+#ifdef DDTABLE_CONCURRENT
+#define DDTABLE_STRESS_THREADS 4
+#define DDTABLE_STRESS_ITERS 200000
+#define DDTABLE_STRESS_KEYS 4096
+
+// Injective, so a value paired with the wrong key is always detectable
+static double _ddtable_stress_fun(const double x)
+{
+	return 2.0 * x + 1.0;
+}
+
+struct _ddtable_stress_args
+{
+	ddtable_t table;
+	uint64_t seed;
+	uint64_t num_torn;
+};
+
+static void* _ddtable_stress_worker(void* _args)
+{
+	struct _ddtable_stress_args* args = (struct _ddtable_stress_args*) _args;
+	uint64_t x = args->seed;
+	double keys[DDTABLE_BATCH], vals[DDTABLE_BATCH];
+
+	for (uint64_t i = 0; i < DDTABLE_STRESS_ITERS; i++)
+	{
+		// xorshift, so threads hit the same buckets in different orders
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		const double key = (double) (x % DDTABLE_STRESS_KEYS) + 0.5;
+
+		switch (i % 4)
+		{
+			case 0:
+				if (ddtable_check_get_set(args->table, key, &_ddtable_stress_fun) != _ddtable_stress_fun(key))
+				{
+					args->num_torn++;
+				}
+				break;
+			case 1:
+			{
+				const double val = ddtable_get_val(args->table, key);
+				if (val != DDTABLE_NULL_VAL && val != _ddtable_stress_fun(key))
+				{
+					args->num_torn++;
+				}
+				break;
+			}
+			case 2:
+				// Overwrites and evictions are what could tear a pair
+				ddtable_clobber_val(args->table, key, _ddtable_stress_fun(key));
+				break;
+			default:
+				for (int b = 0; b < DDTABLE_BATCH; b++)
+				{
+					keys[b] = (double) ((x + b) % DDTABLE_STRESS_KEYS) + 0.5;
+				}
+				ddtable_get_many(args->table, DDTABLE_BATCH, keys, vals, &_ddtable_stress_fun);
+				for (int b = 0; b < DDTABLE_BATCH; b++)
+				{
+					if (vals[b] != _ddtable_stress_fun(keys[b]))
+					{
+						args->num_torn++;
+					}
+				}
+				break;
+		}
+	}
+
+	return NULL;
+}
+#endif /* DDTABLE_CONCURRENT */
+
+static int ddtable_concurrent_test()
+{
+#ifndef DDTABLE_CONCURRENT
+	return EXIT_SUCCESS;
+#else
+	// Far more keys than slots, so buckets are constantly contended and evicted
+	ddtable_t table = ddtable_new(64);
+	assert(table != NULL);
+
+	pthread_t threads[DDTABLE_STRESS_THREADS];
+	struct _ddtable_stress_args args[DDTABLE_STRESS_THREADS];
+	for (int t = 0; t < DDTABLE_STRESS_THREADS; t++)
+	{
+		args[t].table = table;
+		args[t].seed = 0x9e3779b97f4a7c15ULL * (t + 1);
+		args[t].num_torn = 0;
+		assert(0 == pthread_create(&threads[t], NULL, &_ddtable_stress_worker, &args[t]));
+	}
+
+	uint64_t num_torn = 0;
+	for (int t = 0; t < DDTABLE_STRESS_THREADS; t++)
+	{
+		assert(0 == pthread_join(threads[t], NULL));
+		num_torn += args[t].num_torn;
+	}
+
+	const struct ddtable_stats stats = ddtable_get_stats(table);
+	ddtable_free(table);
+
+	if (num_torn != 0)
+	{
+		fprintf(stderr, "%lu lookups returned a torn key-value pair\n", (unsigned long) num_torn);
+		return EXIT_FAILURE;
+	}
+	if (stats.hits == 0 || stats.misses == 0)
+	{
+		fputs("Stress test never hit or missed the cache\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+#endif /* DDTABLE_CONCURRENT */
+}
+
+/////////////////////////////////////
+// Test simulation thread barriers //
+/////////////////////////////////////
+
+#define BARRIER_TEST_THREADS 5
+#define BARRIER_TEST_ROUNDS 10000
+
+struct _barrier_test_args
+{
+	thread_barrier_t* barrier;
+	uint32_t* count;
+	uint64_t num_stale;
+};
+
+static void* _barrier_test_worker(void* _args)
+{
+	struct _barrier_test_args* args = (struct _barrier_test_args*) _args;
+	uint32_t local_sense = 0;
+
+	for (uint32_t r = 0; r < BARRIER_TEST_ROUNDS; r++)
+	{
+		__atomic_fetch_add(args->count, 1, __ATOMIC_RELAXED);
+		thread_barrier_wait(args->barrier, &local_sense);
+		// Everyone has counted round r, and nobody can count past round r + 1
+		// until we have arrived there too
+		const uint32_t seen = __atomic_load_n(args->count, __ATOMIC_RELAXED);
+		if (seen < (r + 1) * BARRIER_TEST_THREADS || seen > (r + 2) * BARRIER_TEST_THREADS)
+		{
+			args->num_stale++;
+		}
+	}
+
+	return NULL;
+}
+
+static int thread_barrier_test()
+{
+	// Spin barrier as configured, spin barrier parking every time, mutex barrier
+	const enum thread_barrier_type types[3] = {THREAD_BARRIER_SPIN, THREAD_BARRIER_SPIN, THREAD_BARRIER_MUTEX};
+	const uint32_t spin_counts[3] = {THREAD_BARRIER_SPIN_COUNT, 0, 0};
+	for (int k = 0; k < 3; k++)
+	{
+		thread_barrier_t barrier;
+		assert(0 == thread_barrier_init(&barrier, types[k], BARRIER_TEST_THREADS));
+		barrier.spin_count = spin_counts[k];
+		uint32_t count = 0;
+
+		pthread_t threads[BARRIER_TEST_THREADS];
+		struct _barrier_test_args args[BARRIER_TEST_THREADS];
+		for (int t = 0; t < BARRIER_TEST_THREADS; t++)
+		{
+			args[t].barrier = &barrier;
+			args[t].count = &count;
+			args[t].num_stale = 0;
+			assert(0 == pthread_create(&threads[t], NULL, &_barrier_test_worker, &args[t]));
+		}
+
+		uint64_t num_stale = 0;
+		for (int t = 0; t < BARRIER_TEST_THREADS; t++)
+		{
+			assert(0 == pthread_join(threads[t], NULL));
+			num_stale += args[t].num_stale;
+		}
+		assert(0 == thread_barrier_destroy(&barrier));
+
+		if (num_stale != 0 || count != BARRIER_TEST_ROUNDS * BARRIER_TEST_THREADS)
+		{
+			fprintf(stderr, "Barrier %d let threads through early %lu times\n",
+					k, (unsigned long) num_stale);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Cell counts that do not divide evenly still give every cell to exactly
+	// one worker, with ranges at most one cell apart in size
+	const uint64_t num_cells[3] = {37, 3, 1001};
+	const uint32_t num_workers[3] = {5, 5, 4};
+	for (int k = 0; k < 3; k++)
+	{
+		cell_sched_t sched;
+		assert(0 == cell_sched_init(&sched, num_cells[k], num_workers[k], false));
+		const uint64_t share = num_cells[k] / num_workers[k];
+		bool ok = sched.bounds[0] == 0 && sched.bounds[num_workers[k]] == num_cells[k];
+		for (uint32_t t = 0; ok && t < num_workers[k]; t++)
+		{
+			const uint64_t size = sched.bounds[t + 1] - sched.bounds[t];
+			ok = sched.bounds[t + 1] >= sched.bounds[t] && (size == share || size == share + 1);
+		}
+		cell_sched_free(&sched);
+		if (!ok)
+		{
+			fprintf(stderr, "%lu cells over %u workers not covered exactly\n",
+					(unsigned long) num_cells[k], num_workers[k]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+//////////////////////////////////////////
+// Test cost-weighted cell partitioning //
+//////////////////////////////////////////
+
+static int cell_sched_rebalance_test()
+{
+	// Cost grows along the cells, so an even split overloads the last worker
+	const uint64_t num_cells = 64;
+	const uint32_t num_workers = 4;
+	cell_sched_t sched;
+	assert(0 == cell_sched_init(&sched, num_cells, num_workers, true));
+
+	double total = 0.0, max_cost = 0.0;
+	for (uint64_t i = 0; i < num_cells; i++)
+	{
+		const double cost = 1000.0 * (i + 1);
+		for (int k = 0; k < CELL_SCHED_SAMPLES; k++)
+		{
+			cell_sched_record_cell(&sched, i, cost);
+		}
+		total += cost;
+		max_cost = cost > max_cost ? cost : max_cost;
+	}
+
+	// Workers report what their current ranges cost, then get re-cut
+	double imbalance[2];
+	for (int round = 0; round < 2; round++)
+	{
+		for (uint32_t t = 0; t < num_workers; t++)
+		{
+			sched.workers[t].interval_ns = 0.0;
+			for (uint64_t i = sched.bounds[t]; i < sched.bounds[t + 1]; i++)
+			{
+				sched.workers[t].interval_ns += 1000.0 * (i + 1);
+			}
+		}
+		sched.worst_imbalance = 0.0;
+		cell_sched_rebalance(&sched);
+		imbalance[round] = sched.worst_imbalance;
+
+		const double ideal = total / num_workers;
+		bool ok = sched.bounds[0] == 0 && sched.bounds[num_workers] == num_cells;
+		for (uint32_t t = 0; ok && t < num_workers; t++)
+		{
+			double share = 0.0;
+			for (uint64_t i = sched.bounds[t]; i < sched.bounds[t + 1]; i++)
+			{
+				share += sched.cell_cost[i];
+			}
+			ok = sched.bounds[t + 1] >= sched.bounds[t] && fabs(share - ideal) <= max_cost;
+		}
+		if (!ok)
+		{
+			fprintf(stderr, "Re-cut %d does not split cells contiguously by cost\n", round);
+			cell_sched_free(&sched);
+			return EXIT_FAILURE;
+		}
+	}
+	cell_sched_free(&sched);
+
+	// The first interval ran on the even split, the second on the re-cut one
+	if (!(imbalance[1] < imbalance[0]) || imbalance[1] > 0.25)
+	{
+		fprintf(stderr, "Imbalance went from %g to %g after re-cutting\n", imbalance[0], imbalance[1]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+///////////////////////////
+// Test spike event bits //
+///////////////////////////
+
+static int spike_events_test()
+{
+	// More than one word, so cells share and straddle words
+	const uint64_t num_cells = 130;
+	spike_events_t events = spike_events_new(num_cells, 0.0, 2);
+	assert(events != NULL);
+
+	// Step 1: cells 3 and 129 cross upwards, cell 64 stays above threshold
+	for (uint64_t c = 0; c < num_cells; c++)
+	{
+		const bool crosses = c == 3 || c == 129;
+		const double prev_vm = (c == 64) ? 10.0 : -65.0;
+		spike_events_record(events, c, prev_vm, crosses || c == 64 ? 10.0 : -65.0, 1);
+	}
+	for (uint64_t c = 0; c < num_cells; c++)
+	{
+		if (spike_events_fired(events, c, 1) != (c == 3 || c == 129))
+		{
+			fprintf(stderr, "Wrong spike bit for cell %lu in step 1\n", (unsigned long) c);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Step 2 writes the other bitmap and leaves step 1 readable
+	spike_events_record(events, 5, -65.0, 10.0, 2);
+	if (!spike_events_fired(events, 3, 1) || !spike_events_fired(events, 5, 2) ||
+		spike_events_fired(events, 3, 2))
+	{
+		fputs("Step parity bitmaps are not independent\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	// Step 3 reuses step 1's bitmap: stale bits must be overwritten
+	for (uint64_t c = 0; c < num_cells; c++)
+	{
+		spike_events_record(events, c, -65.0, -65.0, 3);
+		if (spike_events_fired(events, c, 3))
+		{
+			fprintf(stderr, "Stale spike bit for cell %lu in step 3\n", (unsigned long) c);
+			return EXIT_FAILURE;
+		}
+	}
+
+	spike_events_free(events);
+
+	return EXIT_SUCCESS;
+}
+
+///////////////////////////////////////
+// Test exact-decay GABA-a synapses //
+///////////////////////////////////////
+
+static int gaba_exact_decay_test()
+{
+#if defined(CUDA) || !defined(HHSPIKEGABAA_EXACT_DECAY)
+	return EXIT_SUCCESS;
+#else
+	initMechanism(0);
+	initCompartment(0);
+	initHHSomaCompartment(0);
+	initHHSpikeGABAAMechanism(0);
+
+	const double G_MAX = 0.1, TAU_ALPHA = 1.0 / 12.0, TAU_BETA = 10.0, E_GABA = -75.0;
+	const double POST_VM = -65.0;
+	// Second spike lands well inside the first one's decay
+	const uint64_t spike_steps[2] = {1000, 1500};
+	const uint64_t num_steps = 20000;
+
+	struct HHSomaCompartment* pre =
+		(struct HHSomaCompartment*) myriad_new(HHSomaCompartment, 0, 0, NULL, NULL, -65.0, 1.0);
+	struct HHSomaCompartment* post =
+		(struct HHSomaCompartment*) myriad_new(HHSomaCompartment, 1, 0, NULL, NULL, POST_VM, 1.0);
+	void* mech = myriad_new(HHSpikeGABAAMechanism, 0, 0.0, -INFINITY, G_MAX, TAU_ALPHA, TAU_BETA, E_GABA);
+	const double norm_const = ((struct HHSpikeGABAAMechanism*) mech)->norm_const;
+
+	double t_spikes[2];
+	int num_spikes = 0;
+	for (uint64_t curr_step = 1; curr_step < num_steps; curr_step++)
+	{
+		const double global_time = curr_step * DT;
+		const bool spiking = curr_step - 1 == spike_steps[0] || curr_step - 1 == spike_steps[1];
+		HHSOMA_VM(pre, curr_step - 1) = spiking ? 10.0 : -65.0;
+		HHSOMA_VM(post, curr_step - 1) = POST_VM;
+		if (spiking)
+		{
+			// Seen by the synapse one step after the voltage crosses
+			t_spikes[num_spikes++] = global_time;
+		}
+
+		// Closed form, summing the dual exponentials of all spikes so far
+		double g_s = 0.0;
+		for (int i = 0; i < num_spikes; i++)
+		{
+			g_s += exp(-(global_time - t_spikes[i]) / TAU_BETA) -
+				exp(-(global_time - t_spikes[i]) / TAU_ALPHA);
+		}
+		const double expected = norm_const * -G_MAX * g_s * (POST_VM - E_GABA);
+
+		const double actual = mechanism_fxn(mech, pre, post, global_time, curr_step);
+		if (fabs(actual - expected) > 1e-10 * G_MAX * fabs(POST_VM - E_GABA))
+		{
+			fprintf(stderr, "Exact decay off by %g at step %lu\n",
+					actual - expected, (unsigned long) curr_step);
+			return EXIT_FAILURE;
+		}
+	}
+
+	assert(EXIT_SUCCESS == myriad_dtor(mech));
+	assert(EXIT_SUCCESS == myriad_dtor(post));
+	assert(EXIT_SUCCESS == myriad_dtor(pre));
+
+	return EXIT_SUCCESS;
+#endif
+}
+
+////////////////////////////////////////
+// Test coarse GABA-a update interval //
+////////////////////////////////////////
+
+static int gaba_update_every_test()
+{
+#ifdef CUDA
+	return EXIT_SUCCESS;
+#else
+	initMechanism(0);
+	initCompartment(0);
+	initHHSomaCompartment(0);
+	initHHSpikeGABAAMechanism(0);
+
+	const double G_MAX = 0.1, TAU_ALPHA = 1.0 / 12.0, TAU_BETA = 10.0, E_GABA = -75.0;
+	const double POST_VM = -65.0;
+	const uint32_t every = 8;
+#ifdef VM_RING_BUFFER
+	// The skipped steps are older than a bounded voltage history keeps, so
+	// the presynaptic cell publishes its crossings instead
+	spike_events_t events = spike_events_new(2, 0.0, every + 1);
+	assert(events != NULL);
+	network_spikes = events;
+#endif
+	// Neither spike lands on an update step of the coarse synapse
+	const uint64_t spike_steps[2] = {1003, 1500};
+	const uint64_t num_steps = 20000;
+
+	struct HHSomaCompartment* pre =
+		(struct HHSomaCompartment*) myriad_new(HHSomaCompartment, 0, 0, NULL, NULL, -65.0, 1.0);
+	struct HHSomaCompartment* post =
+		(struct HHSomaCompartment*) myriad_new(HHSomaCompartment, 1, 0, NULL, NULL, POST_VM, 1.0);
+	void* fine = myriad_new(HHSpikeGABAAMechanism, 0, 0.0, -INFINITY, G_MAX, TAU_ALPHA, TAU_BETA, E_GABA);
+	void* coarse = myriad_new(HHSpikeGABAAMechanism, 0, 0.0, -INFINITY, G_MAX, TAU_ALPHA, TAU_BETA, E_GABA);
+	((struct Mechanism*) coarse)->update_every = every;
+
+	double held = 0.0;
+	uint64_t num_updates = 0;
+	for (uint64_t curr_step = 1; curr_step < num_steps; curr_step++)
+	{
+		const double global_time = curr_step * DT;
+		const bool spiking = curr_step - 1 == spike_steps[0] || curr_step - 1 == spike_steps[1];
+		HHSOMA_VM(pre, curr_step - 1) = spiking ? 10.0 : -65.0;
+		HHSOMA_VM(post, curr_step - 1) = POST_VM;
+#ifdef VM_RING_BUFFER
+		spike_events_record(events, 0, curr_step > 1 ? HHSOMA_VM(pre, curr_step - 2) : INFINITY,
+							HHSOMA_VM(pre, curr_step - 1), curr_step - 1);
+#endif
+
+		const double expected = mechanism_fxn_every(fine, pre, post, global_time, curr_step);
+		const double actual = mechanism_fxn_every(coarse, pre, post, global_time, curr_step);
+		// Source ID 0, so updates land on multiples of the interval
+		if (curr_step % every == 0)
+		{
+			// Spikes in skipped steps must be caught up on, with their own timing
+			if (fabs(actual - expected) > 1e-10 * G_MAX * fabs(POST_VM - E_GABA))
+			{
+				fprintf(stderr, "Coarse synapse off by %g at step %lu\n",
+						actual - expected, (unsigned long) curr_step);
+				return EXIT_FAILURE;
+			}
+			held = actual;
+			num_updates++;
+		} else if (actual != held) {
+			fprintf(stderr, "Coarse synapse did not hold its current at step %lu\n",
+					(unsigned long) curr_step);
+			return EXIT_FAILURE;
+		}
+	}
+	if (num_updates != (num_steps - 1) / every || held == 0.0)
+	{
+		fputs("Coarse synapse was not updated as often as expected\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+#ifdef VM_RING_BUFFER
+	network_spikes = NULL;
+	spike_events_free(events);
+#endif
+	assert(EXIT_SUCCESS == myriad_dtor(coarse));
+	assert(EXIT_SUCCESS == myriad_dtor(fine));
+	assert(EXIT_SUCCESS == myriad_dtor(post));
+	assert(EXIT_SUCCESS == myriad_dtor(pre));
+
+	return EXIT_SUCCESS;
+#endif
+}
+
+////////////////////////////
+// Test CSR synapse table //
+////////////////////////////
+
+static int synapse_table_test()
+{
+	const double G_MAX = 0.1, TAU_ALPHA = 1.0 / 12.0, TAU_BETA = 10.0, E_GABA = -75.0;
+	const double POST_VM = -65.0;
+	// Cell 2 has more synapses than MAX_NUM_MECHS: one from cell 0, a delayed
+	// one from cell 1 and many from cell 3, which never fires. Cell 1 has none.
+	const uint64_t num_cells = 4, num_silent = 2 * MAX_NUM_MECHS;
+	const uint32_t delay = 7;
+	const uint64_t spike_steps[2] = {100, 150};
+
+	synapse_table_t table = synapse_table_new(num_cells, 1, TAU_ALPHA, TAU_BETA, E_GABA);
+	assert(table != NULL);
+	assert(0 == synapse_table_add(table, 0, 2, G_MAX, 0));
+	assert(0 == synapse_table_add(table, 2, 0, G_MAX, 0));
+	assert(0 == synapse_table_add(table, 2, 1, 2.0 * G_MAX, delay));
+	for (uint64_t i = 0; i < num_silent; i++)
+	{
+		assert(0 == synapse_table_add(table, 2, 3, G_MAX, 0));
+	}
+	if (synapse_table_add(table, 1, 0, G_MAX, 0) == 0 ||
+		synapse_table_add(table, 3, num_cells, G_MAX, 0) == 0)
+	{
+		fputs("Out of order or out of range synapse accepted\n", stderr);
+		return EXIT_FAILURE;
+	}
+	synapse_table_finish(table);
+	if (table->num_syns != 3 + num_silent || table->max_delay != delay ||
+		table->first[1] != 1 || table->first[2] != 1 ||
+		table->first[3] != 3 + num_silent || table->first[4] != table->num_syns)
+	{
+		fputs("Wrong synapse table layout\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	spike_events_t spikes = spike_events_new(num_cells, 0.0, table->max_delay + 2);
+	assert(spikes != NULL);
+
+	// Cell 0 fires at spike_steps[0], cell 1 at spike_steps[1]
+	double t_spikes[2] = {0.0, 0.0};
+	bool seen[2] = {false, false};
+	for (uint64_t curr_step = 1; curr_step < 2000; curr_step++)
+	{
+		const double global_time = curr_step * DT;
+		for (uint64_t c = 0; c < 2; c++)
+		{
+			// Seen one step after the crossing, plus the synapse's delay
+			const uint64_t seen_step = spike_steps[c] + 1 + (c == 1 ? delay : 0);
+			if (curr_step == seen_step)
+			{
+				t_spikes[c] = global_time;
+				seen[c] = true;
+			}
+		}
+
+		double g_s = 0.0;
+		for (int c = 0; c < 2; c++)
+		{
+			if (seen[c])
+			{
+				g_s += (c == 1 ? 2.0 : 1.0) *
+					(exp(-(global_time - t_spikes[c]) / TAU_BETA) -
+					 exp(-(global_time - t_spikes[c]) / TAU_ALPHA));
+			}
+		}
+		const bool arrives = curr_step == spike_steps[0] + 1 || curr_step == spike_steps[1] + 1 + delay;
+		if (synapse_table_pending(table, spikes, 2, curr_step) != arrives ||
+			synapse_table_pending(table, spikes, 1, curr_step))
+		{
+			fprintf(stderr, "Wrong pending events at step %lu\n", (unsigned long) curr_step);
+			return EXIT_FAILURE;
+		}
+
+		const double expected = table->norm_const * -G_MAX * g_s * (POST_VM - E_GABA);
+		const double actual = synapse_table_step(table, spikes, 2, POST_VM, global_time, curr_step);
+		if (fabs(actual - expected) > 1e-10 * G_MAX * fabs(POST_VM - E_GABA) ||
+			synapse_table_step(table, spikes, 1, POST_VM, global_time, curr_step) != 0.0)
+		{
+			fprintf(stderr, "Synaptic current off by %g at step %lu\n",
+					actual - expected, (unsigned long) curr_step);
+			return EXIT_FAILURE;
+		}
+
+		for (uint64_t c = 0; c < num_cells; c++)
+		{
+			const bool fires = (c < 2 && curr_step == spike_steps[c]);
+			spike_events_record(spikes, c, -65.0, fires ? 10.0 : -65.0, curr_step);
+		}
+	}
+
+#ifndef HHSPIKEGABAA_EXACT_DECAY
+	// Past the decay cutoff every synapse forgets its last spike and goes idle
+	const double t_late = t_spikes[1] + HHSPIKEGABAA_DECAY_CUTOFF * TAU_BETA + DT;
+	if (synapse_table_step(table, spikes, 2, POST_VM, t_late, 2000) != 0.0)
+	{
+		fputs("Synaptic current past the decay cutoff\n", stderr);
+		return EXIT_FAILURE;
+	}
+	for (uint64_t s = table->first[2]; s < table->first[3]; s++)
+	{
+		if (table->t_fired[s] != -INFINITY)
+		{
+			fprintf(stderr, "Synapse %lu still active past the decay cutoff\n", (unsigned long) s);
+			return EXIT_FAILURE;
+		}
+	}
+#endif
+
+	spike_events_free(spikes);
+	synapse_table_free(table);
+
+	return EXIT_SUCCESS;
+}
+
+///////////////////////////////////
+// Test adaptive per-cell stride //
+///////////////////////////////////
+
+static int adaptive_step_test()
+{
+	if (adaptive_step_new(1, 0.01, 0) != NULL || adaptive_step_new(1, 0.01, 48) != NULL)
+	{
+		fputs("Stride that is not a power of 2 accepted\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	const uint32_t max_stride = 16;
+	adaptive_step_t ctl = adaptive_step_new(2, 0.01, max_stride);
+	assert(ctl != NULL);
+
+	// Cell 0 ramps at a constant slope, so its stride should double up to the cap
+	double vm = -65.0;
+	uint64_t curr_step = 0;
+	while (ctl->stride[0] < max_stride)
+	{
+		if (curr_step > 64)
+		{
+			fputs("Stride did not grow on a linear ramp\n", stderr);
+			return EXIT_FAILURE;
+		}
+		curr_step += ctl->stride[0];
+		assert(adaptive_step_due(ctl, 0, curr_step) && !adaptive_step_due(ctl, 0, curr_step - 1));
+		const double h = adaptive_step_size(ctl, 0, curr_step);
+		adaptive_step_update(ctl, 0, curr_step, vm, vm + 1.0 * h, false);
+		vm += 1.0 * h;
+	}
+
+	// A sharp change of slope has to bring the stride back down
+	curr_step += max_stride;
+	double h = adaptive_step_size(ctl, 0, curr_step);
+	adaptive_step_update(ctl, 0, curr_step, vm, vm + 100.0 * h, false);
+	if (ctl->stride[0] != max_stride / 2)
+	{
+		fprintf(stderr, "Stride %u after an error of %g mV\n", ctl->stride[0], 0.5 * h * 99.0);
+		return EXIT_FAILURE;
+	}
+
+	// Synaptic input restarts at a single step
+	curr_step += ctl->stride[0];
+	h = adaptive_step_size(ctl, 0, curr_step);
+	adaptive_step_update(ctl, 0, curr_step, vm, vm + 100.0 * h, true);
+	if (ctl->stride[0] != 1 || ctl->stride[1] != 1 || ctl->last_step[1] != 0)
+	{
+		fputs("Event did not reset the stride, or touched another cell\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	if (adaptive_step_total(ctl) != ctl->num_updates[0] || ctl->num_updates[0] < 3)
+	{
+		fputs("Wrong update count\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	// Cell 1 coasts on a flat line, but a stimulus switches at step 100:
+	// it must be updated at 99 and 100, and restart at stride 1 there
+	const uint64_t onset = 100;
+	assert(adaptive_step_add_change(ctl, 1, 1000) == 0 && adaptive_step_add_change(ctl, 1, onset) == 0);
+	curr_step = 0;
+	while (curr_step < onset - 1)
+	{
+		curr_step += ctl->stride[1];
+		adaptive_step_update(ctl, 1, curr_step, -65.0, -65.0, false);
+	}
+	if (curr_step != onset - 1 || ctl->stride[1] != 1)
+	{
+		fprintf(stderr, "Stride ran past the stimulus onset to step %lu\n", (unsigned long) curr_step);
+		return EXIT_FAILURE;
+	}
+	adaptive_step_update(ctl, 1, onset, -65.0, -65.0, false);
+	if (ctl->stride[1] != 1 || ctl->next_change[1] != 1)
+	{
+		fputs("Stimulus onset did not reset the stride\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	adaptive_step_free(ctl);
+
+	return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////
+// Test Hines solver of section trees //
+////////////////////////////////////////
+
+static int section_tree_test()
+{
+	// Cell 0 is an unbranched cable, cell 1 is empty, cell 2 branches in two
+	// at every node; compartments are numbered backwards on purpose.
+	const uint64_t num_cells = 3, chain_len = 5, tree_len = 7;
+	section_tree_t tree = section_tree_new(num_cells, 1);
+	assert(tree != NULL);
+	uint64_t comp = chain_len + tree_len;
+	for (uint64_t n = 0; n < chain_len; n++)
+	{
+		const int64_t parent = n == 0 ? SECTION_NO_PARENT : (int64_t) n - 1;
+		assert((int64_t) n == section_tree_add(tree, 0, --comp, parent, 0.5 + n));
+	}
+	for (uint64_t n = 0; n < tree_len; n++)
+	{
+		const int64_t parent = n == 0 ? SECTION_NO_PARENT : ((int64_t) n - 1) / 2;
+		assert((int64_t) n == section_tree_add(tree, 2, --comp, parent, 10.0 * (n + 1)));
+	}
+	if (section_tree_add(tree, 1, 0, SECTION_NO_PARENT, 1.0) != -1 ||
+		section_tree_add(tree, 2, 0, SECTION_NO_PARENT, 1.0) != -1 ||
+		section_tree_add(tree, 2, 0, tree_len, 1.0) != -1)
+	{
+		fputs("Out of order node accepted\n", stderr);
+		return EXIT_FAILURE;
+	}
+	section_tree_finish(tree);
+	if (tree->num_nodes != chain_len + tree_len || tree->first[1] != chain_len ||
+		tree->first[2] != chain_len || tree->first[3] != tree->num_nodes ||
+		tree->comp[0] != tree->num_nodes - 1 || tree->parent[chain_len + 6] != 2)
+	{
+		fputs("Wrong section tree layout\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	// Whatever the inputs, the solution must satisfy every node's equation
+	double vm[12], diag[12], rhs[12];
+	for (uint64_t n = 0; n < tree->num_nodes; n++)
+	{
+		vm[n] = tree->vm[n] = -65.0 + 7.0 * sin(n + 1.0);
+		diag[n] = tree->diag[n] = 1.0 / DT + 0.3 * n;
+		rhs[n] = tree->rhs[n] = 4.0 * cos(3.0 * n);
+	}
+	for (uint64_t c = 0; c < num_cells; c++)
+	{
+		section_tree_solve(tree, c);
+	}
+	const double* dv = tree->rhs;
+	for (uint64_t c = 0; c < num_cells; c++)
+	{
+		for (uint64_t n = tree->first[c]; n < tree->first[c + 1]; n++)
+		{
+			double lhs = diag[n] * dv[n], expected = rhs[n];
+			for (uint64_t m = tree->first[c] + 1; m < tree->first[c + 1]; m++)
+			{
+				const uint64_t p = tree->first[c] + tree->parent[m];
+				const double g = tree->g_axial[m];
+				if (m == n || p == n)
+				{
+					const uint64_t other = m == n ? p : m;
+					lhs += g * (dv[n] - dv[other]);
+					expected += g * (vm[other] - vm[n]);
+				}
+			}
+			if (fabs(lhs - expected) > 1e-9 * fabs(diag[n] * dv[n]) + 1e-9)
+			{
+				fprintf(stderr, "Node %lu off by %g\n", (unsigned long) n, lhs - expected);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	section_tree_free(tree);
+
+	// Centre to centre of two 10 um compartments is 10 um of a 1 um wide cable
+	const double g_cyl = section_axial_conductance(100.0, 1.0, 10.0, 1.0, 10.0);
+	if (fabs(g_cyl - 1e2 / (100.0 * 10.0 / (M_PI * 0.25))) > 1e-12)
+	{
+		fprintf(stderr, "Wrong axial conductance %g\n", g_cyl);
+		return EXIT_FAILURE;
+	}
+
+#ifdef CUDA
+	// Stepping goes through host objects
+	return EXIT_SUCCESS;
+#else
+	initMechanism(0);
+	initDCCurrMech(0);
+	initHHLeakMechanism(0);
+	initCompartment(0);
+	initHHSomaCompartment(0);
+
+	// Passive soma and dendrite, DC into the soma. Axial coupling this
+	// strong would need a step below 0.1 ms if it were explicit.
+	const double g_leak = 1.0, g_ax = 5.0, i_dc = 3.0, e_leak = -65.0, dt = 0.5;
+	void* network[2];
+	for (unsigned int id = 0; id < 2; id++)
+	{
+		network[id] = myriad_new(HHSomaCompartment, id, 0, NULL, NULL, e_leak, 1.0);
+		assert(EXIT_SUCCESS == add_mechanism(network[id], myriad_new(HHLeakMechanism, id, g_leak, e_leak)));
+	}
+	assert(EXIT_SUCCESS == add_mechanism(network[0], myriad_new(DCCurrentMech, 0, 0, SIMUL_LEN, i_dc)));
+
+	tree = section_tree_new(1, 0);
+	assert(tree != NULL);
+	assert(0 == section_tree_add(tree, 0, 0, SECTION_NO_PARENT, 0.0));
+	assert(1 == section_tree_add(tree, 0, 1, 0, g_ax));
+	section_tree_finish(tree);
+
+	for (uint64_t curr_step = 1; curr_step < 200; curr_step++)
+	{
+		section_tree_step(tree, network, 0, NULL, NULL, NULL, dt, curr_step * dt, curr_step);
+	}
+
+	// Steady state of a two-node passive cable
+	const double denom = g_leak * (g_leak + 2.0 * g_ax);
+	const double vm_soma = e_leak + i_dc * (g_leak + g_ax) / denom;
+	const double vm_dend = e_leak + i_dc * g_ax / denom;
+	const struct HHSomaCompartment* soma = (const struct HHSomaCompartment*) network[0];
+	const struct HHSomaCompartment* dend = (const struct HHSomaCompartment*) network[1];
+	if (fabs(HHSOMA_VM(soma, 199) - vm_soma) > 1e-9 || fabs(HHSOMA_VM(dend, 199) - vm_dend) > 1e-9)
+	{
+		fprintf(stderr, "Steady state %g/%g mV, expected %g/%g mV\n",
+				HHSOMA_VM(soma, 199), HHSOMA_VM(dend, 199), vm_soma, vm_dend);
+		return EXIT_FAILURE;
+	}
+
+	section_tree_free(tree);
+
+	return EXIT_SUCCESS;
+#endif /* CUDA */
+}
+
+////////////////////////////////////////
+// Test lockstep ensemble of variants //
+////////////////////////////////////////
+
+#define ENSEMBLE_TEST_CELLS 3
+#define ENSEMBLE_TEST_STEPS 20000
+
+//! Small all-to-all network with the given conductances, driven through the SoA engine
+static void _ensemble_test_network(void** network,
+								   hh_soa_t* soa,
+								   synapse_table_t* table,
+								   const double g_na,
+								   const double g_k,
+								   const double g_gaba)
+{
+	*table = synapse_table_new(ENSEMBLE_TEST_CELLS, 0, 1.0 / 12.0, 10.0, -75.0);
+	assert(*table != NULL);
+	for (unsigned int id = 0; id < ENSEMBLE_TEST_CELLS; id++)
+	{
+		network[id] = myriad_new(HHSomaCompartment, id, 0, NULL, NULL, -65.0, 1.0);
+		assert(EXIT_SUCCESS == add_mechanism(network[id], myriad_new(HHLeakMechanism, id, 1.0, -65.0)));
+		assert(EXIT_SUCCESS == add_mechanism(network[id], myriad_new(HHNaCurrMechanism, id, g_na, 55.0, 0.5, 0.1)));
+		assert(EXIT_SUCCESS == add_mechanism(network[id], myriad_new(HHKCurrMechanism, id, g_k, -90.0, 0.1)));
+		// Cells are driven unequally, so they spike at different times
+		assert(EXIT_SUCCESS == add_mechanism(network[id], myriad_new(DCCurrentMech, id, 1000, SIMUL_LEN, 5.0 + 5.0 * id)));
+		for (unsigned int src = 0; src < ENSEMBLE_TEST_CELLS; src++)
+		{
+			if (src != id)
+			{
+				assert(0 == synapse_table_add(*table, id, src, g_gaba, 0));
+			}
+		}
+	}
+	synapse_table_finish(*table);
+	*soa = hh_soa_new(network, ENSEMBLE_TEST_CELLS);
+	assert(*soa != NULL);
+}
+
+static int ensemble_test()
+{
+#ifdef CUDA
+	// The SoA engine is host-only
+	return EXIT_SUCCESS;
+#else
+	initMechanism(0);
+	initDCCurrMech(0);
+	initHHLeakMechanism(0);
+	initHHNaCurrMechanism(0);
+	initHHKCurrMechanism(0);
+	initCompartment(0);
+	initHHSomaCompartment(0);
+
+	// Lane 0 keeps the network's own values
+	const double g_na = 35.0, g_k = 9.0, g_gaba = 0.1;
+	double lane_g_na[ENSEMBLE_LANES], lane_g_k[ENSEMBLE_LANES], lane_g_gaba[ENSEMBLE_LANES];
+	lane_g_na[0] = lane_g_k[0] = lane_g_gaba[0] = NAN;
+	for (uint32_t l = 1; l < ENSEMBLE_LANES; l++)
+	{
+		lane_g_na[l] = g_na * (1.0 - 0.1 * l / ENSEMBLE_LANES);
+		lane_g_k[l] = g_k * (1.0 + 0.05 * l / ENSEMBLE_LANES);
+		lane_g_gaba[l] = g_gaba * (1.0 + 1.0 * l / ENSEMBLE_LANES);
+	}
+
+	// Reference: each variant run alone, as dsac would with HH_SOA and SYNAPSE_TABLE
+	double* vm_ref = (double*) calloc(ENSEMBLE_LANES * ENSEMBLE_TEST_STEPS * ENSEMBLE_TEST_CELLS, sizeof(double));
+	assert(vm_ref != NULL);
+	for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+	{
+		void* network[ENSEMBLE_TEST_CELLS];
+		hh_soa_t soa = NULL;
+		synapse_table_t table = NULL;
+		_ensemble_test_network(network, &soa, &table,
+							   l > 0 ? lane_g_na[l] : g_na,
+							   l > 0 ? lane_g_k[l] : g_k,
+							   l > 0 ? lane_g_gaba[l] : g_gaba);
+		network_spikes = spike_events_new(ENSEMBLE_TEST_CELLS, 0.0, 2);
+		assert(network_spikes != NULL);
+
+		for (uint64_t curr_step = 1; curr_step < ENSEMBLE_TEST_STEPS; curr_step++)
+		{
+			const double curr_time = curr_step * DT;
+			hh_soa_step(soa, network, 0, ENSEMBLE_TEST_CELLS, curr_step);
+			for (uint64_t c = 0; c < ENSEMBLE_TEST_CELLS; c++)
+			{
+				struct HHSomaCompartment* comp = (struct HHSomaCompartment*) network[c];
+				double G_ext = 0.0;
+#ifdef HH_IMPLICIT_VM
+				G_ext = soa->g_ion[c];
+#endif
+				const double I_ext = soa->i_ion[c] +
+					synapse_table_step(table, network_spikes, c, HHSOMA_VM(comp, curr_step - 1),
+									   curr_time, curr_step);
+				HHSomaCompartment_integrate(comp, network, I_ext, G_ext, soa->num_owned[c],
+											DT, curr_time, curr_step);
+				vm_ref[(l * ENSEMBLE_TEST_STEPS + curr_step) * ENSEMBLE_TEST_CELLS + c] =
+					HHSOMA_VM(comp, curr_step);
+			}
+		}
+
+		spike_events_free(network_spikes);
+		network_spikes = NULL;
+		hh_soa_free(soa);
+		synapse_table_free(table);
+	}
+
+	// All variants in lockstep, built from the lane 0 network
+	void* network[ENSEMBLE_TEST_CELLS];
+	hh_soa_t soa = NULL;
+	synapse_table_t table = NULL;
+	_ensemble_test_network(network, &soa, &table, g_na, g_k, g_gaba);
+	ensemble_t ens = ensemble_new(network, soa, table, 0.0, lane_g_na, lane_g_k, lane_g_gaba);
+	assert(ens != NULL);
+
+	// The last lane's trace is recorded on its own, as dsac does per lane
+	const uint32_t rec_lane = ENSEMBLE_LANES - 1;
+	char path[] = "/tmp/ensemble_test_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd != -1);
+	close(fd);
+	const uint64_t rec_cell = ENSEMBLE_TEST_CELLS - 1;
+	vm_recorder_t rec = vm_recorder_new(path, &rec_cell, 1, 1, 0, DT);
+	assert(rec != NULL);
+	vm_recorder_sample_values(rec, ens->vm + rec_lane, ENSEMBLE_LANES);
+
+	// Only rounding may differ: contracted multiply-adds, HH_SIMD exponentials
+	const double tol = 1e-6;
+	for (uint64_t curr_step = 1; curr_step < ENSEMBLE_TEST_STEPS; curr_step++)
+	{
+		ensemble_step(ens, network, 0, ENSEMBLE_TEST_CELLS, curr_step * DT, curr_step);
+		vm_recorder_sample_values(rec, ens->vm + rec_lane, ENSEMBLE_LANES);
+		for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+		{
+			for (uint64_t c = 0; c < ENSEMBLE_TEST_CELLS; c++)
+			{
+				const double expected = vm_ref[(l * ENSEMBLE_TEST_STEPS + curr_step) * ENSEMBLE_TEST_CELLS + c];
+				if (fabs(ensemble_vm(ens, c, l) - expected) > tol)
+				{
+					fprintf(stderr, "Lane %u of cell %lu off by %g mV at step %lu\n",
+							l, (unsigned long) c, ensemble_vm(ens, c, l) - expected,
+							(unsigned long) curr_step);
+					return EXIT_FAILURE;
+				}
+			}
+		}
+		if (HHSOMA_VM((struct HHSomaCompartment*) network[0], curr_step) != ensemble_vm(ens, 0, 0))
+		{
+			fputs("Objects do not hold lane 0\n", stderr);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Variants must actually differ, and spike
+	if (ENSEMBLE_LANES > 1 && ensemble_vm(ens, 0, 0) == ensemble_vm(ens, 0, 1))
+	{
+		fputs("Lanes did not diverge\n", stderr);
+		return EXIT_FAILURE;
+	}
+	for (uint32_t l = 0; l < ENSEMBLE_LANES; l++)
+	{
+		if (ens->num_spikes[(ENSEMBLE_TEST_CELLS - 1) * ENSEMBLE_LANES + l] == 0)
+		{
+			fprintf(stderr, "No spikes in lane %u\n", l);
+			return EXIT_FAILURE;
+		}
+	}
+
+	assert(vm_recorder_close(rec) == 0);
+	trace_reader_t reader = trace_reader_open(path);
+	unlink(path);
+	assert(reader != NULL && reader->num_rows == ENSEMBLE_TEST_STEPS);
+	double* trace = (double*) malloc(ENSEMBLE_TEST_STEPS * sizeof(double));
+	assert(trace != NULL);
+	assert(trace_reader_read(reader, 0, 0, ENSEMBLE_TEST_STEPS, trace) == 0);
+	trace_reader_close(reader);
+	for (uint64_t curr_step = 1; curr_step < ENSEMBLE_TEST_STEPS; curr_step++)
+	{
+		const double expected = vm_ref[(rec_lane * ENSEMBLE_TEST_STEPS + curr_step) * ENSEMBLE_TEST_CELLS + rec_cell];
+		if (fabs(trace[curr_step] - expected) > tol)
+		{
+			fprintf(stderr, "Recorded lane %u off at step %lu\n", rec_lane, (unsigned long) curr_step);
+			return EXIT_FAILURE;
+		}
+	}
+	free(trace);
+
+	// Splitting a lane back out gives its own gate state
+	ensemble_scatter(ens, ENSEMBLE_LANES - 1);
+	if (soa->hh_n[0] != ens->hh_n[ENSEMBLE_LANES - 1])
+	{
+		fputs("Scattered lane does not match its state\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	ensemble_free(ens);
+	hh_soa_free(soa);
+	synapse_table_free(table);
+	free(vm_ref);
+
+	return EXIT_SUCCESS;
+#endif /* CUDA */
+}
+
+/////////////////////////////
+// Test runtime parameters //
+/////////////////////////////
+
+static int myriad_params_test()
+{
+	struct myriad_params params = myriad_params;
+	if (myriad_params_validate(&params) != 0)
+	{
+		fputs("Compiled-in defaults rejected\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	// Keys are case-insensitive; bad keys and values change nothing
+	assert(myriad_params_set(&params, "dt", "0.025") == 0 && params.dt == 0.025);
+	assert(myriad_params_set(&params, "NUM_CELLS", "100") == 0 && params.num_cells == 100);
+	if (myriad_params_set(&params, "NOT_A_PARAM", "1") == 0 ||
+		myriad_params_set(&params, "SIMUL_LEN", "10ms") == 0 ||
+		myriad_params_set(&params, "SIMUL_LEN", "-5") == 0 ||
+		myriad_params_set(&params, "DT", "") == 0 ||
+		params.dt != 0.025 || params.simul_len != myriad_params.simul_len)
+	{
+		fputs("Invalid parameter accepted\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	char path[] = "/tmp/myriad_params_test_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd != -1);
+	FILE* fp = fdopen(fd, "w");
+	fputs("# Sweep point\n\nSIMUL_LEN = 5000\n  gaba_g_max=0.2   # nS\nNUM_THREADS = 2\n", fp);
+	fclose(fp);
+
+	// Command line is applied in order: config first, then the override
+	char* argv[] = {(char*) "dsac", (char*) "--config", path, (char*) "--NUM_THREADS=4", (char*) "E_K=-85"};
+	const int rc = myriad_params_parse_args(&params, 5, argv);
+	if (rc != 0 || params.simul_len != 5000 || params.gaba_g_max != 0.2 ||
+		params.num_threads != 4 || params.e_k != -85.0 || params.dt != 0.025)
+	{
+		fputs("Config file/arguments not applied\n", stderr);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+
+	// Printed parameters load back to the same values
+	fp = fopen(path, "w");
+	myriad_params_print(&params, fp);
+	fclose(fp);
+	struct myriad_params reloaded = myriad_params;
+	assert(myriad_params_load(&reloaded, path) == 0);
+	unlink(path);
+	if (memcmp(&reloaded, &params, sizeof(params)) != 0)
+	{
+		fputs("Printed parameters did not round-trip\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	char* bad_argv[] = {(char*) "dsac", (char*) "SIMUL_LEN"};
+	params.num_threads = params.num_cells + 1;
+	if (myriad_params_parse_args(&params, 2, bad_argv) == 0 || myriad_params_validate(&params) == 0)
+	{
+		fputs("Invalid arguments/parameters accepted\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	// More cells than the network and its synapses can be sized for
+	params = myriad_params;
+	params.num_cells = MYRIAD_PARAMS_MAX_CELLS + 1;
+	if (myriad_params_validate(&params) == 0)
+	{
+		fputs("Oversized network accepted\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+///////////////////////////////
+// Test compressed trace file //
+///////////////////////////////
+
+static int trace_file_test()
+{
+	const uint64_t num_rows = 1000, chunk_rows = 128;
+	const uint64_t cells[3] = {7, 3, 11};
+	const char* const vars[2] = {"vm", "i_syn"};
+	double* rows = (double*) malloc(num_rows * 6 * sizeof(double));
+	assert(rows != NULL);
+
+	// A smooth voltage, a constant and noise that will not compress
+	srand(42);
+	for (uint64_t r = 0; r < num_rows; r++)
+	{
+		for (uint64_t c = 0; c < 3; c++)
+		{
+			rows[r * 6 + c] = -65.0 + 10.0 * sin(0.01 * r + c);
+			rows[r * 6 + 3 + c] = c == 1 ? (double) rand() / RAND_MAX : 0.5;
+		}
+	}
+
+	char path[] = "/tmp/trace_file_test_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd != -1);
+	close(fd);
+	trace_writer_t writer = trace_writer_new(path, vars, 2, cells, 3, 10, 0.025, chunk_rows);
+	assert(writer != NULL);
+	for (uint64_t r = 0; r < num_rows; r += chunk_rows)
+	{
+		const uint64_t len = num_rows - r < chunk_rows ? num_rows - r : chunk_rows;
+		assert(trace_writer_append(writer, rows + r * 6, len) == 0);
+
+		// Chunks are readable before the index exists
+		if (r == chunk_rows)
+		{
+			trace_reader_t live = trace_reader_open(path);
+			assert(live != NULL && live->num_rows == 2 * chunk_rows);
+			trace_reader_close(live);
+		}
+	}
+	assert(trace_writer_close(writer) == 0);
+
+	trace_reader_t reader = trace_reader_open(path);
+	unlink(path);
+	assert(reader != NULL && reader->num_rows == num_rows && reader->num_chunks == 8);
+	assert(trace_reader_column(reader, "i_syn", 3) == 4);
+	assert(trace_reader_column(reader, "vm", 4) == -1);
+	assert(trace_reader_column(reader, "gna", 3) == -1);
+
+	// Windows within a chunk, across chunk boundaries and up to the end
+	const uint64_t windows[4][2] = {{0, num_rows}, {130, 10}, {100, 300}, {990, 10}};
+	double out[1000];
+	int ret = EXIT_SUCCESS;
+	for (uint64_t w = 0; w < 4; w++)
+	{
+		for (int64_t col = 0; col < 6; col++)
+		{
+			assert(trace_reader_read(reader, col, windows[w][0], windows[w][1], out) == 0);
+			for (uint64_t i = 0; i < windows[w][1]; i++)
+			{
+				if (out[i] != rows[(windows[w][0] + i) * 6 + col])
+				{
+					fprintf(stderr, "Wrong value in column %ld, row %lu\n",
+							(long) col, (unsigned long) (windows[w][0] + i));
+					ret = EXIT_FAILURE;
+					break;
+				}
+			}
+		}
+	}
+	assert(trace_reader_read(reader, 0, 995, 10, out) == -1);
+
+	// The voltages should have shrunk, the noise not grown
+	if (reader->map_len >= num_rows * 6 * sizeof(double))
+	{
+		fprintf(stderr, "Trace of %lu bytes is not compressed\n", (unsigned long) reader->map_len);
+		ret = EXIT_FAILURE;
+	}
+	trace_reader_close(reader);
+	free(rows);
+
+	return ret;
+}
+
+////////////////////////////////////
+// Test streaming voltage recorder //
+////////////////////////////////////
+
+static int vm_recorder_test()
+{
+	const uint64_t num_comps = 3, num_steps = 100, every = 3;
+	void* network[3];
+	for (uint64_t c = 0; c < num_comps; c++)
+	{
+		network[c] = calloc(1, sizeof(struct HHSomaCompartment));
+		assert(network[c] != NULL);
+	}
+
+	// Out-of-order subset, and small chunks so several full ones and a
+	// partial last one go through the writer thread
+	char path[] = "/tmp/vm_recorder_test_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd != -1);
+	close(fd);
+	const uint64_t cells[2] = {2, 0};
+	vm_recorder_t rec = vm_recorder_new(path, cells, 2, every, 4, 0.025);
+	assert(rec != NULL);
+	for (uint64_t step = 0; step < num_steps; step++)
+	{
+		for (uint64_t c = 0; c < num_comps; c++)
+		{
+			HHSOMA_VM((struct HHSomaCompartment*) network[c], step) = 1000.0 * c + step;
+		}
+		if (vm_recorder_due(rec, step))
+		{
+			vm_recorder_sample(rec, network, step);
+		}
+	}
+	assert(vm_recorder_close(rec) == 0);
+
+	trace_reader_t reader = trace_reader_open(path);
+	unlink(path);
+	assert(reader != NULL);
+	const uint64_t num_rows = (num_steps + every - 1) / every;
+	if (reader->header->num_cells != 2 || reader->header->every != every ||
+		reader->header->dt != 0.025 || reader->num_rows != num_rows ||
+		trace_reader_column(reader, "vm", 2) != 0 || trace_reader_column(reader, "vm", 0) != 1)
+	{
+		fputs("Wrong trace header\n", stderr);
+		trace_reader_close(reader);
+		return EXIT_FAILURE;
+	}
+
+	double vms[2][34];
+	assert(num_rows <= 34);
+	assert(trace_reader_read(reader, 0, 0, num_rows, vms[0]) == 0);
+	assert(trace_reader_read(reader, 1, 0, num_rows, vms[1]) == 0);
+	trace_reader_close(reader);
+	for (uint64_t r = 0; r < num_rows; r++)
+	{
+		const double step = (double) (r * every);
+		if (vms[0][r] != 2000.0 + step || vms[1][r] != step)
+		{
+			fprintf(stderr, "Wrong voltages in trace row %lu\n", (unsigned long) r);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (uint64_t c = 0; c < num_comps; c++)
+	{
+		free(network[c]);
+	}
+
+	return EXIT_SUCCESS;
+}
+
 ///////////////////
 // Main function //
 ///////////////////
@@ -386,6 +2108,24 @@ int main(int argc, char const *argv[])
 	UNIT_TEST_FUN(mechanism_test);
 	UNIT_TEST_FUN(compartment_test);
 	UNIT_TEST_FUN(HHCompartmentTest);
+	UNIT_TEST_FUN(hh_soa_test);
+	UNIT_TEST_FUN(hh_kernels_test);
+	UNIT_TEST_FUN(hh_integrate_test);
+	UNIT_TEST_FUN(hh_rate_table_test);
+	UNIT_TEST_FUN(ddtable_test);
+	UNIT_TEST_FUN(ddtable_concurrent_test);
+	UNIT_TEST_FUN(thread_barrier_test);
+	UNIT_TEST_FUN(cell_sched_rebalance_test);
+	UNIT_TEST_FUN(spike_events_test);
+	UNIT_TEST_FUN(gaba_exact_decay_test);
+	UNIT_TEST_FUN(gaba_update_every_test);
+	UNIT_TEST_FUN(synapse_table_test);
+	UNIT_TEST_FUN(adaptive_step_test);
+	UNIT_TEST_FUN(section_tree_test);
+	UNIT_TEST_FUN(ensemble_test);
+	UNIT_TEST_FUN(myriad_params_test);
+	UNIT_TEST_FUN(vm_recorder_test);
+	UNIT_TEST_FUN(trace_file_test);
 
     puts("\nDone.");
 
@@ -87,7 +87,7 @@ extern ddtable_t exp_table;
 #endif /* USE_DDTABLE */
 
 
-// Simulation parameters
+// Simulation parameters (defaults of myriad_params with MYRIAD_RUNTIME_PARAMS)
 #define NUM_THREADS 1
 #define SIMUL_LEN 1000000
 #define DT 0.001
@@ -114,6 +114,161 @@ extern ddtable_t exp_table;
 #define GABA_TAU_ALPHA 0.08333333333333333
 #define GABA_TAU_BETA 10.0
 #define GABA_REV -75.0
+//! Steps between GABA-a synapse updates, holding their current in between
+#ifndef GABA_UPDATE_EVERY
+#define GABA_UPDATE_EVERY 1
+#endif
+
+//! Build the threaded engine; with runtime parameters it is picked at startup
+#if defined(MYRIAD_RUNTIME_PARAMS) || NUM_THREADS > 1
+#define MYRIAD_THREADED
+#endif
+
+//! Keep GABA-a synapses in a compressed sparse row table (see synapse_table.h)
+#ifdef SYNAPSE_TABLE
+#ifdef CUDA
+#error "SYNAPSE_TABLE is not supported with CUDA."
+#endif
+// The table reads presynaptic spikes, not voltages
+#ifndef SPIKE_EVENTS
+#define SPIKE_EVENTS
+#endif
+// Delay of every GABA-a synapse - steps
+#ifndef GABA_DELAY_STEPS
+#define GABA_DELAY_STEPS 0
+#endif
+#endif /* SYNAPSE_TABLE */
+
+//! Step each cell on its own error-controlled schedule (see adaptive_step.h)
+#ifdef ADAPTIVE_STEP
+// Cells are advanced outside the objects, and synapses woken by spike events
+#if !defined(HH_SOA) || !defined(SYNAPSE_TABLE)
+#error "ADAPTIVE_STEP requires HH_SOA and SYNAPSE_TABLE."
+#endif
+// Exact decay advances synapse traces one DT per call
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+#error "ADAPTIVE_STEP is not supported with HHSPIKEGABAA_EXACT_DECAY."
+#endif
+// Long strides need integration rules that stay stable and accurate on stiff
+// gates and voltage; forward Euler drifts visibly at ADAPTIVE_STEP_MAX_STRIDE
+#ifndef HH_EXP_EULER
+#define HH_EXP_EULER
+#endif
+#ifndef HH_IMPLICIT_VM
+#define HH_IMPLICIT_VM
+#endif
+#endif /* ADAPTIVE_STEP */
+
+//! Multi-compartment cells solved with the Hines algorithm (see section.h)
+#ifdef SECTIONS
+// Membrane currents come from the SoA engine; cells share one step size
+#if !defined(HH_SOA) || defined(ADAPTIVE_STEP)
+#error "SECTIONS requires HH_SOA and is not supported with ADAPTIVE_STEP."
+#endif
+#endif /* SECTIONS */
+
+//! Parameter variants of the network in SIMD lanes (see ensemble.h)
+#ifdef ENSEMBLE
+// Lanes replicate the SoA engine and synapse table state
+#if !defined(HH_SOA) || !defined(SYNAPSE_TABLE)
+#error "ENSEMBLE requires HH_SOA and SYNAPSE_TABLE."
+#endif
+#if defined(ADAPTIVE_STEP) || defined(SECTIONS) || defined(HHSPIKEGABAA_EXACT_DECAY)
+#error "ENSEMBLE is not supported with ADAPTIVE_STEP, SECTIONS or HHSPIKEGABAA_EXACT_DECAY."
+#endif
+#endif /* ENSEMBLE */
+
+//! Implicit voltage steps need channel conductances, which only the SoA engine knows
+#if defined(HH_IMPLICIT_VM) && !defined(HH_SOA)
+#error "HH_IMPLICIT_VM requires HH_SOA."
+#endif
+
+// Threads share exp_table, so it has to be the thread-safe variant
+#if defined(USE_DDTABLE) && defined(MYRIAD_THREADED) && !defined(DDTABLE_CONCURRENT)
+#error "USE_DDTABLE with NUM_THREADS > 1 requires DDTABLE_CONCURRENT."
+#endif
+
+//! Read the parameters above at startup (see myriad_params.h) instead
+#ifdef MYRIAD_RUNTIME_PARAMS
+#ifdef CUDA
+#error "MYRIAD_RUNTIME_PARAMS is not supported with CUDA."
+#endif
+#ifndef VM_RING_BUFFER
+#error "MYRIAD_RUNTIME_PARAMS requires VM_RING_BUFFER, since a full voltage history is sized by SIMUL_LEN."
+#endif
+#include "myriad_params.h"
+// myriad_params.c needs the constants themselves for its defaults
+#ifndef MYRIAD_PARAMS_DEFAULTS
+#undef NUM_THREADS
+#undef SIMUL_LEN
+#undef DT
+#undef NUM_CELLS
+#undef G_LEAK
+#undef E_REV
+#undef G_NA
+#undef E_NA
+#undef HH_M
+#undef HH_H
+#undef G_K
+#undef E_K
+#undef HH_N
+#undef CM
+#undef INIT_VM
+#undef GABA_VM_THRESH
+#undef GABA_G_MAX
+#undef GABA_TAU_ALPHA
+#undef GABA_TAU_BETA
+#undef GABA_REV
+#define NUM_THREADS (myriad_params.num_threads)
+#define SIMUL_LEN (myriad_params.simul_len)
+#define DT (myriad_params.dt)
+#define NUM_CELLS (myriad_params.num_cells)
+#define G_LEAK (myriad_params.g_leak)
+#define E_REV (myriad_params.e_rev)
+#define G_NA (myriad_params.g_na)
+#define E_NA (myriad_params.e_na)
+#define HH_M (myriad_params.hh_m)
+#define HH_H (myriad_params.hh_h)
+#define G_K (myriad_params.g_k)
+#define E_K (myriad_params.e_k)
+#define HH_N (myriad_params.hh_n)
+#define CM (myriad_params.cm)
+#define INIT_VM (myriad_params.init_vm)
+#define GABA_VM_THRESH (myriad_params.gaba_vm_thresh)
+#define GABA_G_MAX (myriad_params.gaba_g_max)
+#define GABA_TAU_ALPHA (myriad_params.gaba_tau_alpha)
+#define GABA_TAU_BETA (myriad_params.gaba_tau_beta)
+#define GABA_REV (myriad_params.gaba_rev)
+#endif /* MYRIAD_PARAMS_DEFAULTS */
+#endif /* MYRIAD_RUNTIME_PARAMS */
+
+//! Keep only a bounded voltage history per compartment instead of SIMUL_LEN;
+//! full traces are streamed to disk by VM_RECORDER
+#ifdef VM_RING_BUFFER
+// Deepest voltage lookback (in steps) of any mechanism. Channels only read
+// the previous step; spike-mediated GABA-a synapses look for a threshold
+// crossing in each of the GABA_UPDATE_EVERY steps since they last ran, which
+// reaches one step further back, unless spike events record crossings.
+#ifdef SPIKE_EVENTS
+#define HHSPIKEGABAA_VM_LOOKBACK 2
+#else
+#define HHSPIKEGABAA_VM_LOOKBACK (GABA_UPDATE_EVERY + 1)
+#endif
+#ifndef VM_MAX_LOOKBACK
+#define VM_MAX_LOOKBACK HHSPIKEGABAA_VM_LOOKBACK
+#elif VM_MAX_LOOKBACK < HHSPIKEGABAA_VM_LOOKBACK
+#error "VM_MAX_LOOKBACK is shallower than HHSpikeGABAAMechanism looks back."
+#endif
+#if VM_MAX_LOOKBACK > 65535
+#error "VM_MAX_LOOKBACK is too deep for a bounded voltage history."
+#endif
+// Ring length must hold [curr_step - VM_MAX_LOOKBACK, curr_step] and be a
+// power of 2 so that indexing is a mask instead of a modulo: smear the
+// lookback's top bit down, then add one.
+#define _VM_RING_SMEAR(x, s) ((x) | ((x) >> (s)))
+#define VM_RING_LEN (1 + _VM_RING_SMEAR(_VM_RING_SMEAR(_VM_RING_SMEAR(_VM_RING_SMEAR( \
+    ((VM_MAX_LOOKBACK) | 1), 1), 2), 4), 8))
+#endif /* VM_RING_BUFFER */
 
 #ifdef CUDA
 #include <cuda_runtime.h>
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+// We want the compiled-in constants themselves as defaults, not the
+// runtime fields myriad.h would otherwise map them to.
+#define MYRIAD_PARAMS_DEFAULTS
+#include "myriad.h"
+#include "myriad_params.h"
+
+//! Longest config file line accepted
+#define MYRIAD_PARAMS_LINE_LEN 256
+
+struct myriad_params myriad_params =
+{
+    .num_threads = NUM_THREADS,
+    .simul_len = SIMUL_LEN,
+    .dt = DT,
+    .num_cells = NUM_CELLS,
+    .g_leak = G_LEAK,
+    .e_rev = E_REV,
+    .g_na = G_NA,
+    .e_na = E_NA,
+    .hh_m = HH_M,
+    .hh_h = HH_H,
+    .g_k = G_K,
+    .e_k = E_K,
+    .hh_n = HH_N,
+    .cm = CM,
+    .init_vm = INIT_VM,
+    .gaba_vm_thresh = GABA_VM_THRESH,
+    .gaba_g_max = GABA_G_MAX,
+    .gaba_tau_alpha = GABA_TAU_ALPHA,
+    .gaba_tau_beta = GABA_TAU_BETA,
+    .gaba_rev = GABA_REV,
+};
+
+enum param_type
+{
+    PARAM_U64,
+    PARAM_DOUBLE,
+};
+
+static const struct
+{
+    const char* name;
+    enum param_type type;
+    size_t offset;
+} _params[] =
+{
+#define PARAM(type, NAME, field) {#NAME, type, offsetof(struct myriad_params, field)}
+    PARAM(PARAM_U64, NUM_THREADS, num_threads),
+    PARAM(PARAM_U64, SIMUL_LEN, simul_len),
+    PARAM(PARAM_DOUBLE, DT, dt),
+    PARAM(PARAM_U64, NUM_CELLS, num_cells),
+    PARAM(PARAM_DOUBLE, G_LEAK, g_leak),
+    PARAM(PARAM_DOUBLE, E_REV, e_rev),
+    PARAM(PARAM_DOUBLE, G_NA, g_na),
+    PARAM(PARAM_DOUBLE, E_NA, e_na),
+    PARAM(PARAM_DOUBLE, HH_M, hh_m),
+    PARAM(PARAM_DOUBLE, HH_H, hh_h),
+    PARAM(PARAM_DOUBLE, G_K, g_k),
+    PARAM(PARAM_DOUBLE, E_K, e_k),
+    PARAM(PARAM_DOUBLE, HH_N, hh_n),
+    PARAM(PARAM_DOUBLE, CM, cm),
+    PARAM(PARAM_DOUBLE, INIT_VM, init_vm),
+    PARAM(PARAM_DOUBLE, GABA_VM_THRESH, gaba_vm_thresh),
+    PARAM(PARAM_DOUBLE, GABA_G_MAX, gaba_g_max),
+    PARAM(PARAM_DOUBLE, GABA_TAU_ALPHA, gaba_tau_alpha),
+    PARAM(PARAM_DOUBLE, GABA_TAU_BETA, gaba_tau_beta),
+    PARAM(PARAM_DOUBLE, GABA_REV, gaba_rev),
+#undef PARAM
+};
+
+#define NUM_PARAMS (sizeof(_params) / sizeof(_params[0]))
+
+// Strips leading/trailing whitespace in place
+static char* _strip(char* str)
+{
+    while (isspace((unsigned char) *str))
+    {
+        str++;
+    }
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char) end[-1]))
+    {
+        end--;
+    }
+    *end = '\0';
+    return str;
+}
+
+int myriad_params_set(struct myriad_params* params,
+                      const char* key,
+                      const char* value)
+{
+    for (size_t i = 0; i < NUM_PARAMS; i++)
+    {
+        if (strcasecmp(key, _params[i].name) != 0)
+        {
+            continue;
+        }
+
+        void* field = (char*) params + _params[i].offset;
+        char* end = NULL;
+        errno = 0;
+        if (_params[i].type == PARAM_U64)
+        {
+            // strtoull would quietly wrap negative values around
+            if (strchr(value, '-') != NULL)
+            {
+                return -1;
+            }
+            const unsigned long long val = strtoull(value, &end, 0);
+            if (errno != 0 || end == value || *end != '\0')
+            {
+                return -1;
+            }
+            *(uint64_t*) field = (uint64_t) val;
+        } else {
+            const double val = strtod(value, &end);
+            if (errno != 0 || end == value || *end != '\0')
+            {
+                return -1;
+            }
+            *(double*) field = val;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+int myriad_params_load(struct myriad_params* params, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        perror("myriad_params_load: ");
+        return -1;
+    }
+
+    char line[MYRIAD_PARAMS_LINE_LEN];
+    unsigned int line_num = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line_num++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+        char* key = _strip(line);
+        if (*key == '\0')
+        {
+            continue;
+        }
+
+        char* eq = strchr(key, '=');
+        if (eq != NULL)
+        {
+            *eq = '\0';
+        }
+        if (eq == NULL || myriad_params_set(params, _strip(key), _strip(eq + 1)) != 0)
+        {
+            fprintf(stderr, "%s:%u: invalid parameter line\n", path, line_num);
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+int myriad_params_parse_args(struct myriad_params* params,
+                             const int argc,
+                             char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-c") == 0 || strcmp(arg, "--config") == 0)
+        {
+            if (i + 1 >= argc || myriad_params_load(params, argv[++i]) != 0)
+            {
+                fprintf(stderr, "Could not load config file for '%s'\n", arg);
+                return -1;
+            }
+            continue;
+        }
+        if (strncmp(arg, "--config=", strlen("--config=")) == 0)
+        {
+            if (myriad_params_load(params, arg + strlen("--config=")) != 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        // KEY=value, optionally spelled --KEY=value
+        if (strncmp(arg, "--", 2) == 0)
+        {
+            arg += 2;
+        }
+        const char* eq = strchr(arg, '=');
+        char key[MYRIAD_PARAMS_LINE_LEN];
+        if (eq == NULL || (size_t) (eq - arg) >= sizeof(key))
+        {
+            fprintf(stderr, "Invalid argument '%s', expected KEY=value\n", argv[i]);
+            return -1;
+        }
+        memcpy(key, arg, eq - arg);
+        key[eq - arg] = '\0';
+        if (myriad_params_set(params, key, eq + 1) != 0)
+        {
+            fprintf(stderr, "Invalid parameter '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int myriad_params_validate(const struct myriad_params* params)
+{
+    const char* err = NULL;
+    if (params->simul_len < 2)
+    {
+        err = "SIMUL_LEN must be at least 2";
+    } else if (!(params->dt > 0.0)) {
+        err = "DT must be positive";
+    } else if (params->num_cells < 1 || params->num_cells > MYRIAD_PARAMS_MAX_CELLS) {
+        err = "NUM_CELLS must be between 1 and MYRIAD_PARAMS_MAX_CELLS";
+#ifdef SYNAPSE_TABLE
+    } else if (params->num_cells * (params->num_cells - 1) > MYRIAD_PARAMS_MAX_SYNAPSES) {
+        err = "NUM_CELLS connects more than MYRIAD_PARAMS_MAX_SYNAPSES synapses";
+#else
+    } else if (params->num_cells - 1 > MAX_NUM_MECHS - 4) {
+        // Leak, sodium, potassium and DC current, then one synapse per other cell
+        err = "NUM_CELLS connects more synapses than MAX_NUM_MECHS allows per cell";
+#endif /* SYNAPSE_TABLE */
+    } else if (params->num_threads < 1 || params->num_threads > params->num_cells) {
+        err = "NUM_THREADS must be between 1 and NUM_CELLS";
+    } else if (!(params->cm > 0.0)) {
+        err = "CM must be positive";
+    } else if (!(params->gaba_tau_alpha > 0.0 && params->gaba_tau_beta > params->gaba_tau_alpha)) {
+        err = "GABA_TAU_BETA must exceed GABA_TAU_ALPHA > 0";
+    }
+
+    if (err != NULL)
+    {
+        fprintf(stderr, "Invalid parameters: %s\n", err);
+        return -1;
+    }
+    return 0;
+}
+
+void myriad_params_print(const struct myriad_params* params, FILE* fp)
+{
+    for (size_t i = 0; i < NUM_PARAMS; i++)
+    {
+        const void* field = (const char*) params + _params[i].offset;
+        if (_params[i].type == PARAM_U64)
+        {
+            fprintf(fp, "%s = %" PRIu64 "\n", _params[i].name, *(const uint64_t*) field);
+        } else {
+            fprintf(fp, "%s = %.17g\n", _params[i].name, *(const double*) field);
+        }
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * @file    myriad_params.h
+ *
+ * @brief   Simulation parameters read at startup instead of compiled in.
+ *
+ * @details Holds the simulation, channel and synapse constants of myriad.h
+ *          in a struct whose defaults are those constants. When built with
+ *          MYRIAD_RUNTIME_PARAMS, myriad.h maps SIMUL_LEN, DT, NUM_CELLS,
+ *          NUM_THREADS and the channel/synapse constants onto the fields of
+ *          myriad_params, so a single binary can be pointed at a config file
+ *          or given overrides on the command line for each point of a sweep.
+ *
+ *          Keys are the macro names (e.g. SIMUL_LEN, GABA_TAU_BETA), matched
+ *          case-insensitively. Config files hold one "KEY = value" per line;
+ *          '#' starts a comment.
+ *
+ *          Only the hand-written purec engine (dsac) reads these. Simulations
+ *          generated by MyriadSimul still render SIMUL_LEN, DT and NUM_CELLS
+ *          into myriad.h and object parameters into main.c, so each sweep
+ *          point there is a new build (mostly served by the build cache).
+ */
+#ifndef MYRIAD_PARAMS_H
+#define MYRIAD_PARAMS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//! Most cells NUM_CELLS may ask for, so cell IDs fit in an unsigned int with room
+#ifndef MYRIAD_PARAMS_MAX_CELLS
+#define MYRIAD_PARAMS_MAX_CELLS (1UL << 20)
+#endif
+
+//! Most synapses a synapse table may be sized for (every cell to every other)
+#ifndef MYRIAD_PARAMS_MAX_SYNAPSES
+#define MYRIAD_PARAMS_MAX_SYNAPSES (1UL << 28)
+#endif
+
+struct myriad_params
+{
+    // Simulation
+    uint64_t num_threads;
+    uint64_t simul_len;
+    double dt;
+    uint64_t num_cells;
+    // Leak
+    double g_leak;
+    double e_rev;
+    // Sodium
+    double g_na;
+    double e_na;
+    double hh_m;
+    double hh_h;
+    // Potassium
+    double g_k;
+    double e_k;
+    double hh_n;
+    // Compartment
+    double cm;
+    double init_vm;
+    // GABA-a
+    double gaba_vm_thresh;
+    double gaba_g_max;
+    double gaba_tau_alpha;
+    double gaba_tau_beta;
+    double gaba_rev;
+};
+
+//! Parameters of the running simulation, initialized to the compiled defaults
+extern struct myriad_params myriad_params;
+
+/**
+ * @brief Sets one parameter from its textual value.
+ *
+ * @returns 0 on success, -1 if the key is unknown or the value does not parse.
+ */
+extern int myriad_params_set(struct myriad_params* params,
+                             const char* key,
+                             const char* value);
+
+/**
+ * @brief Applies every "KEY = value" line of a config file.
+ *
+ * @returns 0 on success, -1 if the file cannot be read or a line is invalid
+ *          (reported on stderr with its line number).
+ */
+extern int myriad_params_load(struct myriad_params* params, const char* path);
+
+/**
+ * @brief Applies command-line arguments in order, so later ones win.
+ *
+ * Accepts "--config=FILE" (or "-c FILE") to load a config file, and
+ * "KEY=value" or "--KEY=value" to set a single parameter.
+ *
+ * @returns 0 on success, -1 on the first invalid argument.
+ */
+extern int myriad_params_parse_args(struct myriad_params* params,
+                                    const int argc,
+                                    char** argv);
+
+/**
+ * @brief Checks that parameters describe a runnable simulation.
+ *
+ * Every cell connects to every other, so NUM_CELLS is also bounded by the
+ * synapses it implies: MYRIAD_PARAMS_MAX_SYNAPSES in a synapse table, or
+ * MAX_NUM_MECHS per compartment for synapse mechanisms.
+ *
+ * @returns 0 if valid, -1 otherwise (reported on stderr).
+ */
+extern int myriad_params_validate(const struct myriad_params* params);
+
+//! Prints all parameters, one "KEY = value" per line, in config file format
+extern void myriad_params_print(const struct myriad_params* params, FILE* fp);
+
+#endif /* MYRIAD_PARAMS_H */
@@ -34,16 +34,87 @@ static PyObject* PyHHSomaCompartment_vm(PyObject* self __attribute__((unused)),
     struct HHSomaCompartment* _self =
         (struct HHSomaCompartment*) ((PyMyriadObject*) ptr)->mobject;
 
+#ifdef VM_RING_BUFFER
+    // Bounded history: copy it out oldest first, up to the latest step
+    const uint64_t len = _self->vm_step + 1 < VM_RING_LEN ? _self->vm_step + 1 : VM_RING_LEN;
+    npy_intp dims[1] = {len};
+    PyObject* buf_arr = PyArray_SimpleNew(1, dims, NPY_FLOAT64);
+    if (buf_arr == NULL)
+    {
+        return NULL;
+    }
+    double* buf = (double*) PyArray_DATA((PyArrayObject*) buf_arr);
+    for (uint64_t i = 0; i < len; i++)
+    {
+        buf[i] = HHSOMA_VM(_self, _self->vm_step + 1 - len + i);
+    }
+#else
+    npy_intp dims[1] = {sizeof(_self->vm) / sizeof(double)};
+    PyObject* buf_arr = PyArray_SimpleNewFromData(1, dims, NPY_FLOAT64, _self->vm);
+    if (buf_arr == NULL)
+    {
+        return NULL;
+    }
+    // A view, so it keeps the object (and whatever holds its memory) alive
+    Py_INCREF(ptr);
+    if (PyArray_SetBaseObject((PyArrayObject*) buf_arr, ptr) < 0)
+    {
+        Py_DECREF(buf_arr);
+        return NULL;
+    }
+#endif
+
+    return buf_arr;
+}
+
+static PyObject* PyHHSomaCompartment_vm_trace(PyObject* self __attribute__((unused)),
+                                              PyObject* args)
+{
+    PyObject* ptr = NULL;
+
+    if (PyArg_ParseTuple(args, "O", &ptr) < 0 || ptr == NULL)
+    {
+        fprintf(stderr, "Couldn't parse tuple argument. \n");
+        return NULL;
+    }
+
+    struct HHSomaCompartment* _self =
+        (struct HHSomaCompartment*) ((PyMyriadObject*) ptr)->mobject;
+
+#ifdef VM_RING_BUFFER
+    // The sink lives in the memory of whoever constructed the compartment
+    if (_self->vm_trace == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "No voltage trace recorded; stream one with VM_RECORDER");
+        return NULL;
+    }
     npy_intp dims[1] = {SIMUL_LEN};
+    PyObject* buf_arr = PyArray_SimpleNewFromData(1, dims, NPY_FLOAT64, _self->vm_trace);
+#else
+    npy_intp dims[1] = {sizeof(_self->vm) / sizeof(double)};
     PyObject* buf_arr = PyArray_SimpleNewFromData(1, dims, NPY_FLOAT64, _self->vm);
-    Py_XINCREF(buf_arr);
+#endif
+    if (buf_arr == NULL)
+    {
+        return NULL;
+    }
+    // A view, so it keeps the object (and whatever holds its memory) alive
+    Py_INCREF(ptr);
+    if (PyArray_SetBaseObject((PyArrayObject*) buf_arr, ptr) < 0)
+    {
+        Py_DECREF(buf_arr);
+        return NULL;
+    }
 
     return buf_arr;
 }
 
 static PyMethodDef pyhhsomacompartment_functions[] = {
     {"cm", PyHHSomaCompartment_cm, METH_VARARGS, "Get membrane capacitance"},
-    {"vm", PyHHSomaCompartment_vm, METH_VARARGS, "Get membrane voltage array"},
+    {"vm", PyHHSomaCompartment_vm, METH_VARARGS,
+     "Get membrane voltage array (with VM_RING_BUFFER, the last few steps, oldest first)"},
+    {"vm_trace", PyHHSomaCompartment_vm_trace, METH_VARARGS, "Get full membrane voltage trace"},
     {NULL, NULL, 0, NULL}           /* sentinel */
 };
 
@@ -15,23 +15,26 @@ static PyObject* PyMyriadObject_Init(struct MyriadObject* ptr,
                                      PyObject* args,
                                      PyObject* kwds)
 {
+    // The type is garbage-collected, so it must come from the GC allocator
     PyMyriadObject* new_obj = NULL;
-    new_obj = PyObject_New(PyMyriadObject, PyMyriadObject_type_p);
+    new_obj = PyObject_GC_New(PyMyriadObject, PyMyriadObject_type_p);
     if (new_obj == NULL)
     {
-        PyObject_Free(new_obj);
         return NULL;
     }
+    new_obj->classname = NULL;
+    new_obj->mobject = NULL;
+    new_obj->owner = NULL;
     
     if (PyMyriadObject_type_p->tp_init((PyObject*) new_obj, args, kwds) < 0)
     {
-        PyObject_Free(new_obj);
+        Py_DECREF(new_obj);
         return NULL;
     }
 
     new_obj->mobject = ptr;
 
-    Py_INCREF(new_obj); // Necessary?
+    PyObject_GC_Track(new_obj);
     return (PyObject*) new_obj;
 }
 
@@ -22,6 +22,7 @@ static int PyMyriadObject_traverse(PyMyriadObject *self,
             return vret;
         }
     }
+    Py_VISIT(self->owner);
 
     return 0;
 }
@@ -33,12 +34,14 @@ static int PyMyriadObject_clear(PyMyriadObject *self)
     tmp = self->classname;
     self->classname = NULL;
     Py_XDECREF(tmp);
+    Py_CLEAR(self->owner);
 
     return 0;
 }
 
 static void PyMyriadObject_dealloc(PyMyriadObject* self)
 {
+    PyObject_GC_UnTrack(self);
     PyMyriadObject_clear(self);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
@@ -60,6 +63,7 @@ static PyObject* PyMyriadObject_new(PyTypeObject *type,
         }
 
         self->mobject = NULL;
+        self->owner = NULL;
     }
 
     return (PyObject *)self;
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "HHSomaCompartment.h"
+#include "section.h"
+
+//! Nodes the tree has room for when no capacity is given
+#define SECTION_TREE_MIN_CAPACITY 64
+
+// Resizes one per-node array, leaving it untouched on failure.
+static int _tree_resize(void** array, const uint64_t num, const size_t size)
+{
+    void* resized = realloc(*array, num * size);
+    if (resized == NULL)
+    {
+        return -1;
+    }
+    *array = resized;
+    return 0;
+}
+
+static int _tree_reserve(section_tree_t tree, const uint64_t capacity)
+{
+    if (_tree_resize((void**) &tree->comp, capacity, sizeof(uint64_t)) ||
+        _tree_resize((void**) &tree->parent, capacity, sizeof(uint32_t)) ||
+        _tree_resize((void**) &tree->g_axial, capacity, sizeof(double)) ||
+        _tree_resize((void**) &tree->vm, capacity, sizeof(double)) ||
+        _tree_resize((void**) &tree->diag, capacity, sizeof(double)) ||
+        _tree_resize((void**) &tree->rhs, capacity, sizeof(double)))
+    {
+        return -1;
+    }
+    tree->capacity = capacity;
+    return 0;
+}
+
+section_tree_t section_tree_new(const uint64_t num_cells, const uint64_t capacity)
+{
+    section_tree_t tree = (section_tree_t) calloc(1, sizeof(struct section_tree));
+    if (tree == NULL)
+    {
+        return NULL;
+    }
+
+    tree->num_cells = num_cells;
+    tree->first = (uint64_t*) calloc(num_cells + 1, sizeof(uint64_t));
+    if (tree->first == NULL ||
+        _tree_reserve(tree, capacity > 0 ? capacity : SECTION_TREE_MIN_CAPACITY))
+    {
+        section_tree_free(tree);
+        return NULL;
+    }
+
+    return tree;
+}
+
+void section_tree_free(section_tree_t tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+    free(tree->first);
+    free(tree->comp);
+    free(tree->parent);
+    free(tree->g_axial);
+    free(tree->vm);
+    free(tree->diag);
+    free(tree->rhs);
+    free(tree);
+}
+
+int64_t section_tree_add(section_tree_t tree,
+                         const uint64_t cell,
+                         const uint64_t comp,
+                         const int64_t parent,
+                         const double g_axial)
+{
+    if (cell < tree->cursor || cell >= tree->num_cells)
+    {
+        return -1;
+    }
+
+    // Cells skipped over have no nodes
+    while (tree->cursor < cell)
+    {
+        tree->first[++tree->cursor] = tree->num_nodes;
+    }
+
+    // Only the first node of a cell is its root; the rest follow their parent
+    const uint64_t offset = tree->num_nodes - tree->first[cell];
+    const bool is_root = parent == SECTION_NO_PARENT;
+    if (is_root != (offset == 0) || (!is_root && (parent < 0 || (uint64_t) parent >= offset)) ||
+        offset >= UINT32_MAX)
+    {
+        return -1;
+    }
+    if (tree->num_nodes == tree->capacity && _tree_reserve(tree, 2 * tree->capacity))
+    {
+        return -1;
+    }
+
+    const uint64_t n = tree->num_nodes++;
+    tree->comp[n] = comp;
+    tree->parent[n] = is_root ? 0 : (uint32_t) parent;
+    tree->g_axial[n] = is_root ? 0.0 : g_axial;
+    tree->vm[n] = 0.0;
+    tree->diag[n] = 0.0;
+    tree->rhs[n] = 0.0;
+
+    return (int64_t) offset;
+}
+
+void section_tree_finish(section_tree_t tree)
+{
+    while (tree->cursor < tree->num_cells)
+    {
+        tree->first[++tree->cursor] = tree->num_nodes;
+    }
+}
+
+double section_axial_conductance(const double ra,
+                                 const double diam_1,
+                                 const double length_1,
+                                 const double diam_2,
+                                 const double length_2)
+{
+    // Half of each cylinder in series: R = ra * (L/2) / (pi * d^2 / 4);
+    // with um lengths, Ohm cm resistivity and uS out that is 1e2 / R.
+    const double r_1 = 2.0 * ra * length_1 / (M_PI * diam_1 * diam_1);
+    const double r_2 = 2.0 * ra * length_2 / (M_PI * diam_2 * diam_2);
+    return 1e2 / (r_1 + r_2);
+}
+
+void section_tree_solve(section_tree_t tree, const uint64_t cell)
+{
+    const uint64_t first = tree->first[cell];
+    const uint64_t end = tree->first[cell + 1];
+    if (first == end)
+    {
+        return;
+    }
+    const uint32_t* restrict parent = tree->parent;
+    const double* restrict g_axial = tree->g_axial;
+    const double* restrict vm = tree->vm;
+    double* restrict diag = tree->diag;
+    double* restrict rhs = tree->rhs;
+
+    // g * (dv_n - dv_p) on the left, g * (vm_p - vm_n) on the right
+    for (uint64_t n = first + 1; n < end; n++)
+    {
+        const uint64_t p = first + parent[n];
+        const double g = g_axial[n];
+        const double i_axial = g * (vm[p] - vm[n]);
+        diag[n] += g;
+        diag[p] += g;
+        rhs[n] += i_axial;
+        rhs[p] -= i_axial;
+    }
+
+    // Leaves to root: fold each node's equation into its parent's
+    for (uint64_t n = end - 1; n > first; n--)
+    {
+        const uint64_t p = first + parent[n];
+        const double f = g_axial[n] / diag[n];
+        diag[p] -= f * g_axial[n];
+        rhs[p] += f * rhs[n];
+    }
+
+    // Root to leaves: every parent is known before its children
+    rhs[first] /= diag[first];
+    for (uint64_t n = first + 1; n < end; n++)
+    {
+        rhs[n] = (rhs[n] + g_axial[n] * rhs[first + parent[n]]) / diag[n];
+    }
+}
+
+void section_tree_step(section_tree_t tree,
+                       void** network,
+                       const uint64_t cell,
+                       const double* I_ext,
+                       const double* G_ext,
+                       const uint64_t* first_mech,
+                       const double dt,
+                       const double global_time,
+                       const uint64_t curr_step)
+{
+    const uint64_t first = tree->first[cell];
+    const uint64_t end = tree->first[cell + 1];
+
+    for (uint64_t n = first; n < end; n++)
+    {
+        const uint64_t c = tree->comp[n];
+        struct HHSomaCompartment* comp = (struct HHSomaCompartment*) network[c];
+        tree->vm[n] = HHSOMA_VM(comp, curr_step - 1);
+        tree->diag[n] = comp->cm / dt + (G_ext != NULL ? G_ext[c] : 0.0);
+        tree->rhs[n] = HHSomaCompartment_current(comp,
+                                                 network,
+                                                 I_ext != NULL ? I_ext[c] : 0.0,
+                                                 first_mech != NULL ? first_mech[c] : 0,
+                                                 global_time,
+                                                 curr_step);
+    }
+
+    section_tree_solve(tree, cell);
+
+    for (uint64_t n = first; n < end; n++)
+    {
+        HHSomaCompartment_set_vm(network[tree->comp[n]], tree->vm[n] + tree->rhs[n], curr_step);
+    }
+}
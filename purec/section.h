@@ -0,0 +1,165 @@
+/**
+ * @file    section.h
+ *
+ * @brief   Multi-compartment cells (Sections) solved with the Hines algorithm.
+ *
+ * @details A cell is a tree of compartments joined by axial conductances.
+ *          Its nodes are numbered so every node comes after its parent (the
+ *          root, usually the soma, is node 0), which makes the voltage
+ *          equations of the whole tree quasi-tridiagonal: one elimination
+ *          sweep from the leaves to the root and one substitution sweep back
+ *          solve them in O(nodes), with no fill-in.
+ *
+ *          Axial currents are taken implicitly (backward Euler) in every
+ *          node's voltage, so tightly coupled compartments do not limit DT.
+ *          Membrane currents are taken as in hh_integrate.h: explicitly, or
+ *          linearly implicit in whatever conductance the caller knows about.
+ *
+ *          Cells of a tree are laid out back to back in node order, as in
+ *          synapse_table.h. Each cell's system is independent of every other,
+ *          so different cells may be solved concurrently.
+ */
+#ifndef SECTION_H
+#define SECTION_H
+
+#include <stdint.h>
+
+#include "myriad.h"
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+//! Compartments per cell in the dsac network, soma first
+#ifndef SECTION_NUM_COMPS
+#define SECTION_NUM_COMPS 5
+#endif
+
+//! Axial conductance between neighbouring compartments in dsac - uS
+#ifndef SECTION_G_AXIAL
+#define SECTION_G_AXIAL 1.0
+#endif
+
+//! Parent of a cell's root node
+#define SECTION_NO_PARENT -1
+
+typedef struct section_tree
+{
+    //! Number of cells, indexed by ID
+    uint64_t num_cells;
+    //! Number of nodes of all cells
+    uint64_t num_nodes;
+    //! Nodes there is room for
+    uint64_t capacity;
+    //! Cell currently being added to
+    uint64_t cursor;
+    //! Node offset of each cell's root (num_cells + 1)
+    uint64_t* restrict first;
+    //! Network index of the compartment of each node
+    uint64_t* restrict comp;
+    //! Offset of each node's parent within its cell (0 for roots)
+    uint32_t* restrict parent;
+    //! Axial conductance between each node and its parent - uS
+    double* restrict g_axial;
+    //! Voltage of each node at the start of the step - mV
+    double* restrict vm;
+    //! Diagonal of each node's equation
+    double* restrict diag;
+    //! Right-hand side of each node's equation
+    double* restrict rhs;
+} *section_tree_t;
+
+/**
+ * @brief Allocates a tree for the given number of cells, without nodes.
+ *
+ * @param num_cells  number of cells, indexed by ID
+ * @param capacity   nodes to make room for, grown as needed
+ *
+ * @returns new tree, or NULL on allocation failure.
+ */
+extern section_tree_t section_tree_new(const uint64_t num_cells,
+                                       const uint64_t capacity);
+
+extern void section_tree_free(section_tree_t tree);
+
+/**
+ * @brief Appends a compartment to a cell.
+ *
+ * Cells must be filled in ascending ID order and each cell's nodes in tree
+ * order: its root first, then every node after its parent.
+ *
+ * @param tree     tree to add to
+ * @param cell     cell the compartment belongs to
+ * @param comp     network index of the compartment
+ * @param parent   offset of the parent node within the cell, or
+ *                 SECTION_NO_PARENT for the cell's root
+ * @param g_axial  axial conductance to the parent - uS (ignored for roots)
+ *
+ * @returns the node's offset within its cell, or -1 if out of order or on
+ *          allocation failure.
+ */
+extern int64_t section_tree_add(section_tree_t tree,
+                                const uint64_t cell,
+                                const uint64_t comp,
+                                const int64_t parent,
+                                const double g_axial);
+
+//! Closes the last cell; must be called once all nodes are added.
+extern void section_tree_finish(section_tree_t tree);
+
+/**
+ * @brief Axial conductance between the centres of two adjacent cylinders.
+ *
+ * @param ra        axial resistivity - Ohm cm
+ * @param diam_1    diameter of the first cylinder - um
+ * @param length_1  length of the first cylinder - um
+ * @param diam_2    diameter of the second cylinder - um
+ * @param length_2  length of the second cylinder - um
+ *
+ * @returns conductance - uS
+ */
+extern double section_axial_conductance(const double ra,
+                                        const double diam_1,
+                                        const double length_1,
+                                        const double diam_2,
+                                        const double length_2);
+
+/**
+ * @brief Solves one cell's voltage equations in place.
+ *
+ * On entry, for every node n of the cell, vm[n] holds its voltage at the
+ * start of the step, diag[n] its cm/dt plus membrane conductance and rhs[n]
+ * its membrane current. Axial terms are added here. On return rhs[n] holds
+ * the change of the node's voltage over the step; diag is clobbered.
+ */
+extern void section_tree_solve(section_tree_t tree, const uint64_t cell);
+
+/**
+ * @brief Advances all compartments of one cell by a step of dt.
+ *
+ * Multi-compartment counterpart of HHSomaCompartment_integrate; every node
+ * must be an HHSomaCompartment. Arrays are indexed by network index and may
+ * be NULL, meaning zero current, zero conductance and no skipped mechanisms.
+ *
+ * @param[in,out] tree         tree the cell belongs to
+ * @param[in]     network      network of compartments, indexed by ID
+ * @param[in]     cell         cell to advance
+ * @param[in]     I_ext        current already computed for this step
+ * @param[in]     G_ext        conductance of I_ext
+ * @param[in]     first_mech   index of the first mechanism to call
+ * @param[in]     dt           step size - ms
+ * @param[in]     global_time  current simulation time
+ * @param[in]     curr_step    current simulation step
+ */
+extern void section_tree_step(section_tree_t tree,
+                              void** network,
+                              const uint64_t cell,
+                              const double* I_ext,
+                              const double* G_ext,
+                              const uint64_t* first_mech,
+                              const double dt,
+                              const double global_time,
+                              const uint64_t curr_step);
+
+#endif /* SECTION_H */
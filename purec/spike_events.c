@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "spike_events.h"
+
+spike_events_t network_spikes = NULL;
+
+spike_events_t spike_events_new(const uint64_t num_cells,
+                                const double vm_thresh,
+                                const uint64_t history)
+{
+    spike_events_t events = (spike_events_t) calloc(1, sizeof(struct spike_events));
+    if (events == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t num_bitmaps = 2;
+    while (num_bitmaps < history)
+    {
+        num_bitmaps <<= 1;
+    }
+
+    events->num_cells = num_cells;
+    events->num_words = (num_cells + 63) / 64;
+    events->vm_thresh = vm_thresh;
+    events->mask = num_bitmaps - 1;
+    events->bits = (uint64_t**) calloc(num_bitmaps, sizeof(uint64_t*));
+    if (events->bits == NULL)
+    {
+        free(events);
+        return NULL;
+    }
+    for (uint64_t i = 0; i < num_bitmaps; i++)
+    {
+        events->bits[i] = (uint64_t*) calloc(events->num_words, sizeof(uint64_t));
+        if (events->bits[i] == NULL)
+        {
+            spike_events_free(events);
+            return NULL;
+        }
+    }
+
+    return events;
+}
+
+void spike_events_free(spike_events_t events)
+{
+    if (events == NULL)
+    {
+        return;
+    }
+    for (uint64_t i = 0; i <= events->mask; i++)
+    {
+        free(events->bits[i]);
+    }
+    free((void*) events->bits);
+    free(events);
+}
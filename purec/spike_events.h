@@ -0,0 +1,98 @@
+/**
+ * @file    spike_events.h
+ *
+ * @brief   Per-step spike bitmaps for event-driven synapses.
+ *
+ * @details Each compartment checks its own membrane voltage for an upward
+ *          threshold crossing once per step and records it as one bit.
+ *          Synapses then test a single bit instead of reading presynaptic
+ *          voltage history. A ring of bitmaps is indexed by step: during
+ *          step s compartments write bitmap s & mask while synapses read the
+ *          crossings of earlier steps from the others, so no clearing pass
+ *          or extra synchronization is needed beyond the per-step barrier.
+ *          Two bitmaps suffice for synapses without delay; delayed ones need
+ *          the ring to reach back further.
+ */
+#ifndef SPIKE_EVENTS_H
+#define SPIKE_EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+typedef struct spike_events
+{
+    //! Number of compartments tracked, indexed by ID
+    uint64_t num_cells;
+    //! Number of 64-bit words per bitmap
+    uint64_t num_words;
+    //! Upward crossing of this voltage counts as a spike - mV
+    double vm_thresh;
+    //! Number of bitmaps in the ring (a power of 2) minus one
+    uint64_t mask;
+    //! Crossings detected in each step, bitmap step & mask
+    uint64_t* restrict* bits;
+} *spike_events_t;
+
+//! Spike events of the running network, NULL if synapses should poll voltage
+extern spike_events_t network_spikes;
+
+/**
+ * @brief Allocates zeroed spike bitmaps for the given number of compartments.
+ *
+ * @param num_cells  number of compartments, indexed by ID
+ * @param vm_thresh  upward crossing of this voltage counts as a spike - mV
+ * @param history    steps of crossings to keep, including the current one;
+ *                   rounded up to a power of 2, and at least 2
+ *
+ * @returns new spike event set, or NULL on allocation failure.
+ */
+extern spike_events_t spike_events_new(const uint64_t num_cells,
+                                       const double vm_thresh,
+                                       const uint64_t history);
+
+extern void spike_events_free(spike_events_t events);
+
+/**
+ * @brief Records whether a compartment spiked in the given step.
+ *
+ * A spike is prev_vm < vm_thresh < vm. Safe to call concurrently for
+ * different compartments; each compartment must only record itself.
+ */
+static inline void spike_events_record(spike_events_t events,
+                                       const uint64_t cell,
+                                       const double prev_vm,
+                                       const double vm,
+                                       const uint64_t curr_step)
+{
+    uint64_t* word = &events->bits[curr_step & events->mask][cell >> 6];
+    const uint64_t mask = UINT64_C(1) << (cell & 63);
+    const bool fired = vm > events->vm_thresh && prev_vm < events->vm_thresh;
+
+    // Neighbouring cells share the word, but only touch it when our bit changes
+    const bool was_set = (__atomic_load_n(word, __ATOMIC_RELAXED) & mask) != 0;
+    if (fired && !was_set)
+    {
+        __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+    } else if (!fired && was_set) {
+        __atomic_fetch_and(word, ~mask, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Whether a compartment spiked in the given step.
+ *
+ * Only valid for the mask steps preceding the one currently being simulated.
+ */
+static inline bool spike_events_fired(const spike_events_t events,
+                                      const uint64_t cell,
+                                      const uint64_t step)
+{
+    return (events->bits[step & events->mask][cell >> 6] >> (cell & 63)) & 1;
+}
+
+#endif /* SPIKE_EVENTS_H */
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "myriad.h"
+#include "HHSpikeGABAAMechanism.h"
+#include "spike_events.h"
+#include "synapse_table.h"
+
+//! Synapses the table has room for when no capacity is given
+#define SYNAPSE_TABLE_MIN_CAPACITY 64
+
+// Resizes one per-synapse array, leaving it untouched on failure.
+static int _table_resize(void** array, const uint64_t num, const size_t size)
+{
+    void* resized = realloc(*array, num * size);
+    if (resized == NULL)
+    {
+        return -1;
+    }
+    *array = resized;
+    return 0;
+}
+
+static int _table_reserve(synapse_table_t table, const uint64_t capacity)
+{
+    if (_table_resize((void**) &table->src, capacity, sizeof(uint32_t)) ||
+        _table_resize((void**) &table->delay, capacity, sizeof(uint32_t)) ||
+        _table_resize((void**) &table->weight, capacity, sizeof(double)) ||
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+        _table_resize((void**) &table->trace_alpha, capacity, sizeof(double)) ||
+        _table_resize((void**) &table->trace_beta, capacity, sizeof(double))
+#else
+        _table_resize((void**) &table->t_fired, capacity, sizeof(double))
+#endif
+        )
+    {
+        return -1;
+    }
+    table->capacity = capacity;
+    return 0;
+}
+
+synapse_table_t synapse_table_new(const uint64_t num_cells,
+                                  const uint64_t capacity,
+                                  const double tau_alpha,
+                                  const double tau_beta,
+                                  const double e_rev)
+{
+    if (num_cells > UINT32_MAX)
+    {
+        return NULL;
+    }
+
+    synapse_table_t table = (synapse_table_t) calloc(1, sizeof(struct synapse_table));
+    if (table == NULL)
+    {
+        return NULL;
+    }
+
+    table->num_cells = num_cells;
+    table->first = (uint64_t*) calloc(num_cells + 1, sizeof(uint64_t));
+    if (table->first == NULL ||
+        _table_reserve(table, capacity > 0 ? capacity : SYNAPSE_TABLE_MIN_CAPACITY))
+    {
+        synapse_table_free(table);
+        return NULL;
+    }
+
+    // Same normalization as HHSpikeGABAAMechanism, so the peak is the weight
+    table->tau_alpha = tau_alpha;
+    table->tau_beta = tau_beta;
+    table->e_rev = e_rev;
+    const double peak_cond_t = ((tau_alpha * tau_beta) / (tau_beta - tau_alpha)) *
+        log(tau_beta / tau_alpha);
+    table->norm_const = 1.0 / (exp(-peak_cond_t / tau_beta) - exp(-peak_cond_t / tau_alpha));
+    table->decay_alpha = exp(-DT / tau_alpha);
+    table->decay_beta = exp(-DT / tau_beta);
+
+    return table;
+}
+
+void synapse_table_free(synapse_table_t table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+    free(table->first);
+    free(table->src);
+    free(table->delay);
+    free(table->weight);
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+    free(table->trace_alpha);
+    free(table->trace_beta);
+#else
+    free(table->t_fired);
+#endif
+    free(table);
+}
+
+int synapse_table_add(synapse_table_t table,
+                      const uint64_t target,
+                      const uint64_t source,
+                      const double weight,
+                      const uint32_t delay)
+{
+    if (target < table->cursor || target >= table->num_cells || source >= table->num_cells)
+    {
+        return -1;
+    }
+    if (table->num_syns == table->capacity && _table_reserve(table, 2 * table->capacity))
+    {
+        return -1;
+    }
+
+    // Cells skipped over have no synapses
+    while (table->cursor < target)
+    {
+        table->first[++table->cursor] = table->num_syns;
+    }
+
+    const uint64_t s = table->num_syns++;
+    table->src[s] = (uint32_t) source;
+    table->delay[s] = delay;
+    table->weight[s] = weight;
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+    table->trace_alpha[s] = 0.0;
+    table->trace_beta[s] = 0.0;
+#else
+    table->t_fired[s] = -INFINITY;
+#endif
+    table->max_delay = delay > table->max_delay ? delay : table->max_delay;
+
+    return 0;
+}
+
+void synapse_table_finish(synapse_table_t table)
+{
+    while (table->cursor < table->num_cells)
+    {
+        table->first[++table->cursor] = table->num_syns;
+    }
+}
+
+// Did the presynaptic cell cross threshold delay steps before the last?
+static inline bool _synapse_fired(const synapse_table_t table,
+                                  const spike_events_t spikes,
+                                  const uint64_t s,
+                                  const uint64_t curr_step)
+{
+    const uint32_t delay = table->delay[s];
+    return curr_step > delay && spike_events_fired(spikes, table->src[s], curr_step - 1 - delay);
+}
+
+bool synapse_table_pending(const synapse_table_t table,
+                           const spike_events_t spikes,
+                           const uint64_t cell,
+                           const uint64_t curr_step)
+{
+    const uint64_t end = table->first[cell + 1];
+    for (uint64_t s = table->first[cell]; s < end; s++)
+    {
+        if (_synapse_fired(table, spikes, s, curr_step))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+double synapse_table_step(synapse_table_t table,
+                          const spike_events_t spikes,
+                          const uint64_t cell,
+                          const double post_vm,
+                          const double global_time,
+                          const uint64_t curr_step)
+{
+    const uint64_t end = table->first[cell + 1];
+    double g_sum = 0.0;
+
+    for (uint64_t s = table->first[cell]; s < end; s++)
+    {
+        const bool fired = _synapse_fired(table, spikes, s, curr_step);
+
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+        double trace_alpha = table->trace_alpha[s] * table->decay_alpha;
+        double trace_beta = table->trace_beta[s] * table->decay_beta;
+        if (fired)
+        {
+            trace_alpha += 1.0;
+            trace_beta += 1.0;
+        } else if (trace_beta < HHSPIKEGABAA_TRACE_FLOOR && trace_alpha < HHSPIKEGABAA_TRACE_FLOOR) {
+            trace_alpha = 0.0;
+            trace_beta = 0.0;
+        }
+        table->trace_alpha[s] = trace_alpha;
+        table->trace_beta[s] = trace_beta;
+
+        g_sum += table->weight[s] * (trace_beta - trace_alpha);
+#else
+        if (fired)
+        {
+            table->t_fired[s] = global_time;
+        }
+
+        const double t_since = global_time - table->t_fired[s];
+        if (t_since == INFINITY)
+        {
+            continue;
+        }
+        if (t_since > HHSPIKEGABAA_DECAY_CUTOFF * table->tau_beta)
+        {
+            table->t_fired[s] = -INFINITY;
+            continue;
+        }
+
+        g_sum += table->weight[s] *
+            (exp(-t_since / table->tau_beta) - exp(-t_since / table->tau_alpha));
+#endif /* HHSPIKEGABAA_EXACT_DECAY */
+    }
+
+    return table->norm_const * -g_sum * (post_vm - table->e_rev);
+}
@@ -0,0 +1,151 @@
+/**
+ * @file    synapse_table.h
+ *
+ * @brief   Compressed sparse row store of spike-mediated GABA-a synapses.
+ *
+ * @details Alternative to one HHSpikeGABAAMechanism object per connection.
+ *          Synapses are grouped by postsynaptic cell, and each field lives in
+ *          its own packed array indexed by synapse; a cell's synapses are the
+ *          range [first[cell], first[cell + 1]). Fan-in is therefore not
+ *          bounded by MAX_NUM_MECHS, and the table grows by doubling, so
+ *          building a network costs a few allocations rather than one per
+ *          synapse.
+ *
+ *          Presynaptic spikes are read from a spike_events ring instead of
+ *          the presynaptic voltage. A synapse with a delay of d steps sees in
+ *          step s a spike recorded in step s - 1 - d, so the ring has to keep
+ *          at least max_delay + 2 steps.
+ *
+ *          Kinetics follow HHSpikeGABAAMechanism, including
+ *          HHSPIKEGABAA_EXACT_DECAY and HHSPIKEGABAA_DECAY_CUTOFF; the time
+ *          constants and reversal potential are shared by every synapse of a
+ *          table, while peak conductance (the weight) and delay are per
+ *          synapse.
+ */
+#ifndef SYNAPSE_TABLE_H
+#define SYNAPSE_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "spike_events.h"
+
+// Grumble grumble, C++
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
+typedef struct synapse_table
+{
+    //! Number of postsynaptic cells, indexed by ID
+    uint64_t num_cells;
+    //! Number of synapses
+    uint64_t num_syns;
+    //! Number of synapses the arrays have room for
+    uint64_t capacity;
+    //! Last cell synapses were added to; first[0 .. cursor] are final
+    uint64_t cursor;
+    //! Synapse offset of each cell's first synapse (num_cells + 1)
+    uint64_t* restrict first;
+    //! Presynaptic cell of each synapse
+    uint32_t* restrict src;
+    //! Delay of each synapse - steps
+    uint32_t* restrict delay;
+    //! Peak conductance of each synapse - nS
+    double* restrict weight;
+#ifdef HHSPIKEGABAA_EXACT_DECAY
+    //! Summed exp(-(t - t_k)/tau_alpha) over past spikes t_k, per synapse
+    double* restrict trace_alpha;
+    //! Summed exp(-(t - t_k)/tau_beta) over past spikes t_k, per synapse
+    double* restrict trace_beta;
+#else
+    //! Time each synapse last saw a spike, -INFINITY if never - ms
+    double* restrict t_fired;
+#endif
+    //! Longest delay of any synapse - steps
+    uint32_t max_delay;
+    //! Channel opening time constant - ms
+    double tau_alpha;
+    //! Channel closing time constant - ms
+    double tau_beta;
+    //! Synaptic reversal potential - mV
+    double e_rev;
+    //! Normalizes the dual exponential to peak at 1
+    double norm_const;
+    //! Per-step decay factors exp(-DT/tau_alpha) and exp(-DT/tau_beta)
+    double decay_alpha;
+    double decay_beta;
+} *synapse_table_t;
+
+/**
+ * @brief Allocates an empty table.
+ *
+ * @param num_cells  number of cells, which must fit in 32 bits
+ * @param capacity   expected number of synapses; the table grows past it
+ * @param tau_alpha  channel opening time constant - ms
+ * @param tau_beta   channel closing time constant - ms
+ * @param e_rev      synaptic reversal potential - mV
+ *
+ * @returns new table, or NULL on allocation failure or too many cells.
+ */
+extern synapse_table_t synapse_table_new(const uint64_t num_cells,
+                                         const uint64_t capacity,
+                                         const double tau_alpha,
+                                         const double tau_beta,
+                                         const double e_rev);
+
+extern void synapse_table_free(synapse_table_t table);
+
+/**
+ * @brief Appends a synapse from source onto target.
+ *
+ * Synapses have to be added in order of target, all of a cell's synapses
+ * before any of the next one's.
+ *
+ * @returns 0 on success, -1 if out of order, out of range or out of memory.
+ */
+extern int synapse_table_add(synapse_table_t table,
+                             const uint64_t target,
+                             const uint64_t source,
+                             const double weight,
+                             const uint32_t delay);
+
+/**
+ * @brief Closes the table once all synapses have been added.
+ *
+ * Must be called before synapse_table_step.
+ */
+extern void synapse_table_finish(synapse_table_t table);
+
+/**
+ * @brief Whether any synapse onto a cell receives a spike in the given step.
+ *
+ * Same test synapse_table_step applies, without touching synapse state.
+ */
+extern bool synapse_table_pending(const synapse_table_t table,
+                                  const spike_events_t spikes,
+                                  const uint64_t cell,
+                                  const uint64_t curr_step);
+
+/**
+ * @brief Advances every synapse onto a cell by one step.
+ *
+ * Safe to call concurrently for different cells.
+ *
+ * @param table        table of synapses
+ * @param spikes       spike events of the presynaptic cells
+ * @param cell         postsynaptic cell
+ * @param post_vm      membrane voltage of cell at curr_step - 1 - mV
+ * @param global_time  current simulation time - ms
+ * @param curr_step    current simulation step
+ *
+ * @returns summed synaptic current into the cell.
+ */
+extern double synapse_table_step(synapse_table_t table,
+                                 const spike_events_t spikes,
+                                 const uint64_t cell,
+                                 const double post_vm,
+                                 const double global_time,
+                                 const uint64_t curr_step);
+
+#endif /* SYNAPSE_TABLE_H */
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "thread_barrier.h"
+
+static inline void _cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static inline void _futex_wait(uint32_t* addr, const uint32_t val)
+{
+    // Returns immediately if *addr != val; spurious returns are re-checked
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void _futex_wake_all(uint32_t* addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+int thread_barrier_init(thread_barrier_t* b,
+                        const enum thread_barrier_type type,
+                        const uint32_t num_threads)
+{
+    if (b == NULL || num_threads == 0)
+    {
+        return -1;
+    }
+
+    memset(b, 0, sizeof(thread_barrier_t));
+    b->type = type;
+    b->num_threads = num_threads;
+    b->spin_count = THREAD_BARRIER_SPIN_COUNT;
+
+    if (type == THREAD_BARRIER_MUTEX)
+    {
+        if (pthread_mutex_init(&b->mutx, NULL) || pthread_cond_init(&b->cv, NULL))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void _spin_wait(thread_barrier_t* b, uint32_t* local_sense)
+{
+    const uint32_t my_sense = *local_sense = !*local_sense;
+
+    // Last to arrive resets the count and releases everyone else
+    if (__atomic_add_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == b->num_threads)
+    {
+        __atomic_store_n(&b->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->sense, my_sense, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&b->num_parked, __ATOMIC_SEQ_CST) > 0)
+        {
+            _futex_wake_all(&b->sense);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < b->spin_count; i++)
+    {
+        if (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) == my_sense)
+        {
+            return;
+        }
+        _cpu_relax();
+    }
+
+    // Announce we are parking before re-checking, so the releasing thread
+    // either sees us parked or we see the flipped sense.
+    __atomic_add_fetch(&b->num_parked, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&b->sense, __ATOMIC_SEQ_CST) != my_sense)
+    {
+        _futex_wait(&b->sense, !my_sense);
+    }
+    __atomic_sub_fetch(&b->num_parked, 1, __ATOMIC_SEQ_CST);
+}
+
+static void _mutex_wait(thread_barrier_t* b)
+{
+    pthread_mutex_lock(&b->mutx);
+    const uint64_t my_generation = b->generation;
+    if (++b->num_done == b->num_threads)
+    {
+        b->num_done = 0;
+        b->generation++;
+        pthread_cond_broadcast(&b->cv);
+    } else {
+        // Loop guards against spurious wakeups
+        while (my_generation == b->generation)
+        {
+            pthread_cond_wait(&b->cv, &b->mutx);
+        }
+    }
+    pthread_mutex_unlock(&b->mutx);
+}
+
+void thread_barrier_wait(thread_barrier_t* b, uint32_t* local_sense)
+{
+    if (b->type == THREAD_BARRIER_MUTEX)
+    {
+        _mutex_wait(b);
+    } else {
+        _spin_wait(b, local_sense);
+    }
+}
+
+int thread_barrier_destroy(thread_barrier_t* b)
+{
+    if (b->type == THREAD_BARRIER_MUTEX)
+    {
+        if (pthread_mutex_destroy(&b->mutx) || pthread_cond_destroy(&b->cv))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+enum thread_barrier_type thread_barrier_type_from_str(const char* name)
+{
+    if (name != NULL && strcmp(name, "mutex") == 0)
+    {
+        return THREAD_BARRIER_MUTEX;
+    } else if (name != NULL && strcmp(name, "spin") != 0) {
+        fprintf(stderr, "Unknown barrier type '%s', using spin\n", name);
+    }
+    return THREAD_BARRIER_SPIN;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file    thread_barrier.h
+ *
+ * @brief   Reusable barriers for lock-step simulation threads.
+ *
+ * @details Two interchangeable implementations, picked at runtime: a
+ *          sense-reversing atomic barrier that spins briefly and then parks
+ *          on a futex, and the classic mutex/condition-variable barrier.
+ */
+#ifndef THREAD_BARRIER_H
+#define THREAD_BARRIER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+//! Number of pause iterations before a waiting thread parks on the futex
+#ifndef THREAD_BARRIER_SPIN_COUNT
+#define THREAD_BARRIER_SPIN_COUNT 4096
+#endif
+
+enum thread_barrier_type
+{
+    //! Atomic sense-reversing, spin-then-park
+    THREAD_BARRIER_SPIN = 0,
+    //! pthread mutex and condition variable
+    THREAD_BARRIER_MUTEX
+};
+
+typedef struct thread_barrier
+{
+    enum thread_barrier_type type;
+    //! Number of threads that must arrive before any may leave
+    uint32_t num_threads;
+    //! Pause iterations before parking
+    uint32_t spin_count;
+
+    // Spin barrier state, kept off the cache line of the fields above
+    //! Threads arrived in the current episode
+    uint32_t count __attribute__((aligned(64)));
+    //! Global sense, flipped by the last arriving thread (futex word)
+    uint32_t sense;
+    //! Threads currently parked on the futex
+    uint32_t num_parked;
+
+    // Mutex barrier state
+    pthread_mutex_t mutx;
+    pthread_cond_t cv;
+    uint32_t num_done;
+    uint64_t generation;
+} thread_barrier_t;
+
+/**
+ * @brief Initializes a barrier for the given number of threads.
+ *
+ * @param[out] b            barrier to initialize
+ * @param[in]  type         implementation to use
+ * @param[in]  num_threads  number of participating threads
+ *
+ * @returns 0 on success, -1 otherwise.
+ */
+extern int thread_barrier_init(thread_barrier_t* b,
+                               const enum thread_barrier_type type,
+                               const uint32_t num_threads);
+
+/**
+ * @brief Blocks until all threads have called this for the current episode.
+ *
+ * @param[in,out] b            barrier to wait on
+ * @param[in,out] local_sense  per-thread sense, initialized to 0 by the caller
+ */
+extern void thread_barrier_wait(thread_barrier_t* b, uint32_t* local_sense);
+
+extern int thread_barrier_destroy(thread_barrier_t* b);
+
+/**
+ * @brief Barrier type named by the given string ("spin" or "mutex").
+ *
+ * NULL or unknown names give the spin barrier.
+ */
+extern enum thread_barrier_type thread_barrier_type_from_str(const char* name);
+
+#endif /* THREAD_BARRIER_H */
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "trace_file.h"
+
+//! Fast deflate: the writer runs alongside the simulation
+#define TRACE_DEFLATE_LEVEL 1
+
+//////////////////
+// Column codec //
+//////////////////
+
+// XOR-delta and byte-shuffle n values into out (n * 8 bytes)
+static void _trace_encode(const double* values,
+                          const uint64_t n,
+                          unsigned char* out)
+{
+    uint64_t prev = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint64_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        const uint64_t delta = bits ^ prev;
+        prev = bits;
+        const unsigned char* bytes = (const unsigned char*) &delta;
+        for (uint64_t b = 0; b < sizeof(delta); b++)
+        {
+            out[b * n + i] = bytes[b];
+        }
+    }
+}
+
+// Inverse of _trace_encode
+static void _trace_decode(const unsigned char* in,
+                          const uint64_t n,
+                          double* values)
+{
+    uint64_t prev = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint64_t delta;
+        unsigned char* bytes = (unsigned char*) &delta;
+        for (uint64_t b = 0; b < sizeof(delta); b++)
+        {
+            bytes[b] = in[b * n + i];
+        }
+        prev ^= delta;
+        memcpy(&values[i], &prev, sizeof(prev));
+    }
+}
+
+////////////
+// Writer //
+////////////
+
+static void _trace_writer_free(trace_writer_t writer)
+{
+    if (writer->fp != NULL)
+    {
+        fclose(writer->fp);
+    }
+    free(writer->chunk_offsets);
+    free(writer->column);
+    free(writer->shuffled);
+    free(writer->packed);
+    free(writer->col_table);
+    free(writer->chunk_data);
+    free(writer);
+}
+
+trace_writer_t trace_writer_new(const char* path,
+                                const char* const* var_names,
+                                const uint32_t num_vars,
+                                const uint64_t* cells,
+                                const uint64_t num_cells,
+                                const uint64_t every,
+                                const double dt,
+                                const uint64_t chunk_rows)
+{
+    if (num_vars == 0 || num_cells == 0 || chunk_rows == 0)
+    {
+        return NULL;
+    }
+
+    trace_writer_t writer = (trace_writer_t) calloc(1, sizeof(struct trace_writer));
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+    memcpy(writer->header.magic, TRACE_MAGIC, sizeof(writer->header.magic));
+    writer->header.num_vars = num_vars;
+    writer->header.num_cells = num_cells;
+    writer->header.every = every;
+    writer->header.dt = dt;
+    writer->header.chunk_rows = chunk_rows;
+
+    const uint64_t num_cols = num_vars * num_cells;
+    writer->packed_cap = compressBound(chunk_rows * sizeof(double));
+    writer->chunk_cap = num_cols * chunk_rows * sizeof(double);
+    writer->column = (double*) malloc(chunk_rows * sizeof(double));
+    writer->shuffled = (unsigned char*) malloc(chunk_rows * sizeof(double));
+    writer->packed = (unsigned char*) malloc(writer->packed_cap);
+    writer->col_table = (struct trace_column*) calloc(num_cols, sizeof(struct trace_column));
+    writer->chunk_data = (unsigned char*) malloc(writer->chunk_cap);
+    writer->fp = fopen(path, "wb");
+    if (writer->column == NULL || writer->shuffled == NULL || writer->packed == NULL ||
+        writer->col_table == NULL || writer->chunk_data == NULL || writer->fp == NULL)
+    {
+        perror("trace_writer_new: ");
+        _trace_writer_free(writer);
+        return NULL;
+    }
+
+    char name[TRACE_VAR_NAME_LEN];
+    bool ok = fwrite(&writer->header, sizeof(writer->header), 1, writer->fp) == 1;
+    for (uint32_t i = 0; ok && i < num_vars; i++)
+    {
+        memset(name, 0, sizeof(name));
+        strncpy(name, var_names[i], sizeof(name) - 1);
+        ok = fwrite(name, sizeof(name), 1, writer->fp) == 1;
+    }
+    ok = ok && fwrite(cells, sizeof(uint64_t), num_cells, writer->fp) == num_cells;
+    if (!ok || fflush(writer->fp) != 0)
+    {
+        perror("trace_writer_new, write header: ");
+        _trace_writer_free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+int trace_writer_append(trace_writer_t writer,
+                        const double* rows,
+                        const uint64_t num_rows)
+{
+    const uint64_t num_cols = writer->header.num_vars * writer->header.num_cells;
+    if (num_rows == 0 || num_rows > writer->header.chunk_rows)
+    {
+        return -1;
+    }
+
+    // Compress each column on its own so that it can be read on its own
+    uint64_t data_size = 0;
+    for (uint64_t c = 0; c < num_cols; c++)
+    {
+        for (uint64_t r = 0; r < num_rows; r++)
+        {
+            writer->column[r] = rows[r * num_cols + c];
+        }
+
+        const unsigned char* data = (const unsigned char*) writer->column;
+        uLongf nbytes = writer->packed_cap;
+        uint32_t codec = TRACE_CODEC_RAW;
+        _trace_encode(writer->column, num_rows, writer->shuffled);
+        if (compress2(writer->packed, &nbytes, writer->shuffled,
+                      num_rows * sizeof(double), TRACE_DEFLATE_LEVEL) == Z_OK &&
+            nbytes < num_rows * sizeof(double))
+        {
+            data = writer->packed;
+            codec = TRACE_CODEC_XOR_SHUFFLE_DEFLATE;
+        } else {
+            nbytes = num_rows * sizeof(double);
+        }
+
+        writer->col_table[c].offset = data_size;
+        writer->col_table[c].nbytes = (uint32_t) nbytes;
+        writer->col_table[c].codec = codec;
+        memcpy(writer->chunk_data + data_size, data, nbytes);
+        data_size += nbytes;
+    }
+
+    const long offset = ftell(writer->fp);
+    uint64_t* chunk_offsets = (uint64_t*)
+        realloc(writer->chunk_offsets, (writer->num_chunks + 1) * sizeof(uint64_t));
+    if (offset < 0 || chunk_offsets == NULL)
+    {
+        return -1;
+    }
+    writer->chunk_offsets = chunk_offsets;
+
+    struct trace_chunk_header chunk;
+    memcpy(chunk.magic, TRACE_CHUNK_MAGIC, sizeof(chunk.magic));
+    chunk.num_cols = (uint32_t) num_cols;
+    chunk.first_row = writer->header.num_rows;
+    chunk.num_rows = num_rows;
+    chunk.data_size = data_size;
+    if (fwrite(&chunk, sizeof(chunk), 1, writer->fp) != 1 ||
+        fwrite(writer->col_table, sizeof(struct trace_column), num_cols, writer->fp) != num_cols ||
+        fwrite(writer->chunk_data, 1, data_size, writer->fp) != data_size ||
+        fflush(writer->fp) != 0)
+    {
+        return -1;
+    }
+
+    writer->chunk_offsets[writer->num_chunks++] = (uint64_t) offset;
+    writer->header.num_rows += num_rows;
+
+    return 0;
+}
+
+int trace_writer_close(trace_writer_t writer)
+{
+    if (writer == NULL)
+    {
+        return 0;
+    }
+
+    const long offset = ftell(writer->fp);
+    bool ok = offset >= 0 &&
+        fwrite(writer->chunk_offsets, sizeof(uint64_t), writer->num_chunks, writer->fp) ==
+        writer->num_chunks;
+
+    // Only point at the index once it has been written
+    writer->header.index_offset = (uint64_t) offset;
+    ok = ok && fflush(writer->fp) == 0 &&
+        fseek(writer->fp, 0, SEEK_SET) == 0 &&
+        fwrite(&writer->header, sizeof(writer->header), 1, writer->fp) == 1;
+
+    ok = (fclose(writer->fp) == 0) && ok;
+    writer->fp = NULL;
+    _trace_writer_free(writer);
+
+    return ok ? 0 : -1;
+}
+
+////////////
+// Reader //
+////////////
+
+// Returns the chunk at offset if it lies wholly within the map, NULL otherwise
+static const struct trace_chunk_header* _trace_chunk_at(const trace_reader_t reader,
+                                                        const uint64_t offset)
+{
+    const uint64_t num_cols = reader->header->num_vars * reader->header->num_cells;
+    if (offset > reader->map_len || reader->map_len - offset < sizeof(struct trace_chunk_header))
+    {
+        return NULL;
+    }
+    const struct trace_chunk_header* chunk =
+        (const struct trace_chunk_header*) (reader->map + offset);
+    const uint64_t table_len = num_cols * sizeof(struct trace_column);
+    if (memcmp(chunk->magic, TRACE_CHUNK_MAGIC, sizeof(chunk->magic)) != 0 ||
+        chunk->num_cols != num_cols ||
+        chunk->num_rows == 0 || chunk->num_rows > reader->header->chunk_rows ||
+        reader->map_len - offset - sizeof(*chunk) < table_len ||
+        reader->map_len - offset - sizeof(*chunk) - table_len < chunk->data_size)
+    {
+        return NULL;
+    }
+    return chunk;
+}
+
+void trace_reader_close(trace_reader_t reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+    if (reader->map != NULL)
+    {
+        munmap((void*) reader->map, reader->map_len);
+    }
+    if (reader->scanned)
+    {
+        free((void*) reader->chunk_offsets);
+    }
+    free(reader->scratch);
+    free(reader->column);
+    free(reader);
+}
+
+trace_reader_t trace_reader_open(const char* path)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < sizeof(struct trace_header))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    trace_reader_t reader = (trace_reader_t) calloc(1, sizeof(struct trace_reader));
+    void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (reader == NULL || map == MAP_FAILED)
+    {
+        free(reader);
+        if (map != MAP_FAILED)
+        {
+            munmap(map, (size_t) st.st_size);
+        }
+        return NULL;
+    }
+    reader->map = (const unsigned char*) map;
+    reader->map_len = (size_t) st.st_size;
+    reader->header = (const struct trace_header*) map;
+
+    const struct trace_header* header = reader->header;
+    const uint64_t meta_len = sizeof(*header) +
+        header->num_vars * TRACE_VAR_NAME_LEN + header->num_cells * sizeof(uint64_t);
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->num_vars == 0 || header->num_cells == 0 || header->chunk_rows == 0 ||
+        meta_len > reader->map_len)
+    {
+        trace_reader_close(reader);
+        return NULL;
+    }
+    reader->var_names = (const char*) (reader->map + sizeof(*header));
+    reader->cells = (const uint64_t*) (reader->var_names + header->num_vars * TRACE_VAR_NAME_LEN);
+
+    // A complete trace has an index; a live one is walked chunk by chunk
+    if (header->index_offset != 0)
+    {
+        reader->num_chunks = (header->num_rows + header->chunk_rows - 1) / header->chunk_rows;
+        reader->num_rows = header->num_rows;
+        if (header->index_offset > reader->map_len ||
+            (reader->map_len - header->index_offset) / sizeof(uint64_t) < reader->num_chunks)
+        {
+            trace_reader_close(reader);
+            return NULL;
+        }
+        reader->chunk_offsets = (const uint64_t*) (reader->map + header->index_offset);
+    } else {
+        uint64_t* offsets = NULL;
+        uint64_t offset = meta_len;
+        const struct trace_chunk_header* chunk;
+        reader->scanned = 1;
+        while ((chunk = _trace_chunk_at(reader, offset)) != NULL &&
+               chunk->first_row == reader->num_rows)
+        {
+            uint64_t* grown = (uint64_t*) realloc(offsets, (reader->num_chunks + 1) * sizeof(uint64_t));
+            if (grown == NULL)
+            {
+                break;
+            }
+            offsets = grown;
+            offsets[reader->num_chunks++] = offset;
+            reader->num_rows += chunk->num_rows;
+            offset += sizeof(*chunk) + chunk->num_cols * sizeof(struct trace_column) + chunk->data_size;
+        }
+        reader->chunk_offsets = offsets;
+    }
+
+    reader->scratch = (unsigned char*) malloc(header->chunk_rows * sizeof(double));
+    reader->column = (double*) malloc(header->chunk_rows * sizeof(double));
+    if (reader->scratch == NULL || reader->column == NULL)
+    {
+        trace_reader_close(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+int64_t trace_reader_column(const trace_reader_t reader,
+                            const char* var_name,
+                            const uint64_t cell)
+{
+    int64_t var = -1, col = -1;
+    for (uint32_t i = 0; i < reader->header->num_vars && var < 0; i++)
+    {
+        if (strncmp(reader->var_names + i * TRACE_VAR_NAME_LEN, var_name, TRACE_VAR_NAME_LEN) == 0)
+        {
+            var = i;
+        }
+    }
+    for (uint64_t i = 0; i < reader->header->num_cells && col < 0; i++)
+    {
+        if (reader->cells[i] == cell)
+        {
+            col = (int64_t) i;
+        }
+    }
+    if (var < 0 || col < 0)
+    {
+        return -1;
+    }
+    return var * (int64_t) reader->header->num_cells + col;
+}
+
+int trace_reader_read(trace_reader_t reader,
+                      const int64_t column,
+                      const uint64_t first_row,
+                      const uint64_t num_rows,
+                      double* out)
+{
+    const uint64_t chunk_rows = reader->header->chunk_rows;
+    if (column < 0 ||
+        (uint64_t) column >= reader->header->num_vars * reader->header->num_cells ||
+        first_row > reader->num_rows || num_rows > reader->num_rows - first_row)
+    {
+        return -1;
+    }
+
+    uint64_t row = first_row;
+    while (row < first_row + num_rows)
+    {
+        const struct trace_chunk_header* chunk =
+            _trace_chunk_at(reader, reader->chunk_offsets[row / chunk_rows]);
+        if (chunk == NULL || chunk->first_row != row / chunk_rows * chunk_rows)
+        {
+            return -1;
+        }
+        const struct trace_column* col = (const struct trace_column*) (chunk + 1) + column;
+        const unsigned char* data = (const unsigned char*) (chunk + 1) +
+            chunk->num_cols * sizeof(struct trace_column) + col->offset;
+        const uint64_t raw_len = chunk->num_rows * sizeof(double);
+        if (col->offset > chunk->data_size || col->nbytes > chunk->data_size - col->offset)
+        {
+            return -1;
+        }
+
+        if (col->codec == TRACE_CODEC_RAW && col->nbytes == raw_len)
+        {
+            memcpy(reader->column, data, raw_len);
+        } else if (col->codec == TRACE_CODEC_XOR_SHUFFLE_DEFLATE) {
+            uLongf len = raw_len;
+            if (uncompress(reader->scratch, &len, data, col->nbytes) != Z_OK || len != raw_len)
+            {
+                return -1;
+            }
+            _trace_decode(reader->scratch, chunk->num_rows, reader->column);
+        } else {
+            return -1;
+        }
+
+        // Copy the part of this chunk that falls in the window
+        const uint64_t start = row - chunk->first_row;
+        uint64_t len = chunk->num_rows - start;
+        len = len < first_row + num_rows - row ? len : first_row + num_rows - row;
+        memcpy(out + (row - first_row), reader->column + start, len * sizeof(double));
+        row += len;
+    }
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/**
+ * @file    trace_file.h
+ *
+ * @brief   Chunked, compressed, columnar file format for recorded traces.
+ *
+ * @details A trace holds one double per (step, variable, cell), recorded
+ *          every `every` steps. Rows are grouped into chunks of chunk_rows
+ *          rows (the last may be shorter), and each chunk stores every
+ *          (variable, cell) column on its own. A time window of one cell can
+ *          therefore be read by decompressing only the overlapping chunks'
+ *          columns for that cell.
+ *
+ *          Columns are stored XOR-delta encoded (each value's bits XORed
+ *          with the previous one's, so slowly changing voltages turn into
+ *          mostly-zero high bytes), byte-shuffled (byte k of every value
+ *          stored together) and deflated. A column that does not shrink is
+ *          stored raw.
+ *
+ *          Layout (native endianness):
+ *          - struct trace_header;
+ *          - num_vars variable names, TRACE_VAR_NAME_LEN bytes each;
+ *          - num_cells uint64_t cell IDs;
+ *          - chunks, each a struct trace_chunk_header, num_vars * num_cells
+ *            struct trace_column entries (variable-major) and the column data;
+ *          - chunk index: num_chunks uint64_t chunk file offsets, at
+ *            header.index_offset.
+ *
+ *          index_offset and num_rows are only filled in when the writer is
+ *          closed; readers of a trace still being written instead walk the
+ *          chunk headers, so the complete chunks written so far are visible.
+ */
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+//! Identifies a trace file ("MYRTRC" followed by a format version)
+#define TRACE_MAGIC "MYRTRC\0\1"
+
+//! Identifies a chunk
+#define TRACE_CHUNK_MAGIC "CHNK"
+
+//! Bytes reserved per variable name, NUL padded
+#define TRACE_VAR_NAME_LEN 16
+
+//! How a column is stored
+enum trace_codec
+{
+    //! Plain doubles
+    TRACE_CODEC_RAW = 0,
+    //! XOR-delta, byte shuffle, deflate
+    TRACE_CODEC_XOR_SHUFFLE_DEFLATE = 1,
+};
+
+struct trace_header
+{
+    //! Always TRACE_MAGIC
+    char magic[8];
+    //! Number of variables per cell
+    uint32_t num_vars;
+    uint32_t _pad;
+    //! Number of cells per variable
+    uint64_t num_cells;
+    //! Steps between rows
+    uint64_t every;
+    //! Simulation time step - ms
+    double dt;
+    //! Rows per chunk
+    uint64_t chunk_rows;
+    //! Total rows, 0 until the writer is closed
+    uint64_t num_rows;
+    //! File offset of the chunk index, 0 until the writer is closed
+    uint64_t index_offset;
+};
+
+struct trace_chunk_header
+{
+    //! Always TRACE_CHUNK_MAGIC
+    char magic[4];
+    //! Number of columns that follow
+    uint32_t num_cols;
+    //! Row of the first value in each column
+    uint64_t first_row;
+    //! Values in each column
+    uint64_t num_rows;
+    //! Bytes of column data after the column table
+    uint64_t data_size;
+};
+
+struct trace_column
+{
+    //! Offset of the column's data from the end of the column table
+    uint64_t offset;
+    //! Bytes of column data
+    uint32_t nbytes;
+    //! One of trace_codec
+    uint32_t codec;
+};
+
+typedef struct trace_writer
+{
+    FILE* fp;
+    struct trace_header header;
+    //! Chunks written so far, and their file offsets
+    uint64_t num_chunks;
+    uint64_t* chunk_offsets;
+    //! Scratch space for one column: values, shuffled bytes, deflated bytes
+    double* column;
+    unsigned char* shuffled;
+    unsigned char* packed;
+    size_t packed_cap;
+    //! Column table and data of the chunk being written
+    struct trace_column* col_table;
+    unsigned char* chunk_data;
+    size_t chunk_cap;
+} *trace_writer_t;
+
+/**
+ * @brief Creates a trace file and writes its header.
+ *
+ * @param[in] path        output file
+ * @param[in] var_names   names of the num_vars variables, e.g. "vm"
+ * @param[in] num_vars    variables per cell
+ * @param[in] cells       IDs of the num_cells cells
+ * @param[in] num_cells   cells per variable
+ * @param[in] every       steps between rows
+ * @param[in] dt          simulation time step - ms
+ * @param[in] chunk_rows  rows per chunk
+ *
+ * @returns new writer, or NULL on failure.
+ */
+extern trace_writer_t trace_writer_new(const char* path,
+                                       const char* const* var_names,
+                                       const uint32_t num_vars,
+                                       const uint64_t* cells,
+                                       const uint64_t num_cells,
+                                       const uint64_t every,
+                                       const double dt,
+                                       const uint64_t chunk_rows);
+
+/**
+ * @brief Compresses and appends one chunk, then flushes it.
+ *
+ * @param[in] rows      num_rows rows of num_vars * num_cells values, each row
+ *                      variable-major (all cells of variable 0 first)
+ * @param[in] num_rows  rows given; must be chunk_rows except for the last chunk
+ *
+ * @returns 0 on success, -1 on failure.
+ */
+extern int trace_writer_append(trace_writer_t writer,
+                               const double* rows,
+                               const uint64_t num_rows);
+
+/**
+ * @brief Writes the chunk index, completes the header and frees writer.
+ *
+ * @returns 0 on success, -1 if anything failed to be written.
+ */
+extern int trace_writer_close(trace_writer_t writer);
+
+typedef struct trace_reader
+{
+    //! Mapped file
+    const unsigned char* map;
+    size_t map_len;
+    const struct trace_header* header;
+    //! num_vars names, TRACE_VAR_NAME_LEN bytes each
+    const char* var_names;
+    const uint64_t* cells;
+    //! Complete chunks, and rows in them
+    uint64_t num_chunks;
+    uint64_t num_rows;
+    const uint64_t* chunk_offsets;
+    //! Whether chunk_offsets was built by walking the chunks
+    int scanned;
+    //! Scratch space for decoding one column
+    unsigned char* scratch;
+    double* column;
+} *trace_reader_t;
+
+/**
+ * @brief Maps a trace file for reading, complete or still being written.
+ *
+ * @returns new reader, or NULL if the file cannot be read or is not a trace.
+ */
+extern trace_reader_t trace_reader_open(const char* path);
+
+/**
+ * @brief Looks up a column by variable name and cell ID.
+ *
+ * @returns column index, or -1 if there is no such variable or cell.
+ */
+extern int64_t trace_reader_column(const trace_reader_t reader,
+                                   const char* var_name,
+                                   const uint64_t cell);
+
+/**
+ * @brief Reads rows [first_row, first_row + num_rows) of one column.
+ *
+ * Only chunks overlapping the window are decompressed.
+ *
+ * @returns 0 on success, -1 if the window is out of range or a chunk is corrupt.
+ */
+extern int trace_reader_read(trace_reader_t reader,
+                             const int64_t column,
+                             const uint64_t first_row,
+                             const uint64_t num_rows,
+                             double* out);
+
+extern void trace_reader_close(trace_reader_t reader);
+
+#endif /* TRACE_FILE_H */
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "myriad.h"
+#include "HHSomaCompartment.h"
+#include "vm_recorder.h"
+
+vm_recorder_t network_recorder = NULL;
+
+static void* _vm_recorder_write(void* arg)
+{
+    vm_recorder_t rec = (vm_recorder_t) arg;
+    int next = 0;
+
+    pthread_mutex_lock(&rec->lock);
+    while (true)
+    {
+        while (!rec->pending[next] && !rec->done)
+        {
+            pthread_cond_wait(&rec->cond, &rec->lock);
+        }
+        if (!rec->pending[next])
+        {
+            break;
+        }
+        pthread_mutex_unlock(&rec->lock);
+
+        // The stepping side never touches a pending buffer
+        const bool ok = trace_writer_append(rec->trace, rec->bufs[next], rec->rows[next]) == 0;
+
+        pthread_mutex_lock(&rec->lock);
+        rec->failed = rec->failed || !ok;
+        rec->pending[next] = false;
+        pthread_cond_broadcast(&rec->cond);
+        next ^= 1;
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    return NULL;
+}
+
+static void _vm_recorder_free(vm_recorder_t rec)
+{
+    trace_writer_close(rec->trace);
+    free(rec->bufs[0]);
+    free(rec->bufs[1]);
+    free(rec->cells);
+    free(rec);
+}
+
+vm_recorder_t vm_recorder_new(const char* path,
+                              const uint64_t* cells,
+                              const uint64_t num_cells,
+                              const uint64_t every,
+                              const uint64_t chunk_rows,
+                              const double dt)
+{
+    if (num_cells == 0 || every == 0)
+    {
+        return NULL;
+    }
+
+    vm_recorder_t rec = (vm_recorder_t) calloc(1, sizeof(struct vm_recorder));
+    if (rec == NULL)
+    {
+        return NULL;
+    }
+    rec->num_cells = num_cells;
+    rec->every = every;
+    rec->chunk_rows = chunk_rows;
+    if (rec->chunk_rows == 0)
+    {
+        rec->chunk_rows = VM_RECORDER_CHUNK_BYTES / (num_cells * sizeof(double));
+        rec->chunk_rows = rec->chunk_rows > VM_RECORDER_MIN_CHUNK_ROWS ?
+            rec->chunk_rows : VM_RECORDER_MIN_CHUNK_ROWS;
+    }
+
+    rec->cells = (uint64_t*) malloc(num_cells * sizeof(uint64_t));
+    rec->bufs[0] = (double*) malloc(rec->chunk_rows * num_cells * sizeof(double));
+    rec->bufs[1] = (double*) malloc(rec->chunk_rows * num_cells * sizeof(double));
+    if (rec->cells == NULL || rec->bufs[0] == NULL || rec->bufs[1] == NULL)
+    {
+        perror("vm_recorder_new: ");
+        _vm_recorder_free(rec);
+        return NULL;
+    }
+    memcpy(rec->cells, cells, num_cells * sizeof(uint64_t));
+
+    const char* const var_names[] = {"vm"};
+    rec->trace = trace_writer_new(path, var_names, 1, cells, num_cells, every, dt, rec->chunk_rows);
+    if (rec->trace == NULL)
+    {
+        _vm_recorder_free(rec);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&rec->lock, NULL) != 0 ||
+        pthread_cond_init(&rec->cond, NULL) != 0 ||
+        pthread_create(&rec->writer, NULL, &_vm_recorder_write, rec) != 0)
+    {
+        fputs("Could not start trace writer thread\n", stderr);
+        _vm_recorder_free(rec);
+        return NULL;
+    }
+
+    return rec;
+}
+
+// Hands the buffer being filled to the writer and switches to the other one
+static void _vm_recorder_hand_off(vm_recorder_t rec)
+{
+    pthread_mutex_lock(&rec->lock);
+    rec->pending[rec->fill] = true;
+    pthread_cond_broadcast(&rec->cond);
+    rec->fill ^= 1;
+    if (rec->pending[rec->fill])
+    {
+        rec->stalls++;
+        while (rec->pending[rec->fill])
+        {
+            pthread_cond_wait(&rec->cond, &rec->lock);
+        }
+    }
+    pthread_mutex_unlock(&rec->lock);
+    rec->rows[rec->fill] = 0;
+}
+
+void vm_recorder_sample(vm_recorder_t rec,
+                        void** network,
+                        const uint64_t curr_step)
+{
+    double* row = rec->bufs[rec->fill] + rec->rows[rec->fill] * rec->num_cells;
+    for (uint64_t i = 0; i < rec->num_cells; i++)
+    {
+        const struct HHSomaCompartment* comp =
+            (const struct HHSomaCompartment*) network[rec->cells[i]];
+        row[i] = HHSOMA_VM(comp, curr_step);
+    }
+
+    if (++rec->rows[rec->fill] == rec->chunk_rows)
+    {
+        _vm_recorder_hand_off(rec);
+    }
+}
+
+void vm_recorder_sample_values(vm_recorder_t rec,
+                               const double* values,
+                               const uint64_t stride)
+{
+    double* row = rec->bufs[rec->fill] + rec->rows[rec->fill] * rec->num_cells;
+    for (uint64_t i = 0; i < rec->num_cells; i++)
+    {
+        row[i] = values[rec->cells[i] * stride];
+    }
+
+    if (++rec->rows[rec->fill] == rec->chunk_rows)
+    {
+        _vm_recorder_hand_off(rec);
+    }
+}
+
+int vm_recorder_close(vm_recorder_t rec)
+{
+    if (rec == NULL)
+    {
+        return 0;
+    }
+
+    if (rec->rows[rec->fill] > 0)
+    {
+        _vm_recorder_hand_off(rec);
+    }
+
+    pthread_mutex_lock(&rec->lock);
+    rec->done = true;
+    pthread_cond_broadcast(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->writer, NULL);
+
+    const bool close_failed = trace_writer_close(rec->trace) != 0;
+    const bool failed = rec->failed || close_failed;
+    rec->trace = NULL;
+    if (rec->stalls > 0)
+    {
+        fprintf(stderr, "Trace writer fell behind %lu times\n", (unsigned long) rec->stalls);
+    }
+    pthread_mutex_destroy(&rec->lock);
+    pthread_cond_destroy(&rec->cond);
+    _vm_recorder_free(rec);
+
+    return failed ? -1 : 0;
+}
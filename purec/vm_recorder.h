@@ -0,0 +1,122 @@
+/**
+ * @file    vm_recorder.h
+ *
+ * @brief   Streams membrane voltage traces to disk while the run progresses.
+ *
+ * @details Every `every` steps the stepping side copies the voltage of the
+ *          recorded cells into one row of the chunk being filled. Full
+ *          chunks are handed to a background writer thread and filling
+ *          carries on in the other chunk, so stepping only waits if the
+ *          writer falls a whole chunk behind. The writer compresses each
+ *          chunk into a trace file (see trace_file.h) with a single "vm"
+ *          variable, row r holding step r * every, and flushes it, so a long
+ *          run can be watched as it goes, and memory stays at two chunks
+ *          however long the run is.
+ */
+#ifndef VM_RECORDER_H
+#define VM_RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "trace_file.h"
+
+//! Target size of each of the two chunk buffers
+#ifndef VM_RECORDER_CHUNK_BYTES
+#define VM_RECORDER_CHUNK_BYTES (1UL << 20)
+#endif
+
+//! Fewest rows per chunk, so that few-cell columns still compress well
+#ifndef VM_RECORDER_MIN_CHUNK_ROWS
+#define VM_RECORDER_MIN_CHUNK_ROWS 1024
+#endif
+
+typedef struct vm_recorder
+{
+    //! Output trace, only written by the writer thread after the header
+    trace_writer_t trace;
+    //! Cells recorded, in column order
+    uint64_t* cells;
+    uint64_t num_cells;
+    //! Record every this many steps
+    uint64_t every;
+    //! Rows per chunk
+    uint64_t chunk_rows;
+    //! The two chunk buffers, chunk_rows * num_cells each
+    double* bufs[2];
+    //! Rows held by each buffer
+    uint64_t rows[2];
+    //! Buffer the stepping side is filling
+    int fill;
+    //! Buffers handed to the writer and not yet written
+    bool pending[2];
+    //! Set once the last chunk has been handed over
+    bool done;
+    //! Set by the writer if a write failed
+    bool failed;
+    //! Times the stepping side had to wait for the writer
+    uint64_t stalls;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t writer;
+} *vm_recorder_t;
+
+//! Recorder of the running network, NULL if not recording
+extern vm_recorder_t network_recorder;
+
+/**
+ * @brief Creates the trace file and starts its writer thread.
+ *
+ * @param[in] path        output file
+ * @param[in] cells       IDs of the cells to record
+ * @param[in] num_cells   number of cells to record
+ * @param[in] every       record every this many steps (at least 1)
+ * @param[in] chunk_rows  rows per chunk, or 0 to fill VM_RECORDER_CHUNK_BYTES
+ *                        (but at least VM_RECORDER_MIN_CHUNK_ROWS)
+ * @param[in] dt          simulation time step, stored in the header
+ *
+ * @returns new recorder, or NULL on failure.
+ */
+extern vm_recorder_t vm_recorder_new(const char* path,
+                                     const uint64_t* cells,
+                                     const uint64_t num_cells,
+                                     const uint64_t every,
+                                     const uint64_t chunk_rows,
+                                     const double dt);
+
+/**
+ * @brief Records the voltage of every recorded cell at the given step.
+ *
+ * Must only be called by one thread at a time, after every cell has
+ * finished the step and before any cell can overwrite it.
+ */
+extern void vm_recorder_sample(vm_recorder_t rec,
+                               void** network,
+                               const uint64_t curr_step);
+
+/**
+ * @brief Records the voltage of every recorded cell from an array instead.
+ *
+ * Cell c's voltage is values[c * stride], e.g. one lane of an ensemble's vm.
+ * Same calling rules as vm_recorder_sample.
+ */
+extern void vm_recorder_sample_values(vm_recorder_t rec,
+                                      const double* values,
+                                      const uint64_t stride);
+
+//! Whether curr_step is one the recorder keeps
+static inline bool vm_recorder_due(const vm_recorder_t rec, const uint64_t curr_step)
+{
+    return rec != NULL && curr_step % rec->every == 0;
+}
+
+/**
+ * @brief Writes out the last partial chunk, stops the writer and frees rec.
+ *
+ * @returns 0 if the whole trace was written, -1 otherwise.
+ */
+extern int vm_recorder_close(vm_recorder_t rec);
+
+#endif /* VM_RECORDER_H */
@@ -0,0 +1,110 @@
+"""
+Test cases for myriad_build_cache.
+"""
+
+import os
+import subprocess
+import unittest
+
+from tempfile import TemporaryDirectory
+
+from context import myriad
+from myriad import myriad_build_cache
+
+#: Two-unit project whose rules log each compiled source to $(LOG)
+MAKEFILE = """\
+OBJECTS := a.o b.o
+
+all: app.bin
+
+%.o: %.c
+\techo $< >> $(LOG)
+\t$(CC) -c $< -o $@
+
+app.bin: $(OBJECTS)
+\t$(CC) -o $@ $^
+"""
+
+
+class TestBuildCache(unittest.TestCase):
+    """ Test cases for BuildCache """
+
+    def setUp(self):
+        self.tmp = TemporaryDirectory()
+        self.src_dir = os.path.join(self.tmp.name, "src")
+        os.makedirs(self.src_dir)
+        self.log = os.path.join(self.tmp.name, "compiled.log")
+        self._write("Makefile", MAKEFILE)
+        self._write("common.h", "#define ANSWER 42\n")
+        self._write("a.c", "#include \"common.h\"\nint a(void) { return ANSWER; }\n")
+        self._write("b.c", "int a(void);\nint main(void) { return a() != 42; }\n")
+        self.cache = myriad_build_cache.BuildCache(
+            root=os.path.join(self.tmp.name, "cache"), jobs=2)
+        self.command = ["make", "-j2", "LOG=" + self.log, "all"]
+
+    def tearDown(self):
+        self.tmp.cleanup()
+
+    def _write(self, name: str, content: str):
+        with open(os.path.join(self.src_dir, name), "w") as filep:
+            filep.write(content)
+
+    def _compiled(self) -> list:
+        """ Returns (and forgets) sources compiled since the last call """
+        if not os.path.isfile(self.log):
+            return []
+        with open(self.log) as filep:
+            compiled = sorted(filep.read().split())
+        os.remove(self.log)
+        return compiled
+
+    def test_unchanged_model_reuses_build(self):
+        """ Testing a repeated build of the same sources is a cache hit """
+        first = self.cache.build(self.src_dir, self.command)
+        self.assertEqual(self._compiled(), ["a.c", "b.c"])
+        self.assertEqual(subprocess.call([os.path.join(first, "app.bin")]), 0)
+        second = self.cache.build(self.src_dir, self.command)
+        self.assertEqual(first, second)
+        self.assertEqual(self._compiled(), [])
+
+    def test_changed_unit_rebuilds_only_it(self):
+        """ Testing only the changed compilation unit is recompiled """
+        first = self.cache.build(self.src_dir, self.command)
+        self._compiled()
+        self._write("b.c", "int a(void);\nint main(void) { return a() - 42; }\n")
+        second = self.cache.build(self.src_dir, self.command)
+        self.assertNotEqual(first, second)
+        self.assertEqual(self._compiled(), ["b.c"])
+        self.assertEqual(subprocess.call([os.path.join(second, "app.bin")]), 0)
+
+    def test_changed_header_rebuilds_all(self):
+        """ Testing a header change invalidates every unit """
+        self.cache.build(self.src_dir, self.command)
+        self._compiled()
+        self._write("common.h", "#define ANSWER 41\n")
+        build_dir = self.cache.build(self.src_dir, self.command)
+        self.assertEqual(self._compiled(), ["a.c", "b.c"])
+        self.assertEqual(subprocess.call([os.path.join(build_dir, "app.bin")]), 1)
+
+    def test_failed_build_not_cached(self):
+        """ Testing a failed build leaves nothing behind """
+        self._write("a.c", "this is not C\n")
+        with self.assertRaises(subprocess.CalledProcessError):
+            self.cache.build(self.src_dir, self.command)
+        self.assertIsNone(self.cache.lookup(self.cache.key(self.src_dir)))
+        self.assertEqual(os.listdir(self.cache.root),
+                         [myriad_build_cache.OBJECTS_DIR])
+
+    def test_prune(self):
+        """ Testing pruning keeps only the most recently used builds """
+        first = self.cache.build(self.src_dir, self.command)
+        self._write("b.c", "int main(void) { return 0; }\n")
+        second = self.cache.build(self.src_dir, self.command)
+        os.utime(first, (0, 0))
+        self.cache.prune(1)
+        self.assertFalse(os.path.exists(first))
+        self.assertTrue(os.path.exists(second))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -2,8 +2,13 @@
 Tests myriad simulation objects
 """
 
+import os
+import struct
+import importlib
 import unittest
 
+from tempfile import TemporaryDirectory
+
 from myriad_testing import set_external_loggers, MyriadTestCase
 
 from context import myriad
@@ -11,6 +16,9 @@ from myriad import myriad_simul
 from myriad import myriad_object
 from myriad import myriad_compartment
 from myriad import myriad_mechanism
+from myriad.myriad_metaclass import myriad_method_verbatim
+from myriad.myriad_types import MyriadScalar, MyriadTimeseriesVector
+from myriad.myriad_types import MDouble, MInt
 
 
 @set_external_loggers("TestMyriadSimulObject", myriad_simul.LOG)
@@ -56,6 +64,196 @@ class TestMyriadSimulObject(MyriadTestCase):
         print(new_obj)
         comm.close_connection()
 
+    def test_simul_bulk_oversize(self):
+        """ Tests an oversize bulk request is refused without desyncing """
+        class TestSimul(myriad_simul.MyriadSimul,
+                        dependencies=[myriad_object.MyriadObject,
+                                      myriad_compartment.Compartment,
+                                      myriad_mechanism.Mechanism]):
+            def setup(self):
+                comp = myriad_compartment.Compartment(cid=0, num_mechs=0)
+                self.add_compartment(comp)
+        # Only the socket protocol sends ID lists to the simulator
+        obj = TestSimul(DEBUG=True, SHM_NETWORK=False)
+        obj.setup()
+        comm = obj.run()
+        # More IDs than the network has cells
+        self.assertRaises(IndexError, comm.request_data_bulk, [0, 0])
+        self.assertEqual(len(comm.request_data_bulk([0])), 1)
+        comm.close_connection()
+
+
+class _FakeCommModule(object):
+    """ Stands in for myriad_comm, recording which retrieval was used """
+
+    def __init__(self):
+        self.calls = []
+
+    def retrieve_range(self, *args):
+        self.calls.append(("range",) + args)
+        return []
+
+    def retrieve_list(self, obj_ids):
+        self.calls.append(("list", obj_ids))
+        return []
+
+
+class TestSubprocessCommunicator(unittest.TestCase):
+    """ Tests SubprocessCommunicator without a child process """
+
+    def setUp(self):
+        self.comm_mod = _FakeCommModule()
+        self.comm = myriad_simul.SubprocessCommunicator(self.comm_mod)
+        self.comm.child_proc = object()
+        self.comm.connected = True
+
+    def test_request_data_bulk(self):
+        """ Tests bulk requests are sent as ranges or lists as appropriate """
+        self.comm.request_data_bulk()
+        self.comm.request_data_bulk(range(4, 10))
+        self.comm.request_data_bulk(range(0, 10, 2))
+        self.comm.request_data_bulk([3, 1, 3])
+        self.assertEqual(self.comm_mod.calls,
+                         [("range",),
+                          ("range", 4, 6),
+                          ("list", [0, 2, 4, 6, 8]),
+                          ("list", [3, 1, 3])])
+        self.assertEqual(self.comm.request_data_bulk(range(5, 5)), [])
+        self.assertRaises(ValueError, self.comm.request_data_bulk, [1, -1])
+
+
+class TestSetupSimulParams(unittest.TestCase):
+    """ Tests simulation parameter defaults and validation """
+
+    def test_checkpoint_every(self):
+        """ Tests checkpointing is off by default and rejected with CUDA """
+        params = myriad_simul._setup_simul_params({}, [])
+        self.assertEqual(params["CHECKPOINT_EVERY"], 0)
+        params = myriad_simul._setup_simul_params({"CHECKPOINT_EVERY": 100}, [])
+        self.assertEqual(params["CHECKPOINT_EVERY"], 100)
+        self.assertRaises(ValueError, myriad_simul._setup_simul_params,
+                          {"CHECKPOINT_EVERY": -1}, [])
+        self.assertRaises(ValueError, myriad_simul._setup_simul_params,
+                          {"CHECKPOINT_EVERY": 100, "CUDA": True}, [])
+
+
+class TraceCompartment(myriad_compartment.Compartment):
+    """ Compartment whose voltage at each step depends on every step before """
+    vm = MyriadTimeseriesVector
+
+    @myriad_method_verbatim
+    def simul_fxn(
+            self,
+            network: MyriadScalar.void_ptr_ptr("network"),
+            global_time: MyriadScalar("global_time", MDouble, quals=["const"]),
+            curr_step: MyriadScalar("curr_step", MInt, quals=["const"])
+    ) -> MDouble:
+        """
+    struct TraceCompartment* _self = (struct TraceCompartment*) self;
+    const double prev_vm = curr_step > 0 ? _self->vm[curr_step - 1] : 0.0;
+    _self->vm[curr_step] = 0.999 * prev_vm + sin(global_time * (_self->cid + 1));
+    return _self->vm[curr_step];
+        """
+
+
+class CheckpointSimul(myriad_simul.MyriadSimul,
+                      dependencies=[myriad_object.MyriadObject,
+                                    myriad_compartment.Compartment,
+                                    myriad_mechanism.Mechanism,
+                                    TraceCompartment]):
+    """ Two trace compartments, checkpointed every CHECKPOINT_EVERY steps """
+    NUM_CELLS = 2
+
+    def setup(self):
+        for cid in range(self.NUM_CELLS):
+            self.add_compartment(TraceCompartment(cid=cid, num_mechs=0))
+
+
+#: struct m_ckpt_header up to its slots (magic, num_cells, num_objs,
+#: num_classes, image_size, slot_offset)
+CKPT_HEADER = struct.Struct("8s5Q")
+
+#: struct m_ckpt_slot (generation, step, gtime, complete)
+CKPT_SLOT = struct.Struct("QQdQ")
+
+
+def read_ckpt_header(path: str) -> tuple:
+    """ Returns the header fields and both slots of a checkpoint file """
+    with open(path, "rb") as ckpt:
+        data = ckpt.read(CKPT_HEADER.size + 2 * CKPT_SLOT.size)
+    slots = [CKPT_SLOT.unpack_from(data, CKPT_HEADER.size + s * CKPT_SLOT.size)
+             for s in range(2)]
+    return CKPT_HEADER.unpack_from(data), slots
+
+
+@set_external_loggers("TestCheckpointRestart", myriad_simul.LOG)
+class TestCheckpointRestart(MyriadTestCase):
+    """ Tests restarting a simulation from its checkpoint file """
+
+    SIMUL_LEN = 1000
+    CHECKPOINT_EVERY = 100
+
+    def setUp(self):
+        self.tmp_dir = TemporaryDirectory()
+
+    def tearDown(self):
+        self.tmp_dir.cleanup()
+
+    def ckpt_path(self, name: str) -> str:
+        """ Path of a checkpoint file in the test's own directory """
+        return os.path.join(self.tmp_dir.name, name)
+
+    def run_traces(self, **kwargs) -> list:
+        """ Runs CheckpointSimul and returns the raw bytes of each vm trace """
+        obj = CheckpointSimul(simul_len=self.SIMUL_LEN,
+                              CHECKPOINT_EVERY=self.CHECKPOINT_EVERY,
+                              DEBUG=True)
+        obj.setup()
+        comm = obj.run(**kwargs)
+        try:
+            trace_mod = importlib.import_module("tracecompartment")
+            comps = comm.request_data_bulk(range(CheckpointSimul.NUM_CELLS))
+            return [trace_mod.vm(comp).tobytes() for comp in comps]
+        finally:
+            comm.close_connection()
+
+    def assertSameTraces(self, expected: list, actual: list):
+        """ Traces must match bit for bit, not just approximately """
+        self.assertEqual(len(expected), len(actual))
+        for cid, (exp_vm, act_vm) in enumerate(zip(expected, actual)):
+            self.assertEqual(exp_vm, act_vm, "vm of cell %d differs" % cid)
+
+    def test_restart_bit_identical(self):
+        """ Tests a restarted run reproduces an uninterrupted one exactly """
+        ckpt = self.ckpt_path("whole.ckpt")
+        whole = self.run_traces(checkpoint_file=ckpt)
+        # Both slots hold a snapshot taken before the end of the run, so the
+        # restart has steps left to simulate
+        _, slots = read_ckpt_header(ckpt)
+        self.assertTrue(all(slot[3] for slot in slots))
+        self.assertLess(max(slot[1] for slot in slots), self.SIMUL_LEN)
+        restarted = self.run_traces(checkpoint_file=self.ckpt_path("re.ckpt"),
+                                    restart_from=ckpt)
+        self.assertSameTraces(whole, restarted)
+
+    def test_restart_torn_slot(self):
+        """ Tests a slot caught mid-write is passed over for the other one """
+        ckpt = self.ckpt_path("whole.ckpt")
+        whole = self.run_traces(checkpoint_file=ckpt)
+        header, slots = read_ckpt_header(ckpt)
+        image_size, slot_offset = header[4], header[5]
+        newest = max(range(2), key=lambda s: slots[s][0])
+        # Leave the newest slot as a crash mid-write would: marked incomplete,
+        # with only part of its image overwritten
+        with open(ckpt, "r+b") as ckpt_file:
+            ckpt_file.seek(CKPT_HEADER.size + newest * CKPT_SLOT.size)
+            ckpt_file.write(CKPT_SLOT.pack(*(slots[newest][:3] + (0,))))
+            ckpt_file.seek(slot_offset + newest * image_size)
+            ckpt_file.write(b"\xff" * (image_size // 2))
+        restarted = self.run_traces(checkpoint_file=self.ckpt_path("re.ckpt"),
+                                    restart_from=ckpt)
+        self.assertSameTraces(whole, restarted)
+
 
 def main():
     unittest.main()
@@ -0,0 +1,119 @@
+"""
+Test cases for myriad_trace.
+"""
+
+import os
+import unittest
+
+from tempfile import TemporaryDirectory
+
+import numpy as np
+
+from context import myriad
+from myriad import myriad_trace
+
+
+class TestColumnCodec(unittest.TestCase):
+    """ Test cases for encode_column and decode_column """
+
+    def test_round_trip(self):
+        """ Tests smooth, constant and noisy columns decode exactly """
+        rng = np.random.RandomState(42)
+        columns = [-65.0 + 10.0 * np.sin(np.arange(1000) * 0.01),
+                   np.full(1000, -65.0),
+                   rng.uniform(size=1000),
+                   np.array([np.nan, np.inf, -0.0, 1e-300])]
+        for column in columns:
+            codec, data = myriad_trace.encode_column(column)
+            decoded = myriad_trace.decode_column(codec, data, len(column))
+            self.assertEqual(decoded.tobytes(), column.tobytes())
+
+    def test_compresses_smooth(self):
+        """ Tests smooth columns shrink and noise falls back to raw """
+        smooth = -65.0 + 10.0 * np.sin(np.arange(1000) * 0.01)
+        codec, data = myriad_trace.encode_column(np.full(1000, -65.0))
+        self.assertEqual(codec, myriad_trace.CODEC_XOR_SHUFFLE_DEFLATE)
+        self.assertLess(len(data), 100)
+        codec, data = myriad_trace.encode_column(smooth)
+        self.assertLess(len(data), smooth.nbytes)
+        noise = np.random.RandomState(0).bytes(800)
+        codec, data = myriad_trace.encode_column(np.frombuffer(noise))
+        self.assertEqual(codec, myriad_trace.CODEC_RAW)
+        self.assertEqual(data, noise)
+
+
+class TestTraceFile(unittest.TestCase):
+    """ Test cases for TraceFile """
+
+    def setUp(self):
+        self.tmp = TemporaryDirectory()
+        self.path = os.path.join(self.tmp.name, "trace.dat")
+        rows = np.arange(1000)[:, np.newaxis]
+        self.values = np.stack([-65.0 + np.sin(rows * 0.01 + [0, 1, 2]),
+                                rows * [0.5, 0.25, 0.125]], axis=1)
+        self.cells = [7, 3, 11]
+        myriad_trace.write_trace(self.path, self.values, self.cells,
+                                 ("vm", "i_syn"), every=10, dt=0.025,
+                                 chunk_rows=128)
+
+    def tearDown(self):
+        self.tmp.cleanup()
+
+    def test_header(self):
+        """ Tests the trace describes its cells and variables """
+        with myriad_trace.TraceFile(self.path) as trace:
+            self.assertEqual(trace.variables, ["vm", "i_syn"])
+            self.assertEqual(list(trace.cells), self.cells)
+            self.assertEqual(trace.num_rows, 1000)
+            self.assertEqual(trace.every, 10)
+            self.assertEqual(trace.dt, 0.025)
+            np.testing.assert_allclose(trace.times(1, 3), [0.25, 0.5])
+
+    def test_read_windows(self):
+        """ Tests windows within and across chunks read back exactly """
+        with myriad_trace.TraceFile(self.path) as trace:
+            for var_idx, var in enumerate(trace.variables):
+                for cell_idx, cell in enumerate(self.cells):
+                    for start, stop in ((0, None), (130, 140), (100, 400),
+                                        (990, 1000), (-10, None)):
+                        expected = self.values[start:stop, var_idx, cell_idx]
+                        np.testing.assert_array_equal(
+                            trace.read(cell, var, start, stop), expected)
+
+    def test_unknown_column(self):
+        """ Tests asking for a missing cell or variable raises KeyError """
+        with myriad_trace.TraceFile(self.path) as trace:
+            self.assertRaises(KeyError, trace.read, 4)
+            self.assertRaises(KeyError, trace.read, 7, "gna")
+
+    def test_live_trace(self):
+        """ Tests a trace without an index shows its complete chunks """
+        with open(self.path, "rb") as trace:
+            data = bytearray(trace.read())
+        header = np.frombuffer(data, dtype=myriad_trace.HEADER_DTYPE, count=1)
+        index_offset = int(header["index_offset"][0])
+        with myriad_trace.TraceFile(self.path) as trace:
+            # Cut the last two chunks short, as if still being written
+            cut = int(trace._chunk_offsets[-2]) + 100
+        live = np.zeros(1, dtype=myriad_trace.HEADER_DTYPE)
+        live[0] = header[0]
+        live["num_rows"] = 0
+        live["index_offset"] = 0
+        with open(self.path, "wb") as trace:
+            trace.write(live.tobytes() + data[live.itemsize:cut])
+        self.assertLess(cut, index_offset)
+
+        with myriad_trace.TraceFile(self.path) as trace:
+            self.assertEqual(trace.num_rows, 6 * 128)
+            np.testing.assert_array_equal(trace.read(3, "vm"),
+                                          self.values[:6 * 128, 0, 1])
+
+    def test_not_a_trace(self):
+        """ Tests other files are rejected """
+        with open(self.path, "wb") as trace:
+            trace.write(b"\0" * 128)
+        self.assertRaises(ValueError, myriad_trace.TraceFile, self.path)
+
+
+if __name__ == '__main__':
+    unittest.main()